@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2020 EfficiOS Inc.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ */
+
+#ifndef LTTNG_SESSION_DAEMON_CONNECTION_H
+#define LTTNG_SESSION_DAEMON_CONNECTION_H
+
+#include <lttng/lttng-error.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct lttng_session_daemon_connection;
+
+/*
+ * Open a persistent connection to the session daemon.
+ *
+ * By default, each call of this library connects to the session daemon,
+ * sends its command, receives the reply and disconnects. While a persistent
+ * connection is open, the commands issued by all the threads of the process
+ * are carried over it instead, one at a time unless a batch of commands is
+ * open, each identified by a request id. This saves the connection setup of
+ * clients issuing many commands, such as monitoring agents polling the state
+ * of many sessions.
+ *
+ * The destruction and clearing of a session always use their own connection.
+ *
+ * If the connection to the session daemon is lost, it is opened again by the
+ * next command.
+ *
+ * Only one persistent connection can be open at a time.
+ *
+ * Return LTTNG_OK on success else an LTTng error code. The returned
+ * connection is owned by the caller and must be closed using
+ * lttng_session_daemon_connection_close().
+ *
+ * Important error codes:
+ *    LTTNG_ERR_NO_SESSIOND
+ *    LTTNG_ERR_INVALID: a persistent connection is already open.
+ *
+ * Session daemons which do not support persistent connections return an
+ * error to the request.
+ */
+extern enum lttng_error_code lttng_session_daemon_connection_open(
+		struct lttng_session_daemon_connection **connection);
+
+/*
+ * Close a persistent connection to the session daemon.
+ *
+ * The commands issued afterwards use a new connection each.
+ */
+extern void lttng_session_daemon_connection_close(
+		struct lttng_session_daemon_connection *connection);
+
+/*
+ * Begin a batch of commands on a persistent connection.
+ *
+ * While a batch is open, the commands which carry no data and whose reply
+ * only carries a return code, such as enabling a channel or an event without
+ * a filter, adding a context or starting a session, are sent without waiting
+ * for their reply and return 0 at once. The session daemon applies the
+ * commands of the connection back-to-back, in the order they were sent.
+ * Their replies are received before the next command which is waited for,
+ * and when the batch ends.
+ *
+ * Once a command of the batch is known to have failed, the following
+ * commands of the batch are not sent and return its error. The commands
+ * sent before its reply was received are still applied.
+ *
+ * Return LTTNG_OK on success else an LTTng error code.
+ *
+ * Important error codes:
+ *    LTTNG_ERR_INVALID: the connection is not the open persistent connection
+ *                       or a batch is already open on it.
+ */
+extern enum lttng_error_code lttng_session_daemon_connection_begin_batch(
+		struct lttng_session_daemon_connection *connection);
+
+/*
+ * End a batch of commands, waiting for the replies to its commands.
+ *
+ * Return LTTNG_OK if all the commands of the batch succeeded, else the LTTng
+ * error code returned to the first of them which failed.
+ *
+ * Important error codes:
+ *    LTTNG_ERR_INVALID: no batch is open on the connection.
+ *    LTTNG_ERR_FATAL: the connection to the session daemon was lost before
+ *                     the outcome of all the commands was known.
+ */
+extern enum lttng_error_code lttng_session_daemon_connection_end_batch(
+		struct lttng_session_daemon_connection *connection);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LTTNG_SESSION_DAEMON_CONNECTION_H */
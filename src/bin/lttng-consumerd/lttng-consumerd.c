@@ -34,6 +34,7 @@
 #include <common/common.h>
 #include <common/consumer/consumer.h>
 #include <common/consumer/consumer-timer.h>
+#include <common/consumer/consumer-writeback.h>
 #include <common/compat/poll.h>
 #include <common/compat/getenv.h>
 #include <common/sessiond-comm/sessiond-comm.h>
@@ -44,8 +45,9 @@
 
 /* threads (channel handling, poll, metadata, sessiond) */
 
-static pthread_t channel_thread, data_thread, metadata_thread,
-		sessiond_thread, metadata_timer_thread, health_thread;
+static pthread_t channel_thread, metadata_thread,
+		sessiond_thread, metadata_timer_thread, health_thread,
+		writeback_thread;
 static bool metadata_timer_thread_online;
 
 /* to count the number of times the user pressed ctrl+c */
@@ -61,6 +63,8 @@ static const char *progname;
 static char command_sock_path[PATH_MAX]; /* Global command socket path */
 static char error_sock_path[PATH_MAX]; /* Global error path */
 static enum lttng_consumer_type opt_type = LTTNG_CONSUMER_KERNEL;
+/* Number of data stream consumption threads, 0 if unset. */
+static unsigned int opt_data_threads;
 
 /* the liblttngconsumerd context */
 static struct lttng_consumer_local_data *ctx;
@@ -155,6 +159,9 @@ static void usage(FILE *fp)
 			"Show version number.\n");
 	fprintf(fp, "  -g, --group NAME                   "
 			"Specify the tracing group name. (default: tracing)\n");
+	fprintf(fp, "  -t, --data-threads NUM             "
+			"Number of data stream consumption threads. (default: %d)\n",
+			DEFAULT_CONSUMERD_DATA_THREADS);
 	fprintf(fp, "  -k, --kernel                       "
 			"Consumer kernel buffers (default).\n");
 	fprintf(fp, "  -u, --ust                          "
@@ -167,6 +174,28 @@ static void usage(FILE *fp)
 			);
 }
 
+/*
+ * Parse a number of threads. Returns 0 on success, -1 on error.
+ */
+static int parse_thread_count(const char *str, unsigned int *count)
+{
+	int ret = 0;
+	char *endptr;
+	unsigned long val;
+
+	errno = 0;
+	val = strtoul(str, &endptr, 10);
+	if (errno != 0 || *endptr != '\0' || endptr == str || val == 0 ||
+			val > UINT_MAX) {
+		ret = -1;
+		goto end;
+	}
+
+	*count = (unsigned int) val;
+end:
+	return ret;
+}
+
 /*
  * daemon argument parsing
  */
@@ -179,6 +208,7 @@ static int parse_args(int argc, char **argv)
 		{ "consumerd-err-sock", 1, 0, 'e' },
 		{ "daemonize", 0, 0, 'd' },
 		{ "group", 1, 0, 'g' },
+		{ "data-threads", 1, 0, 't' },
 		{ "help", 0, 0, 'h' },
 		{ "quiet", 0, 0, 'q' },
 		{ "verbose", 0, 0, 'v' },
@@ -192,7 +222,7 @@ static int parse_args(int argc, char **argv)
 
 	while (1) {
 		int option_index = 0;
-		c = getopt_long(argc, argv, "dhqvVku" "c:e:g:",
+		c = getopt_long(argc, argv, "dhqvVku" "c:e:g:t:",
 				long_options, &option_index);
 		if (c == -1) {
 			break;
@@ -235,6 +265,14 @@ static int parse_args(int argc, char **argv)
 				tracing_group_name = optarg;
 			}
 			break;
+		case 't':
+			if (parse_thread_count(optarg, &opt_data_threads)) {
+				ERR("Invalid number of data threads \"%s\"",
+						optarg);
+				ret = -1;
+				goto end;
+			}
+			break;
 		case 'h':
 			usage(stdout);
 			exit(EXIT_SUCCESS);
@@ -290,12 +328,192 @@ static void set_ulimit(void)
 	}
 }
 
+/*
+ * Resolve the number of data threads from the command line option, the
+ * environment or the default value, in that order of precedence.
+ */
+static int resolve_data_threads(unsigned int *data_threads)
+{
+	int ret = 0;
+	const char *env_value;
+
+	if (opt_data_threads) {
+		*data_threads = opt_data_threads;
+		goto end;
+	}
+
+	env_value = lttng_secure_getenv(DEFAULT_CONSUMERD_DATA_THREADS_ENV);
+	if (env_value) {
+		ret = parse_thread_count(env_value, data_threads);
+		if (ret) {
+			ERR("Invalid value \"%s\" used for \"%s\" environment variable",
+					env_value, DEFAULT_CONSUMERD_DATA_THREADS_ENV);
+		}
+		goto end;
+	}
+
+	*data_threads = DEFAULT_CONSUMERD_DATA_THREADS;
+end:
+	return ret;
+}
+
+/*
+ * Apply the relayd send batch size set in the environment, if any.
+ */
+static int apply_relayd_batch_size(struct lttng_consumer_local_data *ctx)
+{
+	int ret = 0;
+	uint64_t size;
+	const char *env_value;
+
+	env_value = lttng_secure_getenv(DEFAULT_CONSUMERD_RELAYD_BATCH_SIZE_ENV);
+	if (!env_value) {
+		goto end;
+	}
+
+	ret = utils_parse_size_suffix(env_value, &size);
+	if (ret) {
+		ERR("Invalid value \"%s\" used for \"%s\" environment variable",
+				env_value, DEFAULT_CONSUMERD_RELAYD_BATCH_SIZE_ENV);
+		goto end;
+	}
+
+	lttng_consumer_set_relayd_batch_size(ctx, size);
+end:
+	return ret;
+}
+
+/*
+ * Apply the number of snapshot threads set in the environment, if any.
+ */
+static int apply_snapshot_threads(struct lttng_consumer_local_data *ctx)
+{
+	int ret = 0;
+	unsigned int count;
+	const char *env_value;
+
+	env_value = lttng_secure_getenv(DEFAULT_CONSUMERD_SNAPSHOT_THREADS_ENV);
+	if (!env_value) {
+		goto end;
+	}
+
+	ret = parse_thread_count(env_value, &count);
+	if (ret) {
+		ERR("Invalid value \"%s\" used for \"%s\" environment variable",
+				env_value, DEFAULT_CONSUMERD_SNAPSHOT_THREADS_ENV);
+		goto end;
+	}
+
+	lttng_consumer_set_snapshot_thread_count(ctx, count);
+end:
+	return ret;
+}
+
+/*
+ * Apply the alignment of the monitor timers set in the environment, if any.
+ */
+static int apply_monitor_timer_alignment(void)
+{
+	int ret = 0;
+	char *endptr;
+	unsigned long val;
+	const char *env_value;
+
+	env_value = lttng_secure_getenv(
+			DEFAULT_CONSUMERD_ALIGN_MONITOR_TIMERS_ENV);
+	if (!env_value) {
+		goto end;
+	}
+
+	errno = 0;
+	val = strtoul(env_value, &endptr, 10);
+	if (errno != 0 || *endptr != '\0' || endptr == env_value || val > 1) {
+		ERR("Invalid value \"%s\" used for \"%s\" environment variable",
+				env_value, DEFAULT_CONSUMERD_ALIGN_MONITOR_TIMERS_ENV);
+		ret = -1;
+		goto end;
+	}
+
+	consumer_timer_monitor_set_aligned(val == 1);
+end:
+	return ret;
+}
+
+/*
+ * Apply the sparse padding mode set in the environment, if any.
+ */
+static int apply_sparse_padding(void)
+{
+	int ret = 0;
+	char *endptr;
+	unsigned long val;
+	const char *env_value;
+
+	env_value = lttng_secure_getenv(DEFAULT_CONSUMERD_SPARSE_PADDING_ENV);
+	if (!env_value) {
+		goto end;
+	}
+
+	errno = 0;
+	val = strtoul(env_value, &endptr, 10);
+	if (errno != 0 || *endptr != '\0' || endptr == env_value || val > 1) {
+		ERR("Invalid value \"%s\" used for \"%s\" environment variable",
+				env_value, DEFAULT_CONSUMERD_SPARSE_PADDING_ENV);
+		ret = -1;
+		goto end;
+	}
+
+	lttng_consumer_set_sparse_padding(val == 1);
+end:
+	return ret;
+}
+
+/*
+ * Apply the writeback dirty byte limits set in the environment, if any.
+ */
+static int apply_writeback_dirty_limits(void)
+{
+	int ret = 0;
+	uint64_t stream_limit = DEFAULT_CONSUMERD_WRITEBACK_STREAM_DIRTY_LIMIT;
+	uint64_t daemon_limit = DEFAULT_CONSUMERD_WRITEBACK_DIRTY_LIMIT;
+	const char *env_value;
+
+	env_value = lttng_secure_getenv(
+			DEFAULT_CONSUMERD_WRITEBACK_STREAM_DIRTY_LIMIT_ENV);
+	if (env_value) {
+		ret = utils_parse_size_suffix(env_value, &stream_limit);
+		if (ret) {
+			ERR("Invalid value \"%s\" used for \"%s\" environment variable",
+					env_value,
+					DEFAULT_CONSUMERD_WRITEBACK_STREAM_DIRTY_LIMIT_ENV);
+			goto end;
+		}
+	}
+
+	env_value = lttng_secure_getenv(
+			DEFAULT_CONSUMERD_WRITEBACK_DIRTY_LIMIT_ENV);
+	if (env_value) {
+		ret = utils_parse_size_suffix(env_value, &daemon_limit);
+		if (ret) {
+			ERR("Invalid value \"%s\" used for \"%s\" environment variable",
+					env_value,
+					DEFAULT_CONSUMERD_WRITEBACK_DIRTY_LIMIT_ENV);
+			goto end;
+		}
+	}
+
+	consumer_writeback_set_dirty_limits(stream_limit, daemon_limit);
+end:
+	return ret;
+}
+
 /*
  * main
  */
 int main(int argc, char **argv)
 {
 	int ret = 0, retval = 0;
+	unsigned int i, data_threads, nb_launched_data_threads = 0;
 	void *status;
 	struct lttng_consumer_local_data *tmp_ctx;
 
@@ -413,6 +631,41 @@ int main(int argc, char **argv)
 		goto exit_init_data;
 	}
 
+	if (resolve_data_threads(&data_threads)) {
+		retval = -1;
+		goto exit_init_data;
+	}
+
+	if (lttng_consumer_create_data_workers(ctx, data_threads)) {
+		retval = -1;
+		goto exit_init_data;
+	}
+
+	if (apply_relayd_batch_size(ctx)) {
+		retval = -1;
+		goto exit_init_data;
+	}
+
+	if (apply_snapshot_threads(ctx)) {
+		retval = -1;
+		goto exit_init_data;
+	}
+
+	if (apply_monitor_timer_alignment()) {
+		retval = -1;
+		goto exit_init_data;
+	}
+
+	if (apply_sparse_padding()) {
+		retval = -1;
+		goto exit_init_data;
+	}
+
+	if (apply_writeback_dirty_limits()) {
+		retval = -1;
+		goto exit_init_data;
+	}
+
 	lttng_consumer_set_command_sock_path(ctx, command_sock_path);
 	if (*error_sock_path == '\0') {
 		switch (opt_type) {
@@ -463,10 +716,10 @@ int main(int argc, char **argv)
 	lttng_consumer_set_error_sock(ctx, ret);
 
 	/*
-	 * Block RT signals used for UST periodical metadata flush and the live
-	 * timer in main, and create a dedicated thread to handle these signals.
+	 * Set up the channel timers (UST periodical metadata flush, live and
+	 * monitor timers), which are run by a dedicated thread.
 	 */
-	if (consumer_signal_init()) {
+	if (consumer_timer_init()) {
 		retval = -1;
 		goto exit_init_data;
 	}
@@ -511,6 +764,26 @@ int main(int argc, char **argv)
 	}
 	metadata_timer_thread_online = true;
 
+	/*
+	 * Create the thread waiting for the writeout of the data written to
+	 * the output files.
+	 */
+	ret = pthread_create(&writeback_thread, default_pthread_attr(),
+			consumer_writeback_thread, (void *) ctx);
+	if (ret) {
+		errno = ret;
+		PERROR("pthread_create");
+		retval = -1;
+		goto exit_writeback_thread;
+	}
+
+	/* Create the threads helping to record the channel snapshots. */
+	ret = lttng_consumer_launch_snapshot_threads(ctx);
+	if (ret) {
+		retval = -1;
+		goto exit_snapshot_threads;
+	}
+
 	/* Create thread to manage channels */
 	ret = pthread_create(&channel_thread, default_pthread_attr(),
 			consumer_thread_channel_poll,
@@ -533,14 +806,19 @@ int main(int argc, char **argv)
 		goto exit_metadata_thread;
 	}
 
-	/* Create thread to manage the polling/writing of trace data */
-	ret = pthread_create(&data_thread, default_pthread_attr(),
-			consumer_thread_data_poll, (void *) ctx);
-	if (ret) {
-		errno = ret;
-		PERROR("pthread_create");
-		retval = -1;
-		goto exit_data_thread;
+	/* Create the threads to manage the polling/writing of trace data */
+	for (i = 0; i < ctx->nb_data_workers; i++) {
+		ret = pthread_create(&ctx->data_workers[i].thread,
+				default_pthread_attr(),
+				consumer_thread_data_poll,
+				(void *) &ctx->data_workers[i]);
+		if (ret) {
+			errno = ret;
+			PERROR("pthread_create");
+			retval = -1;
+			goto exit_data_thread;
+		}
+		nb_launched_data_threads++;
 	}
 
 	/* Create the thread to manage the reception of fds */
@@ -568,13 +846,16 @@ int main(int argc, char **argv)
 	}
 exit_sessiond_thread:
 
-	ret = pthread_join(data_thread, &status);
-	if (ret) {
-		errno = ret;
-		PERROR("pthread_join data_thread");
-		retval = -1;
-	}
 exit_data_thread:
+	for (i = 0; i < nb_launched_data_threads; i++) {
+		ret = pthread_join(ctx->data_workers[i].thread, &status);
+		if (ret) {
+			errno = ret;
+			PERROR("pthread_join data_thread");
+			retval = -1;
+		}
+	}
+	lttng_consumer_log_data_worker_stats(ctx);
 
 	ret = pthread_join(metadata_thread, &status);
 	if (ret) {
@@ -592,6 +873,21 @@ exit_metadata_thread:
 	}
 exit_channel_thread:
 
+exit_snapshot_threads:
+	lttng_consumer_stop_snapshot_threads(ctx);
+	lttng_consumer_log_snapshot_stats(ctx);
+
+	/* The threads writing to the output files are gone. */
+	consumer_writeback_thread_quit();
+	ret = pthread_join(writeback_thread, &status);
+	if (ret) {
+		errno = ret;
+		PERROR("pthread_join writeback_thread");
+		retval = -1;
+	}
+	consumer_writeback_log_stats();
+exit_writeback_thread:
+
 exit_metadata_timer_thread:
 
 	ret = pthread_join(health_thread, &status);
@@ -625,7 +921,7 @@ exit_init_data:
 		 * threads are gone, because it is required to perform timer
 		 * teardown synchronization.
 		 */
-		kill(getpid(), LTTNG_CONSUMER_SIG_EXIT);
+		consumer_timer_thread_quit();
 		ret = pthread_join(metadata_timer_thread, &status);
 		if (ret) {
 			errno = ret;
@@ -641,6 +937,7 @@ exit_init_data:
 		}
 		metadata_timer_thread_online = false;
 	}
+	consumer_timer_fini();
 	tmp_ctx = ctx;
 	ctx = NULL;
 	cmm_barrier();	/* Clear ctx for signal handler. */
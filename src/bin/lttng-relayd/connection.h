@@ -70,8 +70,9 @@ struct ctrl_connection_state_receive_payload {
  * connections between the relay and a live client are only accessed
  * from the live worker thread.
  *
- * The connections between the consumerd/sessiond and the relayd are only
- * handled by the "main" worker thread (as in, the worker thread in main.c).
+ * A connection between the consumerd/sessiond and the relayd is only
+ * handled by the "main" worker thread it was dispatched to (as in, one of
+ * the worker threads in main.c).
  *
  * This is why there are no back references to connections from the
  * sessions and session list.
@@ -97,6 +98,11 @@ struct relay_connection {
 	 */
 	uint32_t major;
 	uint32_t minor;
+	/*
+	 * Capabilities announced to the viewer (enum lttng_viewer_capability).
+	 * Only valid for RELAY_VIEWER_COMMAND connection type.
+	 */
+	uint32_t viewer_capabilities;
 
 	struct urcu_ref ref;
 
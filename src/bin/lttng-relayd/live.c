@@ -32,9 +32,11 @@
 
 #include <common/common.h>
 #include <common/compat/endian.h>
+#include <common/compat/fcntl.h>
 #include <common/compat/poll.h>
 #include <common/compat/socket.h>
 #include <common/defaults.h>
+#include <common/dynamic-buffer.h>
 #include <common/fd-tracker/utils.h>
 #include <common/fs-handle.h>
 #include <common/futex.h>
@@ -60,21 +62,35 @@
 #include "viewer-stream.h"
 
 #define SESSION_BUF_DEFAULT_COUNT	16
+#define PACKET_SEND_BUFFER_SIZE		65536
 
 static struct lttng_uri *live_uri;
 
 /*
- * This pipe is used to inform the worker thread that a command is queued and
- * ready to be processed.
+ * Worker thread handling the viewer connections handed to it by the
+ * dispatcher thread. A viewer connection, and the viewer session it owns,
+ * is only ever accessed by the worker it was dispatched to.
  */
-static int live_conn_pipe[2] = { -1, -1 };
+struct live_worker {
+	unsigned int id;
+	pthread_t thread;
+	/*
+	 * This pipe is used to inform the worker thread that a connection is
+	 * ready to be processed.
+	 */
+	int conn_pipe[2];
+};
+
+static struct live_worker *live_workers;
+static unsigned int live_worker_count;
+/* Only used by the dispatcher thread. */
+static unsigned int live_next_worker;
 
 /* Shared between threads */
 static int live_dispatch_thread_exit;
 
 static pthread_t live_listener_thread;
 static pthread_t live_dispatcher_thread;
-static pthread_t live_worker_thread;
 
 /*
  * Relay command queue.
@@ -84,6 +100,19 @@ static pthread_t live_worker_thread;
  */
 static struct relay_conn_queue viewer_conn_queue;
 
+/*
+ * Number of indexes sent to the viewers, by where they were read from.
+ * Updated atomically by the workers.
+ */
+static struct {
+	/* Indexes kept in memory by the relay stream. */
+	uint64_t tail_hits;
+	/* Indexes read from the mapping of the index file. */
+	uint64_t map_hits;
+	/* Indexes read from the index file. */
+	uint64_t misses;
+} viewer_index_stats;
+
 static uint64_t last_relay_viewer_session_id;
 static pthread_mutex_t last_relay_viewer_session_id_lock =
 		PTHREAD_MUTEX_INITIALIZER;
@@ -94,8 +123,29 @@ static pthread_mutex_t last_relay_viewer_session_id_lock =
 static
 void cleanup_relayd_live(void)
 {
-	DBG("Cleaning up");
+	unsigned int i;
+	uint64_t tail_hits, map_hits, misses;
 
+	DBG("Cleaning up");
+	tail_hits = uatomic_read(&viewer_index_stats.tail_hits);
+	map_hits = uatomic_read(&viewer_index_stats.map_hits);
+	misses = uatomic_read(&viewer_index_stats.misses);
+	if (tail_hits || map_hits || misses) {
+		MSG("Viewer indexes served from memory: %" PRIu64
+				", from index file mappings: %" PRIu64
+				", read from index files: %" PRIu64,
+				tail_hits, map_hits, misses);
+	}
+
+	for (i = 0; live_workers && i < live_worker_count; i++) {
+		if (live_workers[i].conn_pipe[0] == -1) {
+			continue;
+		}
+		(void) fd_tracker_util_pipe_close(the_fd_tracker,
+				live_workers[i].conn_pipe);
+	}
+	free(live_workers);
+	live_workers = NULL;
 	free(live_uri);
 }
 
@@ -844,6 +894,8 @@ void *thread_dispatcher(void *data)
 		}
 
 		do {
+			struct live_worker *worker;
+
 			health_code_update();
 
 			/* Dequeue commands */
@@ -856,8 +908,13 @@ void *thread_dispatcher(void *data)
 				break;
 			}
 			conn = caa_container_of(node, struct relay_connection, qnode);
-			DBG("Dispatching viewer request waiting on sock %d",
-					conn->sock->fd);
+
+			/* Viewer connections are spread evenly across the workers. */
+			worker = &live_workers[live_next_worker];
+			live_next_worker = (live_next_worker + 1) %
+					live_worker_count;
+			DBG("Dispatching viewer request waiting on sock %d to live worker %u",
+					conn->sock->fd, worker->id);
 
 			/*
 			 * Inform worker thread of the new request. This
@@ -865,7 +922,8 @@ void *thread_dispatcher(void *data)
 			 * the data will be read at some point in time
 			 * or wait to the end of the world :)
 			 */
-			ret = lttng_write(live_conn_pipe[1], &conn, sizeof(conn));
+			ret = lttng_write(worker->conn_pipe[1], &conn,
+					sizeof(conn));
 			if (ret < 0) {
 				PERROR("write conn pipe");
 				connection_put(conn);
@@ -953,15 +1011,20 @@ int viewer_connect(struct relay_connection *conn)
 	reply.major = htobe32(reply.major);
 	reply.minor = htobe32(reply.minor);
 	if (conn->type == RELAY_VIEWER_COMMAND) {
+		uint64_t viewer_session_id;
+
+		/* The viewer may use the commands announced here. */
+		conn->viewer_capabilities = LTTNG_VIEWER_CAPABILITY_BATCH;
+		reply.type = htobe32(conn->viewer_capabilities);
+
 		/*
-		 * Increment outside of htobe64 macro, because the argument can
-		 * be used more than once within the macro, and thus the
-		 * operation may be undefined.
+		 * Sample the id while the lock is held as the live workers
+		 * accept viewers concurrently.
 		 */
 		pthread_mutex_lock(&last_relay_viewer_session_id_lock);
-		last_relay_viewer_session_id++;
+		viewer_session_id = ++last_relay_viewer_session_id;
 		pthread_mutex_unlock(&last_relay_viewer_session_id_lock);
-		reply.viewer_session_id = htobe64(last_relay_viewer_session_id);
+		reply.viewer_session_id = htobe64(viewer_session_id);
 	}
 
 	health_code_update();
@@ -1529,41 +1592,31 @@ index_ready:
 }
 
 /*
- * Send the next index for a stream.
+ * Fill the next index of a viewer stream. The status of the index indicates
+ * whether one was available.
  *
  * Return 0 on success or else a negative value.
  */
 static
-int viewer_get_next_index(struct relay_connection *conn)
+int get_next_index(struct relay_connection *conn, uint64_t stream_id,
+		struct lttng_viewer_index *viewer_index)
 {
 	int ret;
-	struct lttng_viewer_get_next_index request_index;
-	struct lttng_viewer_index viewer_index;
 	struct ctf_packet_index packet_index;
+	enum lttng_index_file_read_source read_source;
 	struct relay_viewer_stream *vstream = NULL;
 	struct relay_stream *rstream = NULL;
 	struct ctf_trace *ctf_trace = NULL;
 	struct relay_viewer_stream *metadata_viewer_stream = NULL;
 
-	assert(conn);
-
-	DBG("Viewer get next index");
-
-	memset(&viewer_index, 0, sizeof(viewer_index));
-	health_code_update();
-
-	ret = recv_request(conn->sock, &request_index, sizeof(request_index));
-	if (ret < 0) {
-		goto end;
-	}
-	health_code_update();
+	memset(viewer_index, 0, sizeof(*viewer_index));
 
-	vstream = viewer_stream_get_by_id(be64toh(request_index.stream_id));
+	vstream = viewer_stream_get_by_id(stream_id);
 	if (!vstream) {
 		DBG("Client requested index of unknown stream id %" PRIu64,
-				(uint64_t) be64toh(request_index.stream_id));
-		viewer_index.status = htobe32(LTTNG_VIEWER_INDEX_ERR);
-		goto send_reply;
+				stream_id);
+		viewer_index->status = htobe32(LTTNG_VIEWER_INDEX_ERR);
+		goto end;
 	}
 
 	/* Use back. ref. Protected by refcounts. */
@@ -1580,20 +1633,20 @@ int viewer_get_next_index(struct relay_connection *conn)
 	 * The viewer should not ask for index on metadata stream.
 	 */
 	if (rstream->is_metadata) {
-		viewer_index.status = htobe32(LTTNG_VIEWER_INDEX_HUP);
-		goto send_reply;
+		viewer_index->status = htobe32(LTTNG_VIEWER_INDEX_HUP);
+		goto end;
 	}
 
 	if (rstream->ongoing_rotation.is_set) {
 		/* Rotation is ongoing, try again later. */
-		viewer_index.status = htobe32(LTTNG_VIEWER_INDEX_RETRY);
-		goto send_reply;
+		viewer_index->status = htobe32(LTTNG_VIEWER_INDEX_RETRY);
+		goto end;
 	}
 
 	if (rstream->trace->session->ongoing_rotation) {
 		/* Rotation is ongoing, try again later. */
-		viewer_index.status = htobe32(LTTNG_VIEWER_INDEX_RETRY);
-		goto send_reply;
+		viewer_index->status = htobe32(LTTNG_VIEWER_INDEX_RETRY);
+		goto end;
 	}
 
 	if (rstream->trace_chunk && !lttng_trace_chunk_ids_equal(
@@ -1605,8 +1658,8 @@ int viewer_get_next_index(struct relay_connection *conn)
 				conn->viewer_session,
 				rstream->trace_chunk);
 		if (ret) {
-			viewer_index.status = htobe32(LTTNG_VIEWER_INDEX_ERR);
-			goto send_reply;
+			viewer_index->status = htobe32(LTTNG_VIEWER_INDEX_ERR);
+			goto end;
 		}
 	}
 	if (conn->viewer_session->current_trace_chunk !=
@@ -1626,7 +1679,7 @@ int viewer_get_next_index(struct relay_connection *conn)
 		viewer_stream_close_files(vstream);
 	}
 
-	ret = check_index_status(vstream, rstream, ctf_trace, &viewer_index);
+	ret = check_index_status(vstream, rstream, ctf_trace, viewer_index);
 	if (ret < 0) {
 		goto error_put;
 	} else if (ret == 1) {
@@ -1634,7 +1687,7 @@ int viewer_get_next_index(struct relay_connection *conn)
 		 * We have no index to send and check_index_status has populated
 		 * viewer_index's status.
 		 */
-		goto send_reply;
+		goto end;
 	}
 	/* At this point, ret is 0 thus we will be able to read the index. */
 	assert(!ret);
@@ -1643,16 +1696,16 @@ int viewer_get_next_index(struct relay_connection *conn)
 	ret = try_open_index(vstream, rstream);
 	if (ret == -ENOENT) {
 	       if (rstream->closed) {
-			viewer_index.status = htobe32(LTTNG_VIEWER_INDEX_HUP);
-			goto send_reply;
+			viewer_index->status = htobe32(LTTNG_VIEWER_INDEX_HUP);
+			goto end;
 	       } else {
-			viewer_index.status = htobe32(LTTNG_VIEWER_INDEX_RETRY);
-			goto send_reply;
+			viewer_index->status = htobe32(LTTNG_VIEWER_INDEX_RETRY);
+			goto end;
 	       }
 	}
 	if (ret < 0) {
-		viewer_index.status = htobe32(LTTNG_VIEWER_INDEX_ERR);
-		goto send_reply;
+		viewer_index->status = htobe32(LTTNG_VIEWER_INDEX_ERR);
+		goto end;
 	}
 
 	/*
@@ -1686,8 +1739,8 @@ int viewer_get_next_index(struct relay_connection *conn)
 		if (status != LTTNG_TRACE_CHUNK_STATUS_OK) {
 			if (status == LTTNG_TRACE_CHUNK_STATUS_NO_FILE &&
 					rstream->closed) {
-				viewer_index.status = htobe32(LTTNG_VIEWER_INDEX_HUP);
-				goto send_reply;
+				viewer_index->status = htobe32(LTTNG_VIEWER_INDEX_HUP);
+				goto end;
 			}
 			PERROR("Failed to open trace file for viewer stream");
 			goto error_put;
@@ -1697,37 +1750,54 @@ int viewer_get_next_index(struct relay_connection *conn)
 
 	ret = check_new_streams(conn);
 	if (ret < 0) {
-		viewer_index.status = htobe32(LTTNG_VIEWER_INDEX_ERR);
-		goto send_reply;
+		viewer_index->status = htobe32(LTTNG_VIEWER_INDEX_ERR);
+		goto end;
 	} else if (ret == 1) {
-		viewer_index.flags |= LTTNG_VIEWER_FLAG_NEW_STREAM;
+		viewer_index->flags |= LTTNG_VIEWER_FLAG_NEW_STREAM;
 	}
 
-	ret = lttng_index_file_read(vstream->index_file, &packet_index);
+	/*
+	 * The stream lock is held: the index file of the relay stream is not
+	 * written to while its tail is used.
+	 */
+	ret = lttng_index_file_read_from(vstream->index_file,
+			rstream->index_file, &packet_index, &read_source);
 	if (ret) {
 		ERR("Relay error reading index file");
-		viewer_index.status = htobe32(LTTNG_VIEWER_INDEX_ERR);
-		goto send_reply;
+		viewer_index->status = htobe32(LTTNG_VIEWER_INDEX_ERR);
+		goto end;
 	} else {
-		viewer_index.status = htobe32(LTTNG_VIEWER_INDEX_OK);
+		viewer_index->status = htobe32(LTTNG_VIEWER_INDEX_OK);
 		vstream->index_sent_seqcount++;
 	}
 
+	switch (read_source) {
+	case LTTNG_INDEX_FILE_READ_SOURCE_TAIL:
+		uatomic_inc(&viewer_index_stats.tail_hits);
+		break;
+	case LTTNG_INDEX_FILE_READ_SOURCE_MAP:
+		uatomic_inc(&viewer_index_stats.map_hits);
+		break;
+	case LTTNG_INDEX_FILE_READ_SOURCE_FILE:
+		uatomic_inc(&viewer_index_stats.misses);
+		break;
+	}
+
 	/*
 	 * Indexes are stored in big endian, no need to switch before sending.
 	 */
 	DBG("Sending viewer index for stream %" PRIu64 " offset %" PRIu64,
 		rstream->stream_handle,
 		(uint64_t) be64toh(packet_index.offset));
-	viewer_index.offset = packet_index.offset;
-	viewer_index.packet_size = packet_index.packet_size;
-	viewer_index.content_size = packet_index.content_size;
-	viewer_index.timestamp_begin = packet_index.timestamp_begin;
-	viewer_index.timestamp_end = packet_index.timestamp_end;
-	viewer_index.events_discarded = packet_index.events_discarded;
-	viewer_index.stream_id = packet_index.stream_id;
+	viewer_index->offset = packet_index.offset;
+	viewer_index->packet_size = packet_index.packet_size;
+	viewer_index->content_size = packet_index.content_size;
+	viewer_index->timestamp_begin = packet_index.timestamp_begin;
+	viewer_index->timestamp_end = packet_index.timestamp_end;
+	viewer_index->events_discarded = packet_index.events_discarded;
+	viewer_index->stream_id = packet_index.stream_id;
 
-send_reply:
+end:
 	if (rstream) {
 		pthread_mutex_unlock(&rstream->lock);
 	}
@@ -1741,26 +1811,19 @@ send_reply:
 		if (!metadata_viewer_stream->stream->metadata_received ||
 				metadata_viewer_stream->stream->metadata_received >
 					metadata_viewer_stream->metadata_sent) {
-			viewer_index.flags |= LTTNG_VIEWER_FLAG_NEW_METADATA;
+			viewer_index->flags |= LTTNG_VIEWER_FLAG_NEW_METADATA;
 		}
 		pthread_mutex_unlock(&metadata_viewer_stream->stream->lock);
 	}
 
-	viewer_index.flags = htobe32(viewer_index.flags);
-	health_code_update();
-
-	ret = send_response(conn->sock, &viewer_index, sizeof(viewer_index));
-	if (ret < 0) {
-		goto end;
-	}
-	health_code_update();
+	viewer_index->flags = htobe32(viewer_index->flags);
+	ret = 0;
 
 	if (vstream) {
-		DBG("Index %" PRIu64 " for stream %" PRIu64 " sent",
+		DBG("Index %" PRIu64 " for stream %" PRIu64 " prepared",
 				vstream->index_sent_seqcount,
 				vstream->stream->stream_handle);
 	}
-end:
 	if (metadata_viewer_stream) {
 		viewer_stream_put(metadata_viewer_stream);
 	}
@@ -1779,114 +1842,515 @@ error_put:
 }
 
 /*
- * Send the next index for a stream
+ * Send the next index for a stream.
  *
  * Return 0 on success or else a negative value.
  */
 static
-int viewer_get_packet(struct relay_connection *conn)
+int viewer_get_next_index(struct relay_connection *conn)
 {
 	int ret;
-	off_t lseek_ret;
-	char *reply = NULL;
-	struct lttng_viewer_get_packet get_packet_info;
-	struct lttng_viewer_trace_packet reply_header;
-	struct relay_viewer_stream *vstream = NULL;
-	uint32_t reply_size = sizeof(reply_header);
-	uint32_t packet_data_len = 0;
-	ssize_t read_len;
+	struct lttng_viewer_get_next_index request_index;
+	struct lttng_viewer_index viewer_index;
+
+	assert(conn);
+
+	DBG("Viewer get next index");
+
+	health_code_update();
+
+	ret = recv_request(conn->sock, &request_index, sizeof(request_index));
+	if (ret < 0) {
+		goto end;
+	}
+	health_code_update();
+
+	ret = get_next_index(conn, be64toh(request_index.stream_id),
+			&viewer_index);
+	if (ret < 0) {
+		goto end;
+	}
+	health_code_update();
+
+	ret = send_response(conn->sock, &viewer_index, sizeof(viewer_index));
+	if (ret < 0) {
+		goto end;
+	}
+	health_code_update();
+end:
+	return ret;
+}
+
+/*
+ * Append the next indexes of a viewer stream to a reply, up to `max_indexes`
+ * indexes or until the first index which is not available.
+ *
+ * Return 0 on success or else a negative value.
+ */
+static
+int append_next_indexes(struct relay_connection *conn, uint64_t stream_id,
+		uint32_t max_indexes, struct lttng_dynamic_buffer *reply,
+		uint32_t *indexes_count)
+{
+	int ret = 0;
+	uint32_t i;
+
+	for (i = 0; i < max_indexes &&
+			*indexes_count < LTTNG_VIEWER_MAX_INDEXES; i++) {
+		struct lttng_viewer_stream_index stream_index;
+
+		health_code_update();
+
+		stream_index.viewer_stream_id = htobe64(stream_id);
+		ret = get_next_index(conn, stream_id, &stream_index.index);
+		if (ret < 0) {
+			goto end;
+		}
+
+		ret = lttng_dynamic_buffer_append(reply, &stream_index,
+				sizeof(stream_index));
+		if (ret) {
+			ERR("Failed to append index to viewer reply");
+			ret = -1;
+			goto end;
+		}
+		(*indexes_count)++;
+
+		if (be32toh(stream_index.index.status) != LTTNG_VIEWER_INDEX_OK) {
+			break;
+		}
+	}
+end:
+	return ret;
+}
+
+/*
+ * Get the IDs of the viewer streams of a session which were sent to the
+ * viewer, except the metadata streams.
+ *
+ * Return 0 on success or else a negative value.
+ */
+static
+int get_session_viewer_stream_ids(uint64_t session_id,
+		struct lttng_dynamic_buffer *stream_ids)
+{
+	int ret = 0;
+	struct lttng_ht_iter iter;
+	struct relay_viewer_stream *vstream;
+
+	rcu_read_lock();
+	cds_lfht_for_each_entry(viewer_streams_ht->ht, &iter.iter, vstream,
+			stream_n.node) {
+		bool selected;
+		uint64_t stream_id;
+
+		if (!viewer_stream_get(vstream)) {
+			continue;
+		}
+
+		stream_id = vstream->stream->stream_handle;
+		pthread_mutex_lock(&vstream->stream->lock);
+		selected = vstream->stream->trace->session->id == session_id &&
+				vstream->sent_flag &&
+				!vstream->stream->is_metadata;
+		pthread_mutex_unlock(&vstream->stream->lock);
+		viewer_stream_put(vstream);
+
+		if (!selected) {
+			continue;
+		}
+		ret = lttng_dynamic_buffer_append(stream_ids, &stream_id,
+				sizeof(stream_id));
+		if (ret) {
+			ret = -1;
+			goto end;
+		}
+	}
+end:
+	rcu_read_unlock();
+	return ret;
+}
+
+/*
+ * Send the next indexes of a stream, or of all the streams of a session.
+ *
+ * Return 0 on success or else a negative value.
+ */
+static
+int viewer_get_next_indexes(struct relay_connection *conn)
+{
+	int ret;
+	size_t i;
+	uint32_t indexes_count = 0, max_indexes;
 	uint64_t stream_id;
+	struct lttng_viewer_get_next_indexes request;
+	struct lttng_viewer_indexes reply_header = {};
+	struct lttng_dynamic_buffer reply, stream_ids;
 
-	DBG2("Relay get data packet");
+	DBG("Viewer get next indexes");
 
+	lttng_dynamic_buffer_init(&reply);
+	lttng_dynamic_buffer_init(&stream_ids);
 	health_code_update();
 
-	ret = recv_request(conn->sock, &get_packet_info,
-			sizeof(get_packet_info));
+	ret = recv_request(conn->sock, &request, sizeof(request));
 	if (ret < 0) {
 		goto end;
 	}
 	health_code_update();
 
-	/* From this point on, the error label can be reached. */
-	memset(&reply_header, 0, sizeof(reply_header));
-	stream_id = (uint64_t) be64toh(get_packet_info.stream_id);
+	/* Reserve the header, which is filled last. */
+	ret = lttng_dynamic_buffer_set_size(&reply, sizeof(reply_header));
+	if (ret) {
+		ret = -1;
+		goto end;
+	}
+
+	reply_header.status = LTTNG_VIEWER_INDEX_OK;
+	stream_id = be64toh(request.stream_id);
+	max_indexes = be32toh(request.max_indexes);
+	if (stream_id == LTTNG_VIEWER_ALL_STREAMS) {
+		struct relay_session *session;
+		const uint64_t session_id = be64toh(request.session_id);
+
+		session = session_get_by_id(session_id);
+		if (!session) {
+			DBG("Relay session %" PRIu64 " not found", session_id);
+			reply_header.status = LTTNG_VIEWER_INDEX_ERR;
+			goto send_reply;
+		}
+		if (!viewer_session_is_attached(conn->viewer_session, session)) {
+			DBG("Relay session %" PRIu64 " is not attached to the viewer",
+					session_id);
+			reply_header.status = LTTNG_VIEWER_INDEX_ERR;
+			session_put(session);
+			goto send_reply;
+		}
+		session_put(session);
+
+		ret = get_session_viewer_stream_ids(session_id, &stream_ids);
+		if (ret) {
+			goto end;
+		}
+	} else {
+		ret = lttng_dynamic_buffer_append(&stream_ids, &stream_id,
+				sizeof(stream_id));
+		if (ret) {
+			ret = -1;
+			goto end;
+		}
+	}
+
+	for (i = 0; i < stream_ids.size / sizeof(uint64_t); i++) {
+		const uint64_t *ids = (const uint64_t *) stream_ids.data;
+
+		ret = append_next_indexes(conn, ids[i], max_indexes, &reply,
+				&indexes_count);
+		if (ret) {
+			goto end;
+		}
+	}
+
+send_reply:
+	reply_header.status = htobe32(reply_header.status);
+	reply_header.indexes_count = htobe32(indexes_count);
+	memcpy(reply.data, &reply_header, sizeof(reply_header));
+	health_code_update();
+
+	ret = send_response(conn->sock, reply.data, reply.size);
+	if (ret < 0) {
+		goto end;
+	}
+	health_code_update();
+
+	DBG("Sent %" PRIu32 " indexes of %zu stream(s)", indexes_count,
+			stream_ids.size / sizeof(uint64_t));
+end:
+	lttng_dynamic_buffer_reset(&reply);
+	lttng_dynamic_buffer_reset(&stream_ids);
+	return ret;
+}
+
+/*
+ * Send 'len' bytes of a trace file, starting at 'offset', to a viewer.
+ *
+ * The data is sent from the page cache to the socket with sendfile(). The
+ * remainder is read and sent through the socket if sendfile() is not
+ * supported by the file or the socket.
+ *
+ * Return 0 on success else a negative value.
+ */
+static
+int send_packet_data(struct lttcomm_sock *sock, int fd, uint64_t offset,
+		size_t len)
+{
+	int ret = 0;
+	off_t file_offset = (off_t) offset;
+	size_t left_to_send = len;
+	char buffer[PACKET_SEND_BUFFER_SIZE];
+
+	while (left_to_send > 0) {
+		const ssize_t sent = lttng_sendfile(sock->fd, fd, &file_offset,
+				left_to_send);
+
+		if (sent < 0 && errno == EINTR) {
+			continue;
+		} else if (sent < 0 && (errno == EINVAL || errno == ENOSYS)) {
+			DBG("sendfile() not supported for viewer packet, falling back to read");
+			break;
+		} else if (sent <= 0) {
+			PERROR("Failed to send packet data to viewer");
+			ret = -1;
+			goto end;
+		}
+		left_to_send -= sent;
+	}
+
+	while (left_to_send > 0) {
+		const size_t to_send_this_pass =
+				min(left_to_send, sizeof(buffer));
+		ssize_t io_ret;
+
+		io_ret = pread(fd, buffer, to_send_this_pass, file_offset);
+		if (io_ret < 0 && errno == EINTR) {
+			continue;
+		} else if (io_ret <= 0) {
+			PERROR("Failed to read packet data of viewer stream");
+			ret = -1;
+			goto end;
+		}
+
+		io_ret = sock->ops->sendmsg(sock, buffer, io_ret, 0);
+		if (io_ret < 0) {
+			ret = -1;
+			goto end;
+		}
+		file_offset += io_ret;
+		left_to_send -= io_ret;
+	}
+end:
+	return ret;
+}
+
+/*
+ * Get the file descriptor of the current trace file of a viewer stream after
+ * checking that it holds `len` bytes from `offset`. The viewer stream files
+ * are only rotated or closed by the live worker owning the viewer connection,
+ * so the packets can be sent without holding the stream lock.
+ *
+ * Return LTTNG_VIEWER_GET_PACKET_OK on success, in which case `_vstream` holds
+ * a reference to the viewer stream and `_fd` is in use until put_packet_fd()
+ * is called.
+ */
+static
+enum lttng_viewer_get_packet_return_code get_packet_fd(uint64_t stream_id,
+		uint64_t offset, uint64_t len,
+		struct relay_viewer_stream **_vstream, int *_fd)
+{
+	int ret, fd = -1;
+	struct stat file_status;
+	struct relay_viewer_stream *vstream;
+	enum lttng_viewer_get_packet_return_code status =
+			LTTNG_VIEWER_GET_PACKET_ERR;
 
 	vstream = viewer_stream_get_by_id(stream_id);
 	if (!vstream) {
 		DBG("Client requested packet of unknown stream id %" PRIu64,
 				stream_id);
-		reply_header.status = htobe32(LTTNG_VIEWER_GET_PACKET_ERR);
-		goto send_reply_nolock;
+		goto end;
+	}
+
+	/* The stream lock is only held to validate the request. */
+	pthread_mutex_lock(&vstream->stream->lock);
+	if (!vstream->stream_file.handle) {
+		ERR("Client requested packet of viewer stream %" PRIu64 " which has no open file",
+				stream_id);
+		goto end_unlock;
+	}
+
+	fd = fs_handle_get_fd(vstream->stream_file.handle);
+	if (fd < 0) {
+		ERR("Failed to get file descriptor of viewer stream %" PRIu64,
+				stream_id);
+		goto end_unlock;
+	}
+
+	ret = fstat(fd, &file_status);
+	if (ret < 0) {
+		PERROR("Failed to stat file of viewer stream %" PRIu64,
+				stream_id);
+		goto end_unlock;
+	}
+
+	if (offset > (uint64_t) file_status.st_size ||
+			len > (uint64_t) file_status.st_size - offset) {
+		ERR("Client requested packet beyond the end of the file of viewer stream %" PRIu64
+				", offset: %" PRIu64 ", length: %" PRIu64,
+				stream_id, offset, len);
+		goto end_unlock;
+	}
+
+	status = LTTNG_VIEWER_GET_PACKET_OK;
+end_unlock:
+	pthread_mutex_unlock(&vstream->stream->lock);
+	if (status == LTTNG_VIEWER_GET_PACKET_OK) {
+		*_vstream = vstream;
+		*_fd = fd;
 	} else {
-		packet_data_len = be32toh(get_packet_info.len);
-		reply_size += packet_data_len;
+		if (fd >= 0) {
+			fs_handle_put_fd(vstream->stream_file.handle);
+		}
+		viewer_stream_put(vstream);
 	}
+end:
+	return status;
+}
 
-	reply = zmalloc(reply_size);
-	if (!reply) {
-		PERROR("packet reply zmalloc");
-		reply_size = sizeof(reply_header);
-		goto error;
+/*
+ * Release the file descriptor and the viewer stream reference acquired by
+ * get_packet_fd().
+ */
+static
+void put_packet_fd(struct relay_viewer_stream *vstream)
+{
+	if (!vstream) {
+		return;
 	}
 
-	pthread_mutex_lock(&vstream->stream->lock);
-	lseek_ret = fs_handle_seek(vstream->stream_file.handle,
-			be64toh(get_packet_info.offset), SEEK_SET);
-	if (lseek_ret < 0) {
-		PERROR("Failed to seek file system handle of viewer stream %" PRIu64
-		       " to offset %" PRIu64,
-				stream_id,
-				(uint64_t) be64toh(get_packet_info.offset));
-		goto error;
+	fs_handle_put_fd(vstream->stream_file.handle);
+	viewer_stream_put(vstream);
+}
+
+/*
+ * Send a data packet to a viewer.
+ *
+ * Return 0 on success or else a negative value.
+ */
+static
+int viewer_get_packet(struct relay_connection *conn)
+{
+	int ret, fd = -1;
+	struct relay_viewer_stream *vstream = NULL;
+	struct lttng_viewer_get_packet get_packet_info;
+	struct lttng_viewer_trace_packet reply_header;
+	uint32_t packet_data_len = 0;
+	uint64_t stream_id, packet_offset;
+	enum lttng_viewer_get_packet_return_code status;
+
+	DBG2("Relay get data packet");
+
+	health_code_update();
+
+	ret = recv_request(conn->sock, &get_packet_info,
+			sizeof(get_packet_info));
+	if (ret < 0) {
+		goto end;
 	}
-	read_len = fs_handle_read(vstream->stream_file.handle,
-			reply + sizeof(reply_header), packet_data_len);
-	if (read_len < packet_data_len) {
-		PERROR("Failed to read from file system handle of viewer stream id %" PRIu64
-		       ", offset: %" PRIu64,
-				stream_id,
-				(uint64_t) be64toh(get_packet_info.offset));
-		goto error;
+	health_code_update();
+
+	memset(&reply_header, 0, sizeof(reply_header));
+	stream_id = (uint64_t) be64toh(get_packet_info.stream_id);
+	packet_offset = (uint64_t) be64toh(get_packet_info.offset);
+
+	status = get_packet_fd(stream_id, packet_offset,
+			be32toh(get_packet_info.len), &vstream, &fd);
+	if (status == LTTNG_VIEWER_GET_PACKET_OK) {
+		packet_data_len = be32toh(get_packet_info.len);
 	}
-	reply_header.status = htobe32(LTTNG_VIEWER_GET_PACKET_OK);
+	reply_header.status = htobe32(status);
 	reply_header.len = htobe32(packet_data_len);
-	goto send_reply;
 
-error:
-	reply_header.status = htobe32(LTTNG_VIEWER_GET_PACKET_ERR);
+	health_code_update();
 
-send_reply:
-	if (vstream) {
-		pthread_mutex_unlock(&vstream->stream->lock);
+	/* The packet data is coalesced with the reply header. */
+	ret = conn->sock->ops->sendmsg(conn->sock, &reply_header,
+			sizeof(reply_header), packet_data_len ? MSG_MORE : 0);
+	if (ret < 0) {
+		ERR("Relayd failed to send response.");
+	} else if (packet_data_len) {
+		ret = send_packet_data(conn->sock, fd, packet_offset,
+				packet_data_len);
 	}
-send_reply_nolock:
 
 	health_code_update();
+	if (ret < 0) {
+		PERROR("sendmsg of packet data failed");
+		goto end;
+	}
+
+	DBG("Sent %zu bytes for stream %" PRIu64,
+			sizeof(reply_header) + packet_data_len, stream_id);
 
-	if (reply) {
-		memcpy(reply, &reply_header, sizeof(reply_header));
-		ret = send_response(conn->sock, reply, reply_size);
+end:
+	put_packet_fd(vstream);
+	return ret;
+}
+
+/*
+ * Send a contiguous run of data packets to a viewer.
+ *
+ * Return 0 on success or else a negative value.
+ */
+static
+int viewer_get_packets(struct relay_connection *conn)
+{
+	int ret, fd = -1;
+	struct relay_viewer_stream *vstream = NULL;
+	struct lttng_viewer_get_packets request;
+	struct lttng_viewer_trace_packets reply_header;
+	uint64_t stream_id, offset, len, data_len = 0;
+	enum lttng_viewer_get_packet_return_code status;
+
+	DBG2("Relay get data packets");
+
+	health_code_update();
+
+	ret = recv_request(conn->sock, &request, sizeof(request));
+	if (ret < 0) {
+		goto end;
+	}
+	health_code_update();
+
+	memset(&reply_header, 0, sizeof(reply_header));
+	stream_id = be64toh(request.stream_id);
+	offset = be64toh(request.offset);
+	len = be64toh(request.len);
+
+	if (len > LTTNG_VIEWER_MAX_PACKETS_LEN) {
+		ERR("Client requested %" PRIu64 " bytes of packets of viewer stream %" PRIu64
+				", more than the maximum of %llu bytes",
+				len, stream_id, LTTNG_VIEWER_MAX_PACKETS_LEN);
+		status = LTTNG_VIEWER_GET_PACKET_ERR;
 	} else {
-		/* No reply to send. */
-		ret = send_response(conn->sock, &reply_header,
-				reply_size);
+		status = get_packet_fd(stream_id, offset, len, &vstream, &fd);
 	}
+	if (status == LTTNG_VIEWER_GET_PACKET_OK) {
+		data_len = len;
+	}
+	reply_header.status = htobe32(status);
+	reply_header.len = htobe64(data_len);
 
 	health_code_update();
+
+	ret = conn->sock->ops->sendmsg(conn->sock, &reply_header,
+			sizeof(reply_header), data_len ? MSG_MORE : 0);
 	if (ret < 0) {
-		PERROR("sendmsg of packet data failed");
-		goto end_free;
+		ERR("Relayd failed to send response.");
+	} else if (data_len) {
+		ret = send_packet_data(conn->sock, fd, offset,
+				(size_t) data_len);
 	}
 
-	DBG("Sent %u bytes for stream %" PRIu64, reply_size, stream_id);
+	health_code_update();
+	if (ret < 0) {
+		PERROR("sendmsg of packets data failed");
+		goto end;
+	}
 
-end_free:
-	free(reply);
+	DBG("Sent %" PRIu64 " bytes of packets for stream %" PRIu64,
+			(uint64_t) sizeof(reply_header) + data_len, stream_id);
 end:
-	if (vstream) {
-		viewer_stream_put(vstream);
-	}
+	put_packet_fd(vstream);
 	return ret;
 }
 
@@ -2324,6 +2788,22 @@ int process_control(struct lttng_viewer_cmd *recv_hdr,
 	case LTTNG_VIEWER_DETACH_SESSION:
 		ret = viewer_detach_session(conn);
 		break;
+	case LTTNG_VIEWER_GET_NEXT_INDEXES:
+	case LTTNG_VIEWER_GET_PACKETS:
+		if (!(conn->viewer_capabilities &
+				LTTNG_VIEWER_CAPABILITY_BATCH)) {
+			ERR("Received viewer command %u, which was not announced to the viewer",
+					msg_value);
+			live_relay_unknown_command(conn);
+			ret = -1;
+			goto end;
+		}
+		if (msg_value == LTTNG_VIEWER_GET_NEXT_INDEXES) {
+			ret = viewer_get_next_indexes(conn);
+		} else {
+			ret = viewer_get_packets(conn);
+		}
+		break;
 	default:
 		ERR("Received unknown viewer command (%u)",
 				be32toh(recv_hdr->cmd));
@@ -2351,7 +2831,8 @@ void cleanup_connection_pollfd(struct lttng_poll_event *events, int pollfd)
 }
 
 /*
- * This thread does the actual work
+ * This thread does the actual work. One such thread is launched per live
+ * worker.
  */
 static
 void *thread_worker(void *data)
@@ -2363,8 +2844,10 @@ void *thread_worker(void *data)
 	struct lttng_ht_iter iter;
 	struct lttng_viewer_cmd recv_hdr;
 	struct relay_connection *destroy_conn;
+	struct live_worker *worker = data;
+	const int conn_pipe_fd = worker->conn_pipe[0];
 
-	DBG("[thread] Live viewer relay worker started");
+	DBG("[thread] Live viewer relay worker %u started", worker->id);
 
 	rcu_register_thread();
 
@@ -2386,7 +2869,7 @@ void *thread_worker(void *data)
 		goto error_poll_create;
 	}
 
-	ret = lttng_poll_add(&events, live_conn_pipe[0], LPOLLIN | LPOLLRDHUP);
+	ret = lttng_poll_add(&events, conn_pipe_fd, LPOLLIN | LPOLLRDHUP);
 	if (ret < 0) {
 		goto error;
 	}
@@ -2434,11 +2917,11 @@ restart:
 			}
 
 			/* Inspect the relay conn pipe for new connection. */
-			if (pollfd == live_conn_pipe[0]) {
+			if (pollfd == conn_pipe_fd) {
 				if (revents & LPOLLIN) {
 					struct relay_connection *conn;
 
-					ret = lttng_read(live_conn_pipe[0],
+					ret = lttng_read(conn_pipe_fd,
 							&conn, sizeof(conn));
 					if (ret < 0) {
 						goto error;
@@ -2518,8 +3001,6 @@ error:
 error_poll_create:
 	lttng_ht_destroy(viewer_connections_ht);
 viewer_connections_ht_error:
-	/* Close relay conn pipes */
-	(void) fd_tracker_util_pipe_close(the_fd_tracker, live_conn_pipe);
 	if (err) {
 		DBG("Viewer worker thread exited with error");
 	}
@@ -2538,13 +3019,68 @@ error_testpoint:
 }
 
 /*
- * Create the relay command pipe to wake thread_manage_apps.
- * Closed in cleanup().
+ * Allocate the live workers and create their connection pipes.
+ * Closed in cleanup_relayd_live().
  */
-static int create_conn_pipe(void)
+static int create_live_workers(unsigned int count)
 {
-	return fd_tracker_util_pipe_open_cloexec(the_fd_tracker,
-			"Live connection pipe", live_conn_pipe);
+	int ret;
+	unsigned int i;
+
+	live_workers = zmalloc(count * sizeof(*live_workers));
+	if (!live_workers) {
+		PERROR("zmalloc live workers");
+		ret = -1;
+		goto end;
+	}
+	live_worker_count = count;
+
+	for (i = 0; i < count; i++) {
+		live_workers[i].id = i;
+		live_workers[i].conn_pipe[0] = -1;
+		live_workers[i].conn_pipe[1] = -1;
+	}
+
+	for (i = 0; i < count; i++) {
+		char name[32];
+
+		ret = snprintf(name, sizeof(name),
+				"Live connection pipe %u", i);
+		if (ret < 0 || (size_t) ret >= sizeof(name)) {
+			ret = -1;
+			goto end;
+		}
+
+		ret = fd_tracker_util_pipe_open_cloexec(the_fd_tracker, name,
+				live_workers[i].conn_pipe);
+		if (ret) {
+			goto end;
+		}
+	}
+	ret = 0;
+end:
+	return ret;
+}
+
+/*
+ * Join the first 'count' live worker threads.
+ */
+static int join_live_workers(unsigned int count)
+{
+	int ret, retval = 0;
+	unsigned int i;
+	void *status;
+
+	for (i = 0; i < count; i++) {
+		ret = pthread_join(live_workers[i].thread, &status);
+		if (ret) {
+			errno = ret;
+			PERROR("pthread_join live worker");
+			retval = -1;
+		}
+	}
+
+	return retval;
 }
 
 int relayd_live_join(void)
@@ -2559,10 +3095,7 @@ int relayd_live_join(void)
 		retval = -1;
 	}
 
-	ret = pthread_join(live_worker_thread, &status);
-	if (ret) {
-		errno = ret;
-		PERROR("pthread_join live worker");
+	if (join_live_workers(live_worker_count)) {
 		retval = -1;
 	}
 
@@ -2581,11 +3114,12 @@ int relayd_live_join(void)
 /*
  * main
  */
-int relayd_live_create(struct lttng_uri *uri)
+int relayd_live_create(struct lttng_uri *uri, unsigned int worker_count)
 {
 	int ret = 0, retval = 0;
 	void *status;
 	int is_root;
+	unsigned int i, nb_launched_workers = 0;
 
 	if (!uri) {
 		retval = -1;
@@ -2604,8 +3138,8 @@ int relayd_live_create(struct lttng_uri *uri)
 		}
 	}
 
-	/* Setup the thread apps communication pipe. */
-	if (create_conn_pipe()) {
+	/* Setup the worker threads communication pipes. */
+	if (create_live_workers(worker_count)) {
 		retval = -1;
 		goto exit_init_data;
 	}
@@ -2629,14 +3163,18 @@ int relayd_live_create(struct lttng_uri *uri)
 		goto exit_dispatcher_thread;
 	}
 
-	/* Setup the worker thread */
-	ret = pthread_create(&live_worker_thread, default_pthread_attr(),
-			thread_worker, NULL);
-	if (ret) {
-		errno = ret;
-		PERROR("pthread_create viewer worker");
-		retval = -1;
-		goto exit_worker_thread;
+	/* Setup the worker threads */
+	for (i = 0; i < live_worker_count; i++) {
+		ret = pthread_create(&live_workers[i].thread,
+				default_pthread_attr(), thread_worker,
+				&live_workers[i]);
+		if (ret) {
+			errno = ret;
+			PERROR("pthread_create viewer worker");
+			retval = -1;
+			goto exit_worker_thread;
+		}
+		nb_launched_workers++;
 	}
 
 	/* Setup the listener thread */
@@ -2660,14 +3198,10 @@ int relayd_live_create(struct lttng_uri *uri)
 	 */
 
 exit_listener_thread:
-
-	ret = pthread_join(live_worker_thread, &status);
-	if (ret) {
-		errno = ret;
-		PERROR("pthread_join live worker");
+exit_worker_thread:
+	if (join_live_workers(nb_launched_workers)) {
 		retval = -1;
 	}
-exit_worker_thread:
 
 	ret = pthread_join(live_dispatcher_thread, &status);
 	if (ret) {
@@ -17,6 +17,13 @@
 #define LTTNG_VIEWER_NAME_MAX		255
 #define LTTNG_VIEWER_HOST_NAME_MAX	64
 
+/* Maximal number of indexes in a LTTNG_VIEWER_GET_NEXT_INDEXES reply. */
+#define LTTNG_VIEWER_MAX_INDEXES		16384
+/* Maximal length of the data of a LTTNG_VIEWER_GET_PACKETS reply. */
+#define LTTNG_VIEWER_MAX_PACKETS_LEN		(64ULL * 1024 * 1024)
+/* Stream ID of a LTTNG_VIEWER_GET_NEXT_INDEXES request for a whole session. */
+#define LTTNG_VIEWER_ALL_STREAMS		-1ULL
+
 /* Flags in reply to get_next_index and get_packet. */
 enum {
 	/* New metadata is required to read this packet. */
@@ -35,6 +42,8 @@ enum lttng_viewer_command {
 	LTTNG_VIEWER_GET_NEW_STREAMS	= 7,
 	LTTNG_VIEWER_CREATE_SESSION	= 8,
 	LTTNG_VIEWER_DETACH_SESSION	= 9,
+	LTTNG_VIEWER_GET_NEXT_INDEXES	= 10,
+	LTTNG_VIEWER_GET_PACKETS	= 11,
 };
 
 enum lttng_viewer_attach_return_code {
@@ -73,6 +82,15 @@ enum lttng_viewer_connection_type {
 	LTTNG_VIEWER_CLIENT_NOTIFICATION	= 2,
 };
 
+/*
+ * Capabilities announced by the relay daemon in the type field of its reply
+ * to LTTNG_VIEWER_CONNECT, which older relay daemons leave to 0.
+ */
+enum lttng_viewer_capability {
+	/* LTTNG_VIEWER_GET_NEXT_INDEXES and LTTNG_VIEWER_GET_PACKETS. */
+	LTTNG_VIEWER_CAPABILITY_BATCH		= (1 << 0),
+};
+
 enum lttng_viewer_seek {
 	/* Receive the trace packets from the beginning. */
 	LTTNG_VIEWER_SEEK_BEGINNING	= 1,
@@ -176,6 +194,41 @@ struct lttng_viewer_index {
 	uint32_t flags;		/* LTTNG_VIEWER_FLAG_* */
 } __attribute__ ((__packed__));
 
+/*
+ * LTTNG_VIEWER_GET_NEXT_INDEXES payload.
+ *
+ * Returns the next indexes of a stream, or of all the streams of a session
+ * which were sent to the viewer, as LTTNG_VIEWER_GET_NEXT_INDEX would in as
+ * many round trips. The indexes of a stream stop after `max_indexes` indexes
+ * or at its first index of which the status is not LTTNG_VIEWER_INDEX_OK,
+ * which is included in the reply.
+ */
+struct lttng_viewer_get_next_indexes {
+	/* Stream ID, or LTTNG_VIEWER_ALL_STREAMS. */
+	uint64_t stream_id;
+	/* Session ID, used if stream_id is LTTNG_VIEWER_ALL_STREAMS. */
+	uint64_t session_id;
+	/* Maximal number of indexes per stream. */
+	uint32_t max_indexes;
+} LTTNG_PACKED;
+
+struct lttng_viewer_stream_index {
+	/* ID of the stream to which the index belongs. */
+	uint64_t viewer_stream_id;
+	struct lttng_viewer_index index;
+} LTTNG_PACKED;
+
+struct lttng_viewer_indexes {
+	/*
+	 * LTTNG_VIEWER_INDEX_OK, or LTTNG_VIEWER_INDEX_ERR if the session
+	 * is unknown or not attached.
+	 */
+	uint32_t status;
+	uint32_t indexes_count;
+	/* struct lttng_viewer_stream_index */
+	char index_list[];
+} LTTNG_PACKED;
+
 /*
  * LTTNG_VIEWER_GET_PACKET payload.
  */
@@ -192,6 +245,26 @@ struct lttng_viewer_trace_packet {
 	char data[];
 } LTTNG_PACKED;
 
+/*
+ * LTTNG_VIEWER_GET_PACKETS payload.
+ *
+ * Returns a contiguous run of packets of a stream, for instance all the
+ * packets described by the indexes returned by LTTNG_VIEWER_GET_NEXT_INDEXES,
+ * in one reply. `len` is at most LTTNG_VIEWER_MAX_PACKETS_LEN.
+ */
+struct lttng_viewer_get_packets {
+	uint64_t stream_id;
+	uint64_t offset;
+	uint64_t len;
+} LTTNG_PACKED;
+
+struct lttng_viewer_trace_packets {
+	uint32_t status;	/* enum lttng_viewer_get_packet_return_code */
+	uint32_t flags;		/* LTTNG_VIEWER_FLAG_* */
+	uint64_t len;
+	char data[];
+} LTTNG_PACKED;
+
 /*
  * LTTNG_VIEWER_GET_METADATA payload.
  */
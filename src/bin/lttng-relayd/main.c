@@ -17,6 +17,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <sys/mount.h>
 #include <sys/resource.h>
@@ -39,6 +40,7 @@
 #include <common/compat/poll.h>
 #include <common/compat/socket.h>
 #include <common/compat/endian.h>
+#include <common/compat/fcntl.h>
 #include <common/compat/getenv.h>
 #include <common/defaults.h>
 #include <common/daemonize.h>
@@ -126,17 +128,36 @@ const char * const config_section_name = "relayd";
 int thread_quit_pipe[2] = { -1, -1 };
 
 /*
- * This pipe is used to inform the worker thread that a command is queued and
- * ready to be processed.
+ * Worker thread handling the control and data connections handed to it by
+ * the dispatcher thread. Each worker owns its connections and its poll set.
  */
-static int relay_conn_pipe[2] = { -1, -1 };
+struct relay_worker {
+	unsigned int id;
+	pthread_t thread;
+	/*
+	 * This pipe is used to inform the worker thread that a connection is
+	 * ready to be processed.
+	 */
+	int conn_pipe[2];
+	/*
+	 * Pipe through which the packet payloads are spliced from the data
+	 * sockets to the stream files. Only used by this worker's thread.
+	 */
+	int splice_pipe[2];
+	/* Cleared if splicing from the data sockets is not supported. */
+	bool splice_enabled;
+};
+
+static struct relay_worker *relay_workers;
+static unsigned int relay_worker_count;
+/* Only used by the dispatcher thread. */
+static unsigned int next_control_worker, next_data_worker;
 
 /* Shared between threads */
 static int dispatch_thread_exit;
 
 static pthread_t listener_thread;
 static pthread_t dispatcher_thread;
-static pthread_t worker_thread;
 static pthread_t health_thread;
 
 /*
@@ -157,6 +178,20 @@ static struct relay_conn_queue relay_conn_queue;
 /* Cap of file desriptors to be in simultaneous use by the relay daemon. */
 static unsigned int lttng_opt_fd_pool_size = -1;
 
+/* Number of worker threads handling the control and data connections. */
+static unsigned int lttng_opt_worker_threads = DEFAULT_RELAYD_WORKER_THREADS;
+
+/* Number of worker threads handling the live viewer connections. */
+static unsigned int lttng_opt_live_worker_threads =
+		DEFAULT_RELAYD_LIVE_WORKER_THREADS;
+
+/* Number of indexes of each live stream kept in memory for the viewers. */
+unsigned int relayd_index_cache_entries =
+		DEFAULT_LTTNG_RELAYD_INDEX_CACHE_ENTRIES;
+
+/* Skip the padding of the packets by extending the stream files sparsely. */
+bool relayd_sparse_padding;
+
 /* Global relay stream hash table. */
 struct lttng_ht *relay_streams_ht;
 
@@ -182,6 +217,8 @@ static struct option long_options[] = {
 	{ "background", 0, 0, 'b', },
 	{ "group", 1, 0, 'g', },
 	{ "fd-pool-size", 1, 0, '\0', },
+	{ "worker-threads", 1, 0, '\0', },
+	{ "live-worker-threads", 1, 0, '\0', },
 	{ "help", 0, 0, 'h', },
 	{ "output", 1, 0, 'o', },
 	{ "verbose", 0, 0, 'v', },
@@ -241,6 +278,40 @@ static int set_option(int opt, const char *arg, const char *optname)
 				goto end;
 			}
 			lttng_opt_fd_pool_size = (unsigned int) v;
+		} else if (!strcmp(optname, "worker-threads")) {
+			unsigned long v;
+
+			errno = 0;
+			v = strtoul(arg, NULL, 0);
+			if (errno != 0 || !isdigit((unsigned char) arg[0]) ||
+					v == 0) {
+				ERR("Wrong value in --worker-threads parameter: %s", arg);
+				ret = -1;
+				goto end;
+			}
+			if (v >= UINT_MAX) {
+				ERR("Worker thread count overflow in --worker-threads parameter: %s", arg);
+				ret = -1;
+				goto end;
+			}
+			lttng_opt_worker_threads = (unsigned int) v;
+		} else if (!strcmp(optname, "live-worker-threads")) {
+			unsigned long v;
+
+			errno = 0;
+			v = strtoul(arg, NULL, 0);
+			if (errno != 0 || !isdigit((unsigned char) arg[0]) ||
+					v == 0) {
+				ERR("Wrong value in --live-worker-threads parameter: %s", arg);
+				ret = -1;
+				goto end;
+			}
+			if (v >= UINT_MAX) {
+				ERR("Worker thread count overflow in --live-worker-threads parameter: %s", arg);
+				ret = -1;
+				goto end;
+			}
+			lttng_opt_live_worker_threads = (unsigned int) v;
 		} else {
 			fprintf(stderr, "unknown option %s", optname);
 			if (arg) {
@@ -654,6 +725,41 @@ static int set_options(int argc, char **argv)
 			opt_allow_clear = !ret;
 		}
 	}
+	{
+		const char *value = lttng_secure_getenv(
+				DEFAULT_LTTNG_RELAYD_INDEX_CACHE_ENTRIES_ENV);
+
+		if (value) {
+			char *endptr;
+			unsigned long entries;
+
+			errno = 0;
+			entries = strtoul(value, &endptr, 10);
+			if (errno != 0 || endptr == value || *endptr != '\0' ||
+					entries > UINT32_MAX) {
+				ERR("Invalid value for %s specified",
+						DEFAULT_LTTNG_RELAYD_INDEX_CACHE_ENTRIES_ENV);
+				retval = -1;
+				goto exit;
+			}
+			relayd_index_cache_entries = (unsigned int) entries;
+		}
+	}
+	{
+		const char *value = lttng_secure_getenv(
+				DEFAULT_LTTNG_RELAYD_SPARSE_PADDING_ENV);
+
+		if (value) {
+			ret = config_parse_value(value);
+			if (ret < 0) {
+				ERR("Invalid value for %s specified",
+						DEFAULT_LTTNG_RELAYD_SPARSE_PADDING_ENV);
+				retval = -1;
+				goto exit;
+			}
+			relayd_sparse_padding = ret;
+		}
+	}
 
 exit:
 	free(optstring);
@@ -706,6 +812,22 @@ static void relayd_cleanup(void)
 	if (health_relayd) {
 		health_app_destroy(health_relayd);
 	}
+	/* Close relay conn pipes */
+	if (relay_workers) {
+		unsigned int i;
+
+		for (i = 0; i < relay_worker_count; i++) {
+			if (relay_workers[i].conn_pipe[0] != -1) {
+				(void) fd_tracker_util_pipe_close(the_fd_tracker,
+						relay_workers[i].conn_pipe);
+			}
+			if (relay_workers[i].splice_pipe[0] != -1) {
+				(void) fd_tracker_util_pipe_close(the_fd_tracker,
+						relay_workers[i].splice_pipe);
+			}
+		}
+		free(relay_workers);
+	}
 	/* Close thread quit pipes */
 	if (health_quit_pipe[0] != -1) {
 		(void) fd_tracker_util_pipe_close(
@@ -1275,6 +1397,24 @@ error_sock_control:
 	return NULL;
 }
 
+/*
+ * Select the worker owning a new connection.
+ *
+ * The control and the data connections are each handed to the workers in
+ * turn, so that the data connections are spread evenly across the workers
+ * even when they all come from the same host. Sessions and streams are
+ * protected by their own locks as the live threads access them concurrently.
+ */
+static struct relay_worker *select_worker(const struct relay_connection *conn)
+{
+	unsigned int *next_worker = conn->type == RELAY_DATA ?
+			&next_data_worker : &next_control_worker;
+	struct relay_worker *worker = &relay_workers[*next_worker];
+
+	*next_worker = (*next_worker + 1) % relay_worker_count;
+	return worker;
+}
+
 /*
  * This thread manages the dispatching of the requests to worker threads
  */
@@ -1306,6 +1446,8 @@ static void *relay_thread_dispatcher(void *data)
 		}
 
 		do {
+			struct relay_worker *worker;
+
 			health_code_update();
 
 			/* Dequeue commands */
@@ -1317,8 +1459,10 @@ static void *relay_thread_dispatcher(void *data)
 				break;
 			}
 			new_conn = caa_container_of(node, struct relay_connection, qnode);
+			worker = select_worker(new_conn);
 
-			DBG("Dispatching request waiting on sock %d", new_conn->sock->fd);
+			DBG("Dispatching request waiting on sock %d to worker %u",
+					new_conn->sock->fd, worker->id);
 
 			/*
 			 * Inform worker thread of the new request. This
@@ -1326,7 +1470,8 @@ static void *relay_thread_dispatcher(void *data)
 			 * the data will be read at some point in time
 			 * or wait to the end of the world :)
 			 */
-			ret = lttng_write(relay_conn_pipe[1], &new_conn, sizeof(new_conn));
+			ret = lttng_write(worker->conn_pipe[1], &new_conn,
+					sizeof(new_conn));
 			if (ret < 0) {
 				PERROR("write connection pipe");
 				connection_put(new_conn);
@@ -3578,8 +3723,92 @@ end:
 	return status;
 }
 
+/*
+ * Move up to 'len' bytes of packet payload from the data socket of a
+ * connection to the stream's file through the worker's splice pipe.
+ *
+ * Only the data already available on the socket is spliced so that the
+ * worker never blocks. Splicing is disabled for the worker if the socket
+ * does not support it.
+ *
+ * Called with the stream lock held.
+ *
+ * Return the number of bytes written to the stream file, 0 if the payload
+ * must be received through the regular receive path, or a negative value
+ * on error.
+ */
+static ssize_t relay_splice_payload(struct relay_worker *worker,
+		struct relay_connection *conn, struct relay_stream *stream,
+		size_t len)
+{
+	int ret, available = 0;
+	ssize_t spliced;
+
+	/* Nothing is taken from the socket for a packet that can't be written. */
+	if (!stream->file || !stream->trace_chunk) {
+		ERR("Protocol error: received a packet for a stream that doesn't have a current trace chunk: stream_id = %" PRIu64 ", channel_name = %s",
+				stream->stream_handle, stream->channel_name);
+		spliced = -1;
+		goto end;
+	}
+
+	ret = ioctl(conn->sock->fd, FIONREAD, &available);
+	if (ret < 0 || available <= 0) {
+		/*
+		 * Let the regular receive path handle idle and closed
+		 * sockets.
+		 */
+		spliced = 0;
+		goto end;
+	}
+
+	spliced = splice(conn->sock->fd, NULL, worker->splice_pipe[1], NULL,
+			min((size_t) available, len),
+			SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+	if (spliced < 0) {
+		if (spliced == -1 && (errno == EAGAIN || errno == EINTR)) {
+			spliced = 0;
+			goto end;
+		}
+		if (errno == EINVAL || errno == ENOSYS) {
+			DBG("Splicing from data sockets is not supported, worker %u falling back to receive",
+					worker->id);
+			worker->splice_enabled = false;
+			spliced = 0;
+			goto end;
+		}
+		PERROR("Failed to splice from socket %d", conn->sock->fd);
+		goto end;
+	}
+
+	ret = stream_write_from_pipe(stream, worker->splice_pipe[0], spliced);
+	if (ret) {
+		ERR("Relay error writing spliced data to file");
+		spliced = -1;
+		available = 0;
+		ret = ioctl(worker->splice_pipe[0], FIONREAD, &available);
+		if (ret < 0 || available > 0) {
+			/*
+			 * Data of this packet could be written to the file of
+			 * another stream by the next splice; stop using the
+			 * pipe.
+			 */
+			ERR("Failed to empty the splice pipe of worker %u, disabling splicing",
+					worker->id);
+			(void) fd_tracker_util_pipe_close(the_fd_tracker,
+					worker->splice_pipe);
+			worker->splice_pipe[0] = -1;
+			worker->splice_pipe[1] = -1;
+			worker->splice_enabled = false;
+		}
+		goto end;
+	}
+end:
+	return spliced;
+}
+
 static enum relay_connection_status relay_process_data_receive_payload(
-		struct relay_connection *conn)
+		struct relay_connection *conn, struct relay_worker *worker)
 {
 	int ret;
 	enum relay_connection_status status = RELAY_CONNECTION_STATUS_OK;
@@ -3620,44 +3849,61 @@ static enum relay_connection_status relay_process_data_receive_payload(
 	 * The size of the "chunk" received on any iteration is bounded by:
 	 *   - the data left to receive,
 	 *   - the data immediately available on the socket,
-	 *   - the on-stack data buffer
+	 *   - the on-stack data buffer (or the splice pipe)
+	 *
+	 * Chunks are spliced directly from the socket to the stream file
+	 * whenever possible; the regular receive path is used otherwise.
 	 */
 	while (left_to_receive > 0 && !partial_recv) {
 		size_t recv_size = min(left_to_receive, chunk_size);
 		struct lttng_buffer_view packet_chunk;
+		ssize_t spliced = 0;
 
-		ret = conn->sock->ops->recvmsg(conn->sock, data_buffer,
-				recv_size, MSG_DONTWAIT);
-		if (ret < 0) {
-			if (errno != EAGAIN && errno != EWOULDBLOCK) {
-				PERROR("Socket %d error", conn->sock->fd);
+		if (worker->splice_enabled) {
+			spliced = relay_splice_payload(worker, conn, stream,
+					recv_size);
+			if (spliced < 0) {
 				status = RELAY_CONNECTION_STATUS_ERROR;
+				goto end_stream_unlock;
 			}
-			goto end_stream_unlock;
-		} else if (ret == 0) {
-			/* No more data ready to be consumed on socket. */
-			DBG3("No more data ready for consumption on data socket of stream id %" PRIu64,
-					state->header.stream_id);
-			status = RELAY_CONNECTION_STATUS_CLOSED;
-			break;
-		} else if (ret < (int) recv_size) {
-			/*
-			 * All the data available on the socket has been
-			 * consumed.
-			 */
-			partial_recv = true;
-			recv_size = ret;
 		}
 
-		packet_chunk = lttng_buffer_view_init(data_buffer,
-				0, recv_size);
-		assert(packet_chunk.data);
+		if (spliced > 0) {
+			recv_size = spliced;
+		} else {
+			ret = conn->sock->ops->recvmsg(conn->sock, data_buffer,
+					recv_size, MSG_DONTWAIT);
+			if (ret < 0) {
+				if (errno != EAGAIN && errno != EWOULDBLOCK) {
+					PERROR("Socket %d error", conn->sock->fd);
+					status = RELAY_CONNECTION_STATUS_ERROR;
+				}
+				goto end_stream_unlock;
+			} else if (ret == 0) {
+				/* No more data ready to be consumed on socket. */
+				DBG3("No more data ready for consumption on data socket of stream id %" PRIu64,
+						state->header.stream_id);
+				status = RELAY_CONNECTION_STATUS_CLOSED;
+				break;
+			} else if (ret < (int) recv_size) {
+				/*
+				 * All the data available on the socket has been
+				 * consumed.
+				 */
+				partial_recv = true;
+				recv_size = ret;
+			}
 
-		ret = stream_write(stream, &packet_chunk, 0);
-		if (ret) {
-			ERR("Relay error writing data to file");
-			status = RELAY_CONNECTION_STATUS_ERROR;
-			goto end_stream_unlock;
+			packet_chunk = lttng_buffer_view_init(data_buffer,
+					0, recv_size);
+			assert(packet_chunk.data);
+
+			ret = stream_write(stream, &packet_chunk, 0);
+			if (ret) {
+				ERR("Relay error writing data to file");
+				status = RELAY_CONNECTION_STATUS_ERROR;
+				goto end_stream_unlock;
+			}
 		}
 
 		left_to_receive -= recv_size;
@@ -3737,7 +3983,7 @@ end:
  * relay_process_data: Process the data received on the data socket
  */
 static enum relay_connection_status relay_process_data(
-		struct relay_connection *conn)
+		struct relay_connection *conn, struct relay_worker *worker)
 {
 	enum relay_connection_status status;
 
@@ -3746,7 +3992,7 @@ static enum relay_connection_status relay_process_data(
 		status = relay_process_data_receive_header(conn);
 		break;
 	case DATA_CONNECTION_STATE_RECEIVE_PAYLOAD:
-		status = relay_process_data_receive_payload(conn);
+		status = relay_process_data_receive_payload(conn, worker);
 		break;
 	default:
 		ERR("Unexpected data connection communication state.");
@@ -3796,7 +4042,7 @@ static void relay_thread_close_connection(struct lttng_poll_event *events,
 }
 
 /*
- * This thread does the actual work
+ * This thread does the actual work. One such thread is launched per worker.
  */
 static void *relay_thread_worker(void *data)
 {
@@ -3806,8 +4052,10 @@ static void *relay_thread_worker(void *data)
 	struct lttng_ht *relay_connections_ht;
 	struct lttng_ht_iter iter;
 	struct relay_connection *destroy_conn = NULL;
+	struct relay_worker *worker = data;
+	const int conn_pipe_fd = worker->conn_pipe[0];
 
-	DBG("[thread] Relay worker started");
+	DBG("[thread] Relay worker %u started", worker->id);
 
 	rcu_register_thread();
 
@@ -3830,7 +4078,7 @@ static void *relay_thread_worker(void *data)
 		goto error_poll_create;
 	}
 
-	ret = lttng_poll_add(&events, relay_conn_pipe[0], LPOLLIN | LPOLLRDHUP);
+	ret = lttng_poll_add(&events, conn_pipe_fd, LPOLLIN | LPOLLRDHUP);
 	if (ret < 0) {
 		goto error;
 	}
@@ -3878,11 +4126,11 @@ restart:
 			}
 
 			/* Inspect the relay conn pipe for new connection */
-			if (pollfd == relay_conn_pipe[0]) {
+			if (pollfd == conn_pipe_fd) {
 				if (revents & LPOLLIN) {
 					struct relay_connection *conn;
 
-					ret = lttng_read(relay_conn_pipe[0], &conn, sizeof(conn));
+					ret = lttng_read(conn_pipe_fd, &conn, sizeof(conn));
 					if (ret < 0) {
 						goto error;
 					}
@@ -3894,7 +4142,8 @@ restart:
 						goto error;
 					}
 					connection_ht_add(relay_connections_ht, conn);
-					DBG("Connection socket %d added", conn->sock->fd);
+					DBG("Connection socket %d added to worker %u",
+							conn->sock->fd, worker->id);
 				} else if (revents & (LPOLLERR | LPOLLHUP | LPOLLRDHUP)) {
 					ERR("Relay connection pipe error");
 					goto error;
@@ -4006,7 +4255,7 @@ restart:
 			}
 
 			/* Skip the command pipe. It's handled in the first loop. */
-			if (pollfd == relay_conn_pipe[0]) {
+			if (pollfd == conn_pipe_fd) {
 				continue;
 			}
 
@@ -4023,7 +4272,7 @@ restart:
 			if (revents & LPOLLIN) {
 				enum relay_connection_status status;
 
-				status = relay_process_data(data_conn);
+				status = relay_process_data(data_conn, worker);
 				/* Connection closed or error. */
 				if (status != RELAY_CONNECTION_STATUS_OK) {
 					/*
@@ -4098,9 +4347,6 @@ error:
 error_poll_create:
 	lttng_ht_destroy(relay_connections_ht);
 relay_connections_ht_error:
-	/* Close relay conn pipes */
-	(void) fd_tracker_util_pipe_close(the_fd_tracker,
-			relay_conn_pipe);
 	if (err) {
 		DBG("Thread exited with error");
 	}
@@ -4117,13 +4363,63 @@ error_testpoint:
 }
 
 /*
- * Create the relay command pipe to wake thread_manage_apps.
+ * Allocate the workers and create their connection pipes.
  * Closed in cleanup().
  */
-static int create_relay_conn_pipe(void)
+static int create_relay_workers(unsigned int count)
 {
-	return fd_tracker_util_pipe_open_cloexec(the_fd_tracker,
-			"Relayd connection pipe", relay_conn_pipe);
+	int ret;
+	unsigned int i;
+
+	relay_workers = zmalloc(count * sizeof(*relay_workers));
+	if (!relay_workers) {
+		PERROR("zmalloc relay workers");
+		ret = -1;
+		goto end;
+	}
+	relay_worker_count = count;
+
+	for (i = 0; i < count; i++) {
+		relay_workers[i].id = i;
+		relay_workers[i].conn_pipe[0] = -1;
+		relay_workers[i].conn_pipe[1] = -1;
+		relay_workers[i].splice_pipe[0] = -1;
+		relay_workers[i].splice_pipe[1] = -1;
+	}
+
+	for (i = 0; i < count; i++) {
+		char name[32];
+
+		ret = snprintf(name, sizeof(name),
+				"Relayd connection pipe %u", i);
+		if (ret < 0 || (size_t) ret >= sizeof(name)) {
+			ret = -1;
+			goto end;
+		}
+
+		ret = fd_tracker_util_pipe_open_cloexec(the_fd_tracker, name,
+				relay_workers[i].conn_pipe);
+		if (ret) {
+			goto end;
+		}
+
+		ret = snprintf(name, sizeof(name),
+				"Relayd splice pipe %u", i);
+		if (ret < 0 || (size_t) ret >= sizeof(name)) {
+			ret = -1;
+			goto end;
+		}
+
+		ret = fd_tracker_util_pipe_open_cloexec(the_fd_tracker, name,
+				relay_workers[i].splice_pipe);
+		if (ret) {
+			goto end;
+		}
+		relay_workers[i].splice_enabled = true;
+	}
+	ret = 0;
+end:
+	return ret;
 }
 
 static int stdio_open(void *data, int *fds)
@@ -4149,6 +4445,7 @@ int main(int argc, char **argv)
 {
 	bool thread_is_rcu_registered = false;
 	int ret = 0, retval = 0;
+	unsigned int i, nb_launched_workers = 0;
 	void *status;
 	char *unlinked_file_directory_path = NULL, *output_path = NULL;
 
@@ -4283,8 +4580,8 @@ int main(int argc, char **argv)
 		goto exit_options;
 	}
 
-	/* Setup the thread apps communication pipe. */
-	if (create_relay_conn_pipe()) {
+	/* Setup the worker threads communication pipes. */
+	if (create_relay_workers(lttng_opt_worker_threads)) {
 		retval = -1;
 		goto exit_options;
 	}
@@ -4343,14 +4640,18 @@ int main(int argc, char **argv)
 		goto exit_dispatcher_thread;
 	}
 
-	/* Setup the worker thread */
-	ret = pthread_create(&worker_thread, default_pthread_attr(),
-			relay_thread_worker, NULL);
-	if (ret) {
-		errno = ret;
-		PERROR("pthread_create worker");
-		retval = -1;
-		goto exit_worker_thread;
+	/* Setup the worker threads */
+	for (i = 0; i < relay_worker_count; i++) {
+		ret = pthread_create(&relay_workers[i].thread,
+				default_pthread_attr(), relay_thread_worker,
+				&relay_workers[i]);
+		if (ret) {
+			errno = ret;
+			PERROR("pthread_create worker");
+			retval = -1;
+			goto exit_worker_thread;
+		}
+		nb_launched_workers++;
 	}
 
 	/* Setup the listener thread */
@@ -4363,7 +4664,7 @@ int main(int argc, char **argv)
 		goto exit_listener_thread;
 	}
 
-	ret = relayd_live_create(live_uri);
+	ret = relayd_live_create(live_uri, lttng_opt_live_worker_threads);
 	if (ret) {
 		ERR("Starting live viewer threads");
 		retval = -1;
@@ -4389,14 +4690,16 @@ exit_live:
 	}
 
 exit_listener_thread:
-	ret = pthread_join(worker_thread, &status);
-	if (ret) {
-		errno = ret;
-		PERROR("pthread_join worker_thread");
-		retval = -1;
+exit_worker_thread:
+	for (i = 0; i < nb_launched_workers; i++) {
+		ret = pthread_join(relay_workers[i].thread, &status);
+		if (ret) {
+			errno = ret;
+			PERROR("pthread_join worker_thread");
+			retval = -1;
+		}
 	}
 
-exit_worker_thread:
 	ret = pthread_join(dispatcher_thread, &status);
 	if (ret) {
 		errno = ret;
@@ -9,7 +9,9 @@
  */
 
 #define _LGPL_SOURCE
+#include <common/align.h>
 #include <common/common.h>
+#include <common/compat/fcntl.h>
 #include <common/defaults.h>
 #include <common/fs-handle.h>
 #include <common/sessiond-comm/relayd.h>
@@ -452,6 +454,15 @@ static int create_index_file(struct relay_stream *stream,
 		goto end;
 	}
 
+	if (stream->trace->session->live_timer) {
+		/* Serve the live viewers from memory. */
+		ret = lttng_index_file_enable_tail(stream->index_file,
+				relayd_index_cache_entries);
+		if (ret) {
+			goto end;
+		}
+	}
+
 	ret = 0;
 
 end:
@@ -1051,7 +1062,33 @@ end:
 	return ret;
 }
 
-/* Note that the packet is not necessarily complete. */
+/*
+ * Skip `len` bytes of padding in the stream's file, leaving a hole rather
+ * than writing zeros.
+ */
+static int skip_stream_file_range(struct relay_stream *stream, size_t len)
+{
+	int ret, fd;
+
+	fd = fs_handle_get_fd(stream->file);
+	if (fd < 0) {
+		ret = -1;
+		goto end;
+	}
+	ret = utils_skip_file_range(fd, (off_t) len);
+	fs_handle_put_fd(stream->file);
+end:
+	return ret;
+}
+
+/*
+ * Write the data of a packet and its padding to the stream's file.
+ *
+ * If sparse padding is enabled, padding of at least a page is skipped by
+ * extending the file rather than written.
+ *
+ * Note that the packet is not necessarily complete.
+ */
 int stream_write(struct relay_stream *stream,
 		const struct lttng_buffer_view *packet, size_t padding_len)
 {
@@ -1082,6 +1119,17 @@ int stream_write(struct relay_stream *stream,
 		}
 	}
 
+	if (relayd_sparse_padding && padding_to_write >= (size_t) PAGE_SIZE) {
+		ret = skip_stream_file_range(stream, padding_to_write);
+		if (ret) {
+			PERROR("Failed to skip padding in file of %sstream %" PRIu64,
+					stream->is_metadata ? "metadata " : "",
+					stream->stream_handle);
+			goto end;
+		}
+		padding_to_write = 0;
+	}
+
 	while (padding_to_write > 0) {
 		const size_t padding_to_write_this_pass =
 				min(padding_to_write, sizeof(padding_buffer));
@@ -1117,6 +1165,125 @@ end:
 	return ret;
 }
 
+/*
+ * Read and drop 'len' bytes from the read end of a pipe.
+ *
+ * Return 0 on success else a negative value.
+ */
+static int discard_pipe_data(int pipe_fd, size_t len)
+{
+	char buffer[FILE_IO_STACK_BUFFER_SIZE];
+
+	while (len > 0) {
+		const size_t to_read = min(len, sizeof(buffer));
+
+		if (lttng_read(pipe_fd, buffer, to_read) != to_read) {
+			PERROR("Failed to discard data from splice pipe");
+			return -1;
+		}
+		len -= to_read;
+	}
+
+	return 0;
+}
+
+/*
+ * Write 'len' bytes available in the read end of a pipe to the stream's
+ * current output file.
+ *
+ * The data is spliced to the file, avoiding a copy through user space. Any
+ * data the file refuses to splice (e.g. the file system does not support it)
+ * is read back from the pipe and written through the file handle.
+ *
+ * On error, the data left in the pipe is discarded so that the pipe can be
+ * used for the next packet. If that also fails, the pipe must not be used
+ * anymore.
+ *
+ * Called with the stream lock held.
+ *
+ * Return 0 on success else a negative value.
+ */
+int stream_write_from_pipe(struct relay_stream *stream, int pipe_fd,
+		size_t len)
+{
+	int ret = 0, fd;
+	size_t left_to_write = len;
+	char buffer[FILE_IO_STACK_BUFFER_SIZE];
+
+	ASSERT_LOCKED(stream->lock);
+
+	if (!stream->file || !stream->trace_chunk) {
+		ERR("Protocol error: received a packet for a stream that doesn't have a current trace chunk: stream_id = %" PRIu64 ", channel_name = %s",
+				stream->stream_handle, stream->channel_name);
+		ret = -1;
+		goto error;
+	}
+
+	fd = fs_handle_get_fd(stream->file);
+	if (fd < 0) {
+		ERR("Failed to get file descriptor of stream %" PRIu64,
+				stream->stream_handle);
+		ret = -1;
+		goto error;
+	}
+
+	while (left_to_write > 0) {
+		const ssize_t splice_ret = splice(pipe_fd, NULL, fd, NULL,
+				left_to_write, SPLICE_F_MOVE);
+
+		if (splice_ret < 0 && errno == EINTR) {
+			continue;
+		} else if (splice_ret <= 0) {
+			DBG("Failed to splice to file of stream %" PRIu64 ", falling back to write",
+					stream->stream_handle);
+			break;
+		}
+		left_to_write -= splice_ret;
+	}
+	fs_handle_put_fd(stream->file);
+
+	while (left_to_write > 0) {
+		const size_t to_write_this_pass =
+				min(left_to_write, sizeof(buffer));
+		ssize_t io_ret;
+
+		io_ret = lttng_read(pipe_fd, buffer, to_write_this_pass);
+		if (io_ret != to_write_this_pass) {
+			PERROR("Failed to read packet data from splice pipe of stream %" PRIu64,
+					stream->stream_handle);
+			/* The amount of data left in the pipe is unknown. */
+			ret = -1;
+			goto end;
+		}
+		left_to_write -= to_write_this_pass;
+
+		io_ret = fs_handle_write(stream->file, buffer,
+				to_write_this_pass);
+		if (io_ret != to_write_this_pass) {
+			PERROR("Failed to write to stream file of %sstream %" PRIu64,
+					stream->is_metadata ? "metadata " : "",
+					stream->stream_handle);
+			ret = -1;
+			goto error;
+		}
+	}
+
+	if (stream->is_metadata && len) {
+		stream->metadata_received += len;
+		stream->no_new_metadata_notified = false;
+	}
+
+	DBG("Spliced to %sstream %" PRIu64 ": data_length = %zu",
+			stream->is_metadata ? "metadata " : "",
+			stream->stream_handle, len);
+	goto end;
+
+error:
+	(void) discard_pipe_data(pipe_fd, left_to_write);
+end:
+	return ret;
+}
+
 /*
  * Update index after receiving a packet for a data stream.
  *
@@ -170,11 +170,7 @@ struct relay_viewer_stream *viewer_stream_create(struct relay_stream *stream,
 	}
 
 	if (seek_t == LTTNG_VIEWER_SEEK_LAST && vstream->index_file) {
-		off_t lseek_ret;
-
-		lseek_ret = fs_handle_seek(
-				vstream->index_file->file, 0, SEEK_END);
-		if (lseek_ret < 0) {
+		if (lttng_index_file_seek_end(vstream->index_file)) {
 			goto error;
 		}
 	}
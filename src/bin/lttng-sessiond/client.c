@@ -27,6 +27,7 @@
 #include <lttng/session-descriptor-internal.h>
 #include <lttng/session-internal.h>
 #include <lttng/userspace-probe-internal.h>
+#include <poll.h>
 #include <pthread.h>
 #include <signal.h>
 #include <stddef.h>
@@ -51,6 +52,46 @@ static struct thread_state {
 	int client_sock;
 } thread_state;
 
+/* Client connection accepted by the client thread. */
+struct client_connection {
+	int sock;
+	/* Carries the commands of the client until it disconnects. */
+	bool persistent;
+	struct cds_list_head node;
+};
+
+/*
+ * Connections accepted by the client thread, waiting to be handled by one of
+ * the command workers.
+ */
+static struct client_command_queue {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	/* List of struct client_connection. */
+	struct cds_list_head connections;
+	/*
+	 * Persistent connections given back by the command workers, to be
+	 * polled by the client thread. The client thread is notified through
+	 * the return pipe.
+	 */
+	struct cds_list_head returned_connections;
+	struct lttng_pipe *return_pipe;
+	bool quit;
+} command_queue = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+	.connections = CDS_LIST_HEAD_INIT(command_queue.connections),
+	.returned_connections = CDS_LIST_HEAD_INIT(
+			command_queue.returned_connections),
+};
+
+/*
+ * Serializes the domain "pre-action" of the commands processed concurrently
+ * by the command workers: loading of the kernel tracer and launch of the
+ * consumer daemons.
+ */
+static pthread_mutex_t domain_setup_lock = PTHREAD_MUTEX_INITIALIZER;
+
 static void set_thread_status(bool running)
 {
 	DBG("Marking client thread's state as %s", running ? "running" : "error");
@@ -751,6 +792,235 @@ end:
 	return ret;
 }
 
+/*
+ * Returns true if the command must be processed with the session list lock
+ * held.
+ *
+ * The listed commands only act on the session they target, under its lock.
+ * They do not look up other sessions, or modify the session list, and do not
+ * reach the code paths which assert that the session list lock is held.
+ */
+static bool command_needs_session_list(enum lttcomm_sessiond_command cmd_type)
+{
+	switch (cmd_type) {
+	case LTTNG_DATA_PENDING:
+	case LTTNG_LIST_DOMAINS:
+	case LTTNG_ROTATION_GET_INFO:
+	case LTTNG_SESSION_LIST_ROTATION_SCHEDULES:
+	case LTTNG_SNAPSHOT_LIST_OUTPUT:
+	case LTTNG_SNAPSHOT_RECORD:
+		return false;
+	default:
+		return true;
+	}
+}
+
+/*
+ * Returns true if variable-length data follows the lttcomm_session_msg of a
+ * command.
+ *
+ * A command which fails may return before it receives all of its data. On a
+ * persistent connection, the rest of the data would be taken for the next
+ * command, so the connection is closed instead.
+ */
+static bool command_has_payload(const struct lttcomm_session_msg *lsm)
+{
+	switch (lsm->cmd_type) {
+	case LTTNG_ENABLE_EVENT:
+		return lsm->u.enable.exclusion_count ||
+				lsm->u.enable.expression_len ||
+				lsm->u.enable.bytecode_len ||
+				lsm->u.enable.userspace_probe_location_len;
+	case LTTNG_DISABLE_EVENT:
+		return lsm->u.disable.expression_len ||
+				lsm->u.disable.bytecode_len;
+	case LTTNG_ADD_CONTEXT:
+		return lsm->u.context.provider_name_len ||
+				lsm->u.context.context_name_len;
+	case LTTNG_PROCESS_ATTR_TRACKER_ADD_INCLUDE_VALUE:
+	case LTTNG_PROCESS_ATTR_TRACKER_REMOVE_INCLUDE_VALUE:
+		return lsm->u.process_attr_tracker_add_remove_include_value
+				.name_len;
+	case LTTNG_SET_CONSUMER_URI:
+		return lsm->u.uri.size;
+	case LTTNG_CREATE_SESSION_EXT:
+	case LTTNG_REGISTER_TRIGGER:
+	case LTTNG_UNREGISTER_TRIGGER:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/*
+ * Check domain type for specific "pre-action": load the kernel tracer, create
+ * the domain's session and start the consumer daemons as needed.
+ *
+ * Must be called with the domain setup lock held.
+ *
+ * Return LTTNG_OK on success, an LTTNG_ERR code or a negative value on error.
+ */
+static int setup_command_domain(struct command_ctx *cmd_ctx,
+		int need_tracing_session)
+{
+	int ret;
+
+	switch (cmd_ctx->lsm.domain.type) {
+	case LTTNG_DOMAIN_KERNEL:
+		if (!is_root) {
+			ret = LTTNG_ERR_NEED_ROOT_SESSIOND;
+			goto end;
+		}
+
+		/* Kernel tracer check */
+		if (!kernel_tracer_is_initialized()) {
+			/* Basically, load kernel tracer modules */
+			ret = init_kernel_tracer();
+			if (ret != 0) {
+				goto end;
+			}
+		}
+
+		/* Consumer is in an ERROR state. Report back to client */
+		if (uatomic_read(&kernel_consumerd_state) == CONSUMER_ERROR) {
+			ret = LTTNG_ERR_NO_KERNCONSUMERD;
+			goto end;
+		}
+
+		/* Need a session for kernel command */
+		if (need_tracing_session) {
+			if (cmd_ctx->session->kernel_session == NULL) {
+				ret = create_kernel_session(cmd_ctx->session);
+				if (ret != LTTNG_OK) {
+					ret = LTTNG_ERR_KERN_SESS_FAIL;
+					goto end;
+				}
+			}
+
+			/* Start the kernel consumer daemon */
+			pthread_mutex_lock(&kconsumer_data.pid_mutex);
+			if (kconsumer_data.pid == 0 &&
+					cmd_ctx->lsm.cmd_type != LTTNG_REGISTER_CONSUMER) {
+				pthread_mutex_unlock(&kconsumer_data.pid_mutex);
+				ret = start_consumerd(&kconsumer_data);
+				if (ret < 0) {
+					ret = LTTNG_ERR_KERN_CONSUMER_FAIL;
+					goto end;
+				}
+				uatomic_set(&kernel_consumerd_state, CONSUMER_STARTED);
+			} else {
+				pthread_mutex_unlock(&kconsumer_data.pid_mutex);
+			}
+
+			/*
+			 * The consumer was just spawned so we need to add the socket to
+			 * the consumer output of the session if exist.
+			 */
+			ret = consumer_create_socket(&kconsumer_data,
+					cmd_ctx->session->kernel_session->consumer);
+			if (ret < 0) {
+				goto end;
+			}
+		}
+
+		break;
+	case LTTNG_DOMAIN_JUL:
+	case LTTNG_DOMAIN_LOG4J:
+	case LTTNG_DOMAIN_PYTHON:
+	case LTTNG_DOMAIN_UST:
+	{
+		if (!ust_app_supported()) {
+			ret = LTTNG_ERR_NO_UST;
+			goto end;
+		}
+		/* Consumer is in an ERROR state. Report back to client */
+		if (uatomic_read(&ust_consumerd_state) == CONSUMER_ERROR) {
+			ret = LTTNG_ERR_NO_USTCONSUMERD;
+			goto end;
+		}
+
+		if (need_tracing_session) {
+			/* Create UST session if none exist. */
+			if (cmd_ctx->session->ust_session == NULL) {
+				ret = create_ust_session(cmd_ctx->session,
+						ALIGNED_CONST_PTR(cmd_ctx->lsm.domain));
+				if (ret != LTTNG_OK) {
+					goto end;
+				}
+			}
+
+			/* Start the UST consumer daemons */
+			/* 64-bit */
+			pthread_mutex_lock(&ustconsumer64_data.pid_mutex);
+			if (config.consumerd64_bin_path.value &&
+					ustconsumer64_data.pid == 0 &&
+					cmd_ctx->lsm.cmd_type != LTTNG_REGISTER_CONSUMER) {
+				pthread_mutex_unlock(&ustconsumer64_data.pid_mutex);
+				ret = start_consumerd(&ustconsumer64_data);
+				if (ret < 0) {
+					ret = LTTNG_ERR_UST_CONSUMER64_FAIL;
+					uatomic_set(&ust_consumerd64_fd, -EINVAL);
+					goto end;
+				}
+
+				uatomic_set(&ust_consumerd64_fd, ustconsumer64_data.cmd_sock);
+				uatomic_set(&ust_consumerd_state, CONSUMER_STARTED);
+			} else {
+				pthread_mutex_unlock(&ustconsumer64_data.pid_mutex);
+			}
+
+			/*
+			 * Setup socket for consumer 64 bit. No need for atomic access
+			 * since it was set above and can ONLY be set under the
+			 * domain setup lock.
+			 */
+			ret = consumer_create_socket(&ustconsumer64_data,
+					cmd_ctx->session->ust_session->consumer);
+			if (ret < 0) {
+				goto end;
+			}
+
+			/* 32-bit */
+			pthread_mutex_lock(&ustconsumer32_data.pid_mutex);
+			if (config.consumerd32_bin_path.value &&
+					ustconsumer32_data.pid == 0 &&
+					cmd_ctx->lsm.cmd_type != LTTNG_REGISTER_CONSUMER) {
+				pthread_mutex_unlock(&ustconsumer32_data.pid_mutex);
+				ret = start_consumerd(&ustconsumer32_data);
+				if (ret < 0) {
+					ret = LTTNG_ERR_UST_CONSUMER32_FAIL;
+					uatomic_set(&ust_consumerd32_fd, -EINVAL);
+					goto end;
+				}
+
+				uatomic_set(&ust_consumerd32_fd, ustconsumer32_data.cmd_sock);
+				uatomic_set(&ust_consumerd_state, CONSUMER_STARTED);
+			} else {
+				pthread_mutex_unlock(&ustconsumer32_data.pid_mutex);
+			}
+
+			/*
+			 * Setup socket for consumer 32 bit. No need for atomic access
+			 * since it was set above and can ONLY be set under the
+			 * domain setup lock.
+			 */
+			ret = consumer_create_socket(&ustconsumer32_data,
+					cmd_ctx->session->ust_session->consumer);
+			if (ret < 0) {
+				goto end;
+			}
+		}
+		break;
+	}
+	default:
+		break;
+	}
+
+	ret = LTTNG_OK;
+end:
+	return ret;
+}
+
 /*
  * Process the command requested by the lttng client within the command
  * context structure. This function make sure that the return structure (llm)
@@ -770,6 +1040,7 @@ static int process_client_msg(struct command_ctx *cmd_ctx, int *sock,
 	int ret = LTTNG_OK;
 	int need_tracing_session = 1;
 	int need_domain;
+	bool session_list_locked = false;
 
 	DBG("Processing client command %d", cmd_ctx->lsm.cmd_type);
 
@@ -800,12 +1071,25 @@ static int process_client_msg(struct command_ctx *cmd_ctx, int *sock,
 	case LTTNG_ROTATION_SET_SCHEDULE:
 	case LTTNG_SESSION_LIST_ROTATION_SCHEDULES:
 	case LTTNG_CLEAR_SESSION:
+	case LTTNG_OPEN_PERSISTENT_CONNECTION:
 		need_domain = 0;
 		break;
 	default:
 		need_domain = 1;
 	}
 
+	/*
+	 * The destruction and clearing of a session reply asynchronously, on a
+	 * socket they take ownership of, which a persistent connection can't
+	 * give away.
+	 */
+	if (cmd_ctx->persistent_connection &&
+			(cmd_ctx->lsm.cmd_type == LTTNG_DESTROY_SESSION ||
+			cmd_ctx->lsm.cmd_type == LTTNG_CLEAR_SESSION)) {
+		ret = LTTNG_ERR_INVALID;
+		goto error;
+	}
+
 	if (config.no_kernel && need_domain
 			&& cmd_ctx->lsm.domain.type == LTTNG_DOMAIN_KERNEL) {
 		if (!is_root) {
@@ -866,24 +1150,36 @@ static int process_client_msg(struct command_ctx *cmd_ctx, int *sock,
 	case LTTNG_SAVE_SESSION:
 	case LTTNG_REGISTER_TRIGGER:
 	case LTTNG_UNREGISTER_TRIGGER:
+	case LTTNG_OPEN_PERSISTENT_CONNECTION:
 		need_tracing_session = 0;
 		break;
 	default:
 		DBG("Getting session %s by name", cmd_ctx->lsm.session.name);
 		/*
-		 * We keep the session list lock across _all_ commands
-		 * for now, because the per-session lock does not
-		 * handle teardown properly.
+		 * We keep the session list lock across most commands for
+		 * now, because the per-session lock does not handle
+		 * teardown properly.
 		 */
 		session_lock_list();
+		session_list_locked = true;
 		cmd_ctx->session = session_find_by_name(cmd_ctx->lsm.session.name);
 		if (cmd_ctx->session == NULL) {
 			ret = LTTNG_ERR_SESS_NOT_FOUND;
 			goto error;
-		} else {
-			/* Acquire lock for the session */
-			session_lock(cmd_ctx->session);
 		}
+
+		/*
+		 * The reference held by the command context keeps the session
+		 * alive; commands which only act on their session can run
+		 * concurrently with the commands on other sessions.
+		 */
+		if (!command_needs_session_list(cmd_ctx->lsm.cmd_type)) {
+			session_unlock_list();
+			session_list_locked = false;
+		}
+
+		/* Acquire lock for the session */
+		session_lock(cmd_ctx->session);
 		break;
 	}
 
@@ -924,198 +1220,53 @@ static int process_client_msg(struct command_ctx *cmd_ctx, int *sock,
 		goto skip_domain;
 	}
 
-	/*
-	 * Check domain type for specific "pre-action".
-	 */
-	switch (cmd_ctx->lsm.domain.type) {
-	case LTTNG_DOMAIN_KERNEL:
-		if (!is_root) {
-			ret = LTTNG_ERR_NEED_ROOT_SESSIOND;
-			goto error;
-		}
+	pthread_mutex_lock(&domain_setup_lock);
+	ret = setup_command_domain(cmd_ctx, need_tracing_session);
+	pthread_mutex_unlock(&domain_setup_lock);
+	if (ret != LTTNG_OK) {
+		goto error;
+	}
+skip_domain:
 
-		/* Kernel tracer check */
-		if (!kernel_tracer_is_initialized()) {
-			/* Basically, load kernel tracer modules */
-			ret = init_kernel_tracer();
-			if (ret != 0) {
+	/* Validate consumer daemon state when start/stop trace command */
+	if (cmd_ctx->lsm.cmd_type == LTTNG_START_TRACE ||
+			cmd_ctx->lsm.cmd_type == LTTNG_STOP_TRACE) {
+		switch (cmd_ctx->lsm.domain.type) {
+		case LTTNG_DOMAIN_NONE:
+			break;
+		case LTTNG_DOMAIN_JUL:
+		case LTTNG_DOMAIN_LOG4J:
+		case LTTNG_DOMAIN_PYTHON:
+		case LTTNG_DOMAIN_UST:
+			if (uatomic_read(&ust_consumerd_state) != CONSUMER_STARTED) {
+				ret = LTTNG_ERR_NO_USTCONSUMERD;
+				goto error;
+			}
+			break;
+		case LTTNG_DOMAIN_KERNEL:
+			if (uatomic_read(&kernel_consumerd_state) != CONSUMER_STARTED) {
+				ret = LTTNG_ERR_NO_KERNCONSUMERD;
 				goto error;
 			}
+			break;
+		default:
+			ret = LTTNG_ERR_UNKNOWN_DOMAIN;
+			goto error;
 		}
+	}
 
-		/* Consumer is in an ERROR state. Report back to client */
-		if (uatomic_read(&kernel_consumerd_state) == CONSUMER_ERROR) {
-			ret = LTTNG_ERR_NO_KERNCONSUMERD;
+	/*
+	 * Check that the UID matches that of the tracing session.
+	 * The root user can interact with all sessions.
+	 */
+	if (need_tracing_session) {
+		if (!session_access_ok(cmd_ctx->session,
+				LTTNG_SOCK_GET_UID_CRED(&cmd_ctx->creds)) ||
+				cmd_ctx->session->destroyed) {
+			ret = LTTNG_ERR_EPERM;
 			goto error;
 		}
-
-		/* Need a session for kernel command */
-		if (need_tracing_session) {
-			if (cmd_ctx->session->kernel_session == NULL) {
-				ret = create_kernel_session(cmd_ctx->session);
-				if (ret != LTTNG_OK) {
-					ret = LTTNG_ERR_KERN_SESS_FAIL;
-					goto error;
-				}
-			}
-
-			/* Start the kernel consumer daemon */
-			pthread_mutex_lock(&kconsumer_data.pid_mutex);
-			if (kconsumer_data.pid == 0 &&
-					cmd_ctx->lsm.cmd_type != LTTNG_REGISTER_CONSUMER) {
-				pthread_mutex_unlock(&kconsumer_data.pid_mutex);
-				ret = start_consumerd(&kconsumer_data);
-				if (ret < 0) {
-					ret = LTTNG_ERR_KERN_CONSUMER_FAIL;
-					goto error;
-				}
-				uatomic_set(&kernel_consumerd_state, CONSUMER_STARTED);
-			} else {
-				pthread_mutex_unlock(&kconsumer_data.pid_mutex);
-			}
-
-			/*
-			 * The consumer was just spawned so we need to add the socket to
-			 * the consumer output of the session if exist.
-			 */
-			ret = consumer_create_socket(&kconsumer_data,
-					cmd_ctx->session->kernel_session->consumer);
-			if (ret < 0) {
-				goto error;
-			}
-		}
-
-		break;
-	case LTTNG_DOMAIN_JUL:
-	case LTTNG_DOMAIN_LOG4J:
-	case LTTNG_DOMAIN_PYTHON:
-	case LTTNG_DOMAIN_UST:
-	{
-		if (!ust_app_supported()) {
-			ret = LTTNG_ERR_NO_UST;
-			goto error;
-		}
-		/* Consumer is in an ERROR state. Report back to client */
-		if (uatomic_read(&ust_consumerd_state) == CONSUMER_ERROR) {
-			ret = LTTNG_ERR_NO_USTCONSUMERD;
-			goto error;
-		}
-
-		if (need_tracing_session) {
-			/* Create UST session if none exist. */
-			if (cmd_ctx->session->ust_session == NULL) {
-				ret = create_ust_session(cmd_ctx->session,
-						ALIGNED_CONST_PTR(cmd_ctx->lsm.domain));
-				if (ret != LTTNG_OK) {
-					goto error;
-				}
-			}
-
-			/* Start the UST consumer daemons */
-			/* 64-bit */
-			pthread_mutex_lock(&ustconsumer64_data.pid_mutex);
-			if (config.consumerd64_bin_path.value &&
-					ustconsumer64_data.pid == 0 &&
-					cmd_ctx->lsm.cmd_type != LTTNG_REGISTER_CONSUMER) {
-				pthread_mutex_unlock(&ustconsumer64_data.pid_mutex);
-				ret = start_consumerd(&ustconsumer64_data);
-				if (ret < 0) {
-					ret = LTTNG_ERR_UST_CONSUMER64_FAIL;
-					uatomic_set(&ust_consumerd64_fd, -EINVAL);
-					goto error;
-				}
-
-				uatomic_set(&ust_consumerd64_fd, ustconsumer64_data.cmd_sock);
-				uatomic_set(&ust_consumerd_state, CONSUMER_STARTED);
-			} else {
-				pthread_mutex_unlock(&ustconsumer64_data.pid_mutex);
-			}
-
-			/*
-			 * Setup socket for consumer 64 bit. No need for atomic access
-			 * since it was set above and can ONLY be set in this thread.
-			 */
-			ret = consumer_create_socket(&ustconsumer64_data,
-					cmd_ctx->session->ust_session->consumer);
-			if (ret < 0) {
-				goto error;
-			}
-
-			/* 32-bit */
-			pthread_mutex_lock(&ustconsumer32_data.pid_mutex);
-			if (config.consumerd32_bin_path.value &&
-					ustconsumer32_data.pid == 0 &&
-					cmd_ctx->lsm.cmd_type != LTTNG_REGISTER_CONSUMER) {
-				pthread_mutex_unlock(&ustconsumer32_data.pid_mutex);
-				ret = start_consumerd(&ustconsumer32_data);
-				if (ret < 0) {
-					ret = LTTNG_ERR_UST_CONSUMER32_FAIL;
-					uatomic_set(&ust_consumerd32_fd, -EINVAL);
-					goto error;
-				}
-
-				uatomic_set(&ust_consumerd32_fd, ustconsumer32_data.cmd_sock);
-				uatomic_set(&ust_consumerd_state, CONSUMER_STARTED);
-			} else {
-				pthread_mutex_unlock(&ustconsumer32_data.pid_mutex);
-			}
-
-			/*
-			 * Setup socket for consumer 32 bit. No need for atomic access
-			 * since it was set above and can ONLY be set in this thread.
-			 */
-			ret = consumer_create_socket(&ustconsumer32_data,
-					cmd_ctx->session->ust_session->consumer);
-			if (ret < 0) {
-				goto error;
-			}
-		}
-		break;
-	}
-	default:
-		break;
-	}
-skip_domain:
-
-	/* Validate consumer daemon state when start/stop trace command */
-	if (cmd_ctx->lsm.cmd_type == LTTNG_START_TRACE ||
-			cmd_ctx->lsm.cmd_type == LTTNG_STOP_TRACE) {
-		switch (cmd_ctx->lsm.domain.type) {
-		case LTTNG_DOMAIN_NONE:
-			break;
-		case LTTNG_DOMAIN_JUL:
-		case LTTNG_DOMAIN_LOG4J:
-		case LTTNG_DOMAIN_PYTHON:
-		case LTTNG_DOMAIN_UST:
-			if (uatomic_read(&ust_consumerd_state) != CONSUMER_STARTED) {
-				ret = LTTNG_ERR_NO_USTCONSUMERD;
-				goto error;
-			}
-			break;
-		case LTTNG_DOMAIN_KERNEL:
-			if (uatomic_read(&kernel_consumerd_state) != CONSUMER_STARTED) {
-				ret = LTTNG_ERR_NO_KERNCONSUMERD;
-				goto error;
-			}
-			break;
-		default:
-			ret = LTTNG_ERR_UNKNOWN_DOMAIN;
-			goto error;
-		}
-	}
-
-	/*
-	 * Check that the UID matches that of the tracing session.
-	 * The root user can interact with all sessions.
-	 */
-	if (need_tracing_session) {
-		if (!session_access_ok(cmd_ctx->session,
-				LTTNG_SOCK_GET_UID_CRED(&cmd_ctx->creds)) ||
-				cmd_ctx->session->destroyed) {
-			ret = LTTNG_ERR_EPERM;
-			goto error;
-		}
-	}
+	}
 
 	/*
 	 * Send relayd information to consumer as soon as we have a domain and a
@@ -2138,6 +2289,16 @@ error_add_context:
 		ret = cmd_clear_session(cmd_ctx->session, sock);
 		break;
 	}
+	case LTTNG_OPEN_PERSISTENT_CONNECTION:
+	{
+		/*
+		 * The connection is made persistent by the client thread once
+		 * the reply is sent.
+		 */
+		ret = cmd_ctx->persistent_connection ?
+				LTTNG_ERR_INVALID : LTTNG_OK;
+		break;
+	}
 	default:
 		ret = LTTNG_ERR_UND;
 		break;
@@ -2155,10 +2316,15 @@ error:
 setup_error:
 	if (cmd_ctx->session) {
 		session_unlock(cmd_ctx->session);
+		/* Releasing the session may remove it from the session list. */
+		if (!session_list_locked) {
+			session_lock_list();
+			session_list_locked = true;
+		}
 		session_put(cmd_ctx->session);
 		cmd_ctx->session = NULL;
 	}
-	if (need_tracing_session) {
+	if (session_list_locked) {
 		session_unlock_list();
 	}
 init_setup_error:
@@ -2216,24 +2382,462 @@ static void thread_init_cleanup(void *data)
 	set_thread_status(false);
 }
 
+/*
+ * Close a client connection, unless a command took ownership of its socket,
+ * and free it.
+ */
+static void close_client_connection(struct client_connection *connection)
+{
+	if (connection->sock >= 0) {
+		if (close(connection->sock)) {
+			PERROR("close");
+		}
+	}
+	free(connection);
+}
+
+/*
+ * Receive a command from a client connection, process it and send the reply.
+ *
+ * Return true if the connection is persistent and can carry the next command
+ * of the client, false if it must be closed.
+ */
+static bool handle_client_command(struct command_ctx *cmd_ctx,
+		struct client_connection *connection)
+{
+	int ret, sock_error;
+	bool keep_connection = false;
+	struct lttcomm_session_request_header request_header;
+	const struct cmd_completion_handler *cmd_completion_handler;
+
+	cmd_ctx->creds = (lttng_sock_cred) {
+		.uid = UINT32_MAX,
+		.gid = UINT32_MAX,
+	};
+	cmd_ctx->session = NULL;
+	lttng_payload_clear(&cmd_ctx->reply_payload);
+	cmd_ctx->lttng_msg_size = 0;
+	cmd_ctx->persistent_connection = connection->persistent;
+
+	health_code_update();
+
+	/*
+	 * Data is received from the lttng client. The struct
+	 * lttcomm_session_msg (lsm) contains the command and data request of
+	 * the client. On a persistent connection, it is preceded by the
+	 * request header, which carries the client's credentials.
+	 */
+	DBG("Receiving data from client ...");
+	if (connection->persistent) {
+		ret = lttcomm_recv_creds_unix_sock(connection->sock,
+				&request_header, sizeof(request_header),
+				&cmd_ctx->creds);
+		if (ret != sizeof(request_header)) {
+			DBG("Persistent client connection closed");
+			goto end;
+		}
+
+		ret = lttcomm_recv_unix_sock(connection->sock, &cmd_ctx->lsm,
+				sizeof(struct lttcomm_session_msg));
+	} else {
+		ret = lttcomm_recv_creds_unix_sock(connection->sock,
+				&cmd_ctx->lsm, sizeof(struct lttcomm_session_msg),
+				&cmd_ctx->creds);
+	}
+	if (ret != sizeof(struct lttcomm_session_msg)) {
+		DBG("Incomplete recv() from client... continuing");
+		goto end;
+	}
+
+	health_code_update();
+
+	// TODO: Validate cmd_ctx including sanity check for
+	// security purpose.
+
+	rcu_thread_online();
+	/*
+	 * This function dispatch the work to the kernel or userspace tracer
+	 * libs and fill the lttcomm_lttng_msg data structure of all the needed
+	 * informations for the client. The command context struct contains
+	 * everything this function may needs.
+	 */
+	ret = process_client_msg(cmd_ctx, &connection->sock, &sock_error);
+	rcu_thread_offline();
+	if (ret < 0) {
+		/*
+		 * TODO: Inform client somehow of the fatal error. At
+		 * this point, ret < 0 means that a zmalloc failed
+		 * (ENOMEM). Error detected but still accept
+		 * command, unless a socket error has been
+		 * detected.
+		 */
+		goto end;
+	}
+
+	cmd_completion_handler = cmd_pop_completion_handler();
+	if (cmd_completion_handler) {
+		enum lttng_error_code completion_code;
+
+		completion_code = cmd_completion_handler->run(
+				cmd_completion_handler->data);
+		if (completion_code != LTTNG_OK) {
+			goto end;
+		}
+	}
+
+	health_code_update();
+
+	if (connection->sock >= 0) {
+		struct lttng_payload_view view =
+				lttng_payload_view_from_payload(
+						&cmd_ctx->reply_payload,
+						0, -1);
+		struct lttcomm_lttng_msg *llm = (typeof(
+				llm)) cmd_ctx->reply_payload.buffer.data;
+
+		assert(cmd_ctx->reply_payload.buffer.size >= sizeof(llm));
+		assert(cmd_ctx->lttng_msg_size == cmd_ctx->reply_payload.buffer.size);
+
+		llm->fd_count = lttng_payload_view_get_fd_handle_count(&view);
+
+		DBG("Sending response (size: %d, retcode: %s (%d))",
+				cmd_ctx->lttng_msg_size,
+				lttng_strerror(-llm->ret_code),
+				llm->ret_code);
+		if (connection->persistent) {
+			ret = lttcomm_send_unix_sock(connection->sock,
+					&request_header,
+					sizeof(request_header));
+			if (ret < 0) {
+				ERR("Failed to send data back to client");
+				goto end;
+			}
+		}
+		ret = send_unix_sock(connection->sock, &view);
+		if (ret < 0) {
+			ERR("Failed to send data back to client");
+			goto end;
+		}
+
+		if (cmd_ctx->lsm.cmd_type == LTTNG_OPEN_PERSISTENT_CONNECTION &&
+				llm->ret_code == LTTNG_OK) {
+			DBG("Client connection is now persistent (sock = %d)",
+					connection->sock);
+			connection->persistent = true;
+		}
+		/*
+		 * The reply to a command which failed to receive all of its
+		 * data leaves the connection in an unknown state.
+		 */
+		keep_connection = connection->persistent && !sock_error &&
+				!(llm->ret_code != LTTNG_OK &&
+				command_has_payload(&cmd_ctx->lsm));
+	}
+
+end:
+	return keep_connection;
+}
+
+/*
+ * Queue a client connection for the command workers. The queue owns the
+ * connection.
+ */
+static void enqueue_client_connection(struct client_connection *connection)
+{
+	pthread_mutex_lock(&command_queue.lock);
+	cds_list_add_tail(&connection->node, &command_queue.connections);
+	pthread_cond_signal(&command_queue.cond);
+	pthread_mutex_unlock(&command_queue.lock);
+}
+
+/*
+ * Wait for a queued client connection.
+ *
+ * Return the connection, or NULL if the command workers must quit.
+ */
+static struct client_connection *dequeue_client_connection(void)
+{
+	struct client_connection *connection = NULL;
+
+	pthread_mutex_lock(&command_queue.lock);
+	while (cds_list_empty(&command_queue.connections) &&
+			!command_queue.quit) {
+		health_poll_entry();
+		pthread_cond_wait(&command_queue.cond, &command_queue.lock);
+		health_poll_exit();
+	}
+	if (command_queue.quit) {
+		goto end;
+	}
+
+	connection = cds_list_entry(command_queue.connections.next,
+			struct client_connection, node);
+	cds_list_del(&connection->node);
+end:
+	pthread_mutex_unlock(&command_queue.lock);
+	return connection;
+}
+
+/*
+ * Give a persistent connection back to the client thread, which waits for
+ * the next command of the client.
+ */
+static void return_client_connection(struct client_connection *connection)
+{
+	const char dummy = 0;
+
+	pthread_mutex_lock(&command_queue.lock);
+	cds_list_add_tail(&connection->node,
+			&command_queue.returned_connections);
+	pthread_mutex_unlock(&command_queue.lock);
+
+	if (lttng_pipe_write(command_queue.return_pipe, &dummy,
+			sizeof(dummy)) != sizeof(dummy)) {
+		PERROR("Failed to notify the client thread of a returned connection");
+	}
+}
+
+/*
+ * Make the command workers quit once they are done with the command they are
+ * processing.
+ */
+static void quit_command_workers(void)
+{
+	pthread_mutex_lock(&command_queue.lock);
+	command_queue.quit = true;
+	pthread_cond_broadcast(&command_queue.cond);
+	pthread_mutex_unlock(&command_queue.lock);
+}
+
+/*
+ * Close the connections which are queued for the command workers or were
+ * returned by them.
+ */
+static void drain_client_connections(void)
+{
+	struct client_connection *connection, *tmp;
+
+	pthread_mutex_lock(&command_queue.lock);
+	cds_list_for_each_entry_safe(connection, tmp,
+			&command_queue.connections, node) {
+		cds_list_del(&connection->node);
+		close_client_connection(connection);
+	}
+	cds_list_for_each_entry_safe(connection, tmp,
+			&command_queue.returned_connections, node) {
+		cds_list_del(&connection->node);
+		close_client_connection(connection);
+	}
+	pthread_mutex_unlock(&command_queue.lock);
+}
+
+/*
+ * Returns true if the next command of a persistent connection was already
+ * sent by the client, as when it sends a batch of commands without waiting
+ * for their replies.
+ */
+static bool client_command_pending(const struct client_connection *connection)
+{
+	int ret;
+	struct pollfd pollfd = {
+		.fd = connection->sock,
+		.events = POLLIN,
+	};
+
+	do {
+		ret = poll(&pollfd, 1, 0);
+	} while (ret < 0 && errno == EINTR);
+
+	return ret > 0 && (pollfd.revents & POLLIN);
+}
+
+/*
+ * This thread processes the client commands of the connections queued by the
+ * client thread.
+ */
+static void *thread_client_command_worker(void *data)
+{
+	struct command_ctx cmd_ctx = {};
+
+	DBG("[thread] Client command worker started");
+
+	rcu_register_thread();
+
+	health_register(health_sessiond, HEALTH_SESSIOND_TYPE_CMD);
+
+	lttng_payload_init(&cmd_ctx.reply_payload);
+
+	for (;;) {
+		bool keep_connection;
+		struct client_connection *connection =
+				dequeue_client_connection();
+
+		if (!connection) {
+			break;
+		}
+
+		/*
+		 * The commands a client sends back-to-back on a persistent
+		 * connection, such as those loading a session, are applied in
+		 * one pass rather than going through the client thread's poll
+		 * set between each of them.
+		 */
+		for (;;) {
+			keep_connection = handle_client_command(&cmd_ctx,
+					connection);
+			health_code_update();
+			if (!keep_connection ||
+					!client_command_pending(connection)) {
+				break;
+			}
+		}
+
+		if (keep_connection) {
+			return_client_connection(connection);
+		} else {
+			close_client_connection(connection);
+		}
+	}
+
+	DBG("Client command worker dying");
+	lttng_payload_reset(&cmd_ctx.reply_payload);
+	health_unregister(health_sessiond);
+	rcu_unregister_thread();
+	return NULL;
+}
+
+/*
+ * Accept a new client connection and queue it for the command workers.
+ *
+ * Return 0 on success, -1 on error.
+ */
+static int accept_client_connection(int client_sock)
+{
+	int ret, sock;
+	struct client_connection *connection;
+
+	sock = lttcomm_accept_unix_sock(client_sock);
+	if (sock < 0) {
+		ret = -1;
+		goto end;
+	}
+
+	/*
+	 * Set the CLOEXEC flag. Return code is useless because either way, the
+	 * show must go on.
+	 */
+	(void) utils_set_fd_cloexec(sock);
+
+	/* Set socket option for credentials retrieval */
+	ret = lttcomm_setsockopt_creds_unix_sock(sock);
+	if (ret < 0) {
+		goto error;
+	}
+
+	connection = zmalloc(sizeof(*connection));
+	if (!connection) {
+		PERROR("zmalloc client connection");
+		ret = -1;
+		goto error;
+	}
+	connection->sock = sock;
+
+	enqueue_client_connection(connection);
+	ret = 0;
+	goto end;
+
+error:
+	if (close(sock)) {
+		PERROR("close");
+	}
+end:
+	return ret;
+}
+
+/*
+ * Add the persistent connections returned by the command workers to the
+ * client thread's poll set, to wait for the next command of their client.
+ */
+static void poll_returned_connections(struct lttng_poll_event *events,
+		struct cds_list_head *polled_connections)
+{
+	char dummy;
+	struct cds_list_head returned_connections;
+	struct client_connection *connection, *tmp;
+
+	/*
+	 * Consume one notification; the poll set reports the pipe as long as
+	 * notifications remain.
+	 */
+	(void) lttng_pipe_read(command_queue.return_pipe, &dummy,
+			sizeof(dummy));
+
+	CDS_INIT_LIST_HEAD(&returned_connections);
+	pthread_mutex_lock(&command_queue.lock);
+	cds_list_splice(&command_queue.returned_connections,
+			&returned_connections);
+	CDS_INIT_LIST_HEAD(&command_queue.returned_connections);
+	pthread_mutex_unlock(&command_queue.lock);
+
+	cds_list_for_each_entry_safe(connection, tmp, &returned_connections,
+			node) {
+		cds_list_del(&connection->node);
+		if (lttng_poll_add(events, connection->sock,
+				LPOLLIN | LPOLLPRI | LPOLLRDHUP) < 0) {
+			ERR("Failed to poll persistent client connection (sock = %d)",
+					connection->sock);
+			close_client_connection(connection);
+			continue;
+		}
+		cds_list_add_tail(&connection->node, polled_connections);
+	}
+}
+
+/*
+ * Find the persistent connection, polled by the client thread, of a socket.
+ *
+ * A client typically keeps a single persistent connection open; the list of
+ * polled connections is expected to be short.
+ */
+static struct client_connection *find_polled_connection(
+		struct cds_list_head *polled_connections, int sock)
+{
+	struct client_connection *connection;
+
+	cds_list_for_each_entry(connection, polled_connections, node) {
+		if (connection->sock == sock) {
+			return connection;
+		}
+	}
+	return NULL;
+}
+
 /*
  * This thread manage all clients request using the unix client socket for
  * communication.
+ *
+ * Accepted connections are handed to a pool of command workers. Commands on
+ * different sessions may thus be processed concurrently; the commands on a
+ * given session are serialized by the session's lock. Persistent
+ * connections are given back by the workers once a command is processed and
+ * are polled by this thread until their next command.
  */
 static void *thread_manage_clients(void *data)
 {
-	int sock = -1, ret, i, pollfd, err = -1;
-	int sock_error;
+	int ret, i, pollfd, err = -1;
 	uint32_t revents, nb_fd;
+	unsigned int nb_workers = 0;
+	pthread_t *workers = NULL;
 	struct lttng_poll_event events;
 	const int client_sock = thread_state.client_sock;
 	struct lttng_pipe *quit_pipe = data;
 	const int thread_quit_pipe_fd = lttng_pipe_get_readfd(quit_pipe);
-	struct command_ctx cmd_ctx = {};
+	struct cds_list_head polled_connections;
+	struct client_connection *connection, *tmp;
 
 	DBG("[thread] Manage client started");
 
-	lttng_payload_init(&cmd_ctx.reply_payload);
+	CDS_INIT_LIST_HEAD(&polled_connections);
 
 	is_root = (getuid() == 0);
 
@@ -2250,11 +2854,17 @@ static void *thread_manage_clients(void *data)
 		goto error_listen;
 	}
 
+	command_queue.return_pipe = lttng_pipe_open(FD_CLOEXEC);
+	if (!command_queue.return_pipe) {
+		goto error_listen;
+	}
+
 	/*
-	 * Pass 2 as size here for the thread quit pipe and client_sock. Nothing
-	 * more will be added to this poll set.
+	 * Pass 3 as size here for the thread quit pipe, client_sock and the
+	 * connection return pipe. The persistent connections are added as
+	 * they are returned by the command workers.
 	 */
-	ret = lttng_poll_create(&events, 2, LTTNG_CLOEXEC);
+	ret = lttng_poll_create(&events, 3, LTTNG_CLOEXEC);
 	if (ret < 0) {
 		goto error_create_poll;
 	}
@@ -2271,6 +2881,31 @@ static void *thread_manage_clients(void *data)
 		goto error;
 	}
 
+	/* Add the pipe notifying the return of persistent connections */
+	ret = lttng_poll_add(&events,
+			lttng_pipe_get_readfd(command_queue.return_pipe),
+			LPOLLIN | LPOLLERR);
+	if (ret < 0) {
+		goto error;
+	}
+
+	workers = zmalloc(config.client_command_threads * sizeof(*workers));
+	if (!workers) {
+		PERROR("zmalloc client command workers");
+		goto error;
+	}
+	for (; nb_workers < config.client_command_threads; nb_workers++) {
+		ret = pthread_create(&workers[nb_workers],
+				default_pthread_attr(),
+				thread_client_command_worker, NULL);
+		if (ret) {
+			errno = ret;
+			PERROR("pthread_create client command worker");
+			goto error;
+		}
+	}
+	DBG("Launched %u client command workers", nb_workers);
+
 	/* Set state as running. */
 	set_thread_status(true);
 	pthread_cleanup_pop(0);
@@ -2287,16 +2922,6 @@ static void *thread_manage_clients(void *data)
 	health_code_update();
 
 	while (1) {
-		const struct cmd_completion_handler *cmd_completion_handler;
-
-		cmd_ctx.creds = (lttng_sock_cred) {
-			.uid = UINT32_MAX,
-			.gid = UINT32_MAX,
-		};
-		cmd_ctx.session = NULL;
-		lttng_payload_clear(&cmd_ctx.reply_payload);
-		cmd_ctx.lttng_msg_size = 0;
-
 		DBG("Accepting client command ...");
 
 		/* Inifinite blocking call, waiting for transmission */
@@ -2325,10 +2950,15 @@ static void *thread_manage_clients(void *data)
 			if (pollfd == thread_quit_pipe_fd) {
 				err = 0;
 				goto exit;
-			} else {
+			} else if (pollfd == client_sock) {
 				/* Event on the registration socket */
 				if (revents & LPOLLIN) {
-					continue;
+					DBG("Wait for client response");
+					ret = accept_client_connection(
+							client_sock);
+					if (ret < 0) {
+						goto error;
+					}
 				} else if (revents & (LPOLLERR | LPOLLHUP | LPOLLRDHUP)) {
 					ERR("Client socket poll error");
 					goto error;
@@ -2336,142 +2966,64 @@ static void *thread_manage_clients(void *data)
 					ERR("Unexpected poll events %u for sock %d", revents, pollfd);
 					goto error;
 				}
-			}
-		}
-
-		DBG("Wait for client response");
-
-		health_code_update();
-
-		sock = lttcomm_accept_unix_sock(client_sock);
-		if (sock < 0) {
-			goto error;
-		}
-
-		/*
-		 * Set the CLOEXEC flag. Return code is useless because either way, the
-		 * show must go on.
-		 */
-		(void) utils_set_fd_cloexec(sock);
-
-		/* Set socket option for credentials retrieval */
-		ret = lttcomm_setsockopt_creds_unix_sock(sock);
-		if (ret < 0) {
-			goto error;
-		}
-
-		health_code_update();
-
-		/*
-		 * Data is received from the lttng client. The struct
-		 * lttcomm_session_msg (lsm) contains the command and data request of
-		 * the client.
-		 */
-		DBG("Receiving data from client ...");
-		ret = lttcomm_recv_creds_unix_sock(sock, &cmd_ctx.lsm,
-				sizeof(struct lttcomm_session_msg), &cmd_ctx.creds);
-		if (ret != sizeof(struct lttcomm_session_msg)) {
-			DBG("Incomplete recv() from client... continuing");
-			ret = close(sock);
-			if (ret) {
-				PERROR("close");
-			}
-			sock = -1;
-			continue;
-		}
-
-		health_code_update();
-
-		// TODO: Validate cmd_ctx including sanity check for
-		// security purpose.
-
-		rcu_thread_online();
-		/*
-		 * This function dispatch the work to the kernel or userspace tracer
-		 * libs and fill the lttcomm_lttng_msg data structure of all the needed
-		 * informations for the client. The command context struct contains
-		 * everything this function may needs.
-		 */
-		ret = process_client_msg(&cmd_ctx, &sock, &sock_error);
-		rcu_thread_offline();
-		if (ret < 0) {
-			if (sock >= 0) {
-				ret = close(sock);
-				if (ret) {
-					PERROR("close");
+			} else if (pollfd == lttng_pipe_get_readfd(
+					command_queue.return_pipe)) {
+				if (revents & LPOLLIN) {
+					poll_returned_connections(&events,
+							&polled_connections);
+				} else {
+					ERR("Client connection return pipe poll error");
+					goto error;
+				}
+			} else {
+				/* Event on a persistent connection */
+				connection = find_polled_connection(
+						&polled_connections, pollfd);
+				if (!connection) {
+					/* Connection already handled. */
+					continue;
 				}
-			}
-			sock = -1;
-			/*
-			 * TODO: Inform client somehow of the fatal error. At
-			 * this point, ret < 0 means that a zmalloc failed
-			 * (ENOMEM). Error detected but still accept
-			 * command, unless a socket error has been
-			 * detected.
-			 */
-			continue;
-		}
-
-		cmd_completion_handler = cmd_pop_completion_handler();
-		if (cmd_completion_handler) {
-			enum lttng_error_code completion_code;
-
-			completion_code = cmd_completion_handler->run(
-					cmd_completion_handler->data);
-			if (completion_code != LTTNG_OK) {
-				continue;
-			}
-		}
-
-		health_code_update();
-
-		if (sock >= 0) {
-			struct lttng_payload_view view =
-					lttng_payload_view_from_payload(
-							&cmd_ctx.reply_payload,
-							0, -1);
-			struct lttcomm_lttng_msg *llm = (typeof(
-					llm)) cmd_ctx.reply_payload.buffer.data;
-
-			assert(cmd_ctx.reply_payload.buffer.size >=
-			       sizeof(llm));
-			assert(cmd_ctx.lttng_msg_size == cmd_ctx.reply_payload.buffer.size);
-
-			llm->fd_count = lttng_payload_view_get_fd_handle_count(&view);
-
-			DBG("Sending response (size: %d, retcode: %s (%d))",
-					cmd_ctx.lttng_msg_size,
-					lttng_strerror(-llm->ret_code),
-					llm->ret_code);
-			ret = send_unix_sock(sock, &view);
-			if (ret < 0) {
-				ERR("Failed to send data back to client");
-			}
 
-			/* End of transmission */
-			ret = close(sock);
-			if (ret) {
-				PERROR("close");
+				cds_list_del(&connection->node);
+				(void) lttng_poll_del(&events, pollfd);
+				if (revents & LPOLLIN) {
+					enqueue_client_connection(connection);
+				} else {
+					DBG("Persistent client connection closed (sock = %d)",
+							pollfd);
+					close_client_connection(connection);
+				}
 			}
 		}
-		sock = -1;
 
 		health_code_update();
 	}
 
 exit:
 error:
-	if (sock >= 0) {
-		ret = close(sock);
+	/* Let the commands being processed complete. */
+	quit_command_workers();
+	while (nb_workers > 0) {
+		ret = pthread_join(workers[--nb_workers], NULL);
 		if (ret) {
-			PERROR("close");
+			errno = ret;
+			PERROR("pthread_join client command worker");
 		}
 	}
+	free(workers);
+	drain_client_connections();
+	cds_list_for_each_entry_safe(connection, tmp, &polled_connections,
+			node) {
+		cds_list_del(&connection->node);
+		close_client_connection(connection);
+	}
 
 	lttng_poll_clean(&events);
 
-error_listen:
 error_create_poll:
+	lttng_pipe_destroy(command_queue.return_pipe);
+	command_queue.return_pipe = NULL;
+error_listen:
 	unlink(config.client_unix_sock_path.value);
 	ret = close(client_sock);
 	if (ret) {
@@ -2486,7 +3038,6 @@ error_create_poll:
 	health_unregister(health_sessiond);
 
 	DBG("Client thread dying");
-	lttng_payload_reset(&cmd_ctx.reply_payload);
 	rcu_unregister_thread();
 	return NULL;
 }
@@ -10,6 +10,7 @@
 #include <assert.h>
 #include <inttypes.h>
 #include <urcu/list.h>
+#include <urcu/tls-compat.h>
 #include <urcu/uatomic.h>
 #include <sys/stat.h>
 #include <stdio.h>
@@ -83,18 +84,19 @@ static enum lttng_error_code wait_on_path(void *path);
  *
  * See comment in cmd_destroy_session() for the rationale.
  */
-static struct destroy_completion_handler {
+struct destroy_completion_handler {
 	struct cmd_completion_handler handler;
 	char shm_path[member_sizeof(struct ltt_session, shm_path)];
-} destroy_completion_handler = {
-	.handler = {
-		.run = wait_on_path,
-		.data = destroy_completion_handler.shm_path
-	},
-	.shm_path = { 0 },
 };
 
-static struct cmd_completion_handler *current_completion_handler;
+/*
+ * Client commands are processed by a pool of threads; the completion handler
+ * of a command is popped by the thread which processed it.
+ */
+static DEFINE_URCU_TLS(struct destroy_completion_handler,
+		destroy_completion_handler);
+static DEFINE_URCU_TLS(struct cmd_completion_handler *,
+		current_completion_handler);
 
 /*
  * Used to keep a unique index for each relayd socket created where this value
@@ -3367,10 +3369,15 @@ int cmd_destroy_session(struct ltt_session *session,
 		 * be destroyed properly, except that we can't offer the
 		 * guarantee that the same session can be re-created.
 		 */
-		current_completion_handler = &destroy_completion_handler.handler;
-		ret = lttng_strncpy(destroy_completion_handler.shm_path,
+		struct destroy_completion_handler *handler =
+				&URCU_TLS(destroy_completion_handler);
+
+		handler->handler.run = wait_on_path;
+		handler->handler.data = handler->shm_path;
+		URCU_TLS(current_completion_handler) = &handler->handler;
+		ret = lttng_strncpy(handler->shm_path,
 				session->shm_path,
-				sizeof(destroy_completion_handler.shm_path));
+				sizeof(handler->shm_path));
 		assert(!ret);
 	}
 
@@ -5444,9 +5451,10 @@ static enum lttng_error_code wait_on_path(void *path_data)
  */
 const struct cmd_completion_handler *cmd_pop_completion_handler(void)
 {
-	struct cmd_completion_handler *handler = current_completion_handler;
+	struct cmd_completion_handler *handler =
+			URCU_TLS(current_completion_handler);
 
-	current_completion_handler = NULL;
+	URCU_TLS(current_completion_handler) = NULL;
 	return handler;
 }
 
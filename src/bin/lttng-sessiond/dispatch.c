@@ -31,11 +31,16 @@ struct thread_notifiers {
 /*
  * For each tracing session, update newly registered apps. The session list
  * lock MUST be acquired before calling this.
+ *
+ * The sessions are updated concurrently by the application synchronization
+ * threads.
  */
 static void update_ust_app(int app_sock)
 {
+	size_t i;
 	struct ltt_session *sess, *stmp;
 	const struct ltt_session_list *session_list = session_get_list();
+	struct lttng_dynamic_pointer_array sessions;
 
 	/* Consumer is in an ERROR state. Stop any application update. */
 	if (uatomic_read(&ust_consumerd_state) == CONSUMER_ERROR) {
@@ -43,38 +48,29 @@ static void update_ust_app(int app_sock)
 		return;
 	}
 
+	assert(app_sock >= 0);
+	lttng_dynamic_pointer_array_init(&sessions, NULL);
+
 	/* For all tracing session(s) */
 	cds_list_for_each_entry_safe(sess, stmp, &session_list->head, list) {
-		struct ust_app *app;
-
 		if (!session_get(sess)) {
 			continue;
 		}
-		session_lock(sess);
-		if (!sess->active || !sess->ust_session) {
-			goto unlock_session;
+		if (lttng_dynamic_pointer_array_add_pointer(&sessions, sess)) {
+			ERR("Failed to gather the sessions to update with app sock %d",
+					app_sock);
+			session_put(sess);
+			goto end;
 		}
+	}
 
-		rcu_read_lock();
-		assert(app_sock >= 0);
-		app = ust_app_find_by_sock(app_sock);
-		if (app == NULL) {
-			/*
-			 * Application can be unregistered before so
-			 * this is possible hence simply stopping the
-			 * update.
-			 */
-			DBG3("UST app update failed to find app sock %d",
-				app_sock);
-			goto unlock_rcu;
-		}
-		ust_app_global_update(sess->ust_session, app);
-	unlock_rcu:
-		rcu_read_unlock();
-	unlock_session:
-		session_unlock(sess);
-		session_put(sess);
+	ust_app_global_update_sessions(app_sock, &sessions);
+end:
+	for (i = 0; i < lttng_dynamic_pointer_array_get_count(&sessions); i++) {
+		session_put(lttng_dynamic_pointer_array_get_pointer(
+				&sessions, i));
 	}
+	lttng_dynamic_pointer_array_reset(&sessions);
 }
 
 /*
@@ -84,6 +84,8 @@ struct command_ctx {
 	/* Reply content, starts with an lttcomm_lttng_msg header. */
 	struct lttng_payload reply_payload;
 	lttng_sock_cred creds;
+	/* The command was received on a persistent connection. */
+	bool persistent_connection;
 };
 
 struct ust_command {
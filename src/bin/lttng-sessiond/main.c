@@ -1687,6 +1687,12 @@ int main(int argc, char **argv)
 		goto stop_threads;
 	}
 
+	/* Create the threads helping to synchronize the applications. */
+	if (!launch_ust_app_sync_threads()) {
+		retval = -1;
+		goto stop_threads;
+	}
+
 	if (!launch_ust_dispatch_thread(&ust_cmd_queue, apps_cmd_pipe[1],
 			apps_cmd_notify_pipe[1])) {
 		retval = -1;
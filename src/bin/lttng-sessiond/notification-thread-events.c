@@ -43,6 +43,11 @@
 #define CLIENT_POLL_MASK_IN (LPOLLIN | LPOLLERR | LPOLLHUP | LPOLLRDHUP)
 #define CLIENT_POLL_MASK_IN_OUT (CLIENT_POLL_MASK_IN | LPOLLOUT)
 
+/* Maximal number of samples queued to a sample evaluator thread. */
+#define SAMPLE_SHARD_QUEUE_LEN 256
+/* Initial number of channel state slots of a sample shard. */
+#define SAMPLE_SHARD_INITIAL_STATE_COUNT 64
+
 enum lttng_object_type {
 	LTTNG_OBJECT_TYPE_UNKNOWN,
 	LTTNG_OBJECT_TYPE_NONE,
@@ -121,12 +126,71 @@ struct lttng_condition_list_element {
 
 struct channel_state_sample {
 	struct channel_key key;
-	struct cds_lfht_node channel_state_ht_node;
 	uint64_t highest_usage;
 	uint64_t lowest_usage;
 	uint64_t channel_total_consumed;
-	/* call_rcu delayed reclaim. */
-	struct rcu_head rcu_node;
+};
+
+/* Slot of a sample shard's open-addressing table of channel states. */
+struct channel_state_slot {
+	bool used;
+	/* A sample was evaluated for this channel. */
+	bool valid;
+	unsigned long hash;
+	/* Sequence number of the last batch which referenced this channel. */
+	uint64_t batch_seq;
+	struct channel_state_sample sample;
+};
+
+struct sample_batch_entry {
+	struct channel_state_sample sample;
+	/* Weak reference, valid while the batch is evaluated. */
+	struct channel_info *channel_info;
+	/* Superseded by a later sample of the same channel. */
+	bool late;
+};
+
+/*
+ * Channel samples are distributed to shards according to the hash of their
+ * channel key. Each shard owns the last sampled state of its channels and,
+ * unless the samples are evaluated inline by the notification thread, is
+ * serviced by an evaluator thread.
+ *
+ * An evaluator thread only reads the notification thread's state. The
+ * notification thread acquires the eval_lock of every shard (see
+ * notification_thread_state_quiesce()) before it modifies that state.
+ */
+struct notification_sample_shard {
+	struct notification_thread_state *state;
+	unsigned int id;
+	pthread_t thread;
+	bool thread_launched;
+	/* Protects the queue. */
+	pthread_mutex_t queue_lock;
+	pthread_cond_t queue_cond;
+	struct {
+		struct channel_state_sample samples[SAMPLE_SHARD_QUEUE_LEN];
+		unsigned int head;
+		unsigned int count;
+		bool quit;
+	} queue;
+	/* Number of samples dropped since the queue was full. */
+	uint64_t dropped_samples;
+	/* Held while the samples of a batch are evaluated. */
+	pthread_mutex_t eval_lock;
+	/* The following fields are protected by eval_lock. */
+	struct {
+		struct channel_state_slot *slots;
+		/* Power of two. */
+		size_t capacity;
+		size_t count;
+	} states;
+	uint64_t batch_seq;
+	struct sample_batch_entry batch[SAMPLE_SHARD_QUEUE_LEN];
+	/* Number of samples superseded before they could be evaluated. */
+	uint64_t late_samples;
+	/* Set when a fatal error occurred on the evaluator thread. */
+	int error;
 };
 
 static unsigned long hash_channel_key(struct channel_key *key);
@@ -234,19 +298,6 @@ int match_session_trigger_list(struct cds_lfht_node *node, const void *key)
 	return !!(strcmp(trigger_list->session_name, session_name) == 0);
 }
 
-static
-int match_channel_state_sample(struct cds_lfht_node *node, const void *key)
-{
-	struct channel_key *channel_key = (struct channel_key *) key;
-	struct channel_state_sample *sample;
-
-	sample = caa_container_of(node, struct channel_state_sample,
-			channel_state_ht_node);
-
-	return !!((channel_key->key == sample->key.key) &&
-			(channel_key->domain == sample->key.domain));
-}
-
 static
 int match_channel_info(struct cds_lfht_node *node, const void *key)
 {
@@ -410,6 +461,157 @@ unsigned long hash_channel_key(struct channel_key *key)
 	return key_hash ^ domain_hash;
 }
 
+static
+struct notification_sample_shard *get_sample_shard(
+		const struct notification_thread_state *state,
+		struct channel_key *key)
+{
+	return &state->sample_shards[hash_channel_key(key) %
+			state->sample_shard_count];
+}
+
+/*
+ * Returns the slot holding the state of a channel or, if the channel is
+ * unknown to the shard, the free slot where it would be stored.
+ *
+ * The channel states are kept in a flat array using linear probing. The
+ * home slot of a channel is derived from the bits of the hash which were
+ * not used to select the shard.
+ */
+static
+struct channel_state_slot *sample_shard_lookup_slot(
+		struct notification_sample_shard *shard,
+		const struct channel_key *key, unsigned long hash)
+{
+	const size_t mask = shard->states.capacity - 1;
+	size_t i = (hash / shard->state->sample_shard_count) & mask;
+
+	for (;;) {
+		struct channel_state_slot *slot = &shard->states.slots[i];
+
+		if (!slot->used || (slot->hash == hash &&
+				slot->sample.key.key == key->key &&
+				slot->sample.key.domain == key->domain)) {
+			return slot;
+		}
+		i = (i + 1) & mask;
+	}
+}
+
+static
+int sample_shard_grow_states(struct notification_sample_shard *shard)
+{
+	int ret = 0;
+	size_t i;
+	struct channel_state_slot *old_slots = shard->states.slots;
+	const size_t old_capacity = shard->states.capacity;
+
+	shard->states.slots = zmalloc(old_capacity * 2 *
+			sizeof(*shard->states.slots));
+	if (!shard->states.slots) {
+		shard->states.slots = old_slots;
+		ret = -1;
+		goto end;
+	}
+	shard->states.capacity = old_capacity * 2;
+
+	for (i = 0; i < old_capacity; i++) {
+		if (!old_slots[i].used) {
+			continue;
+		}
+
+		*sample_shard_lookup_slot(shard, &old_slots[i].sample.key,
+				old_slots[i].hash) = old_slots[i];
+	}
+	free(old_slots);
+end:
+	return ret;
+}
+
+/*
+ * Returns the slot holding the state of a channel, claiming a slot if the
+ * channel is unknown to the shard. Returns NULL on allocation failure.
+ */
+static
+struct channel_state_slot *sample_shard_get_slot(
+		struct notification_sample_shard *shard,
+		struct channel_key *key)
+{
+	const unsigned long hash = hash_channel_key(key);
+	struct channel_state_slot *slot;
+
+	slot = sample_shard_lookup_slot(shard, key, hash);
+	if (slot->used) {
+		goto end;
+	}
+
+	/* Keep the table at most half-full to keep the probes short. */
+	if ((shard->states.count + 1) * 2 > shard->states.capacity) {
+		if (sample_shard_grow_states(shard)) {
+			slot = NULL;
+			goto end;
+		}
+		slot = sample_shard_lookup_slot(shard, key, hash);
+	}
+
+	memset(slot, 0, sizeof(*slot));
+	slot->used = true;
+	slot->hash = hash;
+	slot->sample.key = *key;
+	shard->states.count++;
+end:
+	return slot;
+}
+
+static
+const struct channel_state_sample *sample_shard_find_state(
+		struct notification_sample_shard *shard,
+		struct channel_key *key)
+{
+	const struct channel_state_slot *slot;
+
+	slot = sample_shard_lookup_slot(shard, key, hash_channel_key(key));
+	return slot->used && slot->valid ? &slot->sample : NULL;
+}
+
+/*
+ * Remove the state of a channel, shifting back the following slots of its
+ * probe sequence so that no tombstone is needed.
+ */
+static
+void sample_shard_remove_state(struct notification_sample_shard *shard,
+		struct channel_key *key)
+{
+	const size_t mask = shard->states.capacity - 1;
+	struct channel_state_slot *slots = shard->states.slots;
+	size_t hole, i;
+
+	hole = sample_shard_lookup_slot(shard, key, hash_channel_key(key)) -
+			slots;
+	if (!slots[hole].used) {
+		return;
+	}
+
+	i = hole;
+	for (;;) {
+		size_t home;
+
+		i = (i + 1) & mask;
+		if (!slots[i].used) {
+			break;
+		}
+
+		home = (slots[i].hash / shard->state->sample_shard_count) & mask;
+		/* Move the entry if the hole lies between its home and itself. */
+		if (((i - home) & mask) >= ((i - hole) & mask)) {
+			slots[hole] = slots[i];
+			hole = i;
+		}
+	}
+	memset(&slots[hole], 0, sizeof(slots[hole]));
+	shard->states.count--;
+}
+
 static
 unsigned long hash_client_socket(int socket)
 {
@@ -736,7 +938,7 @@ int evaluate_channel_condition_for_client(
 	struct cds_lfht_node *node;
 	struct channel_info *channel_info = NULL;
 	struct channel_key *channel_key = NULL;
-	struct channel_state_sample *last_sample = NULL;
+	const struct channel_state_sample *last_sample = NULL;
 	struct lttng_channel_trigger_list *channel_trigger_list = NULL;
 
 	rcu_read_lock();
@@ -786,17 +988,9 @@ int evaluate_channel_condition_for_client(
 			channels_ht_node);
 
 	/* Retrieve the channel's last sample, if it exists. */
-	cds_lfht_lookup(state->channel_state_ht,
-			hash_channel_key(channel_key),
-			match_channel_state_sample,
-			channel_key,
-			&iter);
-	node = cds_lfht_iter_get_node(&iter);
-	if (node) {
-		last_sample = caa_container_of(node,
-				struct channel_state_sample,
-				channel_state_ht_node);
-	} else {
+	last_sample = sample_shard_find_state(
+			get_sample_shard(state, channel_key), channel_key);
+	if (!last_sample) {
 		/* Nothing to evaluate, no sample was ever taken. Normal exit */
 		DBG("[notification-thread] No channel sample associated with newly subscribed-to condition");
 		ret = 0;
@@ -805,7 +999,7 @@ int evaluate_channel_condition_for_client(
 
 	ret = evaluate_buffer_condition(condition, evaluation, state,
 			NULL, last_sample,
-			0, channel_info->session_info->consumed_data_size,
+			0, uatomic_read(&channel_info->session_info->consumed_data_size),
 			channel_info);
 	if (ret) {
 		WARN("[notification-thread] Fatal error occurred while evaluating a newly subscribed-to condition");
@@ -1703,13 +1897,6 @@ void free_channel_trigger_list_rcu(struct rcu_head *node)
 			rcu_node));
 }
 
-static
-void free_channel_state_sample_rcu(struct rcu_head *node)
-{
-	free(caa_container_of(node, struct channel_state_sample,
-			rcu_node));
-}
-
 static
 int handle_notification_thread_command_remove_channel(
 	struct notification_thread_state *state,
@@ -1754,25 +1941,11 @@ int handle_notification_thread_command_remove_channel(
 	cds_lfht_del(state->channel_triggers_ht, node);
 	call_rcu(&trigger_list->rcu_node, free_channel_trigger_list_rcu);
 
-	/* Free sampled channel state. */
-	cds_lfht_lookup(state->channel_state_ht,
-			hash_channel_key(&key),
-			match_channel_state_sample,
-			&key,
-			&iter);
-	node = cds_lfht_iter_get_node(&iter);
 	/*
-	 * This is expected to be NULL if the channel is destroyed before we
-	 * received a sample.
+	 * Free sampled channel state. There is none if the channel is
+	 * destroyed before we received a sample.
 	 */
-	if (node) {
-		struct channel_state_sample *sample = caa_container_of(node,
-				struct channel_state_sample,
-				channel_state_ht_node);
-
-		cds_lfht_del(state->channel_state_ht, node);
-		call_rcu(&sample->rcu_node, free_channel_state_sample_rcu);
-	}
+	sample_shard_remove_state(get_sample_shard(state, &key), &key);
 
 	/* Remove the channel from the channels_ht and free it. */
 	cds_lfht_lookup(state->channels_ht,
@@ -3760,137 +3933,60 @@ end:
 	return ret;
 }
 
-int handle_notification_thread_channel_sample(
-		struct notification_thread_state *state, int pipe,
-		enum lttng_domain_type domain)
+/*
+ * Evaluate the conditions of the triggers associated with a channel against
+ * its latest sample.
+ *
+ * Called with the RCU read lock held, either by the notification thread or
+ * by an evaluator thread while the notification thread's state is quiesced.
+ */
+static
+int evaluate_channel_sample(struct notification_thread_state *state,
+		struct channel_info *channel_info,
+		const struct channel_state_sample *previous_sample,
+		const struct channel_state_sample *latest_sample)
 {
 	int ret = 0;
-	struct lttcomm_consumer_channel_monitor_msg sample_msg;
-	struct channel_info *channel_info;
 	struct cds_lfht_node *node;
 	struct cds_lfht_iter iter;
 	struct lttng_channel_trigger_list *trigger_list;
 	struct lttng_trigger_list_element *trigger_list_element;
-	bool previous_sample_available = false;
-	struct channel_state_sample previous_sample, latest_sample;
 	uint64_t previous_session_consumed_total, latest_session_consumed_total;
+	uint64_t consumed_delta;
 	struct lttng_credentials channel_creds;
+	struct channel_key key = latest_sample->key;
 
-	/*
-	 * The monitoring pipe only holds messages smaller than PIPE_BUF,
-	 * ensuring that read/write of sampling messages are atomic.
-	 */
-	ret = lttng_read(pipe, &sample_msg, sizeof(sample_msg));
-	if (ret != sizeof(sample_msg)) {
-		ERR("[notification-thread] Failed to read from monitoring pipe (fd = %i)",
-				pipe);
-		ret = -1;
-		goto end;
-	}
-
-	ret = 0;
-	latest_sample.key.key = sample_msg.key;
-	latest_sample.key.domain = domain;
-	latest_sample.highest_usage = sample_msg.highest;
-	latest_sample.lowest_usage = sample_msg.lowest;
-	latest_sample.channel_total_consumed = sample_msg.total_consumed;
-
-	rcu_read_lock();
-
-	/* Retrieve the channel's informations */
-	cds_lfht_lookup(state->channels_ht,
-			hash_channel_key(&latest_sample.key),
-			match_channel_info,
-			&latest_sample.key,
-			&iter);
-	node = cds_lfht_iter_get_node(&iter);
-	if (caa_unlikely(!node)) {
-		/*
-		 * Not an error since the consumer can push a sample to the pipe
-		 * and the rest of the session daemon could notify us of the
-		 * channel's destruction before we get a chance to process that
-		 * sample.
-		 */
-		DBG("[notification-thread] Received a sample for an unknown channel from consumerd, key = %" PRIu64 " in %s domain",
-				latest_sample.key.key,
-				domain == LTTNG_DOMAIN_KERNEL ? "kernel" :
-					"user space");
-		goto end_unlock;
-	}
-	channel_info = caa_container_of(node, struct channel_info,
-			channels_ht_node);
 	DBG("[notification-thread] Handling channel sample for channel %s (key = %" PRIu64 ") in session %s (highest usage = %" PRIu64 ", lowest usage = %" PRIu64", total consumed = %" PRIu64")",
 			channel_info->name,
-			latest_sample.key.key,
+			latest_sample->key.key,
 			channel_info->session_info->name,
-			latest_sample.highest_usage,
-			latest_sample.lowest_usage,
-			latest_sample.channel_total_consumed);
-
-	previous_session_consumed_total =
-			channel_info->session_info->consumed_data_size;
-
-	/* Retrieve the channel's last sample, if it exists, and update it. */
-	cds_lfht_lookup(state->channel_state_ht,
-			hash_channel_key(&latest_sample.key),
-			match_channel_state_sample,
-			&latest_sample.key,
-			&iter);
-	node = cds_lfht_iter_get_node(&iter);
-	if (caa_likely(node)) {
-		struct channel_state_sample *stored_sample;
-
-		/* Update the sample stored. */
-		stored_sample = caa_container_of(node,
-				struct channel_state_sample,
-				channel_state_ht_node);
-
-		memcpy(&previous_sample, stored_sample,
-				sizeof(previous_sample));
-		stored_sample->highest_usage = latest_sample.highest_usage;
-		stored_sample->lowest_usage = latest_sample.lowest_usage;
-		stored_sample->channel_total_consumed = latest_sample.channel_total_consumed;
-		previous_sample_available = true;
-
-		latest_session_consumed_total =
-				previous_session_consumed_total +
-				(latest_sample.channel_total_consumed - previous_sample.channel_total_consumed);
-	} else {
-		/*
-		 * This is the channel's first sample, allocate space for and
-		 * store the new sample.
-		 */
-		struct channel_state_sample *stored_sample;
-
-		stored_sample = zmalloc(sizeof(*stored_sample));
-		if (!stored_sample) {
-			ret = -1;
-			goto end_unlock;
-		}
+			latest_sample->highest_usage,
+			latest_sample->lowest_usage,
+			latest_sample->channel_total_consumed);
 
-		memcpy(stored_sample, &latest_sample, sizeof(*stored_sample));
-		cds_lfht_node_init(&stored_sample->channel_state_ht_node);
-		cds_lfht_add(state->channel_state_ht,
-				hash_channel_key(&stored_sample->key),
-				&stored_sample->channel_state_ht_node);
-
-		latest_session_consumed_total =
-				previous_session_consumed_total +
-				latest_sample.channel_total_consumed;
+	/*
+	 * The channels of a session may be sampled by different evaluator
+	 * threads.
+	 */
+	consumed_delta = latest_sample->channel_total_consumed;
+	if (previous_sample) {
+		consumed_delta -= previous_sample->channel_total_consumed;
 	}
-
-	channel_info->session_info->consumed_data_size =
-			latest_session_consumed_total;
+	latest_session_consumed_total = uatomic_add_return(
+			&channel_info->session_info->consumed_data_size,
+			consumed_delta);
+	previous_session_consumed_total =
+			latest_session_consumed_total - consumed_delta;
 
 	/* Find triggers associated with this channel. */
 	cds_lfht_lookup(state->channel_triggers_ht,
-			hash_channel_key(&latest_sample.key),
+			hash_channel_key(&key),
 			match_channel_trigger_list,
-			&latest_sample.key,
+			&key,
 			&iter);
 	node = cds_lfht_iter_get_node(&iter);
 	if (caa_likely(!node)) {
-		goto end_unlock;
+		goto end;
 	}
 
 	channel_creds = (typeof(channel_creds)) {
@@ -3920,8 +4016,8 @@ int handle_notification_thread_channel_sample(
 		client_list = get_client_list_from_condition(state, condition);
 
 		ret = evaluate_buffer_condition(condition, &evaluation, state,
-				previous_sample_available ? &previous_sample : NULL,
-				&latest_sample,
+				previous_sample,
+				latest_sample,
 				previous_session_consumed_total,
 				latest_session_consumed_total,
 				channel_info);
@@ -3973,8 +4069,389 @@ put_list:
 			break;
 		}
 	}
-end_unlock:
-	rcu_read_unlock();
+end:
+	return ret;
+}
+
+/*
+ * Evaluate the first `count` samples of a shard's batch.
+ *
+ * Only the most recent sample of a channel is evaluated; the samples it
+ * supersedes are counted as late. Since the buffer usage conditions are
+ * evaluated on the transitions between consecutive samples, this is
+ * equivalent to a lower sampling rate for that channel.
+ *
+ * Called with the RCU read lock held.
+ */
+static
+int sample_shard_evaluate_batch(struct notification_sample_shard *shard,
+		unsigned int count)
+{
+	int ret = 0;
+	unsigned int i;
+	const uint64_t batch_seq = ++shard->batch_seq;
+	struct notification_thread_state *state = shard->state;
+
+	/*
+	 * Resolve the channels and flag the superseded samples, starting from
+	 * the most recent one.
+	 */
+	for (i = count; i-- > 0;) {
+		struct sample_batch_entry *entry = &shard->batch[i];
+		struct channel_state_slot *slot;
+		struct cds_lfht_node *node;
+		struct cds_lfht_iter iter;
+
+		entry->channel_info = NULL;
+		entry->late = false;
+
+		cds_lfht_lookup(state->channels_ht,
+				hash_channel_key(&entry->sample.key),
+				match_channel_info,
+				&entry->sample.key,
+				&iter);
+		node = cds_lfht_iter_get_node(&iter);
+		if (caa_unlikely(!node)) {
+			/*
+			 * Not an error since the consumer can push a sample to
+			 * the pipe and the rest of the session daemon could
+			 * notify us of the channel's destruction before we get
+			 * a chance to process that sample.
+			 */
+			DBG("[notification-thread] Received a sample for an unknown channel from consumerd, key = %" PRIu64 " in %s domain",
+					entry->sample.key.key,
+					entry->sample.key.domain == LTTNG_DOMAIN_KERNEL ?
+						"kernel" : "user space");
+			continue;
+		}
+
+		slot = sample_shard_get_slot(shard, &entry->sample.key);
+		if (!slot) {
+			ret = -1;
+			goto end;
+		}
+
+		if (slot->batch_seq == batch_seq) {
+			entry->late = true;
+			shard->late_samples++;
+			continue;
+		}
+
+		slot->batch_seq = batch_seq;
+		entry->channel_info = caa_container_of(node,
+				struct channel_info, channels_ht_node);
+	}
+
+	for (i = 0; i < count; i++) {
+		struct sample_batch_entry *entry = &shard->batch[i];
+		struct channel_state_slot *slot;
+		struct channel_state_sample previous_sample;
+		bool previous_sample_available;
+
+		if (!entry->channel_info) {
+			continue;
+		}
+
+		/* Retrieve the channel's last sample, if any, and update it. */
+		slot = sample_shard_lookup_slot(shard, &entry->sample.key,
+				hash_channel_key(&entry->sample.key));
+		assert(slot->used);
+		previous_sample_available = slot->valid;
+		previous_sample = slot->sample;
+		slot->sample = entry->sample;
+		slot->valid = true;
+
+		ret = evaluate_channel_sample(state, entry->channel_info,
+				previous_sample_available ? &previous_sample : NULL,
+				&entry->sample);
+		if (ret) {
+			goto end;
+		}
+	}
+end:
+	return ret;
+}
+
+static
+void *thread_sample_evaluator(void *data)
+{
+	int ret;
+	struct notification_sample_shard *shard = data;
+
+	DBG("[notification-thread] Sample evaluator thread %u started",
+			shard->id);
+	rcu_register_thread();
+
+	for (;;) {
+		unsigned int i, count;
+
+		pthread_mutex_lock(&shard->queue_lock);
+		while (!shard->queue.count && !shard->queue.quit) {
+			pthread_cond_wait(&shard->queue_cond,
+					&shard->queue_lock);
+		}
+		if (shard->queue.quit) {
+			pthread_mutex_unlock(&shard->queue_lock);
+			break;
+		}
+		pthread_mutex_unlock(&shard->queue_lock);
+
+		/* The eval_lock nests outside of the queue_lock. */
+		pthread_mutex_lock(&shard->eval_lock);
+		pthread_mutex_lock(&shard->queue_lock);
+		count = shard->queue.count;
+		for (i = 0; i < count; i++) {
+			shard->batch[i].sample = shard->queue.samples[
+					(shard->queue.head + i) %
+					SAMPLE_SHARD_QUEUE_LEN];
+		}
+		shard->queue.head = (shard->queue.head + count) %
+				SAMPLE_SHARD_QUEUE_LEN;
+		shard->queue.count = 0;
+		pthread_mutex_unlock(&shard->queue_lock);
+
+		rcu_read_lock();
+		ret = sample_shard_evaluate_batch(shard, count);
+		rcu_read_unlock();
+		pthread_mutex_unlock(&shard->eval_lock);
+		if (ret) {
+			ERR("[notification-thread] Fatal error occurred while evaluating channel samples on evaluator thread %u",
+					shard->id);
+			uatomic_set(&shard->error, 1);
+			break;
+		}
+	}
+
+	rcu_unregister_thread();
+	DBG("[notification-thread] Sample evaluator thread %u exiting",
+			shard->id);
+	return NULL;
+}
+
+/*
+ * Create the sample shards of the notification thread's state. The samples
+ * are evaluated inline by the notification thread when `evaluator_threads`
+ * is 0.
+ */
+int notification_thread_sample_shards_create(
+		struct notification_thread_state *state,
+		unsigned int evaluator_threads)
+{
+	int ret = 0;
+	unsigned int i;
+
+	state->threaded_sample_evaluation = evaluator_threads > 0;
+	state->sample_shard_count = max_t(unsigned int, evaluator_threads, 1);
+	state->sample_shards = zmalloc(state->sample_shard_count *
+			sizeof(*state->sample_shards));
+	if (!state->sample_shards) {
+		state->sample_shard_count = 0;
+		ret = -1;
+		goto end;
+	}
+
+	for (i = 0; i < state->sample_shard_count; i++) {
+		struct notification_sample_shard *shard =
+				&state->sample_shards[i];
+
+		shard->state = state;
+		shard->id = i;
+		pthread_mutex_init(&shard->queue_lock, NULL);
+		pthread_cond_init(&shard->queue_cond, NULL);
+		pthread_mutex_init(&shard->eval_lock, NULL);
+		shard->states.slots = zmalloc(SAMPLE_SHARD_INITIAL_STATE_COUNT *
+				sizeof(*shard->states.slots));
+		if (!shard->states.slots) {
+			ret = -1;
+			goto end;
+		}
+		shard->states.capacity = SAMPLE_SHARD_INITIAL_STATE_COUNT;
+	}
+
+	if (!state->threaded_sample_evaluation) {
+		goto end;
+	}
+
+	for (i = 0; i < state->sample_shard_count; i++) {
+		struct notification_sample_shard *shard =
+				&state->sample_shards[i];
+
+		ret = pthread_create(&shard->thread, default_pthread_attr(),
+				thread_sample_evaluator, shard);
+		if (ret) {
+			errno = ret;
+			PERROR("pthread_create sample evaluator thread");
+			ret = -1;
+			goto end;
+		}
+		shard->thread_launched = true;
+	}
+	DBG("[notification-thread] Evaluating channel samples on %u threads",
+			state->sample_shard_count);
+end:
+	return ret;
+}
+
+/*
+ * Stop the evaluator threads and release the sample shards. Must be called
+ * before the rest of the notification thread's state is torn down.
+ */
+void notification_thread_sample_shards_destroy(
+		struct notification_thread_state *state)
+{
+	unsigned int i;
+
+	for (i = 0; i < state->sample_shard_count; i++) {
+		struct notification_sample_shard *shard =
+				&state->sample_shards[i];
+		int ret;
+
+		if (!shard->thread_launched) {
+			continue;
+		}
+
+		pthread_mutex_lock(&shard->queue_lock);
+		shard->queue.quit = true;
+		pthread_cond_signal(&shard->queue_cond);
+		pthread_mutex_unlock(&shard->queue_lock);
+
+		ret = pthread_join(shard->thread, NULL);
+		if (ret) {
+			errno = ret;
+			PERROR("pthread_join sample evaluator thread");
+		}
+	}
+
+	for (i = 0; i < state->sample_shard_count; i++) {
+		struct notification_sample_shard *shard =
+				&state->sample_shards[i];
+
+		if (state->threaded_sample_evaluation) {
+			MSG("Sample evaluator thread %u: %zu channels, %" PRIu64 " dropped samples, %" PRIu64 " late samples",
+					i, shard->states.count,
+					shard->dropped_samples,
+					shard->late_samples);
+		}
+		free(shard->states.slots);
+		pthread_mutex_destroy(&shard->eval_lock);
+		pthread_cond_destroy(&shard->queue_cond);
+		pthread_mutex_destroy(&shard->queue_lock);
+	}
+	free(state->sample_shards);
+	state->sample_shards = NULL;
+	state->sample_shard_count = 0;
+}
+
+/*
+ * Wait for the evaluator threads to be done with their current batch and
+ * prevent them from evaluating samples until the state is resumed.
+ */
+void notification_thread_state_quiesce(struct notification_thread_state *state)
+{
+	unsigned int i;
+
+	if (!state->threaded_sample_evaluation) {
+		return;
+	}
+
+	for (i = 0; i < state->sample_shard_count; i++) {
+		pthread_mutex_lock(&state->sample_shards[i].eval_lock);
+	}
+}
+
+void notification_thread_state_resume(struct notification_thread_state *state)
+{
+	unsigned int i;
+
+	if (!state->threaded_sample_evaluation) {
+		return;
+	}
+
+	for (i = state->sample_shard_count; i-- > 0;) {
+		pthread_mutex_unlock(&state->sample_shards[i].eval_lock);
+	}
+}
+
+/*
+ * Queue a sample to the evaluator thread of its shard.
+ */
+static
+void queue_channel_sample(struct notification_sample_shard *shard,
+		const struct channel_state_sample *sample)
+{
+	pthread_mutex_lock(&shard->queue_lock);
+	if (caa_unlikely(shard->queue.count == SAMPLE_SHARD_QUEUE_LEN)) {
+		shard->dropped_samples++;
+		DBG("[notification-thread] Sample queue of evaluator thread %u is full, dropping sample of channel key = %" PRIu64 " (%" PRIu64 " samples dropped)",
+				shard->id, sample->key.key,
+				shard->dropped_samples);
+	} else {
+		shard->queue.samples[(shard->queue.head + shard->queue.count) %
+				SAMPLE_SHARD_QUEUE_LEN] = *sample;
+		shard->queue.count++;
+		pthread_cond_signal(&shard->queue_cond);
+	}
+	pthread_mutex_unlock(&shard->queue_lock);
+}
+
+int handle_notification_thread_channel_sample(
+		struct notification_thread_state *state, int pipe,
+		enum lttng_domain_type domain)
+{
+	int ret = 0;
+	ssize_t read_ret;
+	unsigned int i, count;
+	struct lttcomm_consumer_channel_monitor_msg
+			sample_msgs[LTTCOMM_CONSUMER_CHANNEL_MONITOR_MSG_BATCH];
+
+	/*
+	 * The consumer daemons write batches of samples smaller than
+	 * PIPE_BUF, ensuring that read/write of sampling messages are
+	 * atomic. Read all the samples available, up to one batch.
+	 */
+	do {
+		read_ret = read(pipe, sample_msgs, sizeof(sample_msgs));
+	} while (read_ret == -1 && errno == EINTR);
+	if (read_ret <= 0 || read_ret % sizeof(sample_msgs[0])) {
+		ERR("[notification-thread] Failed to read from monitoring pipe (fd = %i)",
+				pipe);
+		ret = -1;
+		goto end;
+	}
+	count = read_ret / sizeof(sample_msgs[0]);
+
+	/* The inline evaluation uses the batch of the only shard. */
+	assert(count <= SAMPLE_SHARD_QUEUE_LEN);
+
+	for (i = 0; i < count; i++) {
+		struct notification_sample_shard *shard;
+		struct channel_state_sample latest_sample = {
+			.key.key = sample_msgs[i].key,
+			.key.domain = domain,
+			.highest_usage = sample_msgs[i].highest,
+			.lowest_usage = sample_msgs[i].lowest,
+			.channel_total_consumed = sample_msgs[i].total_consumed,
+		};
+
+		shard = get_sample_shard(state, &latest_sample.key);
+		if (!state->threaded_sample_evaluation) {
+			shard->batch[i].sample = latest_sample;
+			continue;
+		}
+
+		if (caa_unlikely(uatomic_read(&shard->error))) {
+			ret = -1;
+			goto end;
+		}
+		queue_channel_sample(shard, &latest_sample);
+	}
+
+	if (!state->threaded_sample_evaluation) {
+		rcu_read_lock();
+		ret = sample_shard_evaluate_batch(&state->sample_shards[0],
+				count);
+		rcu_read_unlock();
+	}
 end:
 	return ret;
 }
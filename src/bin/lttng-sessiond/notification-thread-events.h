@@ -44,4 +44,21 @@ int handle_notification_thread_channel_sample(
 		struct notification_thread_state *state, int pipe,
 		enum lttng_domain_type domain);
 
+int notification_thread_sample_shards_create(
+		struct notification_thread_state *state,
+		unsigned int evaluator_threads);
+
+void notification_thread_sample_shards_destroy(
+		struct notification_thread_state *state);
+
+/*
+ * The notification thread's state must be quiesced while it is modified
+ * by anything else than the reception of channel samples.
+ */
+void notification_thread_state_quiesce(
+		struct notification_thread_state *state);
+
+void notification_thread_state_resume(
+		struct notification_thread_state *state);
+
 #endif /* NOTIFICATION_THREAD_EVENTS_H */
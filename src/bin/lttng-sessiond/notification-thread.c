@@ -326,6 +326,8 @@ void fini_thread_state(struct notification_thread_state *state)
 {
 	int ret;
 
+	/* Stop the evaluator threads before tearing down what they use. */
+	notification_thread_sample_shards_destroy(state);
 	if (state->client_socket_ht) {
 		ret = handle_notification_thread_client_disconnect_all(state);
 		assert(!ret);
@@ -346,10 +348,6 @@ void fini_thread_state(struct notification_thread_state *state)
 		ret = cds_lfht_destroy(state->channel_triggers_ht, NULL);
 		assert(!ret);
 	}
-	if (state->channel_state_ht) {
-		ret = cds_lfht_destroy(state->channel_state_ht, NULL);
-		assert(!ret);
-	}
 	if (state->notification_trigger_clients_ht) {
 		ret = cds_lfht_destroy(state->notification_trigger_clients_ht,
 				NULL);
@@ -449,12 +447,6 @@ int init_thread_state(struct notification_thread_handle *handle,
 		goto error;
 	}
 
-	state->channel_state_ht = cds_lfht_new(DEFAULT_HT_SIZE, 1, 0,
-			CDS_LFHT_AUTO_RESIZE | CDS_LFHT_ACCOUNTING, NULL);
-	if (!state->channel_state_ht) {
-		goto error;
-	}
-
 	state->notification_trigger_clients_ht = cds_lfht_new(DEFAULT_HT_SIZE,
 			1, 0, CDS_LFHT_AUTO_RESIZE | CDS_LFHT_ACCOUNTING, NULL);
 	if (!state->notification_trigger_clients_ht) {
@@ -481,6 +473,12 @@ int init_thread_state(struct notification_thread_handle *handle,
 	if (!state->executor) {
 		goto error;
 	}
+
+	ret = notification_thread_sample_shards_create(state,
+			config.notification_evaluator_threads);
+	if (ret) {
+		goto error;
+	}
 	mark_thread_as_ready(handle);
 end:
 	return 0;
@@ -525,6 +523,39 @@ end:
 	return ret;
 }
 
+/*
+ * Handle activity on a client's socket.
+ */
+static
+int handle_client_activity(int fd, uint32_t revents,
+		struct notification_thread_state *state)
+{
+	int ret = 0;
+
+	if (revents & (LPOLLERR | LPOLLHUP | LPOLLRDHUP)) {
+		/*
+		 * It doesn't matter if a command was pending on the client
+		 * socket at this point since it now has no way to receive the
+		 * notifications to which it was subscribing or unsubscribing.
+		 */
+		ret = handle_notification_thread_client_disconnect(fd, state);
+		goto end;
+	}
+
+	if (revents & LPOLLIN) {
+		ret = handle_notification_thread_client_in(state, fd);
+		if (ret) {
+			goto end;
+		}
+	}
+
+	if (revents & LPOLLOUT) {
+		ret = handle_notification_thread_client_out(state, fd);
+	}
+end:
+	return ret;
+}
+
 /*
  * This thread services notification channel clients and commands received
  * from various lttng-sessiond components over a command queue.
@@ -582,8 +613,10 @@ void *thread_notification(void *data)
 
 			if (fd == state.notification_channel_socket) {
 				if (revents & LPOLLIN) {
+					notification_thread_state_quiesce(&state);
 					ret = handle_notification_thread_client_connect(
 							&state);
+					notification_thread_state_resume(&state);
 					if (ret < 0) {
 						goto error;
 					}
@@ -596,8 +629,10 @@ void *thread_notification(void *data)
 					goto error;
 				}
 			} else if (fd == lttng_pipe_get_readfd(handle->cmd_queue.event_pipe)) {
+				notification_thread_state_quiesce(&state);
 				ret = handle_notification_thread_command(handle,
 						&state);
+				notification_thread_state_resume(&state);
 				if (ret < 0) {
 					DBG("[notification-thread] Error encountered while servicing command queue");
 					goto error;
@@ -614,35 +649,12 @@ void *thread_notification(void *data)
 				}
 			} else {
 				/* Activity on a client's socket. */
-				if (revents & (LPOLLERR | LPOLLHUP | LPOLLRDHUP)) {
-					/*
-					 * It doesn't matter if a command was
-					 * pending on the client socket at this
-					 * point since it now has no way to
-					 * receive the notifications to which
-					 * it was subscribing or unsubscribing.
-					 */
-					ret = handle_notification_thread_client_disconnect(
-							fd, &state);
-					if (ret) {
-						goto error;
-					}
-				} else {
-					if (revents & LPOLLIN) {
-						ret = handle_notification_thread_client_in(
-							&state, fd);
-						if (ret) {
-							goto error;
-						}
-					}
-
-					if (revents & LPOLLOUT) {
-						ret = handle_notification_thread_client_out(
-							&state, fd);
-						if (ret) {
-							goto error;
-						}
-					}
+				notification_thread_state_quiesce(&state);
+				ret = handle_client_activity(fd, revents,
+						&state);
+				notification_thread_state_resume(&state);
+				if (ret) {
+					goto error;
 				}
 			}
 		}
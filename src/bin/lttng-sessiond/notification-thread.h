@@ -23,6 +23,8 @@
 
 typedef uint64_t notification_client_id;
 
+struct notification_sample_shard;
+
 struct notification_thread_handle {
 	/*
 	 * Queue of struct notification command.
@@ -81,13 +83,16 @@ struct notification_thread_handle {
  *             Likewise, the list is destroyed at the time of the session_info's
  *             destruction.
  *
- *   - channel_state_ht:
+ *   - sample_shards:
  *             associates a pair (channel key, channel domain) to its last
  *             sampled state received from the consumer daemon
- *             (struct channel_state).
+ *             (struct channel_state_sample).
  *             This previous sample is kept to implement edge-triggered
  *             conditions as we need to detect the state transitions.
- *             This hash table owns the channel state.
+ *             The channels are distributed to shards by the hash of their
+ *             key; each shard keeps the states in an open-addressing array
+ *             which it owns and, optionally, evaluates the samples of its
+ *             channels on its own thread.
  *
  *   - notification_trigger_clients_ht:
  *             associates notification-emitting triggers to clients
@@ -140,7 +145,7 @@ struct notification_thread_handle {
  * 2) Destruction of a tracing channel
  *    - remove entry from channel_triggers_ht, releasing the list wrapper and
  *      elements,
- *    - remove entry from the channel_state_ht.
+ *    - remove the channel's state from its sample shard.
  *    - remove channel from channels_ht
  *    - if it was the last known channel of a session, the session_info
  *      structure is torndown, which in return destroys the list of triggers
@@ -166,6 +171,8 @@ struct notification_thread_handle {
  *    - remove trigger from triggers_ht
  *
  * 5) Reception of a channel monitor sample from the consumer daemon
+ *    - queue the sample to the evaluator thread of the channel's sample
+ *      shard, or evaluate it inline when no evaluator thread is used,
  *    - evaluate the conditions associated with the triggers found in
  *      the channel_triggers_ht,
  *      - if a condition evaluates to "true" and the condition is of type
@@ -197,6 +204,9 @@ struct notification_thread_handle {
  *    - Remove the condition from the client's list of subscribed conditions,
  *    - Look-up notification_trigger_clients_ht and remove the client
  *      from the list of clients.
+ *
+ * The evaluator threads only read the hash tables above. The notification
+ * thread quiesces them while it handles any other event.
  */
 struct notification_thread_state {
 	int notification_channel_socket;
@@ -205,13 +215,16 @@ struct notification_thread_state {
 	struct cds_lfht *client_id_ht;
 	struct cds_lfht *channel_triggers_ht;
 	struct cds_lfht *session_triggers_ht;
-	struct cds_lfht *channel_state_ht;
 	struct cds_lfht *notification_trigger_clients_ht;
 	struct cds_lfht *channels_ht;
 	struct cds_lfht *sessions_ht;
 	struct cds_lfht *triggers_ht;
 	notification_client_id next_notification_client_id;
 	struct action_executor *executor;
+	struct notification_sample_shard *sample_shards;
+	unsigned int sample_shard_count;
+	/* Samples are evaluated by the shards' evaluator threads. */
+	bool threaded_sample_evaluation;
 };
 
 /* notification_thread_data takes ownership of the channel monitor pipes. */
@@ -25,6 +25,9 @@ struct sessiond_config sessiond_config_build_defaults = {
 
 	.agent_tcp_port = 			{ .begin = DEFAULT_AGENT_TCP_PORT_RANGE_BEGIN, .end = DEFAULT_AGENT_TCP_PORT_RANGE_END },
 	.app_socket_timeout = 			DEFAULT_APP_SOCKET_RW_TIMEOUT,
+	.app_sync_threads =			DEFAULT_APP_SYNC_THREADS,
+	.client_command_threads =		DEFAULT_CLIENT_COMMAND_THREADS,
+	.notification_evaluator_threads =	DEFAULT_NOTIFICATION_EVALUATOR_THREADS,
 
 	.no_kernel = 				false,
 	.background = 				false,
@@ -92,6 +95,42 @@ void config_string_set(struct config_string *config_str, char *value)
 	config_str->value = value;
 }
 
+/*
+ * Set `value` from the `name` environment variable, if it is set, which must
+ * hold a decimal integer of at least `min`.
+ *
+ * Return 0 on success or if the variable is not set, -1 if its value is
+ * invalid.
+ */
+static
+int config_get_env_uint(const char *name, unsigned int min,
+		unsigned int *value)
+{
+	int ret = 0;
+	char *endptr;
+	unsigned long parsed_value;
+	const char *env_value = getenv(name);
+
+	if (!env_value) {
+		goto end;
+	}
+
+	errno = 0;
+	parsed_value = strtoul(env_value, &endptr, 10);
+	if (errno != 0 || *endptr != '\0' || endptr == env_value ||
+			!isdigit((unsigned char) *env_value) ||
+			parsed_value < min || parsed_value > UINT_MAX) {
+		ERR("Invalid value \"%s\" used for \"%s\" environment variable",
+				env_value, name);
+		ret = -1;
+		goto end;
+	}
+
+	*value = (unsigned int) parsed_value;
+end:
+	return ret;
+}
+
 LTTNG_HIDDEN
 int sessiond_config_apply_env_config(struct sessiond_config *config)
 {
@@ -116,6 +155,24 @@ int sessiond_config_apply_env_config(struct sessiond_config *config)
 		config->app_socket_timeout = int_val;
 	}
 
+	ret = config_get_env_uint(DEFAULT_APP_SYNC_THREADS_ENV, 1,
+			&config->app_sync_threads);
+	if (ret) {
+		goto end;
+	}
+
+	ret = config_get_env_uint(DEFAULT_CLIENT_COMMAND_THREADS_ENV, 1,
+			&config->client_command_threads);
+	if (ret) {
+		goto end;
+	}
+
+	ret = config_get_env_uint(DEFAULT_NOTIFICATION_EVALUATOR_THREADS_ENV, 0,
+			&config->notification_evaluator_threads);
+	if (ret) {
+		goto end;
+	}
+
 	env_value = lttng_secure_getenv("LTTNG_CONSUMERD32_BIN");
 	if (env_value) {
 		config_string_set_static(&config->consumerd32_bin_path,
@@ -512,6 +569,9 @@ void sessiond_config_log(struct sessiond_config *config)
 				config->agent_tcp_port.end);
 	}
 	DBG_NO_LOC("\tapplication socket timeout:    %i", config->app_socket_timeout);
+	DBG_NO_LOC("\tapplication sync threads:      %u", config->app_sync_threads);
+	DBG_NO_LOC("\tclient command threads:        %u", config->client_command_threads);
+	DBG_NO_LOC("\tnotification evaluator threads: %u", config->notification_evaluator_threads);
 	DBG_NO_LOC("\tno-kernel:                     %s", config->no_kernel ? "True" : "False");
 	DBG_NO_LOC("\tbackground:                    %s", config->background ? "True" : "False");
 	DBG_NO_LOC("\tdaemonize:                     %s", config->daemonize ? "True" : "False");
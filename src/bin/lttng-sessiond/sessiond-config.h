@@ -31,6 +31,15 @@ struct sessiond_config {
 	struct config_int_range agent_tcp_port;
 	/* Socket timeout for receiving and sending (in seconds). */
 	int app_socket_timeout;
+	/* Number of threads synchronizing applications concurrently. */
+	unsigned int app_sync_threads;
+	/* Number of threads processing client commands concurrently. */
+	unsigned int client_command_threads;
+	/*
+	 * Number of threads evaluating the channel samples of the
+	 * notification thread. 0 evaluates them on the notification thread.
+	 */
+	unsigned int notification_evaluator_threads;
 
 	bool quiet;
 	bool no_kernel;
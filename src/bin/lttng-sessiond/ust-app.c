@@ -21,6 +21,7 @@
 
 #include <common/common.h>
 #include <common/sessiond-comm/sessiond-comm.h>
+#include <common/dynamic-array.h>
 
 #include "buffer-registry.h"
 #include "fd-limit.h"
@@ -34,6 +35,7 @@
 #include "lttng-sessiond.h"
 #include "notification-thread-commands.h"
 #include "rotate.h"
+#include "thread.h"
 
 struct lttng_ht *ust_app_ht;
 struct lttng_ht *ust_app_ht_by_sock;
@@ -50,6 +52,14 @@ static pthread_mutex_t next_channel_key_lock = PTHREAD_MUTEX_INITIALIZER;
 static uint64_t _next_session_id;
 static pthread_mutex_t next_session_id_lock = PTHREAD_MUTEX_INITIALIZER;
 
+/*
+ * Serializes the lookup and creation of the per-UID buffer registries and of
+ * their channels, as well as the updates of the list of per-UID buffer
+ * registries of a session, since the applications of a session are
+ * synchronized concurrently.
+ */
+static pthread_mutex_t buffer_reg_uid_setup_lock = PTHREAD_MUTEX_INITIALIZER;
+
 /*
  * Return the incremented value of next_channel_key.
  */
@@ -2040,6 +2050,7 @@ static int setup_buffer_reg_uid(struct ltt_ust_session *usess,
 	assert(app);
 
 	rcu_read_lock();
+	pthread_mutex_lock(&buffer_reg_uid_setup_lock);
 
 	reg_uid = buffer_reg_uid_find(usess->id, app->bits_per_long, app->uid);
 	if (!reg_uid) {
@@ -2087,6 +2098,7 @@ end:
 		*regp = reg_uid;
 	}
 error:
+	pthread_mutex_unlock(&buffer_reg_uid_setup_lock);
 	rcu_read_unlock();
 	return ret;
 }
@@ -2792,31 +2804,27 @@ error:
 }
 
 /*
- * Create and send to the application the created buffers with per UID buffers.
+ * Find the buffer registry channel of a channel with per UID buffers, creating
+ * it and its buffers on the consumer side if needed.
  *
- * This MUST be called with a RCU read side lock acquired.
+ * This MUST be called with a RCU read side lock acquired and the
+ * buffer_reg_uid_setup_lock held.
  * The session list lock and the session's lock must be acquired.
  *
  * Return 0 on success else a negative value.
  */
-static int create_channel_per_uid(struct ust_app *app,
+static int find_or_create_reg_channel_per_uid(struct ust_app *app,
 		struct ltt_ust_session *usess, struct ust_app_session *ua_sess,
-		struct ust_app_channel *ua_chan)
+		struct ust_app_channel *ua_chan,
+		struct buffer_reg_channel **reg_chanp)
 {
-	int ret;
+	int ret = 0;
 	struct buffer_reg_uid *reg_uid;
 	struct buffer_reg_channel *reg_chan;
 	struct ltt_session *session = NULL;
 	enum lttng_error_code notification_ret;
 	struct ust_registry_channel *chan_reg;
 
-	assert(app);
-	assert(usess);
-	assert(ua_sess);
-	assert(ua_chan);
-
-	DBG("UST app creating channel %s with per UID buffers", ua_chan->name);
-
 	reg_uid = buffer_reg_uid_find(usess->id, app->bits_per_long, app->uid);
 	/*
 	 * The session creation handles the creation of this global registry
@@ -2828,7 +2836,7 @@ static int create_channel_per_uid(struct ust_app *app,
 	reg_chan = buffer_reg_channel_find(ua_chan->tracing_channel_id,
 			reg_uid);
 	if (reg_chan) {
-		goto send_channel;
+		goto end;
 	}
 
 	/* Create the buffer registry channel object. */
@@ -2897,7 +2905,49 @@ static int create_channel_per_uid(struct ust_app *app,
 		goto error;
 	}
 
-send_channel:
+end:
+	*reg_chanp = reg_chan;
+error:
+	if (session) {
+		session_put(session);
+	}
+	return ret;
+}
+
+/*
+ * Create and send to the application the created buffers with per UID buffers.
+ *
+ * This MUST be called with a RCU read side lock acquired.
+ * The session list lock and the session's lock must be acquired.
+ *
+ * Return 0 on success else a negative value.
+ */
+static int create_channel_per_uid(struct ust_app *app,
+		struct ltt_ust_session *usess, struct ust_app_session *ua_sess,
+		struct ust_app_channel *ua_chan)
+{
+	int ret;
+	struct buffer_reg_channel *reg_chan;
+
+	assert(app);
+	assert(usess);
+	assert(ua_sess);
+	assert(ua_chan);
+
+	DBG("UST app creating channel %s with per UID buffers", ua_chan->name);
+
+	/*
+	 * The other applications of the session sharing this registry may be
+	 * synchronized concurrently; the first one creates the buffers.
+	 */
+	pthread_mutex_lock(&buffer_reg_uid_setup_lock);
+	ret = find_or_create_reg_channel_per_uid(app, usess, ua_sess, ua_chan,
+			&reg_chan);
+	pthread_mutex_unlock(&buffer_reg_uid_setup_lock);
+	if (ret < 0) {
+		goto error;
+	}
+
 	/* Send buffers to the application. */
 	ret = send_channel_uid_to_ust(reg_chan, app, ua_sess, ua_chan);
 	if (ret < 0) {
@@ -2908,9 +2958,6 @@ send_channel:
 	}
 
 error:
-	if (session) {
-		session_put(session);
-	}
 	return ret;
 }
 
@@ -4852,9 +4899,6 @@ end:
  */
 int ust_app_start_trace_all(struct ltt_ust_session *usess)
 {
-	struct lttng_ht_iter iter;
-	struct ust_app *app;
-
 	DBG("Starting all UST traces");
 
 	/*
@@ -4873,12 +4917,10 @@ int ust_app_start_trace_all(struct ltt_ust_session *usess)
 	 */
 	(void) ust_app_clear_quiescent_session(usess);
 
-	cds_lfht_for_each_entry(ust_app_ht->ht, &iter.iter, app, pid_n.node) {
-		ust_app_global_update(usess, app);
-	}
-
 	rcu_read_unlock();
 
+	ust_app_global_update_all(usess);
+
 	return 0;
 }
 
@@ -5004,7 +5046,7 @@ end:
  * by the process attribute trackers.
  */
 static
-void ust_app_synchronize(struct ltt_ust_session *usess,
+int ust_app_synchronize(struct ltt_ust_session *usess,
 		struct ust_app *app)
 {
 	int ret = 0;
@@ -5080,7 +5122,7 @@ void ust_app_synchronize(struct ltt_ust_session *usess,
 end:
 	pthread_mutex_unlock(&ua_sess->lock);
 	/* Everything went well at this point. */
-	return;
+	return 0;
 
 error_unlock:
 	rcu_read_unlock();
@@ -5089,7 +5131,7 @@ error:
 	if (ua_sess) {
 		destroy_app_session(app, ua_sess);
 	}
-	return;
+	return ret;
 }
 
 static
@@ -5109,9 +5151,14 @@ void ust_app_global_destroy(struct ltt_ust_session *usess, struct ust_app *app)
  *
  * Called with session lock held.
  * Called with RCU read-side lock held.
+ *
+ * Return 0 on success or else a negative value if the application could not
+ * be synchronized or started.
  */
-void ust_app_global_update(struct ltt_ust_session *usess, struct ust_app *app)
+static int global_update(struct ltt_ust_session *usess, struct ust_app *app)
 {
+	int ret = 0;
+
 	assert(usess);
 	assert(usess->active);
 
@@ -5119,7 +5166,7 @@ void ust_app_global_update(struct ltt_ust_session *usess, struct ust_app *app)
 			app->sock, usess->id);
 
 	if (!app->compatible) {
-		return;
+		goto end;
 	}
 	if (trace_ust_id_tracker_lookup(LTTNG_PROCESS_ATTR_VIRTUAL_PROCESS_ID,
 			    usess, app->pid) &&
@@ -5133,26 +5180,337 @@ void ust_app_global_update(struct ltt_ust_session *usess, struct ust_app *app)
 		 * Synchronize the application's internal tracing configuration
 		 * and start tracing.
 		 */
-		ust_app_synchronize(usess, app);
-		ust_app_start_trace(usess, app);
+		ret = ust_app_synchronize(usess, app);
+		if (ret < 0) {
+			goto end;
+		}
+		ret = ust_app_start_trace(usess, app);
 	} else {
 		ust_app_global_destroy(usess, app);
 	}
+end:
+	return ret;
+}
+
+/*
+ * Same as global_update(), for callers which do not report errors.
+ */
+void ust_app_global_update(struct ltt_ust_session *usess, struct ust_app *app)
+{
+	(void) global_update(usess, app);
+}
+
+/*
+ * Set of synchronization jobs shared by the application synchronization
+ * threads.
+ */
+struct ust_app_sync_pool {
+	/* Number of jobs. */
+	unsigned int count;
+	/* Index of the next job to run. */
+	unsigned int next;
+	/* Number of jobs which failed. */
+	unsigned int failed;
+	int (*sync)(unsigned int index, void *data);
+	void *data;
+};
+
+/*
+ * Run the jobs of the pool until all of them have been claimed.
+ */
+static void ust_app_sync_pool_work(struct ust_app_sync_pool *pool)
+{
+	for (;;) {
+		const unsigned int index =
+				uatomic_add_return(&pool->next, 1) - 1;
+
+		if (index >= pool->count) {
+			break;
+		}
+
+		rcu_read_lock();
+		if (pool->sync(index, pool->data)) {
+			uatomic_inc(&pool->failed);
+		}
+		rcu_read_unlock();
+		health_code_update();
+	}
+}
+
+/*
+ * Application synchronization threads, launched with the session daemon and
+ * shared by all synchronization runs. One run is posted to them at a time.
+ */
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t run_cond;
+	pthread_cond_t done_cond;
+	/* Jobs of the posted run, NULL if none. */
+	struct ust_app_sync_pool *pool;
+	/* Incremented every time a run is posted. */
+	uint64_t run_id;
+	/* Number of threads working on the posted run. */
+	unsigned int nb_busy_threads;
+	bool quit;
+} sync_threads = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.run_cond = PTHREAD_COND_INITIALIZER,
+	.done_cond = PTHREAD_COND_INITIALIZER,
+};
+
+/*
+ * Entry point of the application synchronization threads.
+ */
+static void *thread_ust_app_sync(void *data)
+{
+	uint64_t last_run_id = 0;
+
+	rcu_register_thread();
+
+	pthread_mutex_lock(&sync_threads.lock);
+	for (;;) {
+		struct ust_app_sync_pool *pool;
+
+		if (sync_threads.quit) {
+			break;
+		}
+
+		if (!sync_threads.pool || sync_threads.run_id == last_run_id) {
+			pthread_cond_wait(&sync_threads.run_cond,
+					&sync_threads.lock);
+			continue;
+		}
+
+		pool = sync_threads.pool;
+		last_run_id = sync_threads.run_id;
+		sync_threads.nb_busy_threads++;
+		pthread_mutex_unlock(&sync_threads.lock);
+
+		ust_app_sync_pool_work(pool);
+
+		pthread_mutex_lock(&sync_threads.lock);
+		sync_threads.nb_busy_threads--;
+		pthread_cond_signal(&sync_threads.done_cond);
+	}
+	pthread_mutex_unlock(&sync_threads.lock);
+
+	rcu_unregister_thread();
+	return NULL;
+}
+
+static bool shutdown_ust_app_sync_thread(void *data)
+{
+	pthread_mutex_lock(&sync_threads.lock);
+	sync_threads.quit = true;
+	pthread_cond_broadcast(&sync_threads.run_cond);
+	pthread_mutex_unlock(&sync_threads.lock);
+	return true;
+}
+
+/*
+ * Launch the threads helping the client and dispatch threads synchronize the
+ * applications: one less than the configured number of application
+ * synchronization threads.
+ */
+bool launch_ust_app_sync_threads(void)
+{
+	unsigned int i;
+
+	for (i = 1; i < config.app_sync_threads; i++) {
+		struct lttng_thread *thread;
+
+		thread = lttng_thread_create("Application synchronization",
+				thread_ust_app_sync,
+				shutdown_ust_app_sync_thread,
+				NULL, NULL);
+		if (!thread) {
+			return false;
+		}
+		lttng_thread_put(thread);
+	}
+	return true;
+}
+
+/*
+ * Run the jobs of the pool with the application synchronization threads. The
+ * calling thread runs jobs too and this returns once all of them are done.
+ *
+ * The threads work on one run at a time: if they are busy with the run of
+ * another caller, the calling thread runs all the jobs itself.
+ *
+ * Each job works on its own application or session. The per-UID buffer
+ * registries shared by the applications of a session are set up under
+ * buffer_reg_uid_setup_lock.
+ */
+static void ust_app_sync_pool_run(struct ust_app_sync_pool *pool)
+{
+	bool posted = false;
+
+	pthread_mutex_lock(&sync_threads.lock);
+	if (pool->count > 1 && !sync_threads.pool && !sync_threads.quit) {
+		sync_threads.pool = pool;
+		sync_threads.run_id++;
+		pthread_cond_broadcast(&sync_threads.run_cond);
+		posted = true;
+	}
+	pthread_mutex_unlock(&sync_threads.lock);
+
+	ust_app_sync_pool_work(pool);
+
+	if (!posted) {
+		return;
+	}
+
+	/* Keep the threads from joining and wait for those which did. */
+	pthread_mutex_lock(&sync_threads.lock);
+	sync_threads.pool = NULL;
+	while (sync_threads.nb_busy_threads > 0) {
+		pthread_cond_wait(&sync_threads.done_cond, &sync_threads.lock);
+	}
+	pthread_mutex_unlock(&sync_threads.lock);
+}
+
+struct sync_apps_data {
+	struct ltt_ust_session *usess;
+	struct lttng_dynamic_pointer_array apps;
+};
+
+/*
+ * Synchronize the application at index of an array of applications.
+ */
+static int sync_app(unsigned int index, void *data)
+{
+	int ret;
+	struct sync_apps_data *sync_data = data;
+	struct ust_app *app = lttng_dynamic_pointer_array_get_pointer(
+			&sync_data->apps, index);
+
+	ret = global_update(sync_data->usess, app);
+	if (ret < 0) {
+		WARN("Failed to synchronize application %s (pid: %d) with session id %" PRIu64,
+				app->name, app->pid, sync_data->usess->id);
+	}
+	return ret;
 }
 
 /*
+ * Synchronize and start all registered applications, concurrently.
+ *
  * Called with session lock held.
  */
 void ust_app_global_update_all(struct ltt_ust_session *usess)
 {
+	int ret;
 	struct lttng_ht_iter iter;
 	struct ust_app *app;
+	struct sync_apps_data sync_data = {
+		.usess = usess,
+	};
+	struct ust_app_sync_pool pool = {
+		.sync = sync_app,
+		.data = &sync_data,
+	};
+
+	lttng_dynamic_pointer_array_init(&sync_data.apps, NULL);
 
+	/*
+	 * The RCU read-side lock is held until all jobs are done, which
+	 * guarantees the existence of the applications gathered here.
+	 */
 	rcu_read_lock();
+	cds_lfht_for_each_entry(ust_app_ht->ht, &iter.iter, app, pid_n.node) {
+		ret = lttng_dynamic_pointer_array_add_pointer(
+				&sync_data.apps, app);
+		if (ret) {
+			goto error;
+		}
+	}
+
+	pool.count = lttng_dynamic_pointer_array_get_count(&sync_data.apps);
+	ust_app_sync_pool_run(&pool);
+
+	DBG("UST app global update of session id %" PRIu64 " done: %u applications, %u failed",
+			usess->id, pool.count, pool.failed);
+	goto end;
+
+error:
+	/* Fall back to updating the applications one at a time. */
+	ERR("Failed to gather the applications of session id %" PRIu64,
+			usess->id);
 	cds_lfht_for_each_entry(ust_app_ht->ht, &iter.iter, app, pid_n.node) {
 		ust_app_global_update(usess, app);
 	}
+end:
 	rcu_read_unlock();
+	lttng_dynamic_pointer_array_reset(&sync_data.apps);
+}
+
+struct sync_sessions_data {
+	const struct lttng_dynamic_pointer_array *sessions;
+	int app_sock;
+};
+
+/*
+ * Synchronize an application with the session at index of an array of
+ * sessions.
+ */
+static int sync_session(unsigned int index, void *data)
+{
+	int ret = 0;
+	const struct sync_sessions_data *sync_data = data;
+	struct ltt_session *session = lttng_dynamic_pointer_array_get_pointer(
+			sync_data->sessions, index);
+	struct ust_app *app;
+
+	session_lock(session);
+	if (!session->active || !session->ust_session) {
+		goto end;
+	}
+
+	app = ust_app_find_by_sock(sync_data->app_sock);
+	if (!app) {
+		/*
+		 * Application can be unregistered before so this is possible
+		 * hence simply stopping the update.
+		 */
+		DBG3("UST app update failed to find app sock %d",
+				sync_data->app_sock);
+		goto end;
+	}
+	ret = global_update(session->ust_session, app);
+	if (ret < 0) {
+		WARN("Failed to synchronize application %s (pid: %d) with session \"%s\"",
+				app->name, app->pid, session->name);
+	}
+end:
+	session_unlock(session);
+	return ret;
+}
+
+/*
+ * Synchronize a newly registered application with the given sessions,
+ * concurrently.
+ *
+ * The session list lock must be held by the caller and a reference to each
+ * session must be held.
+ */
+void ust_app_global_update_sessions(int app_sock,
+		const struct lttng_dynamic_pointer_array *sessions)
+{
+	struct sync_sessions_data sync_data = {
+		.sessions = sessions,
+		.app_sock = app_sock,
+	};
+	struct ust_app_sync_pool pool = {
+		.count = lttng_dynamic_pointer_array_get_count(sessions),
+		.sync = sync_session,
+		.data = &sync_data,
+	};
+
+	ust_app_sync_pool_run(&pool);
+
+	DBG("UST app sock %d update done: %u sessions, %u failed",
+			app_sock, pool.count, pool.failed);
 }
 
 /*
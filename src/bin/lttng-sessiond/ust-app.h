@@ -319,6 +319,9 @@ int ust_app_add_ctx_channel_glb(struct ltt_ust_session *usess,
 		struct ltt_ust_channel *uchan, struct ltt_ust_context *uctx);
 void ust_app_global_update(struct ltt_ust_session *usess, struct ust_app *app);
 void ust_app_global_update_all(struct ltt_ust_session *usess);
+void ust_app_global_update_sessions(int app_sock,
+		const struct lttng_dynamic_pointer_array *sessions);
+bool launch_ust_app_sync_threads(void);
 
 void ust_app_clean_list(void);
 int ust_app_ht_alloc(void);
@@ -444,6 +447,15 @@ static inline
 void ust_app_global_update(struct ltt_ust_session *usess, struct ust_app *app)
 {}
 static inline
+void ust_app_global_update_sessions(int app_sock,
+		const struct lttng_dynamic_pointer_array *sessions)
+{}
+static inline
+bool launch_ust_app_sync_threads(void)
+{
+	return true;
+}
+static inline
 int ust_app_disable_channel_glb(struct ltt_ust_session *usess,
 		struct ltt_ust_channel *uchan)
 {
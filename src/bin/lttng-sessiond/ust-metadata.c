@@ -79,15 +79,15 @@ int get_count_order(unsigned int count)
 }
 
 /*
- * Returns offset where to write in metadata array, or negative error value on error.
+ * Grow the metadata array so it can hold at least 'len' bytes.
+ *
+ * Returns 0 on success, or negative error value on error.
  */
 static
-ssize_t metadata_reserve(struct ust_registry_session *session, size_t len)
+int metadata_grow(struct ust_registry_session *session, size_t len)
 {
-	size_t new_len = session->metadata_len + len;
-	size_t new_alloc_len = new_len;
+	size_t new_alloc_len = len;
 	size_t old_alloc_len = session->metadata_alloc_len;
-	ssize_t ret;
 
 	if (new_alloc_len > (UINT32_MAX >> 1))
 		return -EINVAL;
@@ -107,67 +107,96 @@ ssize_t metadata_reserve(struct ust_registry_session *session, size_t len)
 		memset(&session->metadata[old_alloc_len], 0, new_alloc_len - old_alloc_len);
 		session->metadata_alloc_len = new_alloc_len;
 	}
-	ret = session->metadata_len;
-	session->metadata_len += len;
-	return ret;
+	return 0;
 }
 
+/*
+ * Append the metadata generated since 'start' to the metadata file.
+ *
+ * The metadata generated by a statedump is written in a single write to
+ * the file rather than one write per line.
+ */
 static
-int metadata_file_append(struct ust_registry_session *session,
-		const char *str, size_t len)
+int metadata_file_flush(struct ust_registry_session *session, size_t start)
 {
 	ssize_t written;
+	const size_t len = session->metadata_len - start;
 
-	if (session->metadata_fd < 0) {
+	if (session->metadata_fd < 0 || len == 0) {
 		return 0;
 	}
 	/* Write to metadata file */
-	written = lttng_write(session->metadata_fd, str, len);
+	written = lttng_write(session->metadata_fd,
+			&session->metadata[start], len);
 	if (written != len) {
+		PERROR("Error appending to metadata file");
 		return -1;
 	}
 	return 0;
 }
 
+/*
+ * Completes a statedump started at 'start': flushes what was generated to
+ * the metadata file, even on error, as was done line per line before.
+ *
+ * Returns 'ret' if it is an error, else the result of the flush.
+ */
+static
+int metadata_statedump_end(struct ust_registry_session *session,
+		size_t start, int ret)
+{
+	const int flush_ret = metadata_file_flush(session, start);
+
+	return ret ? ret : flush_ret;
+}
+
 /*
  * We have exclusive access to our metadata buffer (protected by the
  * ust_lock), so we can do racy operations such as looking for
  * remaining space left in packet and write, since mutual exclusion
  * protects us from concurrent writes.
+ *
+ * The output is formatted directly at the end of the metadata array. It is
+ * only formatted a second time if the array had to grow to hold it.
  */
 static
 int lttng_metadata_printf(struct ust_registry_session *session,
 		const char *fmt, ...)
 {
-	char *str = NULL;
-	size_t len;
+	char *str;
+	size_t len, available;
 	va_list ap;
-	ssize_t offset;
 	int ret;
 
+	available = session->metadata_alloc_len - session->metadata_len;
 	va_start(ap, fmt);
-	ret = vasprintf(&str, fmt, ap);
+	ret = vsnprintf(available ? &session->metadata[session->metadata_len] : NULL,
+			available, fmt, ap);
 	va_end(ap);
 	if (ret < 0)
-		return -ENOMEM;
+		return -EINVAL;
 
-	len = strlen(str);
-	offset = metadata_reserve(session, len);
-	if (offset < 0) {
-		ret = offset;
-		goto end;
-	}
-	memcpy(&session->metadata[offset], str, len);
-	ret = metadata_file_append(session, str, len);
-	if (ret) {
-		PERROR("Error appending to metadata file");
-		goto end;
+	len = ret;
+	/* Keep room for the null terminator written by vsnprintf(). */
+	if (len >= available) {
+		ret = metadata_grow(session, session->metadata_len + len + 1);
+		if (ret) {
+			goto end;
+		}
+
+		va_start(ap, fmt);
+		ret = vsnprintf(&session->metadata[session->metadata_len],
+				len + 1, fmt, ap);
+		va_end(ap);
+		assert((size_t) ret == len);
 	}
+	/* The null terminator lies in the zeroed area past metadata_len. */
+	str = &session->metadata[session->metadata_len];
+	session->metadata_len += len;
 	DBG3("Append to metadata: \"%s\"", str);
 	ret = 0;
 
 end:
-	free(str);
 	return ret;
 }
 
@@ -873,6 +902,7 @@ int ust_metadata_event_statedump(struct ust_registry_session *session,
 		struct ust_registry_event *event)
 {
 	int ret = 0;
+	const size_t metadata_start = session->metadata_len;
 
 	/* Don't dump metadata events */
 	if (chan->chan_id == -1U)
@@ -927,7 +957,7 @@ int ust_metadata_event_statedump(struct ust_registry_session *session,
 	event->metadata_dumped = 1;
 
 end:
-	return ret;
+	return metadata_statedump_end(session, metadata_start, ret);
 }
 
 /*
@@ -937,6 +967,7 @@ int ust_metadata_channel_statedump(struct ust_registry_session *session,
 		struct ust_registry_channel *chan)
 {
 	int ret = 0;
+	const size_t metadata_start = session->metadata_len;
 
 	/* Don't dump metadata events */
 	if (chan->chan_id == -1U)
@@ -985,7 +1016,7 @@ int ust_metadata_channel_statedump(struct ust_registry_session *session,
 	chan->metadata_dumped = 1;
 
 end:
-	return ret;
+	return metadata_statedump_end(session, metadata_start, ret);
 }
 
 static
@@ -1211,8 +1242,10 @@ int ust_metadata_session_statedump(struct ust_registry_session *session,
 	char uuid_s[LTTNG_UUID_STR_LEN],
 		clock_uuid_s[LTTNG_UUID_STR_LEN];
 	int ret = 0;
+	size_t metadata_start;
 
 	assert(session);
+	metadata_start = session->metadata_len;
 
 	lttng_uuid_to_str(session->uuid, uuid_s);
 
@@ -1369,5 +1402,5 @@ int ust_metadata_session_statedump(struct ust_registry_session *session,
 	}
 
 end:
-	return ret;
+	return metadata_statedump_end(session, metadata_start, ret);
 }
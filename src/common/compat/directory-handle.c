@@ -43,6 +43,10 @@ int _run_as_open(const struct lttng_directory_handle *handle,
 		const char *filename,
 		int flags, mode_t mode, uid_t uid, gid_t gid);
 static
+int _run_as_open_batch(const struct lttng_directory_handle *handle,
+		const char **filenames, unsigned int count,
+		int flags, mode_t mode, uid_t uid, gid_t gid, int *fds);
+static
 int lttng_directory_handle_unlink(
 		const struct lttng_directory_handle *handle,
 		const char *filename);
@@ -78,6 +82,41 @@ void lttng_directory_handle_invalidate(struct lttng_directory_handle *handle);
 static
 void lttng_directory_handle_release(struct urcu_ref *ref);
 
+/*
+ * Open files relative to a directory handle one at a time, as a given user if
+ * creds is not NULL. Either all the files are opened or none of them.
+ */
+static
+int open_files_one_by_one(const struct lttng_directory_handle *handle,
+		const char **filenames, unsigned int count,
+		int flags, mode_t mode, const struct lttng_credentials *creds,
+		int *fds)
+{
+	int ret = 0, saved_errno;
+	unsigned int i, opened;
+
+	for (opened = 0; opened < count; opened++) {
+		fds[opened] = lttng_directory_handle_open_file_as_user(handle,
+				filenames[opened], flags, mode, creds);
+		if (fds[opened] < 0) {
+			ret = -1;
+			goto error;
+		}
+	}
+	goto end;
+error:
+	saved_errno = errno;
+	for (i = 0; i < opened; i++) {
+		if (close(fds[i])) {
+			PERROR("Failed to close file descriptor");
+		}
+		fds[i] = -1;
+	}
+	errno = saved_errno;
+end:
+	return ret;
+}
+
 #ifdef COMPAT_DIRFD
 
 /*
@@ -274,6 +313,25 @@ int _run_as_open(const struct lttng_directory_handle *handle,
 	return run_as_openat(handle->dirfd, filename, flags, mode, uid, gid);
 }
 
+static
+int _run_as_open_batch(const struct lttng_directory_handle *handle,
+		const char **filenames, unsigned int count,
+		int flags, mode_t mode, uid_t uid, gid_t gid, int *fds)
+{
+	if (handle->dirfd == AT_FDCWD) {
+		const struct lttng_credentials creds = {
+			.uid = uid,
+			.gid = gid,
+		};
+
+		/* The batch command needs a directory file descriptor. */
+		return open_files_one_by_one(handle, filenames, count, flags,
+				mode, &creds, fds);
+	}
+	return run_as_openat_batch(handle->dirfd, filenames, count, flags,
+			mode, uid, gid, fds);
+}
+
 static
 int _run_as_unlink(const struct lttng_directory_handle *handle,
 		const char *filename, uid_t uid, gid_t gid)
@@ -724,6 +782,20 @@ end:
 	return ret;
 }
 
+static
+int _run_as_open_batch(const struct lttng_directory_handle *handle,
+		const char **filenames, unsigned int count,
+		int flags, mode_t mode, uid_t uid, gid_t gid, int *fds)
+{
+	const struct lttng_credentials creds = {
+		.uid = uid,
+		.gid = gid,
+	};
+
+	return open_files_one_by_one(handle, filenames, count, flags, mode,
+			&creds, fds);
+}
+
 static
 int _run_as_unlink(const struct lttng_directory_handle *handle,
 		const char *filename, uid_t uid, gid_t gid)
@@ -1096,6 +1168,27 @@ int lttng_directory_handle_open_file(
 			mode, NULL);
 }
 
+LTTNG_HIDDEN
+int lttng_directory_handle_open_files_as_user(
+		const struct lttng_directory_handle *handle,
+		const char **filenames, unsigned int count,
+		int flags, mode_t mode,
+		const struct lttng_credentials *creds,
+		int *fds)
+{
+	int ret;
+
+	if (!creds) {
+		/* Run as current user. */
+		ret = open_files_one_by_one(handle, filenames, count, flags,
+				mode, NULL, fds);
+	} else {
+		ret = _run_as_open_batch(handle, filenames, count, flags, mode,
+				creds->uid, creds->gid, fds);
+	}
+	return ret;
+}
+
 LTTNG_HIDDEN
 int lttng_directory_handle_unlink_file_as_user(
 		const struct lttng_directory_handle *handle,
@@ -177,6 +177,22 @@ int lttng_directory_handle_open_file_as_user(
 		int flags, mode_t mode,
 		const struct lttng_credentials *creds);
 
+/*
+ * Open several files relative to a directory handle as a given user. When
+ * creds is not NULL, as many files as possible are opened by a single run-as
+ * command.
+ *
+ * On success, the file descriptors are returned in `fds` and 0 is returned.
+ * On failure, no file is left opened and -1 is returned with errno set.
+ */
+LTTNG_HIDDEN
+int lttng_directory_handle_open_files_as_user(
+		const struct lttng_directory_handle *handle,
+		const char **filenames, unsigned int count,
+		int flags, mode_t mode,
+		const struct lttng_credentials *creds,
+		int *fds);
+
 /*
  * Unlink a file to a path relative to a directory handle.
  */
@@ -59,6 +59,20 @@ static inline ssize_t splice(int fd_in, loff_t *off_in, int fd_out, loff_t *off_
 }
 #endif
 
+#ifdef __linux__
+#include <sys/sendfile.h>
+
+#define lttng_sendfile(out_fd, in_fd, offset, count) \
+	sendfile(out_fd, in_fd, offset, count)
+#else
+static inline ssize_t lttng_sendfile(int out_fd, int in_fd, off_t *offset,
+		size_t count)
+{
+	errno = ENOSYS;
+	return -1;
+}
+#endif
+
 #ifdef __FreeBSD__
 #define POSIX_FADV_DONTNEED 0
 
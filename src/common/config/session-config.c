@@ -18,6 +18,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <stdbool.h>
+#include <pthread.h>
 
 #include <common/defaults.h>
 #include <common/error.h>
@@ -52,6 +53,21 @@ struct session_config_validation_ctx {
 	xmlSchemaValidCtxtPtr schema_validation_ctx;
 };
 
+/*
+ * Validation context of the session configuration XML schema, kept for the
+ * next loads of the process since parsing the schema costs more than loading
+ * most session configurations.
+ */
+static struct {
+	/* Held during each load, which uses the context. */
+	pthread_mutex_t lock;
+	/* Path of the schema the context was created from. */
+	char *xsd_path;
+	struct session_config_validation_ctx ctx;
+} validation_cache = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
 LTTNG_HIDDEN const char * const config_element_all = "all";
 const char * const config_str_yes = "yes";
 const char * const config_str_true = "true";
@@ -743,15 +759,9 @@ end:
 
 static
 int init_session_config_validation_ctx(
-	struct session_config_validation_ctx *ctx)
+	struct session_config_validation_ctx *ctx, const char *xsd_path)
 {
 	int ret;
-	char *xsd_path = get_session_config_xsd_path();
-
-	if (!xsd_path) {
-		ret = -LTTNG_ERR_NOMEM;
-		goto end;
-	}
 
 	ctx->parser_ctx = xmlSchemaNewParserCtxt(xsd_path);
 	if (!ctx->parser_ctx) {
@@ -785,6 +795,71 @@ end:
 		fini_session_config_validation_ctx(ctx);
 	}
 
+	return ret;
+}
+
+/*
+ * Returns true unless the validation of the session configurations against
+ * the XML schema is disabled by the environment.
+ */
+static
+bool session_config_validation_enabled(void)
+{
+	int ret;
+	const char *value = lttng_secure_getenv(
+			DEFAULT_SESSION_CONFIG_XSD_VALIDATION_ENV);
+
+	if (!value) {
+		return true;
+	}
+
+	ret = config_parse_value(value);
+	if (ret < 0) {
+		WARN("Invalid value \"%s\" for %s, validating the session configurations",
+				value, DEFAULT_SESSION_CONFIG_XSD_VALIDATION_ENV);
+		return true;
+	}
+
+	return ret != 0;
+}
+
+/*
+ * Get the cached validation context, creating it from the schema the first
+ * time or when the schema path changed.
+ *
+ * Must be called with the validation cache lock held.
+ */
+static
+int get_session_config_validation_ctx(
+	struct session_config_validation_ctx **ctx)
+{
+	int ret;
+	char *xsd_path = get_session_config_xsd_path();
+
+	if (!xsd_path) {
+		ret = -LTTNG_ERR_NOMEM;
+		goto end;
+	}
+
+	if (!validation_cache.xsd_path ||
+			strcmp(validation_cache.xsd_path, xsd_path)) {
+		fini_session_config_validation_ctx(&validation_cache.ctx);
+		free(validation_cache.xsd_path);
+		validation_cache.xsd_path = NULL;
+
+		ret = init_session_config_validation_ctx(&validation_cache.ctx,
+				xsd_path);
+		if (ret) {
+			goto end;
+		}
+
+		validation_cache.xsd_path = xsd_path;
+		xsd_path = NULL;
+	}
+
+	*ctx = &validation_cache.ctx;
+	ret = 0;
+end:
 	free(xsd_path);
 	return ret;
 }
@@ -3409,9 +3484,11 @@ end:
 static
 int process_session_node(xmlNodePtr session_node, const char *session_name,
 		int overwrite,
-		const struct config_load_session_override_attr *overrides)
+		const struct config_load_session_override_attr *overrides,
+		struct lttng_session_daemon_connection *connection)
 {
 	int ret, started = -1, snapshot_mode = -1;
+	bool batch = false;
 	uint64_t live_timer_interval = UINT64_MAX,
 			 rotation_timer_interval = 0,
 			 rotation_size = 0;
@@ -3643,6 +3720,17 @@ domain_init_error:
 		goto error;
 	}
 
+	/*
+	 * The rest of the session is applied in a batch: its commands are sent
+	 * back-to-back and applied in one pass by the session daemon. The
+	 * batch stops at the first error, which is returned by the following
+	 * command or when the batch ends.
+	 */
+	if (connection && lttng_session_daemon_connection_begin_batch(
+			connection) == LTTNG_OK) {
+		batch = true;
+	}
+
 	if (shm_path) {
 		ret = lttng_set_session_shm_path((const char *) name,
 				(const char *) shm_path);
@@ -3682,6 +3770,17 @@ domain_init_error:
 	}
 
 end:
+	if (batch) {
+		const enum lttng_error_code batch_ret =
+				lttng_session_daemon_connection_end_batch(
+						connection);
+
+		batch = false;
+		if (!ret && batch_ret != LTTNG_OK) {
+			ret = -batch_ret;
+		}
+	}
+
 	if (ret < 0) {
 		ERR("Failed to load session %s: %s", (const char *) name,
 			lttng_strerror(ret));
@@ -3689,6 +3788,9 @@ end:
 	}
 
 error:
+	if (batch) {
+		(void) lttng_session_daemon_connection_end_batch(connection);
+	}
 	free(kernel_domain);
 	free(ust_domain);
 	free(jul_domain);
@@ -3727,7 +3829,8 @@ valid:
 static
 int load_session_from_file(const char *path, const char *session_name,
 	struct session_config_validation_ctx *validation_ctx, int overwrite,
-	const struct config_load_session_override_attr *overrides)
+	const struct config_load_session_override_attr *overrides,
+	struct lttng_session_daemon_connection *connection)
 {
 	int ret, session_found = !session_name;
 	xmlDocPtr doc = NULL;
@@ -3735,7 +3838,6 @@ int load_session_from_file(const char *path, const char *session_name,
 	xmlNodePtr session_node;
 
 	assert(path);
-	assert(validation_ctx);
 
 	ret = validate_file_read_creds(path);
 	if (ret != 1) {
@@ -3753,11 +3855,15 @@ int load_session_from_file(const char *path, const char *session_name,
 		goto end;
 	}
 
-	ret = xmlSchemaValidateDoc(validation_ctx->schema_validation_ctx, doc);
-	if (ret) {
-		ERR("Session configuration file validation failed");
-		ret = -LTTNG_ERR_LOAD_INVALID_CONFIG;
-		goto end;
+	/* Validation is skipped if disabled by the environment. */
+	if (validation_ctx) {
+		ret = xmlSchemaValidateDoc(
+				validation_ctx->schema_validation_ctx, doc);
+		if (ret) {
+			ERR("Session configuration file validation failed");
+			ret = -LTTNG_ERR_LOAD_INVALID_CONFIG;
+			goto end;
+		}
 	}
 
 	sessions_node = xmlDocGetRootElement(doc);
@@ -3770,7 +3876,7 @@ int load_session_from_file(const char *path, const char *session_name,
 		session_node; session_node =
 			xmlNextElementSibling(session_node)) {
 		ret = process_session_node(session_node,
-			session_name, overwrite, overrides);
+			session_name, overwrite, overrides, connection);
 		if (!session_name && ret) {
 			/* Loading error occurred. */
 			goto end;
@@ -3802,7 +3908,8 @@ end:
 static
 int load_session_from_path(const char *path, const char *session_name,
 	struct session_config_validation_ctx *validation_ctx, int overwrite,
-	const struct config_load_session_override_attr *overrides)
+	const struct config_load_session_override_attr *overrides,
+	struct lttng_session_daemon_connection *connection)
 {
 	int ret, session_found = !session_name;
 	DIR *directory = NULL;
@@ -3810,7 +3917,6 @@ int load_session_from_path(const char *path, const char *session_name,
 	size_t path_len;
 
 	assert(path);
-	assert(validation_ctx);
 	path_len = strlen(path);
 	lttng_dynamic_buffer_init(&file_path);
 	if (path_len >= LTTNG_PATH_MAX) {
@@ -3919,7 +4025,8 @@ int load_session_from_path(const char *path, const char *session_name,
 			}
 
 			ret = load_session_from_file(file_path.data, session_name,
-				validation_ctx, overwrite, overrides);
+				validation_ctx, overwrite, overrides,
+				connection);
 			if (session_name &&
 					(!ret || ret != -LTTNG_ERR_LOAD_SESSION_NOENT)) {
 				session_found = 1;
@@ -3941,7 +4048,7 @@ int load_session_from_path(const char *path, const char *session_name,
 		}
 	} else {
 		ret = load_session_from_file(path, session_name,
-			validation_ctx, overwrite, overrides);
+			validation_ctx, overwrite, overrides, connection);
 		if (ret) {
 			goto end;
 		}
@@ -4003,11 +4110,25 @@ int config_load_session(const char *path, const char *session_name,
 	int ret;
 	bool session_loaded = false;
 	const char *path_ptr = NULL;
-	struct session_config_validation_ctx validation_ctx = { 0 };
+	struct session_config_validation_ctx *validation_ctx = NULL;
+	struct lttng_session_daemon_connection *connection = NULL;
 
-	ret = init_session_config_validation_ctx(&validation_ctx);
-	if (ret) {
-		goto end;
+	pthread_mutex_lock(&validation_cache.lock);
+	if (session_config_validation_enabled()) {
+		ret = get_session_config_validation_ctx(&validation_ctx);
+		if (ret) {
+			goto end;
+		}
+	}
+
+	/*
+	 * Carry the commands of the load over a persistent connection so that
+	 * the commands of each session can be batched. Each command uses a
+	 * connection of its own if none can be opened, such as when the
+	 * process already has one open.
+	 */
+	if (lttng_session_daemon_connection_open(&connection) != LTTNG_OK) {
+		connection = NULL;
 	}
 
 	if (!path) {
@@ -4054,7 +4175,8 @@ int config_load_session(const char *path, const char *session_name,
 			}
 			if (path_ptr) {
 				ret = load_session_from_path(path_ptr, session_name,
-						&validation_ctx, overwrite, overrides);
+						validation_ctx, overwrite, overrides,
+						connection);
 				if (ret && ret != -LTTNG_ERR_LOAD_SESSION_NOENT) {
 					goto end;
 				}
@@ -4084,7 +4206,8 @@ int config_load_session(const char *path, const char *session_name,
 
 		if (path_ptr) {
 			ret = load_session_from_path(path_ptr, session_name,
-					&validation_ctx, overwrite, overrides);
+					validation_ctx, overwrite, overrides,
+					connection);
 			if (!ret) {
 				session_loaded = true;
 			}
@@ -4111,10 +4234,11 @@ int config_load_session(const char *path, const char *session_name,
 		}
 
 		ret = load_session_from_path(path, session_name,
-			&validation_ctx, overwrite, overrides);
+			validation_ctx, overwrite, overrides, connection);
 	}
 end:
-	fini_session_config_validation_ctx(&validation_ctx);
+	lttng_session_daemon_connection_close(connection);
+	pthread_mutex_unlock(&validation_cache.lock);
 	if (ret == -LTTNG_ERR_LOAD_SESSION_NOENT && !session_name && !path) {
 		/*
 		 * Don't report an error if no sessions are found when called
@@ -4133,5 +4257,8 @@ end:
 static
 void __attribute__((destructor)) session_config_exit(void)
 {
+	fini_session_config_validation_ctx(&validation_cache.ctx);
+	free(validation_cache.xsd_path);
+	validation_cache.xsd_path = NULL;
 	xmlCleanupParser();
 }
@@ -644,6 +644,8 @@ struct lttng_consumer_stream *consumer_stream_create(
 	stream->output_written = 0;
 	stream->net_seq_idx = relayd_id;
 	stream->session_id = session_id;
+	stream->cpu = cpu;
+	CDS_INIT_LIST_HEAD(&stream->data_pending_node);
 	stream->monitor = monitor;
 	stream->endpoint_status = CONSUMER_ENDPOINT_ACTIVE;
 	stream->index_file = NULL;
@@ -934,10 +936,10 @@ void consumer_stream_delete(struct lttng_consumer_stream *stream,
 
 	rcu_read_unlock();
 
-	if (!stream->metadata_flag) {
-		/* Decrement the stream count of the global consumer data. */
-		assert(consumer_data.stream_count > 0);
-		consumer_data.stream_count--;
+	if (stream->data_worker) {
+		/* Decrement the stream count of the owning data worker. */
+		assert(stream->data_worker->stream_count > 0);
+		stream->data_worker->stream_count--;
 	}
 }
 
@@ -949,6 +951,7 @@ void consumer_stream_free(struct lttng_consumer_stream *stream)
 	assert(stream);
 
 	metadata_bucket_destroy(stream->metadata_bucket);
+	consumer_writeback_stream_put(stream->writeback);
 	call_rcu(&stream->node.head, free_stream_rcu);
 }
 
@@ -1042,9 +1045,6 @@ void consumer_stream_destroy(struct lttng_consumer_stream *stream,
 			/* Update channel's refcount of the stream. */
 			free_chan = unref_channel(stream);
 
-			/* Indicates that the consumer data state MUST be updated after this. */
-			consumer_data.need_update = 1;
-
 			pthread_mutex_unlock(&stream->lock);
 			pthread_mutex_unlock(&stream->chan->lock);
 			pthread_mutex_unlock(&consumer_data.lock);
@@ -1129,7 +1129,12 @@ int consumer_stream_create_output_files(struct lttng_consumer_stream *stream,
 	enum lttng_trace_chunk_status chunk_status;
 	const int flags = O_WRONLY | O_CREAT | O_TRUNC;
 	const mode_t mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP;
+	const bool create_index_file = !stream->metadata_flag &&
+			(create_index || stream->index_file);
 	char stream_path[LTTNG_PATH_MAX];
+	char index_path[LTTNG_PATH_MAX];
+	const char *file_paths[2] = { stream_path, index_path };
+	int fds[2];
 
 	ASSERT_LOCKED(stream->lock);
 	assert(stream->trace_chunk);
@@ -1142,6 +1147,16 @@ int consumer_stream_create_output_files(struct lttng_consumer_stream *stream,
 		goto end;
 	}
 
+	if (create_index_file) {
+		ret = lttng_index_file_get_path(stream->chan->pathname,
+				stream->name, stream->chan->tracefile_size,
+				stream->tracefile_count_current,
+				index_path, sizeof(index_path));
+		if (ret < 0) {
+			goto end;
+		}
+	}
+
 	if (stream->out_fd >= 0) {
 		ret = close(stream->out_fd);
 		if (ret < 0) {
@@ -1152,27 +1167,31 @@ int consumer_stream_create_output_files(struct lttng_consumer_stream *stream,
 		stream->out_fd = -1;
 	}
 
+	if (stream->index_file) {
+		lttng_index_file_put(stream->index_file);
+		stream->index_file = NULL;
+	}
+
+	/*
+	 * The stream file and its index file are opened together, which
+	 * only takes one run-as command when they belong to another user.
+	 */
 	DBG("Opening stream output file \"%s\"", stream_path);
-	chunk_status = lttng_trace_chunk_open_file(stream->trace_chunk, stream_path,
-			flags, mode, &stream->out_fd, false);
+	chunk_status = lttng_trace_chunk_open_files(stream->trace_chunk,
+			file_paths, create_index_file ? 2 : 1, flags, mode,
+			fds);
 	if (chunk_status != LTTNG_TRACE_CHUNK_STATUS_OK) {
 		ERR("Failed to open stream file \"%s\"", stream->name);
 		ret = -1;
 		goto end;
 	}
+	stream->out_fd = fds[0];
 
-	if (!stream->metadata_flag && (create_index || stream->index_file)) {
-		if (stream->index_file) {
-			lttng_index_file_put(stream->index_file);
-		}
-		chunk_status = lttng_index_file_create_from_trace_chunk(
-				stream->trace_chunk,
-				stream->chan->pathname,
-				stream->name,
-				stream->chan->tracefile_size,
-				stream->tracefile_count_current,
+	if (create_index_file) {
+		chunk_status = lttng_index_file_create_from_trace_chunk_fd(
+				stream->trace_chunk, index_path, fds[1],
 				CTF_INDEX_MAJOR, CTF_INDEX_MINOR,
-				false, &stream->index_file);
+				&stream->index_file);
 		if (chunk_status != LTTNG_TRACE_CHUNK_STATUS_OK) {
 			ret = -1;
 			goto end;
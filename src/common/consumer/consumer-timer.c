@@ -9,11 +9,13 @@
 #define _LGPL_SOURCE
 #include <assert.h>
 #include <inttypes.h>
-#include <signal.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
 
 #include <bin/lttng-consumerd/health-consumerd.h>
 #include <common/common.h>
 #include <common/compat/endian.h>
+#include <common/compat/poll.h>
 #include <common/kernel-ctl/kernel-ctl.h>
 #include <common/kernel-consumer/kernel-consumer.h>
 #include <common/consumer/consumer-stream.h>
@@ -28,47 +30,52 @@ typedef int (*get_produced_cb)(struct lttng_consumer_stream *stream,
 		unsigned long *produced);
 typedef int (*flush_index_cb)(struct lttng_consumer_stream *stream);
 
-static struct timer_signal_data timer_signal = {
-	.tid = 0,
-	.setup_done = 0,
-	.qs_done = 0,
+/* Granularity of the channel timers. */
+#define CONSUMER_TIMER_TICK_NS	NSEC_PER_MSEC
+
+/*
+ * The timers of all the channels are kept in a single timer wheel serviced
+ * by the timer thread. The thread sleeps on a timerfd armed for the next
+ * tick of the wheel and runs all the timers expiring at that tick in one
+ * wake-up.
+ */
+static struct {
+	/* Protects the fields below and the timers of the channels. */
+	pthread_mutex_t lock;
+	/* Signaled when the timer thread is done running a timer. */
+	pthread_cond_t timer_done_cond;
+	struct timer_wheel wheel;
+	/* Tick for which the timerfd is armed, UINT64_MAX if disarmed. */
+	uint64_t armed_tick;
+	/* Timer being run by the timer thread, if any. */
+	struct consumer_channel_timer *running;
+	int timer_fd;
+	/* Wakes up the timer thread when it must exit. */
+	int quit_fd;
+} timers = {
 	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.timer_done_cond = PTHREAD_COND_INITIALIZER,
+	.armed_tick = UINT64_MAX,
+	.timer_fd = -1,
+	.quit_fd = -1,
 };
 
+static int channel_monitor_pipe = -1;
+
 /*
- * Set custom signal mask to current thread.
+ * Samples taken by the monitor timers which expired together, sent in one
+ * write to the channel monitor pipe. Only used by the timer thread.
  */
-static void setmask(sigset_t *mask)
-{
-	int ret;
-
-	ret = sigemptyset(mask);
-	if (ret) {
-		PERROR("sigemptyset");
-	}
-	ret = sigaddset(mask, LTTNG_CONSUMER_SIG_SWITCH);
-	if (ret) {
-		PERROR("sigaddset switch");
-	}
-	ret = sigaddset(mask, LTTNG_CONSUMER_SIG_TEARDOWN);
-	if (ret) {
-		PERROR("sigaddset teardown");
-	}
-	ret = sigaddset(mask, LTTNG_CONSUMER_SIG_LIVE);
-	if (ret) {
-		PERROR("sigaddset live");
-	}
-	ret = sigaddset(mask, LTTNG_CONSUMER_SIG_MONITOR);
-	if (ret) {
-		PERROR("sigaddset monitor");
-	}
-	ret = sigaddset(mask, LTTNG_CONSUMER_SIG_EXIT);
-	if (ret) {
-		PERROR("sigaddset exit");
-	}
-}
+static struct {
+	struct lttcomm_consumer_channel_monitor_msg
+			msgs[LTTCOMM_CONSUMER_CHANNEL_MONITOR_MSG_BATCH];
+	unsigned int count;
+	/* Samples dropped since the channel monitor pipe was full. */
+	uint64_t dropped;
+} monitor_batch;
 
-static int channel_monitor_pipe = -1;
+/* Fire the monitor timers of all channels on multiples of their interval. */
+static bool monitor_timer_aligned;
 
 /*
  * Execute action on a timer switch.
@@ -78,12 +85,10 @@ static int channel_monitor_pipe = -1;
  * deadlocks.
  */
 static void metadata_switch_timer(struct lttng_consumer_local_data *ctx,
-		siginfo_t *si)
+		struct lttng_consumer_channel *channel)
 {
 	int ret;
-	struct lttng_consumer_channel *channel;
 
-	channel = si->si_value.sival_ptr;
 	assert(channel);
 
 	if (channel->switch_timer_error) {
@@ -265,10 +270,9 @@ end:
  * Execute action on a live timer
  */
 static void live_timer(struct lttng_consumer_local_data *ctx,
-		siginfo_t *si)
+		struct lttng_consumer_channel *channel)
 {
 	int ret;
-	struct lttng_consumer_channel *channel;
 	struct lttng_consumer_stream *stream;
 	struct lttng_ht_iter iter;
 	const struct lttng_ht *ht = consumer_data.stream_per_chan_id_ht;
@@ -277,7 +281,6 @@ static void live_timer(struct lttng_consumer_local_data *ctx,
 					consumer_flush_kernel_index :
 					consumer_flush_ust_index;
 
-	channel = si->si_value.sival_ptr;
 	assert(channel);
 
 	if (channel->switch_timer_error) {
@@ -304,72 +307,76 @@ error:
 	return;
 }
 
+/*
+ * Get the current tick of the channel timers.
+ */
 static
-void consumer_timer_signal_thread_qs(unsigned int signr)
+int get_current_tick(uint64_t *tick)
 {
-	sigset_t pending_set;
 	int ret;
+	struct timespec now;
 
-	/*
-	 * We need to be the only thread interacting with the thread
-	 * that manages signals for teardown synchronization.
-	 */
-	pthread_mutex_lock(&timer_signal.lock);
-
-	/* Ensure we don't have any signal queued for this channel. */
-	for (;;) {
-		ret = sigemptyset(&pending_set);
-		if (ret == -1) {
-			PERROR("sigemptyset");
-		}
-		ret = sigpending(&pending_set);
-		if (ret == -1) {
-			PERROR("sigpending");
-		}
-		if (!sigismember(&pending_set, signr)) {
-			break;
-		}
-		caa_cpu_relax();
+	ret = clock_gettime(CLOCKID, &now);
+	if (ret == -1) {
+		PERROR("clock_gettime");
+		goto end;
 	}
 
-	/*
-	 * From this point, no new signal handler will be fired that would try to
-	 * access "chan". However, we still need to wait for any currently
-	 * executing handler to complete.
-	 */
-	cmm_smp_mb();
-	CMM_STORE_SHARED(timer_signal.qs_done, 0);
-	cmm_smp_mb();
+	*tick = ((uint64_t) now.tv_sec * NSEC_PER_SEC + now.tv_nsec) /
+			CONSUMER_TIMER_TICK_NS;
+end:
+	return ret;
+}
 
-	/*
-	 * Kill with LTTNG_CONSUMER_SIG_TEARDOWN, so signal management thread wakes
-	 * up.
-	 */
-	kill(getpid(), LTTNG_CONSUMER_SIG_TEARDOWN);
+/*
+ * Arm the timerfd for the next tick of the timer wheel if it is earlier than
+ * the tick for which it is armed, or unconditionally if `force` is set.
+ *
+ * Called with the timers lock held.
+ */
+static
+void arm_timer_fd(bool force)
+{
+	int ret;
+	struct itimerspec its = {};
+	const uint64_t next_tick = timer_wheel_next_tick(&timers.wheel);
 
-	while (!CMM_LOAD_SHARED(timer_signal.qs_done)) {
-		caa_cpu_relax();
+	if (!force && next_tick >= timers.armed_tick) {
+		return;
+	}
+
+	/* A zero it_value disarms the timerfd. */
+	if (next_tick != UINT64_MAX) {
+		const uint64_t next_ns = next_tick * CONSUMER_TIMER_TICK_NS;
+
+		its.it_value.tv_sec = next_ns / NSEC_PER_SEC;
+		its.it_value.tv_nsec = next_ns % NSEC_PER_SEC;
 	}
-	cmm_smp_mb();
 
-	pthread_mutex_unlock(&timer_signal.lock);
+	ret = timerfd_settime(timers.timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+	if (ret == -1) {
+		PERROR("timerfd_settime");
+		return;
+	}
+	timers.armed_tick = next_tick;
 }
 
 /*
- * Start a timer channel timer which will fire at a given interval
- * (timer_interval_us)and fire a given signal (signal).
+ * Start a channel timer which will fire at a given interval
+ * (timer_interval_us). Aligned timers first expire on the next multiple of
+ * their interval so that the timers sharing an interval fire together.
  *
  * Returns a negative value on error, 0 if a timer was created, and
  * a positive value if no timer was created (not an error).
  */
 static
-int consumer_channel_timer_start(timer_t *timer_id,
+int consumer_channel_timer_start(struct consumer_channel_timer *timer,
 		struct lttng_consumer_channel *channel,
-		unsigned int timer_interval_us, int signal)
+		unsigned int timer_interval_us,
+		enum consumer_channel_timer_type type, bool aligned)
 {
-	int ret = 0, delete_ret;
-	struct sigevent sev;
-	struct itimerspec its;
+	int ret = 0;
+	uint64_t now, expiry;
 
 	assert(channel);
 	assert(channel->key);
@@ -380,50 +387,42 @@ int consumer_channel_timer_start(timer_t *timer_id,
 		goto end;
 	}
 
-	sev.sigev_notify = SIGEV_SIGNAL;
-	sev.sigev_signo = signal;
-	sev.sigev_value.sival_ptr = channel;
-	ret = timer_create(CLOCKID, &sev, timer_id);
-	if (ret == -1) {
-		PERROR("timer_create");
+	ret = get_current_tick(&now);
+	if (ret) {
 		goto end;
 	}
 
-	its.it_value.tv_sec = timer_interval_us / 1000000;
-	its.it_value.tv_nsec = (timer_interval_us % 1000000) * 1000;
-	its.it_interval.tv_sec = its.it_value.tv_sec;
-	its.it_interval.tv_nsec = its.it_value.tv_nsec;
+	timer->channel = channel;
+	timer->type = type;
+	/* Round the interval up to a whole number of ticks. */
+	timer->period = ((uint64_t) timer_interval_us * NSEC_PER_USEC +
+			CONSUMER_TIMER_TICK_NS - 1) / CONSUMER_TIMER_TICK_NS;
+	expiry = aligned ? (now / timer->period + 1) * timer->period :
+			now + timer->period;
 
-	ret = timer_settime(*timer_id, 0, &its, NULL);
-	if (ret == -1) {
-		PERROR("timer_settime");
-		goto error_destroy_timer;
-	}
+	pthread_mutex_lock(&timers.lock);
+	timer->enabled = true;
+	timer_wheel_arm(&timers.wheel, &timer->entry, expiry);
+	arm_timer_fd(false);
+	pthread_mutex_unlock(&timers.lock);
 end:
 	return ret;
-error_destroy_timer:
-	delete_ret = timer_delete(*timer_id);
-	if (delete_ret == -1) {
-		PERROR("timer_delete");
-	}
-	goto end;
 }
 
+/*
+ * Stop a channel timer. On return, the timer thread is guaranteed not to be
+ * running the timer.
+ */
 static
-int consumer_channel_timer_stop(timer_t *timer_id, int signal)
+void consumer_channel_timer_stop(struct consumer_channel_timer *timer)
 {
-	int ret = 0;
-
-	ret = timer_delete(*timer_id);
-	if (ret == -1) {
-		PERROR("timer_delete");
-		goto end;
+	pthread_mutex_lock(&timers.lock);
+	timer->enabled = false;
+	timer_wheel_cancel(&timers.wheel, &timer->entry);
+	while (timers.running == timer) {
+		pthread_cond_wait(&timers.timer_done_cond, &timers.lock);
 	}
-
-	consumer_timer_signal_thread_qs(signal);
-	*timer_id = 0;
-end:
-	return ret;
+	pthread_mutex_unlock(&timers.lock);
 }
 
 /*
@@ -438,7 +437,8 @@ void consumer_timer_switch_start(struct lttng_consumer_channel *channel,
 	assert(channel->key);
 
 	ret = consumer_channel_timer_start(&channel->switch_timer, channel,
-			switch_timer_interval_us, LTTNG_CONSUMER_SIG_SWITCH);
+			switch_timer_interval_us, CONSUMER_CHANNEL_TIMER_SWITCH,
+			false);
 
 	channel->switch_timer_enabled = !!(ret == 0);
 }
@@ -448,16 +448,9 @@ void consumer_timer_switch_start(struct lttng_consumer_channel *channel,
  */
 void consumer_timer_switch_stop(struct lttng_consumer_channel *channel)
 {
-	int ret;
-
 	assert(channel);
 
-	ret = consumer_channel_timer_stop(&channel->switch_timer,
-			LTTNG_CONSUMER_SIG_SWITCH);
-	if (ret == -1) {
-		ERR("Failed to stop switch timer");
-	}
-
+	consumer_channel_timer_stop(&channel->switch_timer);
 	channel->switch_timer_enabled = 0;
 }
 
@@ -473,7 +466,8 @@ void consumer_timer_live_start(struct lttng_consumer_channel *channel,
 	assert(channel->key);
 
 	ret = consumer_channel_timer_start(&channel->live_timer, channel,
-			live_timer_interval_us, LTTNG_CONSUMER_SIG_LIVE);
+			live_timer_interval_us, CONSUMER_CHANNEL_TIMER_LIVE,
+			false);
 
 	channel->live_timer_enabled = !!(ret == 0);
 }
@@ -483,16 +477,9 @@ void consumer_timer_live_start(struct lttng_consumer_channel *channel,
  */
 void consumer_timer_live_stop(struct lttng_consumer_channel *channel)
 {
-	int ret;
-
 	assert(channel);
 
-	ret = consumer_channel_timer_stop(&channel->live_timer,
-			LTTNG_CONSUMER_SIG_LIVE);
-	if (ret == -1) {
-		ERR("Failed to stop live timer");
-	}
-
+	consumer_channel_timer_stop(&channel->live_timer);
 	channel->live_timer_enabled = 0;
 }
 
@@ -512,7 +499,8 @@ int consumer_timer_monitor_start(struct lttng_consumer_channel *channel,
 	assert(!channel->monitor_timer_enabled);
 
 	ret = consumer_channel_timer_start(&channel->monitor_timer, channel,
-			monitor_timer_interval_us, LTTNG_CONSUMER_SIG_MONITOR);
+			monitor_timer_interval_us, CONSUMER_CHANNEL_TIMER_MONITOR,
+			monitor_timer_aligned);
 	channel->monitor_timer_enabled = !!(ret == 0);
 	return ret;
 }
@@ -522,41 +510,60 @@ int consumer_timer_monitor_start(struct lttng_consumer_channel *channel,
  */
 int consumer_timer_monitor_stop(struct lttng_consumer_channel *channel)
 {
-	int ret;
-
 	assert(channel);
 	assert(channel->monitor_timer_enabled);
 
-	ret = consumer_channel_timer_stop(&channel->monitor_timer,
-			LTTNG_CONSUMER_SIG_MONITOR);
-	if (ret == -1) {
-		ERR("Failed to stop live timer");
+	consumer_channel_timer_stop(&channel->monitor_timer);
+	channel->monitor_timer_enabled = 0;
+	return 0;
+}
+
+/*
+ * Create the timerfd and the wake-up eventfd of the timer thread. It must be
+ * called from the consumer main before creating the threads.
+ */
+int consumer_timer_init(void)
+{
+	int ret = 0;
+	uint64_t now;
+
+	ret = get_current_tick(&now);
+	if (ret) {
 		goto end;
 	}
+	timer_wheel_init(&timers.wheel, now);
 
-	channel->monitor_timer_enabled = 0;
+	timers.timer_fd = timerfd_create(CLOCKID, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (timers.timer_fd < 0) {
+		PERROR("timerfd_create");
+		ret = -1;
+		goto end;
+	}
+
+	timers.quit_fd = eventfd(0, EFD_CLOEXEC);
+	if (timers.quit_fd < 0) {
+		PERROR("eventfd");
+		ret = -1;
+		goto end;
+	}
 end:
 	return ret;
 }
 
 /*
- * Block the RT signals for the entire process. It must be called from the
- * consumer main before creating the threads
+ * Release the resources of the channel timers once the timer thread has
+ * exited.
  */
-int consumer_signal_init(void)
+void consumer_timer_fini(void)
 {
-	int ret;
-	sigset_t mask;
-
-	/* Block signal for entire process, so only our thread processes it. */
-	setmask(&mask);
-	ret = pthread_sigmask(SIG_BLOCK, &mask, NULL);
-	if (ret) {
-		errno = ret;
-		PERROR("pthread_sigmask");
-		return -1;
+	if (timers.timer_fd >= 0 && close(timers.timer_fd)) {
+		PERROR("close timerfd");
 	}
-	return 0;
+	timers.timer_fd = -1;
+	if (timers.quit_fd >= 0 && close(timers.quit_fd)) {
+		PERROR("close timer thread quit eventfd");
+	}
+	timers.quit_fd = -1;
 }
 
 static
@@ -634,8 +641,51 @@ end:
 	return ret;
 }
 
+/*
+ * Send the pending channel monitor samples in a single write.
+ */
+static
+void monitor_batch_flush(void)
+{
+	ssize_t ret;
+	const int channel_monitor_pipe =
+			consumer_timer_thread_get_channel_monitor_pipe();
+	const size_t len = monitor_batch.count * sizeof(monitor_batch.msgs[0]);
+
+	if (!monitor_batch.count) {
+		return;
+	}
+
+	/*
+	 * Writes performed here are assumed to be atomic which is only
+	 * guaranteed for sizes <= PIPE_BUF.
+	 */
+	assert(len <= PIPE_BUF);
+
+	do {
+		ret = write(channel_monitor_pipe, monitor_batch.msgs, len);
+	} while (ret == -1 && errno == EINTR);
+	if (ret == -1) {
+		if (errno == EAGAIN) {
+			/* Not an error, the samples are merely dropped. */
+			monitor_batch.dropped += monitor_batch.count;
+			DBG("Channel monitor pipe is full; dropping %u samples (%" PRIu64 " samples dropped)",
+					monitor_batch.count,
+					monitor_batch.dropped);
+		} else {
+			PERROR("write to the channel monitor pipe");
+		}
+	} else {
+		DBG("Sent %u channel monitoring samples", monitor_batch.count);
+	}
+	monitor_batch.count = 0;
+}
+
 /*
  * Execute action on a monitor timer.
+ *
+ * The sample is queued to the pending batch, which is sent once all the
+ * timers of the current tick have run or when it is full.
  */
 static
 void monitor_timer(struct lttng_consumer_channel *channel)
@@ -643,9 +693,7 @@ void monitor_timer(struct lttng_consumer_channel *channel)
 	int ret;
 	int channel_monitor_pipe =
 			consumer_timer_thread_get_channel_monitor_pipe();
-	struct lttcomm_consumer_channel_monitor_msg msg = {
-		.key = channel->key,
-	};
+	struct lttcomm_consumer_channel_monitor_msg *msg;
 	sample_positions_cb sample;
 	get_consumed_cb get_consumed;
 	get_produced_cb get_produced;
@@ -678,31 +726,18 @@ void monitor_timer(struct lttng_consumer_channel *channel)
 	if (ret) {
 		return;
 	}
-	msg.highest = highest;
-	msg.lowest = lowest;
-	msg.total_consumed = total_consumed;
 
-	/*
-	 * Writes performed here are assumed to be atomic which is only
-	 * guaranteed for sizes < than PIPE_BUF.
-	 */
-	assert(sizeof(msg) <= PIPE_BUF);
+	msg = &monitor_batch.msgs[monitor_batch.count++];
+	msg->key = channel->key;
+	msg->highest = highest;
+	msg->lowest = lowest;
+	msg->total_consumed = total_consumed;
+	DBG("Sampled channel key %" PRIu64
+			", (highest = %" PRIu64 ", lowest = %"PRIu64")",
+			channel->key, msg->highest, msg->lowest);
 
-	do {
-		ret = write(channel_monitor_pipe, &msg, sizeof(msg));
-	} while (ret == -1 && errno == EINTR);
-	if (ret == -1) {
-		if (errno == EAGAIN) {
-			/* Not an error, the sample is merely dropped. */
-			DBG("Channel monitor pipe is full; dropping sample for channel key = %"PRIu64,
-					channel->key);
-		} else {
-			PERROR("write to the channel monitor pipe");
-		}
-	} else {
-		DBG("Sent channel monitoring sample for channel key %" PRIu64
-				", (highest = %" PRIu64 ", lowest = %"PRIu64")",
-				channel->key, msg.highest, msg.lowest);
+	if (monitor_batch.count == LTTCOMM_CONSUMER_CHANNEL_MONITOR_MSG_BATCH) {
+		monitor_batch_flush();
 	}
 }
 
@@ -711,6 +746,11 @@ int consumer_timer_thread_get_channel_monitor_pipe(void)
 	return uatomic_read(&channel_monitor_pipe);
 }
 
+void consumer_timer_monitor_set_aligned(bool aligned)
+{
+	monitor_timer_aligned = aligned;
+}
+
 int consumer_timer_thread_set_channel_monitor_pipe(int fd)
 {
 	int ret;
@@ -726,74 +766,166 @@ end:
 }
 
 /*
- * This thread is the sighandler for signals LTTNG_CONSUMER_SIG_SWITCH,
- * LTTNG_CONSUMER_SIG_TEARDOWN, LTTNG_CONSUMER_SIG_LIVE, and
- * LTTNG_CONSUMER_SIG_MONITOR, LTTNG_CONSUMER_SIG_EXIT.
+ * Wake up the timer thread and make it exit.
+ */
+void consumer_timer_thread_quit(void)
+{
+	int ret;
+	const uint64_t value = 1;
+
+	ret = lttng_write(timers.quit_fd, &value, sizeof(value));
+	if (ret != sizeof(value)) {
+		PERROR("write to the timer thread quit eventfd");
+	}
+}
+
+static
+void run_channel_timer(struct lttng_consumer_local_data *ctx,
+		struct consumer_channel_timer *timer)
+{
+	switch (timer->type) {
+	case CONSUMER_CHANNEL_TIMER_SWITCH:
+		metadata_switch_timer(ctx, timer->channel);
+		break;
+	case CONSUMER_CHANNEL_TIMER_LIVE:
+		live_timer(ctx, timer->channel);
+		break;
+	case CONSUMER_CHANNEL_TIMER_MONITOR:
+		monitor_timer(timer->channel);
+		break;
+	default:
+		abort();
+	}
+}
+
+/*
+ * Run the timers which expired and re-arm them for their next period.
+ *
+ * The timers are run without holding the timers lock, which allows them to
+ * be stopped concurrently; consumer_channel_timer_stop() waits until the
+ * timer it stops is no longer running.
+ */
+static
+void run_expired_timers(struct lttng_consumer_local_data *ctx)
+{
+	int ret;
+	uint64_t now;
+	struct cds_list_head expired;
+
+	ret = get_current_tick(&now);
+	if (ret) {
+		return;
+	}
+
+	CDS_INIT_LIST_HEAD(&expired);
+	pthread_mutex_lock(&timers.lock);
+	timer_wheel_advance(&timers.wheel, now, &expired);
+	while (!cds_list_empty(&expired)) {
+		struct consumer_channel_timer *timer = caa_container_of(
+				expired.next, struct consumer_channel_timer,
+				entry.node);
+		uint64_t expiry;
+
+		timer_wheel_cancel(&timers.wheel, &timer->entry);
+		timers.running = timer;
+		pthread_mutex_unlock(&timers.lock);
+
+		run_channel_timer(ctx, timer);
+
+		pthread_mutex_lock(&timers.lock);
+		timers.running = NULL;
+		pthread_cond_broadcast(&timers.timer_done_cond);
+		if (!timer->enabled) {
+			continue;
+		}
+
+		/* Skip the periods which were missed, if any. */
+		expiry = timer->entry.expiry + timer->period;
+		if (expiry <= now) {
+			expiry += ((now - expiry) / timer->period + 1) *
+					timer->period;
+		}
+		timer_wheel_arm(&timers.wheel, &timer->entry, expiry);
+	}
+	arm_timer_fd(true);
+	pthread_mutex_unlock(&timers.lock);
+}
+
+/*
+ * This thread runs the switch, live and monitor timers of the channels.
  */
 void *consumer_timer_thread(void *data)
 {
-	int signr;
-	sigset_t mask;
-	siginfo_t info;
+	int ret, i, nb_fd;
+	struct lttng_poll_event events;
 	struct lttng_consumer_local_data *ctx = data;
 
 	rcu_register_thread();
+	lttng_poll_init(&events);
 
 	health_register(health_consumerd, HEALTH_CONSUMERD_TYPE_METADATA_TIMER);
 
 	if (testpoint(consumerd_thread_metadata_timer)) {
-		goto error_testpoint;
+		goto error;
 	}
 
 	health_code_update();
 
-	/* Only self thread will receive signal mask. */
-	setmask(&mask);
-	CMM_STORE_SHARED(timer_signal.tid, pthread_self());
+	ret = lttng_poll_create(&events, 2, LTTNG_CLOEXEC);
+	if (ret < 0) {
+		goto error;
+	}
+	ret = lttng_poll_add(&events, timers.timer_fd, LPOLLIN);
+	if (ret < 0) {
+		goto error;
+	}
+	ret = lttng_poll_add(&events, timers.quit_fd, LPOLLIN);
+	if (ret < 0) {
+		goto error;
+	}
 
 	while (1) {
 		health_code_update();
 
 		health_poll_entry();
-		signr = sigwaitinfo(&mask, &info);
+		ret = lttng_poll_wait(&events, -1);
 		health_poll_exit();
+		if (ret < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			PERROR("poll timer thread");
+			goto error;
+		}
 
-		/*
-		 * NOTE: cascading conditions are used instead of a switch case
-		 * since the use of SIGRTMIN in the definition of the signals'
-		 * values prevents the reduction to an integer constant.
-		 */
-		if (signr == -1) {
-			if (errno != EINTR) {
-				PERROR("sigwaitinfo");
+		nb_fd = ret;
+		for (i = 0; i < nb_fd; i++) {
+			const int fd = LTTNG_POLL_GETFD(&events, i);
+
+			if (fd == timers.quit_fd) {
+				assert(CMM_LOAD_SHARED(consumer_quit));
+				goto end;
+			} else if (fd == timers.timer_fd) {
+				uint64_t expirations;
+
+				/* Nothing to read on a spurious wake-up. */
+				(void) read(timers.timer_fd, &expirations,
+						sizeof(expirations));
 			}
-			continue;
-		} else if (signr == LTTNG_CONSUMER_SIG_SWITCH) {
-			metadata_switch_timer(ctx, &info);
-		} else if (signr == LTTNG_CONSUMER_SIG_TEARDOWN) {
-			cmm_smp_mb();
-			CMM_STORE_SHARED(timer_signal.qs_done, 1);
-			cmm_smp_mb();
-			DBG("Signal timer metadata thread teardown");
-		} else if (signr == LTTNG_CONSUMER_SIG_LIVE) {
-			live_timer(ctx, &info);
-		} else if (signr == LTTNG_CONSUMER_SIG_MONITOR) {
-			struct lttng_consumer_channel *channel;
-
-			channel = info.si_value.sival_ptr;
-			monitor_timer(channel);
-		} else if (signr == LTTNG_CONSUMER_SIG_EXIT) {
-			assert(CMM_LOAD_SHARED(consumer_quit));
-			goto end;
-		} else {
-			ERR("Unexpected signal %d\n", info.si_signo);
 		}
+
+		run_expired_timers(ctx);
+		monitor_batch_flush();
 	}
 
-error_testpoint:
-	/* Only reached in testpoint error */
+error:
 	health_error();
 end:
+	lttng_poll_clean(&events);
+	if (monitor_batch.dropped) {
+		DBG("%" PRIu64 " channel monitoring samples were dropped",
+				monitor_batch.dropped);
+	}
 	health_unregister(health_consumerd);
 	rcu_unregister_thread();
 	return NULL;
@@ -0,0 +1,475 @@
+/*
+ * Copyright (C) 2020 EfficiOS Inc.
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ *
+ */
+
+#define _LGPL_SOURCE
+#include <assert.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <common/common.h>
+#include <common/compat/fcntl.h>
+#include <common/defaults.h>
+#include <common/time.h>
+#include <urcu/list.h>
+#include <urcu/ref.h>
+
+#include "consumer-writeback.h"
+
+/*
+ * Duplicate of an output file descriptor, shared by the pending writebacks
+ * of the file.
+ */
+struct writeback_file {
+	struct urcu_ref ref;
+	int fd;
+	/* Identity of the file, the caller's descriptor number is reused. */
+	dev_t dev;
+	ino_t ino;
+};
+
+struct consumer_writeback_stream {
+	struct urcu_ref ref;
+	/* Bytes submitted for the stream whose writeout is not complete. */
+	uint64_t dirty_bytes;
+	/* Current output file of the stream, only used by the submitter. */
+	struct writeback_file *file;
+	/*
+	 * Last request of the stream which the writeback thread has not
+	 * dequeued yet, NULL if none.
+	 */
+	struct writeback_request *last_request;
+};
+
+struct writeback_request {
+	struct cds_list_head node;
+	struct consumer_writeback_stream *stream;
+	struct writeback_file *file;
+	off_t offset;
+	off_t len;
+};
+
+/*
+ * Writeback stage of the output files.
+ *
+ * Waiting for the writeout of the data written to the output files and
+ * evicting it from the page cache keeps the trace data from filling the page
+ * cache, but a slow disk makes the wait long. The consumption threads hand
+ * those waits to the writeback thread and only block when the dirty byte
+ * limits are exceeded.
+ */
+static struct {
+	/* Protects the fields below and the dirty bytes of the streams. */
+	pthread_mutex_t lock;
+	/* Signaled when a request is queued or the thread must quit. */
+	pthread_cond_t request_cond;
+	/* Signaled when the writeout of a request is complete. */
+	pthread_cond_t done_cond;
+	struct cds_list_head requests;
+	uint64_t stream_dirty_limit;
+	uint64_t daemon_dirty_limit;
+	/* Bytes submitted whose writeout is not complete. */
+	uint64_t dirty_bytes;
+	struct consumer_writeback_stats stats;
+	bool running;
+	bool quit;
+} writeback = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.request_cond = PTHREAD_COND_INITIALIZER,
+	.done_cond = PTHREAD_COND_INITIALIZER,
+	.requests = CDS_LIST_HEAD_INIT(writeback.requests),
+	.stream_dirty_limit = DEFAULT_CONSUMERD_WRITEBACK_STREAM_DIRTY_LIMIT,
+	.daemon_dirty_limit = DEFAULT_CONSUMERD_WRITEBACK_DIRTY_LIMIT,
+};
+
+static
+uint64_t get_monotonic_ns(void)
+{
+	struct timespec ts;
+
+	if (lttng_clock_gettime(CLOCK_MONOTONIC, &ts)) {
+		PERROR("clock_gettime");
+		return 0;
+	}
+
+	return (uint64_t) ts.tv_sec * NSEC_PER_SEC + (uint64_t) ts.tv_nsec;
+}
+
+/*
+ * Must be called with the writeback lock held.
+ */
+static
+void histogram_add(struct consumer_writeback_histogram *histogram,
+		uint64_t duration_ns)
+{
+	unsigned int bucket = 0;
+	const uint64_t duration_us = duration_ns / NSEC_PER_USEC;
+
+	if (duration_us > 0) {
+		bucket = 63 - __builtin_clzll(duration_us);
+		bucket = min_t(unsigned int, bucket,
+				CONSUMER_WRITEBACK_HISTOGRAM_BUCKETS - 1);
+	}
+	histogram->buckets[bucket]++;
+	histogram->count++;
+	histogram->total_ns += duration_ns;
+	histogram->max_ns = max_t(uint64_t, histogram->max_ns, duration_ns);
+}
+
+static
+void release_file(struct urcu_ref *ref)
+{
+	struct writeback_file *file = caa_container_of(ref,
+			struct writeback_file, ref);
+
+	if (close(file->fd)) {
+		PERROR("close writeback file descriptor");
+	}
+	free(file);
+}
+
+static
+void file_put(struct writeback_file *file)
+{
+	if (!file) {
+		return;
+	}
+
+	urcu_ref_put(&file->ref, release_file);
+}
+
+static
+void release_stream(struct urcu_ref *ref)
+{
+	struct consumer_writeback_stream *stream = caa_container_of(ref,
+			struct consumer_writeback_stream, ref);
+
+	assert(stream->dirty_bytes == 0);
+	assert(!stream->last_request);
+	file_put(stream->file);
+	free(stream);
+}
+
+void consumer_writeback_set_dirty_limits(uint64_t stream_limit,
+		uint64_t daemon_limit)
+{
+	pthread_mutex_lock(&writeback.lock);
+	writeback.stream_dirty_limit = stream_limit;
+	writeback.daemon_dirty_limit = daemon_limit;
+	pthread_mutex_unlock(&writeback.lock);
+}
+
+bool consumer_writeback_enabled(void)
+{
+	bool enabled;
+
+	pthread_mutex_lock(&writeback.lock);
+	enabled = writeback.running && writeback.stream_dirty_limit > 0;
+	pthread_mutex_unlock(&writeback.lock);
+
+	return enabled;
+}
+
+struct consumer_writeback_stream *consumer_writeback_stream_create(void)
+{
+	struct consumer_writeback_stream *stream;
+
+	stream = zmalloc(sizeof(*stream));
+	if (!stream) {
+		PERROR("zmalloc writeback stream");
+		goto end;
+	}
+
+	urcu_ref_init(&stream->ref);
+end:
+	return stream;
+}
+
+void consumer_writeback_stream_put(struct consumer_writeback_stream *stream)
+{
+	if (!stream) {
+		return;
+	}
+
+	pthread_mutex_lock(&writeback.lock);
+	urcu_ref_put(&stream->ref, release_stream);
+	pthread_mutex_unlock(&writeback.lock);
+}
+
+/*
+ * Returns true if a writeback of `len` bytes for the stream must wait for
+ * the completion of the pending ones. A writeback exceeding the limits on
+ * its own is let through once nothing is pending.
+ *
+ * Must be called with the writeback lock held.
+ */
+static
+bool dirty_limits_exceeded(const struct consumer_writeback_stream *stream,
+		uint64_t len)
+{
+	if (stream->dirty_bytes > 0 &&
+			stream->dirty_bytes + len > writeback.stream_dirty_limit) {
+		return true;
+	}
+
+	if (writeback.daemon_dirty_limit > 0 && writeback.dirty_bytes > 0 &&
+			writeback.dirty_bytes + len >
+				writeback.daemon_dirty_limit) {
+		return true;
+	}
+
+	return false;
+}
+
+/*
+ * Returns a reference to the duplicate of `fd` shared with the pending
+ * writebacks of the stream, replacing the current file of the stream when
+ * `fd` refers to another file.
+ */
+static
+struct writeback_file *get_file(struct consumer_writeback_stream *stream,
+		int fd)
+{
+	int ret;
+	struct stat st;
+	struct writeback_file *file = NULL;
+
+	ret = fstat(fd, &st);
+	if (ret) {
+		PERROR("fstat output file descriptor for writeback");
+		goto end;
+	}
+
+	if (stream->file && stream->file->dev == st.st_dev &&
+			stream->file->ino == st.st_ino) {
+		file = stream->file;
+		goto end;
+	}
+
+	file = zmalloc(sizeof(*file));
+	if (!file) {
+		PERROR("zmalloc writeback file");
+		goto end;
+	}
+
+	file->fd = dup(fd);
+	if (file->fd < 0) {
+		PERROR("dup output file descriptor for writeback");
+		free(file);
+		file = NULL;
+		goto end;
+	}
+	urcu_ref_init(&file->ref);
+	file->dev = st.st_dev;
+	file->ino = st.st_ino;
+
+	file_put(stream->file);
+	stream->file = file;
+end:
+	if (file) {
+		urcu_ref_get(&file->ref);
+	}
+	return file;
+}
+
+int consumer_writeback_submit(struct consumer_writeback_stream *stream,
+		int fd, off_t offset, off_t len)
+{
+	int ret;
+	struct writeback_request *request;
+	struct writeback_request *last_request;
+	uint64_t throttle_start_ns = 0;
+
+	assert(stream);
+	assert(len >= 0);
+
+	request = zmalloc(sizeof(*request));
+	if (!request) {
+		PERROR("zmalloc writeback request");
+		ret = -1;
+		goto end;
+	}
+
+	request->file = get_file(stream, fd);
+	if (!request->file) {
+		ret = -1;
+		goto error;
+	}
+	request->offset = offset;
+	request->len = len;
+
+	pthread_mutex_lock(&writeback.lock);
+	while (!writeback.quit && dirty_limits_exceeded(stream, len)) {
+		if (!throttle_start_ns) {
+			throttle_start_ns = get_monotonic_ns();
+		}
+		pthread_cond_wait(&writeback.done_cond, &writeback.lock);
+	}
+	if (throttle_start_ns) {
+		histogram_add(&writeback.stats.throttle,
+				get_monotonic_ns() - throttle_start_ns);
+	}
+
+	if (writeback.quit) {
+		pthread_mutex_unlock(&writeback.lock);
+		ret = -1;
+		goto error;
+	}
+
+	stream->dirty_bytes += len;
+	writeback.dirty_bytes += len;
+	writeback.stats.submitted_bytes += len;
+
+	/* Extend the pending request of the stream ending at `offset`. */
+	last_request = stream->last_request;
+	if (last_request && last_request->file == request->file &&
+			last_request->offset + last_request->len == offset) {
+		last_request->len += len;
+		pthread_mutex_unlock(&writeback.lock);
+		ret = 0;
+		goto error;
+	}
+
+	urcu_ref_get(&stream->ref);
+	request->stream = stream;
+	stream->last_request = request;
+	cds_list_add_tail(&request->node, &writeback.requests);
+	pthread_cond_signal(&writeback.request_cond);
+	pthread_mutex_unlock(&writeback.lock);
+
+	ret = 0;
+	goto end;
+
+error:
+	file_put(request->file);
+	free(request);
+end:
+	return ret;
+}
+
+/*
+ * Wait for the writeout of the range of the request and evict it from the
+ * page cache. Errors are ignored as these are only hints limiting the
+ * amount of page cache used.
+ */
+static
+void perform_writeback(const struct writeback_request *request)
+{
+	lttng_sync_file_range(request->file->fd, request->offset, request->len,
+			SYNC_FILE_RANGE_WAIT_BEFORE
+			| SYNC_FILE_RANGE_WRITE
+			| SYNC_FILE_RANGE_WAIT_AFTER);
+	(void) posix_fadvise(request->file->fd, request->offset, request->len,
+			POSIX_FADV_DONTNEED);
+}
+
+void *consumer_writeback_thread(void *data)
+{
+	DBG("Writeback thread started");
+
+	pthread_mutex_lock(&writeback.lock);
+	writeback.running = true;
+	for (;;) {
+		struct writeback_request *request;
+		uint64_t start_ns, duration_ns;
+
+		if (cds_list_empty(&writeback.requests)) {
+			if (writeback.quit) {
+				break;
+			}
+			pthread_cond_wait(&writeback.request_cond,
+					&writeback.lock);
+			continue;
+		}
+
+		request = cds_list_first_entry(&writeback.requests,
+				struct writeback_request, node);
+		cds_list_del(&request->node);
+		if (request->stream->last_request == request) {
+			request->stream->last_request = NULL;
+		}
+		pthread_mutex_unlock(&writeback.lock);
+
+		start_ns = get_monotonic_ns();
+		perform_writeback(request);
+		duration_ns = get_monotonic_ns() - start_ns;
+		file_put(request->file);
+
+		pthread_mutex_lock(&writeback.lock);
+		histogram_add(&writeback.stats.writeout, duration_ns);
+		request->stream->dirty_bytes -= request->len;
+		writeback.dirty_bytes -= request->len;
+		urcu_ref_put(&request->stream->ref, release_stream);
+		pthread_cond_broadcast(&writeback.done_cond);
+		free(request);
+	}
+	writeback.running = false;
+	pthread_mutex_unlock(&writeback.lock);
+
+	DBG("Writeback thread exiting");
+	return NULL;
+}
+
+/*
+ * Make the writeback thread exit once its pending requests are complete.
+ * Later writebacks are performed by their submitter.
+ */
+void consumer_writeback_thread_quit(void)
+{
+	pthread_mutex_lock(&writeback.lock);
+	writeback.quit = true;
+	pthread_cond_signal(&writeback.request_cond);
+	pthread_cond_broadcast(&writeback.done_cond);
+	pthread_mutex_unlock(&writeback.lock);
+}
+
+void consumer_writeback_get_stats(struct consumer_writeback_stats *stats)
+{
+	pthread_mutex_lock(&writeback.lock);
+	*stats = writeback.stats;
+	pthread_mutex_unlock(&writeback.lock);
+}
+
+static
+void log_histogram(const char *name,
+		const struct consumer_writeback_histogram *histogram)
+{
+	unsigned int i;
+
+	MSG("Writeback %s: count = %" PRIu64 ", total = %" PRIu64 " ns, max = %" PRIu64 " ns",
+			name, histogram->count, histogram->total_ns,
+			histogram->max_ns);
+	for (i = 0; i < CONSUMER_WRITEBACK_HISTOGRAM_BUCKETS; i++) {
+		if (!histogram->buckets[i]) {
+			continue;
+		}
+
+		if (i == CONSUMER_WRITEBACK_HISTOGRAM_BUCKETS - 1) {
+			MSG("    >= %" PRIu64 " us: %" PRIu64,
+					UINT64_C(1) << i, histogram->buckets[i]);
+		} else {
+			MSG("    < %" PRIu64 " us: %" PRIu64,
+					UINT64_C(1) << (i + 1),
+					histogram->buckets[i]);
+		}
+	}
+}
+
+void consumer_writeback_log_stats(void)
+{
+	struct consumer_writeback_stats stats;
+
+	consumer_writeback_get_stats(&stats);
+	if (!stats.submitted_bytes) {
+		return;
+	}
+
+	MSG("Writeback submitted %" PRIu64 " bytes", stats.submitted_bytes);
+	log_histogram("writeout", &stats.writeout);
+	log_histogram("throttle", &stats.throttle);
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2020 EfficiOS Inc.
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ *
+ */
+
+#ifndef CONSUMER_WRITEBACK_H
+#define CONSUMER_WRITEBACK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Bucket `i` of a stall histogram counts the durations in
+ * [2^i, 2^(i + 1)) microseconds. The first bucket also counts the
+ * durations shorter than a microsecond and the last one is unbounded.
+ */
+#define CONSUMER_WRITEBACK_HISTOGRAM_BUCKETS	24
+
+struct consumer_writeback_histogram {
+	uint64_t buckets[CONSUMER_WRITEBACK_HISTOGRAM_BUCKETS];
+	uint64_t count;
+	uint64_t total_ns;
+	uint64_t max_ns;
+};
+
+struct consumer_writeback_stats {
+	/* Time spent by the writeback thread waiting for writeouts. */
+	struct consumer_writeback_histogram writeout;
+	/*
+	 * Time spent by the consumption threads blocked on the dirty byte
+	 * limits.
+	 */
+	struct consumer_writeback_histogram throttle;
+	/* Bytes handed to the writeback thread. */
+	uint64_t submitted_bytes;
+};
+
+/* Writeback accounting of a stream, shared with its pending writebacks. */
+struct consumer_writeback_stream;
+
+/*
+ * Set the maximum number of bytes written to the output files of a stream,
+ * and of all streams, whose writeout is not complete. A stream limit of 0
+ * disables the writeback thread.
+ */
+void consumer_writeback_set_dirty_limits(uint64_t stream_limit,
+		uint64_t daemon_limit);
+
+void *consumer_writeback_thread(void *data);
+void consumer_writeback_thread_quit(void);
+
+/*
+ * Returns true if writebacks must be submitted to the writeback thread
+ * rather than performed by the caller.
+ */
+bool consumer_writeback_enabled(void);
+
+struct consumer_writeback_stream *consumer_writeback_stream_create(void);
+void consumer_writeback_stream_put(struct consumer_writeback_stream *stream);
+
+/*
+ * Hand the writeout of a range of an output file to the writeback thread,
+ * which waits for it and evicts the range from the page cache. The file
+ * descriptor is duplicated once per output file of the stream and can be
+ * closed by the caller. A range contiguous to the pending one of the stream
+ * is merged into it.
+ *
+ * Blocks while the dirty byte limits are exceeded.
+ */
+int consumer_writeback_submit(struct consumer_writeback_stream *stream,
+		int fd, off_t offset, off_t len);
+
+void consumer_writeback_get_stats(struct consumer_writeback_stats *stats);
+/* Print the writeback statistics, if any data was handed to the thread. */
+void consumer_writeback_log_stats(void);
+
+#endif /* CONSUMER_WRITEBACK_H */
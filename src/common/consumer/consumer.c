@@ -46,8 +46,6 @@
 #include <common/dynamic-array.h>
 
 struct lttng_consumer_global_data consumer_data = {
-	.stream_count = 0,
-	.need_update = 1,
 	.type = LTTNG_CONSUMER_UNKNOWN,
 };
 
@@ -75,12 +73,22 @@ int data_consumption_paused;
 int consumer_quit;
 
 /*
- * Global hash table containing respectively metadata and data streams. The
- * stream element in this ht should only be updated by the metadata poll thread
- * for the metadata and the data poll thread for the data.
+ * Global hash table containing the metadata streams. The stream element in
+ * this ht should only be updated by the metadata poll thread. Data streams
+ * are sharded across the data workers (see struct
+ * lttng_consumer_data_worker).
  */
 static struct lttng_ht *metadata_ht;
-static struct lttng_ht *data_ht;
+
+/*
+ * Skip the padding of the sub-buffers written to the local output files by
+ * extending the files sparsely. Set before the consumption threads start.
+ */
+static bool sparse_padding;
+
+/* Data worker running on the current thread, NULL for the other threads. */
+static DEFINE_URCU_TLS(struct lttng_consumer_data_worker *,
+		current_data_worker);
 
 static const char *get_consumer_domain(void)
 {
@@ -110,6 +118,18 @@ static void notify_thread_lttng_pipe(struct lttng_pipe *pipe)
 	(void) lttng_pipe_write(pipe, &null_stream, sizeof(null_stream));
 }
 
+/*
+ * Notify every data worker to poll back again.
+ */
+static void notify_data_workers(struct lttng_consumer_local_data *ctx)
+{
+	unsigned int i;
+
+	for (i = 0; i < ctx->nb_data_workers; i++) {
+		notify_thread_lttng_pipe(ctx->data_workers[i].data_pipe);
+	}
+}
+
 static void notify_health_quit_pipe(int *pipe)
 {
 	ssize_t ret;
@@ -334,6 +354,7 @@ static void free_relayd_rcu(struct rcu_head *head)
 	(void) relayd_close(&relayd->data_sock);
 
 	pthread_mutex_destroy(&relayd->ctrl_sock_mutex);
+	pthread_mutex_destroy(&relayd->data_sock_mutex);
 	free(relayd);
 }
 
@@ -451,9 +472,11 @@ static void cleanup_relayd_ht(void)
  * It's atomically set without having the stream mutex locked which is fine
  * because we handle the write/read race with a pipe wakeup for each thread.
  */
-static void update_endpoint_status_by_netidx(uint64_t net_seq_idx,
+static void update_endpoint_status_by_netidx(
+		struct lttng_consumer_local_data *ctx, uint64_t net_seq_idx,
 		enum consumer_endpoint_status status)
 {
+	unsigned int i;
 	struct lttng_ht_iter iter;
 	struct lttng_consumer_stream *stream;
 
@@ -469,11 +492,15 @@ static void update_endpoint_status_by_netidx(uint64_t net_seq_idx,
 		}
 	}
 
-	/* Follow up by the data streams */
-	cds_lfht_for_each_entry(data_ht->ht, &iter.iter, stream, node.node) {
-		if (stream->net_seq_idx == net_seq_idx) {
-			uatomic_set(&stream->endpoint_status, status);
-			DBG("Delete flag set to data stream %d", stream->wait_fd);
+	/* Follow up by the data streams of every worker */
+	for (i = 0; i < ctx->nb_data_workers; i++) {
+		struct lttng_ht *ht = ctx->data_workers[i].stream_ht;
+
+		cds_lfht_for_each_entry(ht->ht, &iter.iter, stream, node.node) {
+			if (stream->net_seq_idx == net_seq_idx) {
+				uatomic_set(&stream->endpoint_status, status);
+				DBG("Delete flag set to data stream %d", stream->wait_fd);
+			}
 		}
 	}
 	rcu_read_unlock();
@@ -505,7 +532,8 @@ void lttng_consumer_cleanup_relayd(struct consumer_relayd_sock_pair *relayd)
 	consumer_destroy_relayd(relayd);
 
 	/* Set inactive endpoint to all streams */
-	update_endpoint_status_by_netidx(netidx, CONSUMER_ENDPOINT_INACTIVE);
+	update_endpoint_status_by_netidx(relayd->ctx, netidx,
+			CONSUMER_ENDPOINT_INACTIVE);
 
 	/*
 	 * With a local data context, notify the threads that the streams' state
@@ -513,7 +541,7 @@ void lttng_consumer_cleanup_relayd(struct consumer_relayd_sock_pair *relayd)
 	 * memory barrier ordering the updates of the end point status from the
 	 * read of this status which happens AFTER receiving this notify.
 	 */
-	notify_thread_lttng_pipe(relayd->ctx->consumer_data_pipe);
+	notify_data_workers(relayd->ctx);
 	notify_thread_lttng_pipe(relayd->ctx->consumer_metadata_pipe);
 }
 
@@ -553,7 +581,9 @@ void consumer_del_stream(struct lttng_consumer_stream *stream,
  */
 void consumer_del_stream_for_data(struct lttng_consumer_stream *stream)
 {
-	consumer_stream_destroy(stream, data_ht);
+	assert(stream->data_worker);
+
+	consumer_stream_destroy(stream, stream->data_worker->stream_ht);
 }
 
 void consumer_del_stream_for_metadata(struct lttng_consumer_stream *stream)
@@ -570,16 +600,45 @@ void consumer_stream_update_channel_attributes(
 }
 
 /*
- * Add a stream to the global list protected by a mutex.
+ * Select the data worker that will own a data stream.
+ *
+ * Per-CPU streams are sharded by CPU id so that the streams of a given CPU,
+ * across all channels and sessions, are consumed by the same worker. Other
+ * streams are sharded by key.
+ */
+static struct lttng_consumer_data_worker *select_data_worker(
+		struct lttng_consumer_local_data *ctx,
+		struct lttng_consumer_stream *stream)
+{
+	uint64_t shard_key;
+
+	if (stream->cpu >= 0) {
+		shard_key = (uint64_t) stream->cpu;
+	} else {
+		shard_key = stream->key;
+	}
+
+	return &ctx->data_workers[shard_key % ctx->nb_data_workers];
+}
+
+/*
+ * Add a stream to the data stream shard of its worker. Protected by the
+ * consumer data mutex.
  */
-void consumer_add_data_stream(struct lttng_consumer_stream *stream)
+void consumer_add_data_stream(struct lttng_consumer_local_data *ctx,
+		struct lttng_consumer_stream *stream)
 {
-	struct lttng_ht *ht = data_ht;
+	unsigned int i;
+	struct lttng_consumer_data_worker *worker;
 
+	assert(ctx);
 	assert(stream);
-	assert(ht);
+	assert(ctx->nb_data_workers > 0);
+
+	worker = select_data_worker(ctx, stream);
 
-	DBG3("Adding consumer stream %" PRIu64, stream->key);
+	DBG3("Adding consumer stream %" PRIu64 " to data worker %u",
+			stream->key, worker->id);
 
 	pthread_mutex_lock(&consumer_data.lock);
 	pthread_mutex_lock(&stream->chan->lock);
@@ -587,10 +646,16 @@ void consumer_add_data_stream(struct lttng_consumer_stream *stream)
 	pthread_mutex_lock(&stream->lock);
 	rcu_read_lock();
 
-	/* Steal stream identifier to avoid having streams with the same key */
-	steal_stream_key(stream->key, ht);
+	/*
+	 * Steal stream identifier to avoid having streams with the same key.
+	 * The key may be held by a stream of any shard.
+	 */
+	for (i = 0; i < ctx->nb_data_workers; i++) {
+		steal_stream_key(stream->key, ctx->data_workers[i].stream_ht);
+	}
 
-	lttng_ht_add_unique_u64(ht, &stream->node);
+	stream->data_worker = worker;
+	lttng_ht_add_unique_u64(worker->stream_ht, &stream->node);
 
 	lttng_ht_add_u64(consumer_data.stream_per_chan_id_ht,
 			&stream->node_channel_id);
@@ -615,9 +680,8 @@ void consumer_add_data_stream(struct lttng_consumer_stream *stream)
 		uatomic_dec(&stream->chan->nb_init_stream_left);
 	}
 
-	/* Update consumer data once the node is inserted. */
-	consumer_data.stream_count++;
-	consumer_data.need_update = 1;
+	/* Update the worker's state once the node is inserted. */
+	worker->stream_count++;
 
 	rcu_read_unlock();
 	pthread_mutex_unlock(&stream->lock);
@@ -676,6 +740,7 @@ static struct consumer_relayd_sock_pair *consumer_allocate_relayd_sock_pair(
 	obj->data_sock.sock.fd = -1;
 	lttng_ht_node_init_u64(&obj->node, obj->net_seq_idx);
 	pthread_mutex_init(&obj->ctrl_sock_mutex, NULL);
+	pthread_mutex_init(&obj->data_sock_mutex, NULL);
 
 error:
 	return obj;
@@ -861,11 +926,14 @@ static int write_relayd_stream_header(struct lttng_consumer_stream *stream,
 		data_hdr.net_seq_num = htobe64(stream->next_net_seq_num);
 		/* Other fields are zeroed previously */
 
+		/* Caller MUST acquire the relayd data socket lock */
 		ret = relayd_send_data_hdr(&relayd->data_sock, &data_hdr,
 				sizeof(data_hdr));
 		if (ret < 0) {
 			goto error;
 		}
+		/* A send without MSG_MORE pushes the held back data. */
+		relayd->data_sock_batched_bytes = 0;
 
 		++stream->next_net_seq_num;
 
@@ -877,6 +945,85 @@ error:
 	return outfd;
 }
 
+/*
+ * Return the flags to use to send a data packet of a stream on the relayd
+ * data socket: MSG_MORE if the packet can be held back by the socket to be
+ * coalesced with the following ones.
+ *
+ * Only the data worker owning the stream batches its sends since it pushes
+ * the held back data once it is done consuming its ready streams. The caller
+ * MUST hold the relayd data socket lock.
+ */
+static int relayd_data_send_flags(struct lttng_consumer_stream *stream,
+		struct consumer_relayd_sock_pair *relayd, size_t packet_size)
+{
+	struct lttng_consumer_data_worker *worker =
+			URCU_TLS(current_data_worker);
+
+	ASSERT_LOCKED(relayd->data_sock_mutex);
+
+	if (!worker || stream->data_worker != worker) {
+		return 0;
+	}
+	if (relayd->data_sock_batched_bytes + packet_size >=
+			worker->ctx->relayd_batch_size) {
+		return 0;
+	}
+
+	return MSG_MORE;
+}
+
+/*
+ * Send a sub-buffer to the relayd along with its header using a single
+ * vectored send. Metadata is sent on the control socket and the caller MUST
+ * hold the relayd control socket lock.
+ *
+ * Return the number of payload bytes sent or a negative value on error.
+ */
+static ssize_t write_relayd_packet(struct lttng_consumer_stream *stream,
+		struct consumer_relayd_sock_pair *relayd,
+		const void *payload, size_t payload_size, unsigned long padding)
+{
+	int flags;
+	ssize_t ret;
+	struct lttcomm_relayd_data_hdr data_hdr;
+
+	if (stream->metadata_flag) {
+		ret = relayd_send_metadata_packet(&relayd->control_sock,
+				stream->relayd_stream_id, padding, payload,
+				payload_size);
+		goto end;
+	}
+
+	memset(&data_hdr, 0, sizeof(data_hdr));
+	data_hdr.stream_id = htobe64(stream->relayd_stream_id);
+	data_hdr.data_size = htobe32(payload_size);
+	data_hdr.padding_size = htobe32(padding);
+	/* See write_relayd_stream_header() regarding next_net_seq_num. */
+	data_hdr.net_seq_num = htobe64(stream->next_net_seq_num);
+
+	pthread_mutex_lock(&relayd->data_sock_mutex);
+	flags = relayd_data_send_flags(stream, relayd,
+			sizeof(data_hdr) + payload_size);
+	ret = relayd_send_data_packet(&relayd->data_sock, &data_hdr, payload,
+			payload_size, flags);
+	if (ret >= 0) {
+		++stream->next_net_seq_num;
+		if (flags & MSG_MORE) {
+			relayd->data_sock_batched_bytes +=
+					sizeof(data_hdr) + payload_size;
+			stream->data_worker->relayd_batch_pending = true;
+		} else {
+			/* A send without MSG_MORE pushes the held back data. */
+			relayd->data_sock_batched_bytes = 0;
+		}
+	}
+	pthread_mutex_unlock(&relayd->data_sock_mutex);
+
+end:
+	return ret;
+}
+
 /*
  * Trigger a dump of the metadata content. Following/during the succesful
  * completion of this call, the metadata poll thread will start receiving
@@ -1116,70 +1263,6 @@ int consumer_add_channel(struct lttng_consumer_channel *channel,
 	return 0;
 }
 
-/*
- * Allocate the pollfd structure and the local view of the out fds to avoid
- * doing a lookup in the linked list and concurrency issues when writing is
- * needed. Called with consumer_data.lock held.
- *
- * Returns the number of fds in the structures.
- */
-static int update_poll_array(struct lttng_consumer_local_data *ctx,
-		struct pollfd **pollfd, struct lttng_consumer_stream **local_stream,
-		struct lttng_ht *ht, int *nb_inactive_fd)
-{
-	int i = 0;
-	struct lttng_ht_iter iter;
-	struct lttng_consumer_stream *stream;
-
-	assert(ctx);
-	assert(ht);
-	assert(pollfd);
-	assert(local_stream);
-
-	DBG("Updating poll fd array");
-	*nb_inactive_fd = 0;
-	rcu_read_lock();
-	cds_lfht_for_each_entry(ht->ht, &iter.iter, stream, node.node) {
-		/*
-		 * Only active streams with an active end point can be added to the
-		 * poll set and local stream storage of the thread.
-		 *
-		 * There is a potential race here for endpoint_status to be updated
-		 * just after the check. However, this is OK since the stream(s) will
-		 * be deleted once the thread is notified that the end point state has
-		 * changed where this function will be called back again.
-		 *
-		 * We track the number of inactive FDs because they still need to be
-		 * closed by the polling thread after a wakeup on the data_pipe or
-		 * metadata_pipe.
-		 */
-		if (stream->endpoint_status == CONSUMER_ENDPOINT_INACTIVE) {
-			(*nb_inactive_fd)++;
-			continue;
-		}
-		/*
-		 * This clobbers way too much the debug output. Uncomment that if you
-		 * need it for debugging purposes.
-		 */
-		(*pollfd)[i].fd = stream->wait_fd;
-		(*pollfd)[i].events = POLLIN | POLLPRI;
-		local_stream[i] = stream;
-		i++;
-	}
-	rcu_read_unlock();
-
-	/*
-	 * Insert the consumer_data_pipe at the end of the array and don't
-	 * increment i so nb_fd is the number of real FD.
-	 */
-	(*pollfd)[i].fd = lttng_pipe_get_readfd(ctx->consumer_data_pipe);
-	(*pollfd)[i].events = POLLIN | POLLPRI;
-
-	(*pollfd)[i + 1].fd = lttng_pipe_get_readfd(ctx->consumer_wakeup_pipe);
-	(*pollfd)[i + 1].events = POLLIN | POLLPRI;
-	return i;
-}
-
 /*
  * Poll on the should_quit pipe and the command socket return -1 on
  * error, 1 if should exit, 0 if data is available on the command socket
@@ -1315,6 +1398,10 @@ void lttng_consumer_should_exit(struct lttng_consumer_local_data *ctx)
 
 /*
  * Flush pending writes to trace output disk file.
+ *
+ * The range written since `orig_offset` is handed to the writeback thread
+ * when it runs. Otherwise, wait for the writeout of the subbuffer prior to
+ * the one just written.
  */
 static
 void lttng_consumer_sync_trace_file(struct lttng_consumer_stream *stream,
@@ -1323,6 +1410,18 @@ void lttng_consumer_sync_trace_file(struct lttng_consumer_stream *stream,
 	int ret;
 	int outfd = stream->out_fd;
 
+	if (consumer_writeback_enabled()) {
+		if (!stream->writeback) {
+			stream->writeback = consumer_writeback_stream_create();
+		}
+		if (stream->writeback &&
+				!consumer_writeback_submit(stream->writeback,
+					outfd, orig_offset,
+					stream->out_fd_offset - orig_offset)) {
+			return;
+		}
+	}
+
 	/*
 	 * This does a blocking write-and-wait on any page that belongs to the
 	 * subbuffer prior to the one we just wrote.
@@ -1396,6 +1495,11 @@ struct lttng_consumer_local_data *lttng_consumer_create(
 
 	ctx->consumer_error_socket = -1;
 	ctx->consumer_metadata_socket = -1;
+	ctx->relayd_batch_size = DEFAULT_CONSUMERD_RELAYD_BATCH_SIZE;
+	ctx->snapshot_thread_count = DEFAULT_CONSUMERD_SNAPSHOT_THREADS;
+	pthread_mutex_init(&ctx->snapshot_pool.lock, NULL);
+	pthread_cond_init(&ctx->snapshot_pool.snapshot_cond, NULL);
+	pthread_cond_init(&ctx->snapshot_pool.done_cond, NULL);
 	pthread_mutex_init(&ctx->metadata_socket_lock, NULL);
 	/* assign the callbacks */
 	ctx->on_buffer_ready = buffer_ready;
@@ -1403,16 +1507,6 @@ struct lttng_consumer_local_data *lttng_consumer_create(
 	ctx->on_recv_stream = recv_stream;
 	ctx->on_update_stream = update_stream;
 
-	ctx->consumer_data_pipe = lttng_pipe_open(0);
-	if (!ctx->consumer_data_pipe) {
-		goto error_poll_pipe;
-	}
-
-	ctx->consumer_wakeup_pipe = lttng_pipe_open(0);
-	if (!ctx->consumer_wakeup_pipe) {
-		goto error_wakeup_pipe;
-	}
-
 	ret = pipe(ctx->consumer_should_quit);
 	if (ret < 0) {
 		PERROR("Error creating recv pipe");
@@ -1439,15 +1533,195 @@ error_metadata_pipe:
 error_channel_pipe:
 	utils_close_pipe(ctx->consumer_should_quit);
 error_quit_pipe:
-	lttng_pipe_destroy(ctx->consumer_wakeup_pipe);
-error_wakeup_pipe:
-	lttng_pipe_destroy(ctx->consumer_data_pipe);
-error_poll_pipe:
 	free(ctx);
 error:
 	return NULL;
 }
 
+/*
+ * Release the resources of a data worker. The worker's stream hash tables
+ * must be empty.
+ */
+static void fini_data_worker(struct lttng_consumer_data_worker *worker)
+{
+	if (worker->stream_ht) {
+		lttng_ht_destroy(worker->stream_ht);
+		worker->stream_ht = NULL;
+	}
+	if (worker->wait_fd_ht) {
+		lttng_ht_destroy(worker->wait_fd_ht);
+		worker->wait_fd_ht = NULL;
+	}
+	lttng_pipe_destroy(worker->data_pipe);
+	worker->data_pipe = NULL;
+	lttng_pipe_destroy(worker->wakeup_pipe);
+	worker->wakeup_pipe = NULL;
+}
+
+/*
+ * Initialize a data worker's stream shard and notification pipes.
+ *
+ * Return 0 on success or else a negative value.
+ */
+static int init_data_worker(struct lttng_consumer_local_data *ctx,
+		struct lttng_consumer_data_worker *worker, unsigned int id)
+{
+	worker->id = id;
+	worker->ctx = ctx;
+	CDS_INIT_LIST_HEAD(&worker->pending_stream_list);
+
+	worker->stream_ht = lttng_ht_new(0, LTTNG_HT_TYPE_U64);
+	if (!worker->stream_ht) {
+		goto error;
+	}
+
+	worker->wait_fd_ht = lttng_ht_new(0, LTTNG_HT_TYPE_U64);
+	if (!worker->wait_fd_ht) {
+		goto error;
+	}
+
+	worker->data_pipe = lttng_pipe_open(0);
+	if (!worker->data_pipe) {
+		goto error;
+	}
+
+	worker->wakeup_pipe = lttng_pipe_open(0);
+	if (!worker->wakeup_pipe) {
+		goto error;
+	}
+
+	return 0;
+
+error:
+	fini_data_worker(worker);
+	return -1;
+}
+
+/*
+ * Allocate the data stream consumption workers of a consumer context. This
+ * must be called before any data stream is added and before the data threads
+ * are launched; one consumer_thread_data_poll() thread must then be launched
+ * per worker.
+ *
+ * Return 0 on success or else a negative value.
+ */
+int lttng_consumer_create_data_workers(struct lttng_consumer_local_data *ctx,
+		unsigned int count)
+{
+	int ret;
+	unsigned int i;
+
+	assert(ctx);
+	assert(!ctx->data_workers);
+
+	if (count == 0) {
+		ERR("At least one data worker is required");
+		ret = -1;
+		goto end;
+	}
+
+	ctx->data_workers = zmalloc(count * sizeof(*ctx->data_workers));
+	if (!ctx->data_workers) {
+		PERROR("zmalloc data workers");
+		ret = -1;
+		goto end;
+	}
+
+	for (i = 0; i < count; i++) {
+		ret = init_data_worker(ctx, &ctx->data_workers[i], i);
+		if (ret) {
+			goto error;
+		}
+	}
+
+	ctx->nb_data_workers = count;
+	ctx->nb_running_data_workers = count;
+	DBG("Created %u data worker(s)", count);
+	ret = 0;
+	goto end;
+
+error:
+	while (i-- > 0) {
+		fini_data_worker(&ctx->data_workers[i]);
+	}
+	free(ctx->data_workers);
+	ctx->data_workers = NULL;
+end:
+	return ret;
+}
+
+/*
+ * Sample the throughput counters of a data worker.
+ */
+void lttng_consumer_get_data_worker_stats(
+		struct lttng_consumer_data_worker *worker,
+		struct lttng_consumer_data_worker_stats *stats)
+{
+	assert(worker);
+	assert(stats);
+
+	stats->bytes_consumed = uatomic_read(&worker->stats.bytes_consumed);
+	stats->subbuffers_consumed =
+			uatomic_read(&worker->stats.subbuffers_consumed);
+	stats->wakeups = uatomic_read(&worker->stats.wakeups);
+}
+
+/*
+ * Print the throughput counters of the data workers, which tell whether the
+ * data streams are evenly spread across them.
+ */
+void lttng_consumer_log_data_worker_stats(
+		struct lttng_consumer_local_data *ctx)
+{
+	unsigned int i;
+
+	for (i = 0; i < ctx->nb_data_workers; i++) {
+		struct lttng_consumer_data_worker_stats stats;
+
+		lttng_consumer_get_data_worker_stats(&ctx->data_workers[i],
+				&stats);
+		MSG("Data worker %u consumed %" PRIu64 " bytes in %" PRIu64
+				" sub-buffers, %" PRIu64 " wakeups",
+				i, stats.bytes_consumed,
+				stats.subbuffers_consumed, stats.wakeups);
+	}
+}
+
+/*
+ * Set the maximum number of bytes the data workers let a relayd data socket
+ * hold back to coalesce consecutive data packets. 0 disables batching. This
+ * must be called before the data threads are launched.
+ */
+void lttng_consumer_set_relayd_batch_size(
+		struct lttng_consumer_local_data *ctx, uint64_t size)
+{
+	assert(ctx);
+
+	ctx->relayd_batch_size = size;
+}
+
+/*
+ * Set the maximum number of threads used to snapshot the streams of a channel.
+ */
+void lttng_consumer_set_snapshot_thread_count(
+		struct lttng_consumer_local_data *ctx, unsigned int count)
+{
+	assert(ctx);
+	assert(count > 0);
+
+	ctx->snapshot_thread_count = count;
+}
+
+/*
+ * Make the sub-buffers written to the local output files skip their padding,
+ * when it spans at least a page, by extending the files rather than writing
+ * zeros. This must be called before the consumption threads are launched.
+ */
+void lttng_consumer_set_sparse_padding(bool enabled)
+{
+	sparse_padding = enabled;
+}
+
 /*
  * Iterate over all streams of the hashtable and free them properly.
  */
@@ -1469,8 +1743,6 @@ static void destroy_data_stream_ht(struct lttng_ht *ht)
 		(void) consumer_del_stream(stream, ht);
 	}
 	rcu_read_unlock();
-
-	lttng_ht_destroy(ht);
 }
 
 /*
@@ -1505,6 +1777,7 @@ static void destroy_metadata_stream_ht(struct lttng_ht *ht)
 void lttng_consumer_destroy(struct lttng_consumer_local_data *ctx)
 {
 	int ret;
+	unsigned int i;
 
 	DBG("Consumer destroying it. Closing everything.");
 
@@ -1512,7 +1785,11 @@ void lttng_consumer_destroy(struct lttng_consumer_local_data *ctx)
 		return;
 	}
 
-	destroy_data_stream_ht(data_ht);
+	for (i = 0; i < ctx->nb_data_workers; i++) {
+		destroy_data_stream_ht(ctx->data_workers[i].stream_ht);
+		fini_data_worker(&ctx->data_workers[i]);
+	}
+	free(ctx->data_workers);
 	destroy_metadata_stream_ht(metadata_ht);
 
 	ret = close(ctx->consumer_error_socket);
@@ -1524,9 +1801,7 @@ void lttng_consumer_destroy(struct lttng_consumer_local_data *ctx)
 		PERROR("close");
 	}
 	utils_close_pipe(ctx->consumer_channel_pipe);
-	lttng_pipe_destroy(ctx->consumer_data_pipe);
 	lttng_pipe_destroy(ctx->consumer_metadata_pipe);
-	lttng_pipe_destroy(ctx->consumer_wakeup_pipe);
 	utils_close_pipe(ctx->consumer_should_quit);
 
 	unlink(ctx->consumer_command_sock_path);
@@ -1612,8 +1887,6 @@ ssize_t lttng_consumer_on_read_subbuffer_mmap(
 
 	/* Handle stream on the relayd if the output is on the network */
 	if (relayd) {
-		unsigned long netlen = subbuf_content_size;
-
 		/*
 		 * Lock the control socket for the complete duration of the function
 		 * since from this point on we will use the socket.
@@ -1631,53 +1904,49 @@ ssize_t lttng_consumer_on_read_subbuffer_mmap(
 				}
 				stream->reset_metadata_flag = 0;
 			}
-			netlen += sizeof(struct lttcomm_relayd_metadata_payload);
 		}
 
-		ret = write_relayd_stream_header(stream, netlen, padding, relayd);
+		ret = write_relayd_packet(stream, relayd, buffer->data,
+				subbuf_content_size, padding);
+		DBG("Consumer relayd packet send ret %zd (len %zu)", ret,
+				subbuf_content_size);
 		if (ret < 0) {
+			/* Socket operation failed. We consider the relayd dead */
 			relayd_hang_up = 1;
 			goto write_error;
 		}
-		/* Use the returned socket. */
-		outfd = ret;
-
-		/* Write metadata stream id before payload */
-		if (stream->metadata_flag) {
-			ret = write_relayd_metadata_id(outfd, stream, padding);
-			if (ret < 0) {
-				relayd_hang_up = 1;
-				goto write_error;
-			}
-		}
+		stream->output_written += ret;
+		goto end;
+	}
 
-		write_len = subbuf_content_size;
-	} else {
-		/* No streaming; we have to write the full padding. */
-		if (stream->metadata_flag && stream->reset_metadata_flag) {
-			ret = utils_truncate_stream_file(stream->out_fd, 0);
-			if (ret < 0) {
-				ERR("Reset metadata file");
-				goto end;
-			}
-			stream->reset_metadata_flag = 0;
+	/* No streaming; we have to write the full padding. */
+	if (stream->metadata_flag && stream->reset_metadata_flag) {
+		ret = utils_truncate_stream_file(stream->out_fd, 0);
+		if (ret < 0) {
+			ERR("Reset metadata file");
+			goto end;
 		}
+		stream->reset_metadata_flag = 0;
+	}
 
-		/*
-		 * Check if we need to change the tracefile before writing the packet.
-		 */
-		if (stream->chan->tracefile_size > 0 &&
-				(stream->tracefile_size_current + buffer->size) >
-				stream->chan->tracefile_size) {
-			ret = consumer_stream_rotate_output_files(stream);
-			if (ret) {
-				goto end;
-			}
-			outfd = stream->out_fd;
-			orig_offset = 0;
+	/*
+	 * Check if we need to change the tracefile before writing the packet.
+	 */
+	if (stream->chan->tracefile_size > 0 &&
+			(stream->tracefile_size_current + buffer->size) >
+			stream->chan->tracefile_size) {
+		ret = consumer_stream_rotate_output_files(stream);
+		if (ret) {
+			goto end;
 		}
-		stream->tracefile_size_current += buffer->size;
-		write_len = buffer->size;
+		outfd = stream->out_fd;
+		orig_offset = 0;
+	}
+	stream->tracefile_size_current += buffer->size;
+	write_len = buffer->size;
+	if (sparse_padding && padding >= (unsigned long) PAGE_SIZE) {
+		/* The padding is skipped once the content is written. */
+		write_len = subbuf_content_size;
 	}
 
 	/*
@@ -1694,34 +1963,28 @@ ssize_t lttng_consumer_on_read_subbuffer_mmap(
 		if (ret < 0) {
 			ret = -errno;
 		}
-		relayd_hang_up = 1;
+		/* Unhandled error, print it and stop function right now. */
+		PERROR("Error in write mmap (ret %zd != write_len %zu)", ret,
+				write_len);
+		goto end;
+	}
 
-		/* Socket operation failed. We consider the relayd dead */
-		if (errno == EPIPE) {
-			/*
-			 * This is possible if the fd is closed on the other side
-			 * (outfd) or any write problem. It can be verbose a bit for a
-			 * normal execution if for instance the relayd is stopped
-			 * abruptly. This can happen so set this to a DBG statement.
-			 */
-			DBG("Consumer mmap write detected relayd hang up");
-		} else {
-			/* Unhandled error, print it and stop function right now. */
-			PERROR("Error in write mmap (ret %zd != write_len %zu)", ret,
-					write_len);
+	if (write_len != buffer->size) {
+		ret = utils_skip_file_range(outfd, buffer->size - write_len);
+		if (ret < 0) {
+			ERR("Failed to skip the padding of a sub-buffer");
+			ret = write_len;
+			goto end;
 		}
-		goto write_error;
+		ret = buffer->size;
 	}
 	stream->output_written += ret;
 
-	/* This call is useless on a socket so better save a syscall. */
-	if (!relayd) {
-		/* This won't block, but will start writeout asynchronously */
-		lttng_sync_file_range(outfd, stream->out_fd_offset, write_len,
-				SYNC_FILE_RANGE_WRITE);
-		stream->out_fd_offset += write_len;
-		lttng_consumer_sync_trace_file(stream, orig_offset);
-	}
+	/* This won't block, but will start writeout asynchronously */
+	lttng_sync_file_range(outfd, stream->out_fd_offset, buffer->size,
+			SYNC_FILE_RANGE_WRITE);
+	stream->out_fd_offset += buffer->size;
+	lttng_consumer_sync_trace_file(stream, orig_offset);
 
 write_error:
 	/*
@@ -1820,8 +2083,14 @@ ssize_t lttng_consumer_on_read_subbuffer_splice(
 			}
 
 			total_len += sizeof(struct lttcomm_relayd_metadata_payload);
-		}
-
+		} else {
+			/*
+			 * Lock the data socket so the spliced payload directly follows
+			 * its header.
+			 */
+			pthread_mutex_lock(&relayd->data_sock_mutex);
+		}
+
 		ret = write_relayd_stream_header(stream, total_len, padding, relayd);
 		if (ret < 0) {
 			written = ret;
@@ -1956,6 +2225,8 @@ splice_error:
 end:
 	if (relayd && stream->metadata_flag) {
 		pthread_mutex_unlock(&relayd->ctrl_sock_mutex);
+	} else if (relayd) {
+		pthread_mutex_unlock(&relayd->data_sock_mutex);
 	}
 
 	rcu_read_unlock();
@@ -2226,23 +2497,196 @@ void consumer_add_metadata_stream(struct lttng_consumer_stream *stream)
 }
 
 /*
- * Delete data stream that are flagged for deletion (endpoint_status).
+ * Find a stream of the poll set of a data worker using its wait fd.
+ *
+ * Return the stream or NULL if no polled stream uses that fd.
+ */
+static struct lttng_consumer_stream *data_worker_find_stream(
+		struct lttng_consumer_data_worker *worker, int wait_fd)
+{
+	uint64_t key = (uint64_t) wait_fd;
+	struct lttng_ht_iter iter;
+	struct lttng_ht_node_u64 *node;
+	struct lttng_consumer_stream *stream = NULL;
+
+	rcu_read_lock();
+	lttng_ht_lookup(worker->wait_fd_ht, &key, &iter);
+	node = lttng_ht_iter_get_node_u64(&iter);
+	if (node) {
+		stream = caa_container_of(node, struct lttng_consumer_stream,
+				node_wait_fd);
+	}
+	rcu_read_unlock();
+
+	return stream;
+}
+
+/*
+ * Add a data stream received on the data pipe to the poll set of its worker.
+ *
+ * Only streams with an active end point are polled. A stream whose end point
+ * became inactive before it reached the worker is deleted right away since
+ * the notification covering it may already have been handled.
+ *
+ * Return 0 on success or else a negative value.
+ */
+static int data_worker_add_stream(struct lttng_consumer_data_worker *worker,
+		struct lttng_poll_event *pollset,
+		struct lttng_consumer_stream *stream)
+{
+	int ret;
+
+	if (stream->endpoint_status == CONSUMER_ENDPOINT_INACTIVE) {
+		consumer_del_stream(stream, worker->stream_ht);
+		ret = 0;
+		goto end;
+	}
+
+	DBG("Adding data stream %d to poll set of data worker %u",
+			stream->wait_fd, worker->id);
+
+	ret = lttng_poll_add(pollset, stream->wait_fd, LPOLLIN | LPOLLPRI);
+	if (ret < 0) {
+		ERR("Failed to add data stream %d to poll set", stream->wait_fd);
+		consumer_del_stream(stream, worker->stream_ht);
+		goto end;
+	}
+
+	lttng_ht_node_init_u64(&stream->node_wait_fd, stream->wait_fd);
+	rcu_read_lock();
+	lttng_ht_add_unique_u64(worker->wait_fd_ht, &stream->node_wait_fd);
+	rcu_read_unlock();
+
+end:
+	return ret;
+}
+
+/*
+ * Remove a stream from the poll set of its worker and delete it.
+ */
+static void data_worker_del_stream(struct lttng_consumer_data_worker *worker,
+		struct lttng_poll_event *pollset,
+		struct lttng_consumer_stream *stream)
+{
+	int ret;
+	struct lttng_ht_iter iter;
+
+	lttng_poll_del(pollset, stream->wait_fd);
+
+	rcu_read_lock();
+	iter.iter.node = &stream->node_wait_fd.node;
+	ret = lttng_ht_del(worker->wait_fd_ht, &iter);
+	assert(!ret);
+	rcu_read_unlock();
+
+	cds_list_del_init(&stream->data_pending_node);
+	consumer_del_stream(stream, worker->stream_ht);
+}
+
+/*
+ * Track whether a polled stream must be consumed even if its wait fd is not
+ * ready, that is if it still holds data or was flushed after a hang up.
+ */
+static void data_worker_update_pending(struct lttng_consumer_data_worker *worker,
+		struct lttng_consumer_stream *stream)
+{
+	const bool pending = stream->has_data || stream->hangup_flush_done;
+
+	if (pending && cds_list_empty(&stream->data_pending_node)) {
+		cds_list_add_tail(&stream->data_pending_node,
+				&worker->pending_stream_list);
+	} else if (!pending) {
+		cds_list_del_init(&stream->data_pending_node);
+	}
+}
+
+/*
+ * Push out the data packets that the sends batched by a data worker left held
+ * back on the relayd data sockets.
+ */
+static void data_worker_push_relayd_batches(
+		struct lttng_consumer_data_worker *worker)
+{
+	struct lttng_ht_iter iter;
+	struct consumer_relayd_sock_pair *relayd;
+
+	if (!worker->relayd_batch_pending) {
+		return;
+	}
+
+	rcu_read_lock();
+	cds_lfht_for_each_entry(consumer_data.relayd_ht->ht, &iter.iter, relayd,
+			node.node) {
+		pthread_mutex_lock(&relayd->data_sock_mutex);
+		if (relayd->data_sock_batched_bytes > 0) {
+			DBG3("Data worker %u pushing %" PRIu64 " bytes to relayd %" PRIu64,
+					worker->id, relayd->data_sock_batched_bytes,
+					relayd->net_seq_idx);
+			(void) relayd_push_data(&relayd->data_sock);
+			relayd->data_sock_batched_bytes = 0;
+		}
+		pthread_mutex_unlock(&relayd->data_sock_mutex);
+	}
+	rcu_read_unlock();
+
+	worker->relayd_batch_pending = false;
+}
+
+/*
+ * Empty the poll state of a data worker on exit of its data thread. The
+ * streams themselves remain in the worker's stream_ht.
+ */
+static void data_worker_clear_poll_state(
+		struct lttng_consumer_data_worker *worker)
+{
+	struct lttng_ht_iter iter;
+	struct lttng_consumer_stream *stream, *tmp;
+
+	rcu_read_lock();
+	cds_lfht_for_each_entry(worker->wait_fd_ht->ht, &iter.iter, stream,
+			node_wait_fd.node) {
+		int ret;
+
+		ret = lttng_ht_del(worker->wait_fd_ht, &iter);
+		assert(!ret);
+	}
+	rcu_read_unlock();
+
+	cds_list_for_each_entry_safe(stream, tmp, &worker->pending_stream_list,
+			data_pending_node) {
+		cds_list_del_init(&stream->data_pending_node);
+	}
+}
+
+/*
+ * Delete the polled data streams of a worker that are flagged for deletion
+ * (endpoint_status).
  */
-static void validate_endpoint_status_data_stream(void)
+static void validate_endpoint_status_data_stream(
+		struct lttng_consumer_data_worker *worker,
+		struct lttng_poll_event *pollset)
 {
 	struct lttng_ht_iter iter;
 	struct lttng_consumer_stream *stream;
 
-	DBG("Consumer delete flagged data stream");
+	DBG("Consumer delete flagged data stream of data worker %u",
+			worker->id);
+
+	assert(pollset);
 
+	/*
+	 * Streams still in transit in the data pipe are not validated here.
+	 * They are checked when they are added to the poll set.
+	 */
 	rcu_read_lock();
-	cds_lfht_for_each_entry(data_ht->ht, &iter.iter, stream, node.node) {
+	cds_lfht_for_each_entry(worker->wait_fd_ht->ht, &iter.iter, stream,
+			node_wait_fd.node) {
 		/* Validate delete flag of the stream */
 		if (stream->endpoint_status == CONSUMER_ENDPOINT_ACTIVE) {
 			continue;
 		}
 		/* Delete it right now */
-		consumer_del_stream(stream, data_ht);
+		data_worker_del_stream(worker, pollset, stream);
 	}
 	rcu_read_unlock();
 }
@@ -2494,37 +2938,77 @@ error_testpoint:
 }
 
 /*
- * This thread polls the fds in the set to consume the data and write
- * it to tracefile if necessary.
+ * Consume data from a stream on behalf of a data worker and account for it in
+ * the worker's throughput counters. The stream is removed from the poll set
+ * and deleted on unrecoverable error.
  */
-void *consumer_thread_data_poll(void *data)
+static void data_worker_consume_stream(
+		struct lttng_consumer_data_worker *worker,
+		struct lttng_poll_event *pollset,
+		struct lttng_consumer_stream *stream)
 {
-	int num_rdy, num_hup, high_prio, ret, i, err = -1;
-	struct pollfd *pollfd = NULL;
-	/* local view of the streams */
-	struct lttng_consumer_stream **local_stream = NULL, *new_stream = NULL;
-	/* local view of consumer_data.fds_count */
-	int nb_fd = 0;
-	/* 2 for the consumer_data_pipe and wake up pipe */
-	const int nb_pipes_fd = 2;
-	/* Number of FDs with CONSUMER_ENDPOINT_INACTIVE but still open. */
-	int nb_inactive_fd = 0;
-	struct lttng_consumer_local_data *ctx = data;
 	ssize_t len;
 
+	len = worker->ctx->on_buffer_ready(stream, worker->ctx, false);
+	/* it's ok to have an unavailable sub-buffer */
+	if (len < 0 && len != -EAGAIN && len != -ENODATA) {
+		/* Clean the stream and free it. */
+		data_worker_del_stream(worker, pollset, stream);
+		return;
+	} else if (len > 0) {
+		uatomic_add(&worker->stats.bytes_consumed, len);
+		uatomic_inc(&worker->stats.subbuffers_consumed);
+		stream->data_read = 1;
+	}
+	data_worker_update_pending(worker, stream);
+}
+
+/*
+ * This thread polls the fds of the data streams owned by a data worker to
+ * consume the data and write it to tracefile if necessary. One such thread is
+ * launched per data worker.
+ *
+ * Streams are added to the worker's poll set as they are received on its data
+ * pipe and removed from it when they are deleted, so that each wake up only
+ * visits the streams that are ready along with those flagged as pending.
+ */
+void *consumer_thread_data_poll(void *data)
+{
+	int ret, i, pollfd, nb_streams, high_prio, err = -1;
+	uint32_t revents, nb_fd;
+	struct lttng_poll_event events;
+	struct lttng_consumer_stream *stream, *tmp, *new_stream = NULL;
+	struct lttng_consumer_data_worker *worker = data;
+	struct lttng_consumer_local_data *ctx = worker->ctx;
+	const int data_pipe_fd = lttng_pipe_get_readfd(worker->data_pipe);
+	const int wakeup_pipe_fd = lttng_pipe_get_readfd(worker->wakeup_pipe);
+
 	rcu_register_thread();
 
 	health_register(health_consumerd, HEALTH_CONSUMERD_TYPE_DATA);
 
+	URCU_TLS(current_data_worker) = worker;
+
 	if (testpoint(consumerd_thread_data)) {
 		goto error_testpoint;
 	}
 
 	health_code_update();
 
-	local_stream = zmalloc(sizeof(struct lttng_consumer_stream *));
-	if (local_stream == NULL) {
-		PERROR("local_stream malloc");
+	/* Size is set to 2 for the worker's data pipe and wake up pipe. */
+	ret = lttng_poll_create(&events, 2, LTTNG_CLOEXEC);
+	if (ret < 0) {
+		ERR("Poll set creation failed");
+		goto end_poll;
+	}
+
+	ret = lttng_poll_add(&events, data_pipe_fd, LPOLLIN | LPOLLPRI);
+	if (ret < 0) {
+		goto end;
+	}
+
+	ret = lttng_poll_add(&events, wakeup_pipe_fd, LPOLLIN | LPOLLPRI);
+	if (ret < 0) {
 		goto end;
 	}
 
@@ -2532,65 +3016,35 @@ void *consumer_thread_data_poll(void *data)
 		health_code_update();
 
 		high_prio = 0;
-		num_hup = 0;
 
 		/*
-		 * the fds set has been updated, we need to update our
-		 * local array as well
+		 * The sends batched while consuming the ready streams must not be
+		 * held back while waiting for the next events.
 		 */
-		pthread_mutex_lock(&consumer_data.lock);
-		if (consumer_data.need_update) {
-			free(pollfd);
-			pollfd = NULL;
-
-			free(local_stream);
-			local_stream = NULL;
-
-			/* Allocate for all fds */
-			pollfd = zmalloc((consumer_data.stream_count + nb_pipes_fd) * sizeof(struct pollfd));
-			if (pollfd == NULL) {
-				PERROR("pollfd malloc");
-				pthread_mutex_unlock(&consumer_data.lock);
-				goto end;
-			}
+		data_worker_push_relayd_batches(worker);
 
-			local_stream = zmalloc((consumer_data.stream_count + nb_pipes_fd) *
-					sizeof(struct lttng_consumer_stream *));
-			if (local_stream == NULL) {
-				PERROR("local_stream malloc");
-				pthread_mutex_unlock(&consumer_data.lock);
-				goto end;
-			}
-			ret = update_poll_array(ctx, &pollfd, local_stream,
-					data_ht, &nb_inactive_fd);
-			if (ret < 0) {
-				ERR("Error in allocating pollfd or local_outfds");
-				lttng_consumer_send_error(ctx, LTTCOMM_CONSUMERD_POLL_ERROR);
-				pthread_mutex_unlock(&consumer_data.lock);
-				goto end;
-			}
-			nb_fd = ret;
-			consumer_data.need_update = 0;
-		}
+		pthread_mutex_lock(&consumer_data.lock);
+		nb_streams = worker->stream_count;
 		pthread_mutex_unlock(&consumer_data.lock);
 
-		/* No FDs and consumer_quit, consumer_cleanup the thread */
-		if (nb_fd == 0 && nb_inactive_fd == 0 &&
-				CMM_LOAD_SHARED(consumer_quit) == 1) {
+		/* No streams and consumer_quit, consumer_cleanup the thread */
+		if (nb_streams == 0 && CMM_LOAD_SHARED(consumer_quit) == 1) {
 			err = 0;	/* All is OK */
 			goto end;
 		}
-		/* poll on the array of fds */
+
 	restart:
-		DBG("polling on %d fd", nb_fd + nb_pipes_fd);
+		DBG("Data worker %u polling on %d fd", worker->id,
+				LTTNG_POLL_GETNB(&events));
 		if (testpoint(consumerd_thread_data_poll)) {
 			goto end;
 		}
 		health_poll_entry();
-		num_rdy = poll(pollfd, nb_fd + nb_pipes_fd, -1);
+		ret = lttng_poll_wait(&events, -1);
 		health_poll_exit();
-		DBG("poll num_rdy : %d", num_rdy);
-		if (num_rdy == -1) {
+		DBG("Data worker %u poll return with %d fd(s)", worker->id, ret);
+		uatomic_inc(&worker->stats.wakeups);
+		if (ret < 0) {
 			/*
 			 * Restart interrupted system call.
 			 */
@@ -2600,11 +3054,13 @@ void *consumer_thread_data_poll(void *data)
 			PERROR("Poll error");
 			lttng_consumer_send_error(ctx, LTTCOMM_CONSUMERD_POLL_ERROR);
 			goto end;
-		} else if (num_rdy == 0) {
+		} else if (ret == 0) {
 			DBG("Polling thread timed out");
 			goto end;
 		}
 
+		nb_fd = ret;
+
 		if (caa_unlikely(data_consumption_paused)) {
 			DBG("Data consumption paused, sleeping...");
 			sleep(1);
@@ -2612,70 +3068,77 @@ void *consumer_thread_data_poll(void *data)
 		}
 
 		/*
-		 * If the consumer_data_pipe triggered poll go directly to the
-		 * beginning of the loop to update the array. We want to prioritize
-		 * array update over low-priority reads.
+		 * Handle the pipes first. If the worker's data pipe triggered the
+		 * poll, go directly to the beginning of the loop once the poll set is
+		 * updated. We want to prioritize poll set updates over low-priority
+		 * reads.
 		 */
-		if (pollfd[nb_fd].revents & (POLLIN | POLLPRI)) {
-			ssize_t pipe_readlen;
-
-			DBG("consumer_data_pipe wake up");
-			pipe_readlen = lttng_pipe_read(ctx->consumer_data_pipe,
-					&new_stream, sizeof(new_stream));
-			if (pipe_readlen < sizeof(new_stream)) {
-				PERROR("Consumer data pipe");
-				/* Continue so we can at least handle the current stream(s). */
-				continue;
-			}
-
-			/*
-			 * If the stream is NULL, just ignore it. It's also possible that
-			 * the sessiond poll thread changed the consumer_quit state and is
-			 * waking us up to test it.
-			 */
-			if (new_stream == NULL) {
-				validate_endpoint_status_data_stream();
-				continue;
-			}
-
-			/* Continue to update the local streams and handle prio ones */
-			continue;
-		}
+		for (i = 0; i < nb_fd; i++) {
+			revents = LTTNG_POLL_GETEV(&events, i);
+			pollfd = LTTNG_POLL_GETFD(&events, i);
 
-		/* Handle wakeup pipe. */
-		if (pollfd[nb_fd + 1].revents & (POLLIN | POLLPRI)) {
-			char dummy;
-			ssize_t pipe_readlen;
+			if (pollfd == data_pipe_fd &&
+					(revents & (LPOLLIN | LPOLLPRI))) {
+				ssize_t pipe_readlen;
+
+				DBG("Data worker %u data pipe wake up", worker->id);
+				pipe_readlen = lttng_pipe_read(worker->data_pipe,
+						&new_stream, sizeof(new_stream));
+				if (pipe_readlen < sizeof(new_stream)) {
+					PERROR("Consumer data pipe");
+					/* Continue so we can at least handle the current stream(s). */
+					break;
+				}
 
-			pipe_readlen = lttng_pipe_read(ctx->consumer_wakeup_pipe, &dummy,
-					sizeof(dummy));
-			if (pipe_readlen < 0) {
-				PERROR("Consumer data wakeup pipe");
+				/*
+				 * A NULL stream means that the endpoint status of
+				 * streams has changed. It's also possible that the
+				 * sessiond poll thread changed the consumer_quit state
+				 * and is waking us up to test it.
+				 */
+				if (new_stream == NULL) {
+					validate_endpoint_status_data_stream(worker,
+							&events);
+				} else {
+					(void) data_worker_add_stream(worker, &events,
+							new_stream);
+				}
+				break;
+			} else if (pollfd == wakeup_pipe_fd &&
+					(revents & (LPOLLIN | LPOLLPRI))) {
+				char dummy;
+				ssize_t pipe_readlen;
+
+				pipe_readlen = lttng_pipe_read(worker->wakeup_pipe,
+						&dummy, sizeof(dummy));
+				if (pipe_readlen < 0) {
+					PERROR("Consumer data wakeup pipe");
+				}
+				/* We've been awakened to handle stream(s). */
+				worker->has_wakeup = 0;
 			}
-			/* We've been awakened to handle stream(s). */
-			ctx->has_wakeup = 0;
+		}
+		if (i < nb_fd) {
+			/* The data pipe was handled, update the poll state. */
+			continue;
 		}
 
 		/* Take care of high priority channels first. */
 		for (i = 0; i < nb_fd; i++) {
 			health_code_update();
 
-			if (local_stream[i] == NULL) {
+			revents = LTTNG_POLL_GETEV(&events, i);
+			if (!(revents & LPOLLPRI)) {
 				continue;
 			}
-			if (pollfd[i].revents & POLLPRI) {
-				DBG("Urgent read on fd %d", pollfd[i].fd);
-				high_prio = 1;
-				len = ctx->on_buffer_ready(local_stream[i], ctx, false);
-				/* it's ok to have an unavailable sub-buffer */
-				if (len < 0 && len != -EAGAIN && len != -ENODATA) {
-					/* Clean the stream and free it. */
-					consumer_del_stream(local_stream[i], data_ht);
-					local_stream[i] = NULL;
-				} else if (len > 0) {
-					local_stream[i]->data_read = 1;
-				}
+			pollfd = LTTNG_POLL_GETFD(&events, i);
+			stream = data_worker_find_stream(worker, pollfd);
+			if (stream == NULL) {
+				continue;
 			}
+			DBG("Urgent read on fd %d", pollfd);
+			high_prio = 1;
+			data_worker_consume_stream(worker, &events, stream);
 		}
 
 		/*
@@ -2686,94 +3149,110 @@ void *consumer_thread_data_poll(void *data)
 			continue;
 		}
 
-		/* Take care of low priority channels. */
+		/*
+		 * Take care of low priority channels, starting with the streams that
+		 * still hold data or were flushed after a hang up. Those remaining
+		 * pending after being consumed are skipped below so that each stream
+		 * is consumed at most once per pass.
+		 */
+		cds_list_for_each_entry_safe(stream, tmp,
+				&worker->pending_stream_list, data_pending_node) {
+			health_code_update();
+
+			DBG("Normal read on pending fd %d", stream->wait_fd);
+			data_worker_consume_stream(worker, &events, stream);
+		}
+
 		for (i = 0; i < nb_fd; i++) {
 			health_code_update();
 
-			if (local_stream[i] == NULL) {
+			revents = LTTNG_POLL_GETEV(&events, i);
+			if (!(revents & LPOLLIN)) {
 				continue;
 			}
-			if ((pollfd[i].revents & POLLIN) ||
-					local_stream[i]->hangup_flush_done ||
-					local_stream[i]->has_data) {
-				DBG("Normal read on fd %d", pollfd[i].fd);
-				len = ctx->on_buffer_ready(local_stream[i], ctx, false);
-				/* it's ok to have an unavailable sub-buffer */
-				if (len < 0 && len != -EAGAIN && len != -ENODATA) {
-					/* Clean the stream and free it. */
-					consumer_del_stream(local_stream[i], data_ht);
-					local_stream[i] = NULL;
-				} else if (len > 0) {
-					local_stream[i]->data_read = 1;
-				}
+			pollfd = LTTNG_POLL_GETFD(&events, i);
+			stream = data_worker_find_stream(worker, pollfd);
+			if (stream == NULL ||
+					!cds_list_empty(&stream->data_pending_node)) {
+				continue;
 			}
+			DBG("Normal read on fd %d", pollfd);
+			data_worker_consume_stream(worker, &events, stream);
 		}
 
 		/* Handle hangup and errors */
 		for (i = 0; i < nb_fd; i++) {
 			health_code_update();
 
-			if (local_stream[i] == NULL) {
+			revents = LTTNG_POLL_GETEV(&events, i);
+			pollfd = LTTNG_POLL_GETFD(&events, i);
+			stream = data_worker_find_stream(worker, pollfd);
+			if (stream == NULL) {
 				continue;
 			}
-			if (!local_stream[i]->hangup_flush_done
-					&& (pollfd[i].revents & (POLLHUP | POLLERR | POLLNVAL))
+			if (!stream->hangup_flush_done
+					&& (revents & (LPOLLHUP | LPOLLERR | LPOLLNVAL))
 					&& (consumer_data.type == LTTNG_CONSUMER32_UST
 						|| consumer_data.type == LTTNG_CONSUMER64_UST)) {
 				DBG("fd %d is hup|err|nval. Attempting flush and read.",
-						pollfd[i].fd);
-				lttng_ustconsumer_on_stream_hangup(local_stream[i]);
+						pollfd);
+				lttng_ustconsumer_on_stream_hangup(stream);
 				/* Attempt read again, for the data we just flushed. */
-				local_stream[i]->data_read = 1;
+				stream->data_read = 1;
+				data_worker_update_pending(worker, stream);
 			}
 			/*
 			 * If the poll flag is HUP/ERR/NVAL and we have
 			 * read no data in this pass, we can remove the
 			 * stream from its hash table.
 			 */
-			if ((pollfd[i].revents & POLLHUP)) {
-				DBG("Polling fd %d tells it has hung up.", pollfd[i].fd);
-				if (!local_stream[i]->data_read) {
-					consumer_del_stream(local_stream[i], data_ht);
-					local_stream[i] = NULL;
-					num_hup++;
+			if ((revents & LPOLLHUP)) {
+				DBG("Polling fd %d tells it has hung up.", pollfd);
+				if (!stream->data_read) {
+					data_worker_del_stream(worker, &events, stream);
+					continue;
 				}
-			} else if (pollfd[i].revents & POLLERR) {
-				ERR("Error returned in polling fd %d.", pollfd[i].fd);
-				if (!local_stream[i]->data_read) {
-					consumer_del_stream(local_stream[i], data_ht);
-					local_stream[i] = NULL;
-					num_hup++;
+			} else if (revents & LPOLLERR) {
+				ERR("Error returned in polling fd %d.", pollfd);
+				if (!stream->data_read) {
+					data_worker_del_stream(worker, &events, stream);
+					continue;
 				}
-			} else if (pollfd[i].revents & POLLNVAL) {
-				ERR("Polling fd %d tells fd is not open.", pollfd[i].fd);
-				if (!local_stream[i]->data_read) {
-					consumer_del_stream(local_stream[i], data_ht);
-					local_stream[i] = NULL;
-					num_hup++;
+			} else if (revents & LPOLLNVAL) {
+				ERR("Polling fd %d tells fd is not open.", pollfd);
+				if (!stream->data_read) {
+					data_worker_del_stream(worker, &events, stream);
+					continue;
 				}
 			}
-			if (local_stream[i] != NULL) {
-				local_stream[i]->data_read = 0;
-			}
+			stream->data_read = 0;
+		}
+
+		cds_list_for_each_entry(stream, &worker->pending_stream_list,
+				data_pending_node) {
+			stream->data_read = 0;
 		}
 	}
 	/* All is OK */
 	err = 0;
 end:
-	DBG("polling thread exiting");
-	free(pollfd);
-	free(local_stream);
+	data_worker_push_relayd_batches(worker);
+	data_worker_clear_poll_state(worker);
+	lttng_poll_clean(&events);
+end_poll:
+	DBG("Data worker %u polling thread exiting", worker->id);
 
 	/*
-	 * Close the write side of the pipe so epoll_wait() in
-	 * consumer_thread_metadata_poll can catch it. The thread is monitoring the
-	 * read side of the pipe. If we close them both, epoll_wait strangely does
-	 * not return and could create a endless wait period if the pipe is the
-	 * only tracked fd in the poll set. The thread will take care of closing
-	 * the read side.
+	 * The last data worker to exit closes the write side of the pipe so
+	 * epoll_wait() in consumer_thread_metadata_poll can catch it. The thread
+	 * is monitoring the read side of the pipe. If we close them both,
+	 * epoll_wait strangely does not return and could create a endless wait
+	 * period if the pipe is the only tracked fd in the poll set. The thread
+	 * will take care of closing the read side.
 	 */
-	(void) lttng_pipe_write_close(ctx->consumer_metadata_pipe);
+	if (uatomic_sub_return(&ctx->nb_running_data_workers, 1) == 0) {
+		(void) lttng_pipe_write_close(ctx->consumer_metadata_pipe);
+	}
 
 error_testpoint:
 	if (err) {
@@ -3279,7 +3758,7 @@ end:
 	 * Notify the data poll thread to poll back again and test the
 	 * consumer_quit state that we just set so to quit gracefully.
 	 */
-	notify_thread_lttng_pipe(ctx->consumer_data_pipe);
+	notify_data_workers(ctx);
 
 	notify_channel_pipe(ctx, NULL, -1, CONSUMER_CHANNEL_QUIT);
 
@@ -3484,11 +3963,6 @@ int lttng_consumer_init(void)
 		goto error;
 	}
 
-	data_ht = lttng_ht_new(0, LTTNG_HT_TYPE_U64);
-	if (!data_ht) {
-		goto error;
-	}
-
 	metadata_ht = lttng_ht_new(0, LTTNG_HT_TYPE_U64);
 	if (!metadata_ht) {
 		goto error;
@@ -3909,6 +4383,325 @@ unsigned long consumer_get_consume_start_pos(unsigned long consumed_pos,
 	return start_pos;
 }
 
+struct snapshot_streams_state {
+	struct lttng_consumer_stream **streams;
+	/* Duration of the snapshot of each stream, in nanoseconds. */
+	uint64_t *durations_ns;
+	unsigned int count;
+	/* Index of the next stream to snapshot. */
+	unsigned int next;
+	/* First error reported by a snapshot thread. */
+	int ret;
+	int (*snapshot_stream)(struct lttng_consumer_stream *stream,
+			void *data);
+	void *data;
+};
+
+/*
+ * Nanoseconds elapsed between two CLOCK_MONOTONIC samples.
+ */
+static uint64_t timespec_diff_ns(const struct timespec *start,
+		const struct timespec *end)
+{
+	return (uint64_t) (end->tv_sec - start->tv_sec) * NSEC_PER_SEC +
+			end->tv_nsec - start->tv_nsec;
+}
+
+/*
+ * Snapshot the streams of the shared state until all of them have been
+ * claimed or a snapshot fails. Called by every snapshot thread, including the
+ * one handling the session daemon command.
+ */
+static void snapshot_streams(struct snapshot_streams_state *state)
+{
+	for (;;) {
+		int ret;
+		unsigned int i;
+		struct timespec start, end;
+
+		if (uatomic_read(&state->ret)) {
+			break;
+		}
+
+		i = uatomic_add_return(&state->next, 1) - 1;
+		if (i >= state->count) {
+			break;
+		}
+
+		ret = lttng_clock_gettime(CLOCK_MONOTONIC, &start);
+		if (ret) {
+			PERROR("clock_gettime");
+			(void) uatomic_cmpxchg(&state->ret, 0, -1);
+			break;
+		}
+
+		rcu_read_lock();
+		ret = state->snapshot_stream(state->streams[i], state->data);
+		rcu_read_unlock();
+		if (ret < 0) {
+			(void) uatomic_cmpxchg(&state->ret, 0, ret);
+			break;
+		}
+
+		ret = lttng_clock_gettime(CLOCK_MONOTONIC, &end);
+		if (ret) {
+			PERROR("clock_gettime");
+			(void) uatomic_cmpxchg(&state->ret, 0, -1);
+			break;
+		}
+		state->durations_ns[i] = timespec_diff_ns(&start, &end);
+	}
+}
+
+/*
+ * Entry point of the snapshot threads. Each thread takes part in every
+ * channel snapshot posted to the pool until it must exit.
+ */
+static void *thread_snapshot_streams(void *data)
+{
+	struct lttng_consumer_snapshot_pool *pool = data;
+	uint64_t last_snapshot_id = 0;
+
+	rcu_register_thread();
+
+	pthread_mutex_lock(&pool->lock);
+	for (;;) {
+		struct snapshot_streams_state *state;
+
+		if (pool->quit) {
+			break;
+		}
+
+		if (!pool->snapshot || pool->snapshot_id == last_snapshot_id) {
+			pthread_cond_wait(&pool->snapshot_cond, &pool->lock);
+			continue;
+		}
+
+		state = pool->snapshot;
+		last_snapshot_id = pool->snapshot_id;
+		pool->nb_busy_threads++;
+		pthread_mutex_unlock(&pool->lock);
+
+		snapshot_streams(state);
+
+		pthread_mutex_lock(&pool->lock);
+		pool->nb_busy_threads--;
+		pthread_cond_signal(&pool->done_cond);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	rcu_unregister_thread();
+	return NULL;
+}
+
+/*
+ * Launch the threads helping the thread handling the session daemon commands
+ * record the channel snapshots: one less than the snapshot thread count.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int lttng_consumer_launch_snapshot_threads(
+		struct lttng_consumer_local_data *ctx)
+{
+	int ret = 0;
+	unsigned int i;
+	struct lttng_consumer_snapshot_pool *pool = &ctx->snapshot_pool;
+	const unsigned int count = ctx->snapshot_thread_count - 1;
+
+	if (count == 0) {
+		goto end;
+	}
+
+	pool->threads = zmalloc(count * sizeof(*pool->threads));
+	if (!pool->threads) {
+		PERROR("zmalloc snapshot threads");
+		ret = -1;
+		goto end;
+	}
+
+	for (i = 0; i < count; i++) {
+		ret = pthread_create(&pool->threads[i], default_pthread_attr(),
+				thread_snapshot_streams, pool);
+		if (ret) {
+			errno = ret;
+			PERROR("pthread_create snapshot thread");
+			ret = -1;
+			goto end;
+		}
+		pool->nb_threads++;
+	}
+end:
+	return ret;
+}
+
+/*
+ * Make the snapshot threads exit and join them. No snapshot must be recorded
+ * anymore.
+ */
+void lttng_consumer_stop_snapshot_threads(
+		struct lttng_consumer_local_data *ctx)
+{
+	int ret;
+	unsigned int i;
+	struct lttng_consumer_snapshot_pool *pool = &ctx->snapshot_pool;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->quit = true;
+	pthread_cond_broadcast(&pool->snapshot_cond);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (i = 0; i < pool->nb_threads; i++) {
+		ret = pthread_join(pool->threads[i], NULL);
+		if (ret) {
+			errno = ret;
+			PERROR("pthread_join snapshot thread");
+		}
+	}
+
+	free(pool->threads);
+	pool->threads = NULL;
+	pool->nb_threads = 0;
+}
+
+/*
+ * Print the latency of the channel snapshots recorded since the consumer
+ * daemon was launched, if any.
+ */
+void lttng_consumer_log_snapshot_stats(struct lttng_consumer_local_data *ctx)
+{
+	struct lttng_consumer_snapshot_stats stats;
+
+	pthread_mutex_lock(&ctx->snapshot_pool.lock);
+	stats = ctx->snapshot_stats;
+	pthread_mutex_unlock(&ctx->snapshot_pool.lock);
+
+	if (!stats.channel_count) {
+		return;
+	}
+
+	MSG("Recorded %" PRIu64 " channel snapshots of %" PRIu64
+			" streams: per channel avg %" PRIu64 " ns, max %" PRIu64
+			" ns; per stream avg %" PRIu64 " ns, max %" PRIu64 " ns",
+			stats.channel_count, stats.stream_count,
+			stats.total_ns / stats.channel_count, stats.max_ns,
+			stats.stream_count ?
+				stats.stream_total_ns / stats.stream_count : 0,
+			stats.stream_max_ns);
+}
+
+/*
+ * Snapshot all the streams of a channel with the snapshot threads. The
+ * calling thread takes part in the snapshot.
+ *
+ * The streams are handed out one at a time to the threads, which call
+ * snapshot_stream() on them. The first error stops the distribution of the
+ * remaining streams and is returned once all threads are done.
+ *
+ * The latency of a successful snapshot is accounted for in the snapshot
+ * statistics of the consumer daemon.
+ *
+ * The channel lock must be held by the caller so that its stream list does not
+ * change.
+ */
+int consumer_snapshot_channel_streams(struct lttng_consumer_channel *channel,
+		struct lttng_consumer_local_data *ctx,
+		int (*snapshot_stream)(struct lttng_consumer_stream *stream,
+			void *data),
+		void *data)
+{
+	int ret;
+	unsigned int i;
+	uint64_t total_ns;
+	struct lttng_consumer_stream *stream;
+	struct snapshot_streams_state state = {};
+	struct lttng_consumer_snapshot_pool *pool = &ctx->snapshot_pool;
+	struct lttng_consumer_snapshot_stats *stats = &ctx->snapshot_stats;
+	struct timespec start, end;
+
+	assert(channel);
+	assert(ctx);
+	assert(snapshot_stream);
+
+	ret = lttng_clock_gettime(CLOCK_MONOTONIC, &start);
+	if (ret) {
+		PERROR("clock_gettime");
+		ret = -1;
+		goto end;
+	}
+
+	state.snapshot_stream = snapshot_stream;
+	state.data = data;
+	cds_list_for_each_entry(stream, &channel->streams.head, send_node) {
+		state.count++;
+	}
+
+	if (state.count > 0) {
+		state.streams = zmalloc(state.count * sizeof(*state.streams));
+		state.durations_ns = zmalloc(
+				state.count * sizeof(*state.durations_ns));
+		if (!state.streams || !state.durations_ns) {
+			PERROR("zmalloc snapshot streams");
+			ret = -ENOMEM;
+			goto end;
+		}
+	}
+	i = 0;
+	cds_list_for_each_entry(stream, &channel->streams.head, send_node) {
+		state.streams[i++] = stream;
+	}
+
+	/* Only post the snapshot if the threads have more than one stream. */
+	pthread_mutex_lock(&pool->lock);
+	if (state.count > 1 && pool->nb_threads > 0) {
+		pool->snapshot = &state;
+		pool->snapshot_id++;
+		pthread_cond_broadcast(&pool->snapshot_cond);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	snapshot_streams(&state);
+
+	/* Keep the threads from joining and wait for those which did. */
+	pthread_mutex_lock(&pool->lock);
+	pool->snapshot = NULL;
+	while (pool->nb_busy_threads > 0) {
+		pthread_cond_wait(&pool->done_cond, &pool->lock);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	ret = uatomic_read(&state.ret);
+	if (ret < 0) {
+		goto end;
+	}
+
+	ret = lttng_clock_gettime(CLOCK_MONOTONIC, &end);
+	if (ret) {
+		PERROR("clock_gettime");
+		ret = -1;
+		goto end;
+	}
+	total_ns = timespec_diff_ns(&start, &end);
+
+	pthread_mutex_lock(&pool->lock);
+	stats->channel_count++;
+	stats->stream_count += state.count;
+	stats->total_ns += total_ns;
+	stats->max_ns = max_t(uint64_t, stats->max_ns, total_ns);
+	for (i = 0; i < state.count; i++) {
+		stats->stream_total_ns += state.durations_ns[i];
+		stats->stream_max_ns = max_t(uint64_t, stats->stream_max_ns,
+				state.durations_ns[i]);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	DBG("Snapshot of channel %" PRIu64 " done: %u streams in %" PRIu64 " ns",
+			channel->key, state.count, total_ns);
+end:
+	free(state.durations_ns);
+	free(state.streams);
+	return ret;
+}
+
 /* Stream lock must be held by the caller. */
 static int sample_stream_positions(struct lttng_consumer_stream *stream,
 			    unsigned long *produced, unsigned long *consumed)
@@ -28,6 +28,8 @@
 #include <common/credentials.h>
 #include <common/buffer-view.h>
 #include <common/dynamic-array.h>
+#include <common/timer-wheel.h>
+#include <common/consumer/consumer-writeback.h>
 
 struct lttng_consumer_local_data;
 
@@ -106,6 +108,23 @@ struct stream_list {
 /* Stub. */
 struct consumer_metadata_cache;
 
+enum consumer_channel_timer_type {
+	CONSUMER_CHANNEL_TIMER_SWITCH,
+	CONSUMER_CHANNEL_TIMER_LIVE,
+	CONSUMER_CHANNEL_TIMER_MONITOR,
+};
+
+/* Periodic timer of a channel, run by the timer thread. */
+struct consumer_channel_timer {
+	struct timer_wheel_entry entry;
+	enum consumer_channel_timer_type type;
+	/* Period, in timer ticks. */
+	uint64_t period;
+	struct lttng_consumer_channel *channel;
+	/* Re-arm the timer after it runs. Protected by the timers lock. */
+	bool enabled;
+};
+
 struct lttng_consumer_channel {
 	/* Is the channel published in the channel hash tables? */
 	bool is_published;
@@ -186,19 +205,19 @@ struct lttng_consumer_channel {
 
 	/* For UST metadata periodical flush */
 	int switch_timer_enabled;
-	timer_t switch_timer;
+	struct consumer_channel_timer switch_timer;
 	int switch_timer_error;
 
 	/* For the live mode */
 	int live_timer_enabled;
-	timer_t live_timer;
+	struct consumer_channel_timer live_timer;
 	int live_timer_error;
 	/* Channel is part of a live session ? */
 	bool is_live;
 
 	/* For channel monitoring timer. */
 	int monitor_timer_enabled;
-	timer_t monitor_timer;
+	struct consumer_channel_timer monitor_timer;
 
 	/* On-disk circular buffer */
 	uint64_t tracefile_size;
@@ -409,6 +428,13 @@ struct lttng_consumer_stream {
 	struct lttng_ht_node_u64 node_channel_id;
 	/* HT node used in consumer_data.stream_list_ht */
 	struct lttng_ht_node_u64 node_session_id;
+	/* HT node used by the wait_fd_ht of the owning data worker. */
+	struct lttng_ht_node_u64 node_wait_fd;
+	/*
+	 * Node of the pending stream list of the owning data worker. Only used
+	 * by the worker's data thread.
+	 */
+	struct cds_list_head data_pending_node;
 	/* Pointer to associated channel. */
 	struct lttng_consumer_channel *chan;
 	/*
@@ -427,6 +453,11 @@ struct lttng_consumer_stream {
 	int out_fd; /* output file to write the data */
 	/* Write position in the output file descriptor */
 	off_t out_fd_offset;
+	/*
+	 * Writeback accounting of the output files, created on the first
+	 * writeback handed to the writeback thread.
+	 */
+	struct consumer_writeback_stream *writeback;
 	/* Amount of bytes written to the output */
 	uint64_t output_written;
 	int shm_fd_is_copy;
@@ -539,6 +570,14 @@ struct lttng_consumer_stream {
 	enum consumer_endpoint_status endpoint_status;
 	/* Stream name. Format is: <channel_name>_<cpu_number> */
 	char name[LTTNG_SYMBOL_NAME_LEN];
+	/* CPU id of the stream's buffer, -1 if the buffer is not per-CPU. */
+	int cpu;
+	/*
+	 * Data worker owning this stream. Assigned once when the stream is
+	 * added to the data streams and never modified afterwards. NULL for
+	 * metadata streams.
+	 */
+	struct lttng_consumer_data_worker *data_worker;
 	/* Internal state of libustctl. */
 	struct ustctl_consumer_stream *ustream;
 	struct cds_list_head send_node;
@@ -676,11 +715,21 @@ struct consumer_relayd_sock_pair {
 	struct lttcomm_relayd_sock control_sock;
 
 	/*
-	 * We don't need a mutex at this point since we only splice or write single
-	 * large chunk of data with a header appended at the begining. Moreover,
-	 * this socket is for now only used in a single thread.
+	 * Mutex protecting the data socket. The streams of a relayd may be
+	 * consumed by different data workers and a packet header must not be
+	 * separated from its payload.
+	 *
+	 * This is nested INSIDE the stream lock.
 	 */
+	pthread_mutex_t data_sock_mutex;
+
+	/* Data socket. Data stream packets are passed over it. */
 	struct lttcomm_relayd_sock data_sock;
+	/*
+	 * Bytes sent on the data socket with MSG_MORE that may still be held
+	 * back by the socket. Protected by data_sock_mutex.
+	 */
+	uint64_t data_sock_batched_bytes;
 	struct lttng_ht_node_u64 node;
 
 	/* Session id on both sides for the sockets. */
@@ -689,6 +738,109 @@ struct consumer_relayd_sock_pair {
 	struct lttng_consumer_local_data *ctx;
 };
 
+struct snapshot_streams_state;
+
+/*
+ * Threads helping the thread handling the session daemon commands record the
+ * streams of a channel to a snapshot output. They are launched with the
+ * consumer daemon and wait for the next channel snapshot in between.
+ */
+struct lttng_consumer_snapshot_pool {
+	pthread_mutex_t lock;
+	/* Signaled when a snapshot is posted or the threads must exit. */
+	pthread_cond_t snapshot_cond;
+	/* Signaled when a thread stops working on the posted snapshot. */
+	pthread_cond_t done_cond;
+	/* Channel snapshot being recorded, NULL if none. */
+	struct snapshot_streams_state *snapshot;
+	/* Incremented each time a snapshot is posted. */
+	uint64_t snapshot_id;
+	/* Number of threads working on the posted snapshot. */
+	unsigned int nb_busy_threads;
+	bool quit;
+	pthread_t *threads;
+	unsigned int nb_threads;
+};
+
+/*
+ * Latency of the channel snapshots recorded since the consumer daemon was
+ * launched. Protected by the lock of the snapshot pool.
+ */
+struct lttng_consumer_snapshot_stats {
+	uint64_t channel_count;
+	uint64_t stream_count;
+	/* Durations of the snapshots of the whole channels. */
+	uint64_t total_ns;
+	uint64_t max_ns;
+	/* Durations of the snapshots of the individual streams. */
+	uint64_t stream_total_ns;
+	uint64_t stream_max_ns;
+};
+
+/*
+ * Throughput counters of a data worker. Updated atomically by the worker
+ * and readable from any thread.
+ */
+struct lttng_consumer_data_worker_stats {
+	/* Number of bytes consumed from the ring buffers. */
+	uint64_t bytes_consumed;
+	/* Number of sub-buffers consumed. */
+	uint64_t subbuffers_consumed;
+	/* Number of times the worker returned from poll(). */
+	uint64_t wakeups;
+};
+
+/*
+ * Data stream consumption worker. The data streams of the consumer are
+ * sharded across a configurable number of workers; each worker owns a shard
+ * of the data streams, its own notification pipes and its own poll set.
+ */
+struct lttng_consumer_data_worker {
+	/* Index of the worker in the context's data worker array. */
+	unsigned int id;
+	pthread_t thread;
+	struct lttng_consumer_local_data *ctx;
+	/*
+	 * Data streams owned by this worker, indexed by stream key. The stream
+	 * elements of this ht should only be updated by this worker.
+	 */
+	struct lttng_ht *stream_ht;
+	/*
+	 * Number of streams in stream_ht. Protected by consumer_data.lock.
+	 */
+	int stream_count;
+	/*
+	 * Streams of this worker that are in its poll set, indexed by wait fd.
+	 * Only used by the worker's data thread.
+	 */
+	struct lttng_ht *wait_fd_ht;
+	/*
+	 * Polled streams flagged with has_data or hangup_flush_done. These must
+	 * be consumed even if their wait fd is not ready. Only used by the
+	 * worker's data thread.
+	 */
+	struct cds_list_head pending_stream_list;
+	/* Transfer data streams to the worker and wake it up. */
+	struct lttng_pipe *data_pipe;
+	/*
+	 * The worker uses that pipe to catch wakeup from read subbuffer that
+	 * detects that there is still data to be read for the stream
+	 * encountered. Before doing so, the stream is flagged to indicate that
+	 * there is still data to be read.
+	 *
+	 * Both pipes (read/write) are owned and used inside the worker.
+	 */
+	struct lttng_pipe *wakeup_pipe;
+	/* Indicate if the wakeup pipe has been notified. */
+	unsigned int has_wakeup:1;
+	/*
+	 * Indicate that the worker batched sends on relayd data sockets since
+	 * it last pushed them. Only used by the worker's data thread.
+	 */
+	bool relayd_batch_pending;
+	struct lttng_consumer_data_worker_stats stats;
+};
+
 /*
  * UST consumer local data to the program. One or more instance per
  * process.
@@ -753,20 +905,23 @@ struct lttng_consumer_local_data {
 	char *consumer_command_sock_path;
 	/* communication with splice */
 	int consumer_channel_pipe[2];
-	/* Data stream poll thread pipe. To transfer data stream to the thread */
-	struct lttng_pipe *consumer_data_pipe;
-
+	/* Data stream consumption workers. */
+	struct lttng_consumer_data_worker *data_workers;
+	unsigned int nb_data_workers;
 	/*
-	 * Data thread use that pipe to catch wakeup from read subbuffer that
-	 * detects that there is still data to be read for the stream encountered.
-	 * Before doing so, the stream is flagged to indicate that there is still
-	 * data to be read.
-	 *
-	 * Both pipes (read/write) are owned and used inside the data thread.
+	 * Number of data workers still running. The last one to exit notifies
+	 * the metadata thread.
 	 */
-	struct lttng_pipe *consumer_wakeup_pipe;
-	/* Indicate if the wakeup thread has been notified. */
-	unsigned int has_wakeup:1;
+	unsigned int nb_running_data_workers;
+	/*
+	 * Maximum number of bytes a data worker lets a relayd data socket hold
+	 * back to coalesce consecutive data packets. 0 disables batching.
+	 */
+	uint64_t relayd_batch_size;
+	/* Maximum number of threads snapshotting the streams of a channel. */
+	unsigned int snapshot_thread_count;
+	struct lttng_consumer_snapshot_pool snapshot_pool;
+	struct lttng_consumer_snapshot_stats snapshot_stats;
 
 	/* to let the signal handler wake up the fd receiver thread */
 	int consumer_should_quit[2];
@@ -794,21 +949,10 @@ struct lttng_consumer_global_data {
 	 */
 	pthread_mutex_t lock;
 
-	/*
-	 * Number of streams in the data stream hash table declared outside.
-	 * Protected by consumer_data.lock.
-	 */
-	int stream_count;
-
 	/* Channel hash table protected by consumer_data.lock. */
 	struct lttng_ht *channel_ht;
 	/* Channel hash table indexed by session id. */
 	struct lttng_ht *channels_by_session_id_ht;
-	/*
-	 * Flag specifying if the local array of FDs needs update in the
-	 * poll function. Protected by consumer_data.lock.
-	 */
-	unsigned int need_update;
 	enum lttng_consumer_type type;
 
 	/*
@@ -973,6 +1117,24 @@ struct lttng_consumer_local_data *lttng_consumer_create(
 		int (*recv_stream)(struct lttng_consumer_stream *stream),
 		int (*update_stream)(uint64_t sessiond_key, uint32_t state));
 void lttng_consumer_destroy(struct lttng_consumer_local_data *ctx);
+int lttng_consumer_create_data_workers(struct lttng_consumer_local_data *ctx,
+		unsigned int count);
+void lttng_consumer_get_data_worker_stats(
+		struct lttng_consumer_data_worker *worker,
+		struct lttng_consumer_data_worker_stats *stats);
+void lttng_consumer_log_data_worker_stats(
+		struct lttng_consumer_local_data *ctx);
+void lttng_consumer_set_relayd_batch_size(
+		struct lttng_consumer_local_data *ctx, uint64_t size);
+void lttng_consumer_set_snapshot_thread_count(
+		struct lttng_consumer_local_data *ctx, unsigned int count);
+int lttng_consumer_launch_snapshot_threads(
+		struct lttng_consumer_local_data *ctx);
+void lttng_consumer_stop_snapshot_threads(
+		struct lttng_consumer_local_data *ctx);
+void lttng_consumer_log_snapshot_stats(
+		struct lttng_consumer_local_data *ctx);
+void lttng_consumer_set_sparse_padding(bool enabled);
 ssize_t lttng_consumer_on_read_subbuffer_mmap(
 		struct lttng_consumer_stream *stream,
 		const struct lttng_buffer_view *buffer,
@@ -1016,7 +1178,13 @@ void consumer_destroy_relayd(struct consumer_relayd_sock_pair *relayd);
 unsigned long consumer_get_consume_start_pos(unsigned long consumed_pos,
 		unsigned long produced_pos, uint64_t nb_packets_per_stream,
 		uint64_t max_sb_size);
-void consumer_add_data_stream(struct lttng_consumer_stream *stream);
+int consumer_snapshot_channel_streams(struct lttng_consumer_channel *channel,
+		struct lttng_consumer_local_data *ctx,
+		int (*snapshot_stream)(struct lttng_consumer_stream *stream,
+			void *data),
+		void *data);
+void consumer_add_data_stream(struct lttng_consumer_local_data *ctx,
+		struct lttng_consumer_stream *stream);
 void consumer_del_stream_for_data(struct lttng_consumer_stream *stream);
 void consumer_add_metadata_stream(struct lttng_consumer_stream *stream);
 void consumer_del_stream_for_metadata(struct lttng_consumer_stream *stream);
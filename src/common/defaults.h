@@ -155,6 +155,8 @@
 #define DEFAULT_SESSION_CONFIG_XSD_FILENAME     "session.xsd"
 #define DEFAULT_SESSION_CONFIG_XSD_PATH         CONFIG_LTTNG_SYSTEM_DATADIR "/xml/lttng/"
 #define DEFAULT_SESSION_CONFIG_XSD_PATH_ENV     "LTTNG_SESSION_CONFIG_XSD_PATH"
+/* Set to 0 to load session configurations without validating them. */
+#define DEFAULT_SESSION_CONFIG_XSD_VALIDATION_ENV "LTTNG_SESSION_CONFIG_XSD_VALIDATION"
 
 #define DEFAULT_GLOBAL_APPS_UNIX_SOCK \
 	DEFAULT_LTTNG_RUNDIR "/" LTTNG_UST_SOCK_FILENAME
@@ -275,6 +277,12 @@
 #define DEFAULT_NETWORK_DATA_PORT           CONFIG_DEFAULT_NETWORK_DATA_PORT
 #define DEFAULT_NETWORK_VIEWER_PORT         CONFIG_DEFAULT_NETWORK_VIEWER_PORT
 
+/* Default number of worker threads handling the relay daemon connections. */
+#define DEFAULT_RELAYD_WORKER_THREADS       1
+
+/* Default number of worker threads handling the live viewer connections. */
+#define DEFAULT_RELAYD_LIVE_WORKER_THREADS  1
+
 /* Agent registration TCP port range. */
 #define DEFAULT_AGENT_TCP_PORT_RANGE_BEGIN  CONFIG_DEFAULT_AGENT_TCP_PORT_RANGE_BEGIN
 #define DEFAULT_AGENT_TCP_PORT_RANGE_END    CONFIG_DEFAULT_AGENT_TCP_PORT_RANGE_END
@@ -315,8 +323,67 @@
 #define DEFAULT_APP_SOCKET_RW_TIMEOUT       CONFIG_DEFAULT_APP_SOCKET_RW_TIMEOUT
 #define DEFAULT_APP_SOCKET_TIMEOUT_ENV      "LTTNG_APP_SOCKET_TIMEOUT"
 
+/*
+ * Default number of threads synchronizing the tracing configuration of
+ * applications concurrently.
+ */
+#define DEFAULT_APP_SYNC_THREADS            1
+#define DEFAULT_APP_SYNC_THREADS_ENV        "LTTNG_APP_SYNC_THREADS"
+
+/* Default number of threads processing client commands concurrently. */
+#define DEFAULT_CLIENT_COMMAND_THREADS      1
+#define DEFAULT_CLIENT_COMMAND_THREADS_ENV  "LTTNG_CLIENT_COMMAND_THREADS"
+
+/*
+ * Default number of threads evaluating the channel samples received by the
+ * notification thread. 0 evaluates them on the notification thread itself.
+ */
+#define DEFAULT_NOTIFICATION_EVALUATOR_THREADS      0
+#define DEFAULT_NOTIFICATION_EVALUATOR_THREADS_ENV  "LTTNG_NOTIFICATION_EVALUATOR_THREADS"
+
 #define DEFAULT_UST_STREAM_FD_NUM			2 /* Number of fd per UST stream. */
 
+/* Default number of data stream consumption threads of a consumer daemon. */
+#define DEFAULT_CONSUMERD_DATA_THREADS			1
+#define DEFAULT_CONSUMERD_DATA_THREADS_ENV		"LTTNG_CONSUMERD_DATA_THREADS"
+
+/*
+ * Default number of bytes a consumer daemon data thread lets a relay daemon
+ * socket hold back to coalesce consecutive data packets.
+ */
+#define DEFAULT_CONSUMERD_RELAYD_BATCH_SIZE		65536
+#define DEFAULT_CONSUMERD_RELAYD_BATCH_SIZE_ENV		"LTTNG_CONSUMERD_RELAYD_BATCH_SIZE"
+
+/*
+ * Default maximum number of threads a consumer daemon uses to snapshot the
+ * streams of a channel.
+ */
+#define DEFAULT_CONSUMERD_SNAPSHOT_THREADS		1
+#define DEFAULT_CONSUMERD_SNAPSHOT_THREADS_ENV		"LTTNG_CONSUMERD_SNAPSHOT_THREADS"
+
+/*
+ * Set to 1 to make the monitor timers of a consumer daemon's channels fire
+ * on multiples of their interval, so that their samples are sent together.
+ */
+#define DEFAULT_CONSUMERD_ALIGN_MONITOR_TIMERS_ENV	"LTTNG_CONSUMERD_ALIGN_MONITOR_TIMERS"
+
+/*
+ * Set to 1 to make a consumer daemon skip the padding of the sub-buffers
+ * written to the local output files by extending the files sparsely.
+ */
+#define DEFAULT_CONSUMERD_SPARSE_PADDING_ENV		"LTTNG_CONSUMERD_SPARSE_PADDING"
+
+/*
+ * Default maximum number of bytes written to the output files of a stream,
+ * and of all the streams of a consumer daemon, whose writeout is not
+ * complete. A stream limit of 0 makes the consumption threads wait for the
+ * writeouts themselves.
+ */
+#define DEFAULT_CONSUMERD_WRITEBACK_STREAM_DIRTY_LIMIT		8388608
+#define DEFAULT_CONSUMERD_WRITEBACK_STREAM_DIRTY_LIMIT_ENV	"LTTNG_CONSUMERD_WRITEBACK_STREAM_DIRTY_LIMIT"
+#define DEFAULT_CONSUMERD_WRITEBACK_DIRTY_LIMIT			134217728
+#define DEFAULT_CONSUMERD_WRITEBACK_DIRTY_LIMIT_ENV		"LTTNG_CONSUMERD_WRITEBACK_DIRTY_LIMIT"
+
 #define DEFAULT_SNAPSHOT_NAME				"snapshot"
 #define DEFAULT_SNAPSHOT_MAX_SIZE			0 /* Unlimited. */
 
@@ -330,6 +397,13 @@
 /* Default runas worker name */
 #define DEFAULT_RUN_AS_WORKER_NAME			"lttng-runas"
 
+/*
+ * Default number of run-as workers launched by a daemon. The commands of the
+ * daemon's threads are dispatched to the idle workers.
+ */
+#define DEFAULT_RUN_AS_WORKERS				1
+#define DEFAULT_RUN_AS_WORKERS_ENV			"LTTNG_RUN_AS_WORKERS"
+
 /* Default LTTng MI XML namespace. */
 #define DEFAULT_LTTNG_MI_NAMESPACE		"https://lttng.org/xml/ns/lttng-mi"
 
@@ -353,6 +427,19 @@
 #define DEFAULT_LTTNG_RELAYD_TCP_KEEP_ALIVE_ABORT_THRESHOLD_ENV "LTTNG_RELAYD_TCP_KEEP_ALIVE_ABORT_THRESHOLD"
 #define DEFAULT_LTTNG_RELAYD_DISALLOW_CLEAR_ENV "LTTNG_RELAYD_DISALLOW_CLEAR"
 
+/*
+ * Default number of the last indexes of each stream of a live session kept in
+ * memory by the relay daemon to serve the live viewers.
+ */
+#define DEFAULT_LTTNG_RELAYD_INDEX_CACHE_ENTRIES	256
+#define DEFAULT_LTTNG_RELAYD_INDEX_CACHE_ENTRIES_ENV "LTTNG_RELAYD_INDEX_CACHE_ENTRIES"
+
+/*
+ * Set to 1 to make the relay daemon skip the padding of the packets by
+ * extending the stream files sparsely rather than writing zeros.
+ */
+#define DEFAULT_LTTNG_RELAYD_SPARSE_PADDING_ENV "LTTNG_RELAYD_SPARSE_PADDING"
+
 #define DEFAULT_LTTNG_RELAYD_WORKING_DIRECTORY_ENV "LTTNG_RELAYD_WORKING_DIRECTORY"
 
 /*
@@ -9,6 +9,7 @@
 
 #define _LGPL_SOURCE
 #include <assert.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <fcntl.h>
@@ -24,36 +25,45 @@
 #define WRITE_FILE_FLAGS	(O_WRONLY | O_CREAT | O_TRUNC)
 #define READ_ONLY_FILE_FLAGS	O_RDONLY
 
-static enum lttng_trace_chunk_status _lttng_index_file_create_from_trace_chunk(
-		struct lttng_trace_chunk *chunk,
-		const char *channel_path, const char *stream_name,
-		uint64_t stream_file_size, uint64_t stream_file_index,
-		uint32_t index_major, uint32_t index_minor,
-		bool unlink_existing_file,
-		int flags, bool expect_no_file, struct lttng_index_file **file)
+/*
+ * Minimal growth of an index file for its mapping to be extended. Smaller
+ * growths are read from the file rather than remapping it for each element.
+ */
+#define MAP_MIN_GROWTH		(64 * 1024)
+
+static int index_file_set_identity(struct lttng_index_file *index_file,
+		struct fs_handle *fs_handle)
 {
-	struct lttng_index_file *index_file;
-	enum lttng_trace_chunk_status chunk_status;
-	int ret;
-	struct fs_handle *fs_handle = NULL;
-	ssize_t size_ret;
-	struct ctf_packet_index_file_hdr hdr;
-	char index_directory_path[LTTNG_PATH_MAX];
-	char index_file_path[LTTNG_PATH_MAX];
-	const mode_t mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP;
-	const bool acquired_reference = lttng_trace_chunk_get(chunk);
-	const char *separator;
+	int ret, fd;
+	struct stat st;
 
-	assert(acquired_reference);
+	fd = fs_handle_get_fd(fs_handle);
+	if (fd < 0) {
+		ret = -1;
+		goto end;
+	}
 
-	index_file = zmalloc(sizeof(*index_file));
-	if (!index_file) {
-		PERROR("Failed to allocate lttng_index_file");
-		chunk_status = LTTNG_TRACE_CHUNK_STATUS_ERROR;
-		goto error;
+	ret = fstat(fd, &st);
+	if (ret) {
+		PERROR("Failed to get the status of index file");
+		goto put_fd;
 	}
+	index_file->dev = st.st_dev;
+	index_file->ino = st.st_ino;
+put_fd:
+	fs_handle_put_fd(fs_handle);
+end:
+	return ret;
+}
+
+int lttng_index_file_get_path(const char *channel_path,
+		const char *stream_name, uint64_t stream_file_size,
+		uint64_t stream_file_index, char *path, size_t len)
+{
+	int ret;
+	char index_directory_path[LTTNG_PATH_MAX];
+	const char *separator;
 
-	index_file->trace_chunk = chunk;
 	if (channel_path[0] == '\0') {
 		separator = "";
 	} else {
@@ -63,43 +73,44 @@ static enum lttng_trace_chunk_status _lttng_index_file_create_from_trace_chunk(
 			"%s%s" DEFAULT_INDEX_DIR, channel_path, separator);
 	if (ret < 0 || ret >= sizeof(index_directory_path)) {
 		ERR("Failed to format index directory path");
-		chunk_status = LTTNG_TRACE_CHUNK_STATUS_ERROR;
-		goto error;
+		ret = -1;
+		goto end;
 	}
 
 	ret = utils_stream_file_path(index_directory_path, stream_name,
 			stream_file_size, stream_file_index,
-			DEFAULT_INDEX_FILE_SUFFIX,
-			index_file_path, sizeof(index_file_path));
-	if (ret) {
-		chunk_status = LTTNG_TRACE_CHUNK_STATUS_ERROR;
-		goto error;
-	}
+			DEFAULT_INDEX_FILE_SUFFIX, path, len);
+end:
+	return ret;
+}
 
-	if (unlink_existing_file) {
-		/*
-		 * For tracefile rotation. We need to unlink the old
-		 * file if present to synchronize with the tail of the
-		 * live viewer which could be working on this same file.
-		 * By doing so, any reference to the old index file
-		 * stays valid even if we re-create a new file with the
-		 * same name afterwards.
-		 */
-		chunk_status = lttng_trace_chunk_unlink_file(
-				chunk, index_file_path);
-		if (chunk_status != LTTNG_TRACE_CHUNK_STATUS_OK &&
-				!(chunk_status == LTTNG_TRACE_CHUNK_STATUS_ERROR &&
-						errno == ENOENT)) {
-			goto error;
-		}
-	}
+/*
+ * Create an index file from the handle of its opened file, of which ownership
+ * is transferred, even on error.
+ */
+static enum lttng_trace_chunk_status index_file_create(
+		struct lttng_trace_chunk *chunk, struct fs_handle *fs_handle,
+		uint32_t index_major, uint32_t index_minor, int flags,
+		struct lttng_index_file **file)
+{
+	struct lttng_index_file *index_file;
+	enum lttng_trace_chunk_status chunk_status;
+	int ret;
+	ssize_t size_ret;
+	struct ctf_packet_index_file_hdr hdr;
+	const bool acquired_reference = lttng_trace_chunk_get(chunk);
 
-	chunk_status = lttng_trace_chunk_open_fs_handle(chunk, index_file_path,
-			flags, mode, &fs_handle, expect_no_file);
-	if (chunk_status != LTTNG_TRACE_CHUNK_STATUS_OK) {
+	assert(acquired_reference);
+
+	index_file = zmalloc(sizeof(*index_file));
+	if (!index_file) {
+		PERROR("Failed to allocate lttng_index_file");
+		chunk_status = LTTNG_TRACE_CHUNK_STATUS_ERROR;
 		goto error;
 	}
 
+	index_file->trace_chunk = chunk;
+
 	if (flags == WRITE_FILE_FLAGS) {
 		ctf_packet_index_file_hdr_init(&hdr, index_major, index_minor);
 		size_ret = fs_handle_write(fs_handle, &hdr, sizeof(hdr));
@@ -142,6 +153,12 @@ static enum lttng_trace_chunk_status _lttng_index_file_create_from_trace_chunk(
 			goto error;
 		}
 		index_file->element_len = element_len;
+		index_file->read_offset = sizeof(hdr);
+	}
+	ret = index_file_set_identity(index_file, fs_handle);
+	if (ret) {
+		chunk_status = LTTNG_TRACE_CHUNK_STATUS_ERROR;
+		goto error;
 	}
 	index_file->file = fs_handle;
 	index_file->major = index_major;
@@ -163,6 +180,58 @@ error:
 	return chunk_status;
 }
 
+static enum lttng_trace_chunk_status _lttng_index_file_create_from_trace_chunk(
+		struct lttng_trace_chunk *chunk,
+		const char *channel_path, const char *stream_name,
+		uint64_t stream_file_size, uint64_t stream_file_index,
+		uint32_t index_major, uint32_t index_minor,
+		bool unlink_existing_file,
+		int flags, bool expect_no_file, struct lttng_index_file **file)
+{
+	enum lttng_trace_chunk_status chunk_status;
+	int ret;
+	struct fs_handle *fs_handle = NULL;
+	char index_file_path[LTTNG_PATH_MAX];
+	const mode_t mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP;
+
+	ret = lttng_index_file_get_path(channel_path, stream_name,
+			stream_file_size, stream_file_index,
+			index_file_path, sizeof(index_file_path));
+	if (ret) {
+		chunk_status = LTTNG_TRACE_CHUNK_STATUS_ERROR;
+		goto end;
+	}
+
+	if (unlink_existing_file) {
+		/*
+		 * For tracefile rotation. We need to unlink the old
+		 * file if present to synchronize with the tail of the
+		 * live viewer which could be working on this same file.
+		 * By doing so, any reference to the old index file
+		 * stays valid even if we re-create a new file with the
+		 * same name afterwards.
+		 */
+		chunk_status = lttng_trace_chunk_unlink_file(
+				chunk, index_file_path);
+		if (chunk_status != LTTNG_TRACE_CHUNK_STATUS_OK &&
+				!(chunk_status == LTTNG_TRACE_CHUNK_STATUS_ERROR &&
+						errno == ENOENT)) {
+			goto end;
+		}
+	}
+
+	chunk_status = lttng_trace_chunk_open_fs_handle(chunk, index_file_path,
+			flags, mode, &fs_handle, expect_no_file);
+	if (chunk_status != LTTNG_TRACE_CHUNK_STATUS_OK) {
+		goto end;
+	}
+
+	chunk_status = index_file_create(chunk, fs_handle, index_major,
+			index_minor, flags, file);
+end:
+	return chunk_status;
+}
+
 enum lttng_trace_chunk_status lttng_index_file_create_from_trace_chunk(
 		struct lttng_trace_chunk *chunk,
 		const char *channel_path, const char *stream_name,
@@ -189,12 +258,54 @@ enum lttng_trace_chunk_status lttng_index_file_create_from_trace_chunk_read_only
 			READ_ONLY_FILE_FLAGS, expect_no_file, file);
 }
 
+enum lttng_trace_chunk_status lttng_index_file_create_from_trace_chunk_fd(
+		struct lttng_trace_chunk *chunk, const char *index_file_path,
+		int fd, uint32_t index_major, uint32_t index_minor,
+		struct lttng_index_file **file)
+{
+	struct fs_handle *fs_handle;
+
+	fs_handle = lttng_trace_chunk_create_fs_handle(chunk, index_file_path,
+			fd);
+	if (!fs_handle) {
+		if (close(fd)) {
+			PERROR("Failed to close file descriptor of index file");
+		}
+		return LTTNG_TRACE_CHUNK_STATUS_ERROR;
+	}
+
+	return index_file_create(chunk, fs_handle, index_major, index_minor,
+			WRITE_FILE_FLAGS, file);
+}
+
+int lttng_index_file_enable_tail(struct lttng_index_file *index_file,
+		uint32_t capacity)
+{
+	int ret = 0;
+
+	assert(!index_file->tail.entries);
+	if (capacity == 0) {
+		goto end;
+	}
+
+	index_file->tail.entries = zmalloc(
+			capacity * sizeof(*index_file->tail.entries));
+	if (!index_file->tail.entries) {
+		PERROR("Failed to allocate index file tail");
+		ret = -1;
+		goto end;
+	}
+	index_file->tail.capacity = capacity;
+end:
+	return ret;
+}
+
 /*
  * Write index values to the given index file.
  *
  * Return 0 on success, -1 on error.
  */
-int lttng_index_file_write(const struct lttng_index_file *index_file,
+int lttng_index_file_write(struct lttng_index_file *index_file,
 		const struct ctf_packet_index *element)
 {
 	ssize_t ret;
@@ -212,21 +323,107 @@ int lttng_index_file_write(const struct lttng_index_file *index_file,
 		PERROR("writing index file");
 		goto error;
 	}
+
+	if (index_file->tail.entries) {
+		memcpy(&index_file->tail.entries[index_file->tail.written %
+				index_file->tail.capacity], element, len);
+	}
+	index_file->tail.written++;
 	return 0;
 
 error:
 	return -1;
 }
 
+/*
+ * Copy the element at the read offset of a reader from the tail kept by the
+ * writer of the same file.
+ *
+ * Return 0 on success, 1 if the tail does not hold the element.
+ */
+static int read_from_tail(const struct lttng_index_file *index_file,
+		const struct lttng_index_file *writer,
+		struct ctf_packet_index *element)
+{
+	int ret = 1;
+	uint64_t position;
+	const off_t first_offset = sizeof(struct ctf_packet_index_file_hdr);
+	const size_t len = index_file->element_len;
+
+	if (!writer || !writer->tail.entries ||
+			writer->dev != index_file->dev ||
+			writer->ino != index_file->ino ||
+			writer->element_len != len ||
+			index_file->read_offset < first_offset ||
+			(index_file->read_offset - first_offset) % len) {
+		goto end;
+	}
+
+	position = (index_file->read_offset - first_offset) / len;
+	if (position >= writer->tail.written ||
+			writer->tail.written - position > writer->tail.capacity) {
+		goto end;
+	}
+
+	memcpy(element, &writer->tail.entries[position % writer->tail.capacity],
+			len);
+	ret = 0;
+end:
+	return ret;
+}
+
+/*
+ * Extend the mapping of a read-only index file to its current size if it
+ * has grown enough since it was mapped. The previous mapping is kept on
+ * error.
+ */
+static void update_map(struct lttng_index_file *index_file)
+{
+	int fd;
+	void *addr;
+	struct stat st;
+
+	fd = fs_handle_get_fd(index_file->file);
+	if (fd < 0) {
+		return;
+	}
+
+	if (fstat(fd, &st)) {
+		PERROR("Failed to get the size of index file");
+		goto end;
+	}
+	if (st.st_size < index_file->map.len + MAP_MIN_GROWTH) {
+		goto end;
+	}
+
+	addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (addr == MAP_FAILED) {
+		PERROR("Failed to map index file");
+		goto end;
+	}
+	if (index_file->map.addr &&
+			munmap(index_file->map.addr, index_file->map.len)) {
+		PERROR("Failed to unmap index file");
+	}
+	index_file->map.addr = addr;
+	index_file->map.len = st.st_size;
+end:
+	fs_handle_put_fd(index_file->file);
+}
+
 /*
  * Read index values from the given index file.
  *
  * Return 0 on success, -1 on error.
  */
-int lttng_index_file_read(const struct lttng_index_file *index_file,
-		struct ctf_packet_index *element)
+int lttng_index_file_read_from(struct lttng_index_file *index_file,
+		const struct lttng_index_file *writer,
+		struct ctf_packet_index *element,
+		enum lttng_index_file_read_source *source)
 {
+	int fd;
 	ssize_t ret;
+	enum lttng_index_file_read_source read_source;
 	const size_t len = index_file->element_len;
 
 	assert(element);
@@ -235,21 +432,69 @@ int lttng_index_file_read(const struct lttng_index_file *index_file,
 		goto error;
 	}
 
-	ret = fs_handle_read(index_file->file, element, len);
+	if (!read_from_tail(index_file, writer, element)) {
+		read_source = LTTNG_INDEX_FILE_READ_SOURCE_TAIL;
+		goto end;
+	}
+
+	if (index_file->read_offset + len >
+			index_file->map.len + MAP_MIN_GROWTH) {
+		/* The file has grown enough to extend the mapping. */
+		update_map(index_file);
+	}
+	if (index_file->read_offset + len <= index_file->map.len) {
+		memcpy(element, (const char *) index_file->map.addr +
+				index_file->read_offset, len);
+		read_source = LTTNG_INDEX_FILE_READ_SOURCE_MAP;
+		goto end;
+	}
+
+	fd = fs_handle_get_fd(index_file->file);
+	if (fd < 0) {
+		goto error;
+	}
+	do {
+		ret = pread(fd, element, len, index_file->read_offset);
+	} while (ret < 0 && errno == EINTR);
+	fs_handle_put_fd(index_file->file);
 	if (ret < 0) {
 		PERROR("read index file");
 		goto error;
 	}
 	if (ret < len) {
-		ERR("lttng_read expected %zu, returned %zd", len, ret);
+		ERR("pread expected %zu, returned %zd", len, ret);
 		goto error;
 	}
+	read_source = LTTNG_INDEX_FILE_READ_SOURCE_FILE;
+end:
+	index_file->read_offset += len;
+	if (source) {
+		*source = read_source;
+	}
 	return 0;
 
 error:
 	return -1;
 }
 
+int lttng_index_file_read(struct lttng_index_file *index_file,
+		struct ctf_packet_index *element)
+{
+	return lttng_index_file_read_from(index_file, NULL, element, NULL);
+}
+
+int lttng_index_file_seek_end(struct lttng_index_file *index_file)
+{
+	off_t offset;
+
+	offset = fs_handle_seek(index_file->file, 0, SEEK_END);
+	if (offset < 0) {
+		return -1;
+	}
+	index_file->read_offset = offset;
+	return 0;
+}
+
 void lttng_index_file_get(struct lttng_index_file *index_file)
 {
 	urcu_ref_get(&index_file->ref);
@@ -263,6 +508,11 @@ static void lttng_index_file_release(struct urcu_ref *ref)
 	if (fs_handle_close(index_file->file)) {
 		PERROR("close index fd");
 	}
+	if (index_file->map.addr &&
+			munmap(index_file->map.addr, index_file->map.len)) {
+		PERROR("Failed to unmap index file");
+	}
+	free(index_file->tail.entries);
 	lttng_trace_chunk_put(index_file->trace_chunk);
 	free(index_file);
 }
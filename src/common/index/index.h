@@ -11,6 +11,7 @@
 #define _INDEX_H
 
 #include <inttypes.h>
+#include <sys/types.h>
 #include <urcu/ref.h>
 
 #include "ctf-index.h"
@@ -24,6 +25,39 @@ struct lttng_index_file {
 	uint32_t element_len;
 	struct lttng_trace_chunk *trace_chunk;
 	struct urcu_ref ref;
+	/* Identity of the file, to match the readers and writer of a file. */
+	dev_t dev;
+	ino_t ino;
+	/* Offset of the next element to read (read-only files). */
+	off_t read_offset;
+	/*
+	 * Read-only mapping of the start of the file (read-only files). It is
+	 * grown as the file is written to.
+	 */
+	struct {
+		void *addr;
+		size_t len;
+	} map;
+	/*
+	 * Last elements written to the file, if enabled by the writer. Element
+	 * `i` of the file is kept in `entries[i % capacity]`.
+	 */
+	struct {
+		struct ctf_packet_index *entries;
+		uint32_t capacity;
+		/* Number of elements written to the file. */
+		uint64_t written;
+	} tail;
+};
+
+/* Where an element returned by lttng_index_file_read_from() was found. */
+enum lttng_index_file_read_source {
+	/* Tail of the elements kept in memory by the writer of the file. */
+	LTTNG_INDEX_FILE_READ_SOURCE_TAIL,
+	/* Mapping of the file. */
+	LTTNG_INDEX_FILE_READ_SOURCE_MAP,
+	/* Read from the file. */
+	LTTNG_INDEX_FILE_READ_SOURCE_FILE,
 };
 
 /*
@@ -44,10 +78,48 @@ enum lttng_trace_chunk_status lttng_index_file_create_from_trace_chunk_read_only
 		uint32_t index_major, uint32_t index_minor,
 		bool expect_no_file, struct lttng_index_file **file);
 
-int lttng_index_file_write(const struct lttng_index_file *index_file,
+/*
+ * Create an index file, for writing, from the file descriptor of
+ * `index_file_path` opened with lttng_trace_chunk_open_files(). The file
+ * descriptor is owned by the index file, or closed on error.
+ */
+enum lttng_trace_chunk_status lttng_index_file_create_from_trace_chunk_fd(
+		struct lttng_trace_chunk *chunk, const char *index_file_path,
+		int fd, uint32_t index_major, uint32_t index_minor,
+		struct lttng_index_file **file);
+
+/*
+ * Format the path, relative to its trace chunk, of the index file of a stream
+ * file.
+ */
+int lttng_index_file_get_path(const char *channel_path,
+		const char *stream_name, uint64_t stream_file_size,
+		uint64_t stream_file_index, char *path, size_t len);
+
+/*
+ * Keep the last `capacity` elements written to an index file in memory so
+ * that the readers of the same file can be served without reading it.
+ */
+int lttng_index_file_enable_tail(struct lttng_index_file *index_file,
+		uint32_t capacity);
+
+int lttng_index_file_write(struct lttng_index_file *index_file,
 		const struct ctf_packet_index *element);
-int lttng_index_file_read(const struct lttng_index_file *index_file,
+int lttng_index_file_read(struct lttng_index_file *index_file,
 		struct ctf_packet_index *element);
+/*
+ * Read the next element of a read-only index file. The element is taken from
+ * the tail kept by `writer`, if it is the writer of the same file and still
+ * holds the element, or else from the file.
+ *
+ * `writer` may be NULL. `source` is optional.
+ */
+int lttng_index_file_read_from(struct lttng_index_file *index_file,
+		const struct lttng_index_file *writer,
+		struct ctf_packet_index *element,
+		enum lttng_index_file_read_source *source);
+/* Position a read-only index file after its last element. */
+int lttng_index_file_seek_end(struct lttng_index_file *index_file);
 
 void lttng_index_file_get(struct lttng_index_file *index_file);
 void lttng_index_file_put(struct lttng_index_file *index_file);
@@ -8,22 +8,27 @@
  */
 
 #include <common/compat/endian.h>
+#include <common/dynamic-array.h>
 #include <common/error.h>
+#include <common/hashtable/utils.h>
 #include <common/lttng-elf.h>
 #include <common/macros.h>
-#include <common/readwrite.h>
+#include <common/utils.h>
 #include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <urcu/list.h>
 
 #include <elf.h>
 
-#define BUF_LEN	4096
 #define TEXT_SECTION_NAME 	".text"
 #define SYMBOL_TAB_SECTION_NAME ".symtab"
 #define STRING_TAB_SECTION_NAME ".strtab"
@@ -32,7 +37,14 @@
 #define NOTE_STAPSDT_SECTION_NAME ".note.stapsdt"
 #define NOTE_STAPSDT_NAME "stapsdt"
 #define NOTE_STAPSDT_TYPE 3
-#define MAX_SECTION_DATA_SIZE   512 * 1024 * 1024
+/*
+ * Maximal number of ELF files kept mapped and indexed by the cache, the least
+ * recently used being evicted first.
+ */
+#define ELF_CACHE_MAX_ENTRIES	16
+/* Ends the chain of elements of a bucket of an index. */
+#define ELF_INDEX_END		UINT32_MAX
+#define ELF_INDEX_HASH_SEED	0x3a6cd4f1UL
 
 #if BYTE_ORDER == LITTLE_ENDIAN
 #define NATIVE_ELF_ENDIANNESS ELFDATA2LSB
@@ -180,7 +192,8 @@ struct lttng_elf_sym {
 };
 
 struct lttng_elf {
-	int fd;
+	/* Read-only mapping of the whole file. */
+	const char *data;
 	size_t file_size;
 	uint8_t bitness;
 	uint8_t endianness;
@@ -188,7 +201,88 @@ struct lttng_elf {
 	off_t section_names_offset;
 	/* Size in bytes of section names string table. */
 	size_t section_names_size;
-	struct lttng_elf_ehdr *ehdr;
+	struct lttng_elf_ehdr ehdr;
+};
+
+/* Identity of an ELF file and of its content. */
+struct lttng_elf_cache_key {
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+	struct timespec mtime;
+};
+
+/* Function symbol of the symbol index of an ELF file. */
+struct lttng_elf_symbol {
+	/* Points to the name in the mapped string table. */
+	const char *name;
+	uint64_t addr;
+	/* Index of the next symbol of the same bucket. */
+	uint32_t next;
+};
+
+/* SDT probe of the SDT probe index of an ELF file. */
+struct lttng_elf_sdt_probe {
+	/* Point to the names in the mapped stap note section. */
+	const char *provider_name;
+	const char *probe_name;
+	uint64_t location;
+	uint64_t semaphore_location;
+	/* Index of the next probe of the same bucket. */
+	uint32_t next;
+};
+
+/*
+ * Hash index of the function symbols or of the SDT probes of an ELF file.
+ *
+ * The elements of a bucket are chained in the order in which they appear in
+ * the file so that a lookup finds the same elements as a scan of the file.
+ */
+struct lttng_elf_index {
+	/* Set once the index is built or failed to be. */
+	bool built;
+	/* Returned by the lookups if the index failed to be built. */
+	int error;
+	struct lttng_dynamic_array elements;
+	/* Index of the first element of each bucket. */
+	uint32_t *buckets;
+	uint32_t bucket_mask;
+};
+
+struct lttng_elf_cache_entry {
+	/* Node in the entries of the cache. */
+	struct cds_list_head node;
+	struct lttng_elf_cache_key key;
+	struct lttng_elf *elf;
+	/* All the addresses looked up are converted using the text section. */
+	bool has_text_section;
+	struct lttng_elf_shdr text_section_hdr;
+	/* Built on their first lookup. */
+	struct lttng_elf_index symbols;
+	struct lttng_elf_index sdt_probes;
+};
+
+typedef int (*lttng_elf_index_build_cb)(struct lttng_elf_cache_entry *entry,
+		struct lttng_elf_index *index);
+
+/*
+ * Cache of the ELF files in which symbols and SDT probes are looked up.
+ *
+ * The lookups are performed by the long-lived run-as workers. Caching the
+ * mapping and the indexes of a binary makes the lookups of the probes
+ * enabled on it after the first one O(1) rather than a scan of its sections.
+ * An entry is keyed by the identity of its file. Its size and modification
+ * time are checked before each use and the entry is dropped if the file
+ * changed, as accessing the mapping of a truncated file raises SIGBUS.
+ */
+static struct {
+	pthread_mutex_t lock;
+	/* Most recently used first. */
+	struct cds_list_head entries;
+	unsigned int nb_entries;
+} elf_cache = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.entries = CDS_LIST_HEAD_INIT(elf_cache.entries),
 };
 
 static inline
@@ -203,31 +297,43 @@ int is_elf_native_endian(struct lttng_elf *elf)
 	return elf->endianness == NATIVE_ELF_ENDIANNESS;
 }
 
+/*
+ * Get a pointer to the `size` bytes at `offset` in the mapped file.
+ *
+ * Returns NULL if the range is not within the file.
+ */
+static
+const char *lttng_elf_get_range(const struct lttng_elf *elf, uint64_t offset,
+		uint64_t size)
+{
+	if (offset > elf->file_size || size > elf->file_size - offset) {
+		return NULL;
+	}
+
+	return elf->data + offset;
+}
+
 static
 int populate_section_header(struct lttng_elf * elf, struct lttng_elf_shdr *shdr,
 		uint32_t index)
 {
 	int ret = 0;
-	off_t offset;
+	const char *shdr_data;
+	uint64_t offset;
 
 	/* Compute the offset of the section in the file */
-	offset = (off_t) elf->ehdr->e_shoff
-			+ (off_t) index * elf->ehdr->e_shentsize;
-
-	if (lseek(elf->fd, offset, SEEK_SET) < 0) {
-		PERROR("Error seeking to the beginning of ELF section header");
-		ret = -1;
-		goto error;
-	}
+	offset = elf->ehdr.e_shoff + (uint64_t) index * elf->ehdr.e_shentsize;
 
 	if (is_elf_32_bit(elf)) {
 		Elf32_Shdr elf_shdr;
 
-		if (lttng_read(elf->fd, &elf_shdr, sizeof(elf_shdr)) < sizeof(elf_shdr)) {
-			PERROR("Error reading ELF section header");
+		shdr_data = lttng_elf_get_range(elf, offset, sizeof(elf_shdr));
+		if (!shdr_data) {
+			DBG("ELF section header is out of the file's bounds");
 			ret = -1;
 			goto error;
 		}
+		memcpy(&elf_shdr, shdr_data, sizeof(elf_shdr));
 		if (!is_elf_native_endian(elf)) {
 			bswap_shdr(elf_shdr);
 		}
@@ -235,11 +341,13 @@ int populate_section_header(struct lttng_elf * elf, struct lttng_elf_shdr *shdr,
 	} else {
 		Elf64_Shdr elf_shdr;
 
-		if (lttng_read(elf->fd, &elf_shdr, sizeof(elf_shdr)) < sizeof(elf_shdr)) {
-			PERROR("Error reading ELF section header");
+		shdr_data = lttng_elf_get_range(elf, offset, sizeof(elf_shdr));
+		if (!shdr_data) {
+			DBG("ELF section header is out of the file's bounds");
 			ret = -1;
 			goto error;
 		}
+		memcpy(&elf_shdr, shdr_data, sizeof(elf_shdr));
 		if (!is_elf_native_endian(elf)) {
 			bswap_shdr(elf_shdr);
 		}
@@ -254,16 +362,7 @@ static
 int populate_elf_header(struct lttng_elf *elf)
 {
 	int ret = 0;
-
-	/*
-	 * Move the read pointer back to the beginning to read the full header
-	 * and copy it in our structure.
-	 */
-	if (lseek(elf->fd, 0, SEEK_SET) < 0) {
-		PERROR("Error seeking to the beginning of the file");
-		ret = -1;
-		goto error;
-	}
+	const char *ehdr_data;
 
 	/*
 	 * Use macros to set fields in the ELF header struct for both 32bit and
@@ -272,25 +371,29 @@ int populate_elf_header(struct lttng_elf *elf)
 	if (is_elf_32_bit(elf)) {
 		Elf32_Ehdr elf_ehdr;
 
-		if (lttng_read(elf->fd, &elf_ehdr, sizeof(elf_ehdr)) < sizeof(elf_ehdr)) {
+		ehdr_data = lttng_elf_get_range(elf, 0, sizeof(elf_ehdr));
+		if (!ehdr_data) {
 			ret = -1;
 			goto error;
 		}
+		memcpy(&elf_ehdr, ehdr_data, sizeof(elf_ehdr));
 		if (!is_elf_native_endian(elf)) {
 			bswap_ehdr(elf_ehdr);
 		}
-		copy_ehdr(elf_ehdr, *(elf->ehdr));
+		copy_ehdr(elf_ehdr, elf->ehdr);
 	} else {
 		Elf64_Ehdr elf_ehdr;
 
-		if (lttng_read(elf->fd, &elf_ehdr, sizeof(elf_ehdr)) < sizeof(elf_ehdr)) {
+		ehdr_data = lttng_elf_get_range(elf, 0, sizeof(elf_ehdr));
+		if (!ehdr_data) {
 			ret = -1;
 			goto error;
 		}
+		memcpy(&elf_ehdr, ehdr_data, sizeof(elf_ehdr));
 		if (!is_elf_native_endian(elf)) {
 			bswap_ehdr(elf_ehdr);
 		}
-		copy_ehdr(elf_ehdr, *(elf->ehdr));
+		copy_ehdr(elf_ehdr, elf->ehdr);
 	}
 error:
 	return ret;
@@ -313,7 +416,7 @@ int lttng_elf_get_section_hdr(struct lttng_elf *elf,
 		goto error;
 	}
 
-	if (index >= elf->ehdr->e_shnum) {
+	if (index >= elf->ehdr.e_shnum) {
 		ret = -1;
 		goto error;
 	}
@@ -333,109 +436,46 @@ error:
  * sh_name value) in bytes relative to the beginning of the section
  * names string table.
  *
- * If no name is found, NULL is returned.
+ * The name points in the mapped file. If no name is found, NULL is returned.
  */
 static
-char *lttng_elf_get_section_name(struct lttng_elf *elf, off_t offset)
+const char *lttng_elf_get_section_name(struct lttng_elf *elf, off_t offset)
 {
-	char *name = NULL;
-	size_t name_length = 0, to_read;	/* name_length does not include \0 */
+	const char *name = NULL;
 
 	if (!elf) {
-		goto error;
+		goto end;
 	}
 
 	if (offset >= elf->section_names_size) {
-		goto error;
-	}
-
-	if (lseek(elf->fd, elf->section_names_offset + offset, SEEK_SET) < 0) {
-		PERROR("Error seeking to the beginning of ELF string table section");
-		goto error;
+		goto end;
 	}
 
-	to_read = elf->section_names_size - offset;
-
-	/* Find first \0 after or at current location, remember name_length. */
-	for (;;) {
-		char buf[BUF_LEN];
-		ssize_t read_len;
-		size_t i;
-
-		if (!to_read) {
-			goto error;
-		}
-		read_len = lttng_read(elf->fd, buf, min_t(size_t, BUF_LEN, to_read));
-		if (read_len <= 0) {
-			PERROR("Error reading ELF string table section");
-			goto error;
-		}
-		for (i = 0; i < read_len; i++) {
-			if (buf[i] == '\0') {
-				name_length += i;
-				goto end;
-			}
-		}
-		name_length += read_len;
-		to_read -= read_len;
+	/* The name must be terminated within the string table. */
+	name = elf->data + elf->section_names_offset + offset;
+	if (!memchr(name, '\0', elf->section_names_size - offset)) {
+		name = NULL;
 	}
 end:
-	/*
-	 * We found the length of the section name, now seek back to the
-	 * beginning of the name and copy it in the newly allocated buffer.
-	 */
-	name = zmalloc(sizeof(char) * (name_length + 1));	/* + 1 for \0 */
-	if (!name) {
-		PERROR("Error allocating ELF section name buffer");
-		goto error;
-	}
-	if (lseek(elf->fd, elf->section_names_offset + offset, SEEK_SET) < 0) {
-		PERROR("Error seeking to the offset of the ELF section name");
-		goto error;
-	}
-	if (lttng_read(elf->fd, name, name_length + 1) < name_length + 1) {
-		PERROR("Error reading the ELF section name");
-		goto error;
-	}
-
 	return name;
-
-error:
-	free(name);
-	return NULL;
 }
 
 static
 int lttng_elf_validate_and_populate(struct lttng_elf *elf)
 {
 	uint8_t version;
-	uint8_t e_ident[EI_NIDENT];
-	uint8_t *magic_number = NULL;
+	const uint8_t *e_ident;
+	const uint8_t *magic_number = NULL;
 	int ret = 0;
 
-	if (elf->fd == -1) {
-		DBG("fd error");
-		ret = LTTNG_ERR_ELF_PARSING;
-		goto end;
-	}
-
 	/*
 	 * First read the magic number, endianness and version to later populate
 	 * the ELF header with the correct endianness and bitness.
 	 * (see elf.h)
 	 */
-
-	if (lseek(elf->fd, 0, SEEK_SET) < 0) {
-		PERROR("Error seeking the beginning of ELF file");
-		ret = LTTNG_ERR_ELF_PARSING;
-		goto end;
-	}
-	ret = lttng_read(elf->fd, e_ident, EI_NIDENT);
-	if (ret < EI_NIDENT) {
+	e_ident = (const uint8_t *) lttng_elf_get_range(elf, 0, EI_NIDENT);
+	if (!e_ident) {
 		DBG("Error reading the ELF identification fields");
-		if (ret == -1) {
-			PERROR("Error reading the ELF identification fields");
-		}
 		ret = LTTNG_ERR_ELF_PARSING;
 		goto end;
 	}
@@ -485,34 +525,40 @@ int lttng_elf_validate_and_populate(struct lttng_elf *elf)
 		goto end;
 	}
 
-	elf->ehdr = zmalloc(sizeof(struct lttng_elf_ehdr));
-	if (!elf->ehdr) {
-		PERROR("Error allocation buffer for ELF header");
-		ret = LTTNG_ERR_NOMEM;
-		goto end;
-	}
-
 	/*
 	 * Copy the content of the elf header.
 	 */
 	ret = populate_elf_header(elf);
 	if (ret) {
 		DBG("Error reading ELF header,");
-		goto free_elf_error;
+		goto end;
 	}
 
-	goto end;
-
-free_elf_error:
-	free(elf->ehdr);
-	elf->ehdr = NULL;
 end:
 	return ret;
 }
 
 /*
- * Create an instance of lttng_elf for the ELF file located at
- * `path`.
+ * Destroy the given lttng_elf instance.
+ */
+static
+void lttng_elf_destroy(struct lttng_elf *elf)
+{
+	if (!elf) {
+		return;
+	}
+
+	if (elf->data && munmap((void *) elf->data, elf->file_size)) {
+		PERROR("Error unmapping ELF file");
+	}
+	free(elf);
+}
+
+/*
+ * Create an instance of lttng_elf for the ELF file open as `fd`.
+ *
+ * The file is mapped rather than read, the mapping outliving the file
+ * descriptor, which remains owned by the caller.
  *
  * Return a pointer to the instance on success, NULL on failure.
  */
@@ -523,6 +569,7 @@ struct lttng_elf *lttng_elf_create(int fd)
 	struct lttng_elf *elf = NULL;
 	int ret;
 	struct stat stat_buf;
+	void *data;
 
 	if (fd < 0) {
 		goto error;
@@ -537,6 +584,11 @@ struct lttng_elf *lttng_elf_create(int fd)
 		ERR("Refusing to initialize lttng_elf from non-regular file");
 		goto error;
 	}
+	if (stat_buf.st_size < EI_NIDENT ||
+			(uint64_t) stat_buf.st_size > SIZE_MAX) {
+		DBG("Invalid ELF file size: %jd", (intmax_t) stat_buf.st_size);
+		goto error;
+	}
 
 	elf = zmalloc(sizeof(struct lttng_elf));
 	if (!elf) {
@@ -545,11 +597,12 @@ struct lttng_elf *lttng_elf_create(int fd)
 	}
 	elf->file_size = (size_t) stat_buf.st_size;
 
-	elf->fd = dup(fd);
-	if (elf->fd < 0) {
-		PERROR("Error duplicating file descriptor to binary");
+	data = mmap(NULL, elf->file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED) {
+		PERROR("Error mapping ELF file");
 		goto error;
 	}
+	elf->data = data;
 
 	ret = lttng_elf_validate_and_populate(elf);
 	if (ret) {
@@ -557,59 +610,34 @@ struct lttng_elf *lttng_elf_create(int fd)
 	}
 
 	ret = lttng_elf_get_section_hdr(
-			elf, elf->ehdr->e_shstrndx, &section_names_shdr);
+			elf, elf->ehdr.e_shstrndx, &section_names_shdr);
 	if (ret) {
 		goto error;
 	}
 
+	if (!lttng_elf_get_range(elf, section_names_shdr.sh_offset,
+			section_names_shdr.sh_size)) {
+		DBG("ELF section names string table is out of the file's bounds");
+		goto error;
+	}
 	elf->section_names_offset = section_names_shdr.sh_offset;
 	elf->section_names_size = section_names_shdr.sh_size;
 	return elf;
 
 error:
-	if (elf) {
-		if (elf->ehdr) {
-			free(elf->ehdr);
-		}
-		if (elf->fd >= 0) {
-			if (close(elf->fd)) {
-				PERROR("Error closing file descriptor in error path");
-				abort();
-			}
-		}
-		free(elf);
-	}
+	lttng_elf_destroy(elf);
 	return NULL;
 }
 
-/*
- * Destroy the given lttng_elf instance.
- */
-static
-void lttng_elf_destroy(struct lttng_elf *elf)
-{
-	if (!elf) {
-		return;
-	}
-
-	free(elf->ehdr);
-	if (close(elf->fd)) {
-		PERROR("Error closing file description in error path");
-		abort();
-	}
-	free(elf);
-}
-
 static
 int lttng_elf_get_section_hdr_by_name(struct lttng_elf *elf,
 		const char *section_name, struct lttng_elf_shdr *section_hdr)
 {
 	int i;
-	char *curr_section_name;
+	const char *curr_section_name;
 
-	for (i = 0; i < elf->ehdr->e_shnum; ++i) {
-		bool name_equal;
-	        int ret = lttng_elf_get_section_hdr(elf, i, section_hdr);
+	for (i = 0; i < elf->ehdr.e_shnum; ++i) {
+		int ret = lttng_elf_get_section_hdr(elf, i, section_hdr);
 
 		if (ret) {
 			break;
@@ -619,58 +647,34 @@ int lttng_elf_get_section_hdr_by_name(struct lttng_elf *elf,
 		if (!curr_section_name) {
 			continue;
 		}
-		name_equal = strcmp(curr_section_name, section_name) == 0;
-		free(curr_section_name);
-		if (name_equal) {
+		if (strcmp(curr_section_name, section_name) == 0) {
 			return 0;
 		}
 	}
 	return LTTNG_ERR_ELF_PARSING;
 }
 
+/*
+ * Get a pointer to the data of a section in the mapped file.
+ *
+ * Returns NULL if the section is not within the file.
+ */
 static
-char *lttng_elf_get_section_data(struct lttng_elf *elf,
+const char *lttng_elf_get_section_data(struct lttng_elf *elf,
 		struct lttng_elf_shdr *shdr)
 {
-	int ret;
-	off_t section_offset;
-	char *data;
-	size_t max_alloc_size;
+	const char *data = NULL;
 
 	if (!elf || !shdr) {
-		goto error;
-	}
-
-	max_alloc_size = min_t(size_t, MAX_SECTION_DATA_SIZE, elf->file_size);
-
-	section_offset = shdr->sh_offset;
-	if (lseek(elf->fd, section_offset, SEEK_SET) < 0) {
-		PERROR("Error seeking to section offset");
-		goto error;
+		goto end;
 	}
 
-	if (shdr->sh_size > max_alloc_size) {
-		ERR("ELF section size exceeds maximal allowed size of %zu bytes",
-				max_alloc_size);
-		goto error;
-	}
-	data = zmalloc(shdr->sh_size);
+	data = lttng_elf_get_range(elf, shdr->sh_offset, shdr->sh_size);
 	if (!data) {
-		PERROR("Error allocating buffer for ELF section data");
-		goto error;
+		ERR("ELF section is out of the bounds of the file");
 	}
-	ret = lttng_read(elf->fd, data, shdr->sh_size);
-	if (ret == -1) {
-		PERROR("Error reading ELF section data");
-		goto free_error;
-	}
-
+end:
 	return data;
-
-free_error:
-	free(data);
-error:
-	return NULL;
 }
 
 /*
@@ -681,41 +685,32 @@ error:
  * Returns the offset on success or non-zero in case of failure.
  */
 static
-int lttng_elf_convert_addr_in_text_to_offset(struct lttng_elf *elf_handle,
-		size_t addr, uint64_t *offset)
+int lttng_elf_convert_addr_in_text_to_offset(
+		const struct lttng_elf_cache_entry *entry,
+		uint64_t addr, uint64_t *offset)
 {
 	int ret = 0;
 	off_t text_section_offset;
 	off_t text_section_addr_beg;
 	off_t text_section_addr_end;
 	off_t offset_in_section;
-	struct lttng_elf_shdr text_section_hdr;
 
-	if (!elf_handle) {
-		DBG("Invalid ELF handle.");
-		ret = LTTNG_ERR_ELF_PARSING;
-		goto error;
-	}
-
-	/* Get a pointer to the .text section header. */
-	ret = lttng_elf_get_section_hdr_by_name(elf_handle,
-			TEXT_SECTION_NAME, &text_section_hdr);
-	if (ret) {
+	if (!entry->has_text_section) {
 		DBG("Text section not found in binary.");
 		ret = LTTNG_ERR_ELF_PARSING;
 		goto error;
 	}
 
-	text_section_offset = text_section_hdr.sh_offset;
-	text_section_addr_beg = text_section_hdr.sh_addr;
+	text_section_offset = entry->text_section_hdr.sh_offset;
+	text_section_addr_beg = entry->text_section_hdr.sh_addr;
 	text_section_addr_end =
-			text_section_addr_beg + text_section_hdr.sh_size;
+			text_section_addr_beg + entry->text_section_hdr.sh_size;
 
 	/*
 	 * Verify that the address is within the .text section boundaries.
 	 */
 	if (addr < text_section_addr_beg || addr > text_section_addr_end) {
-		DBG("Address found is outside of the .text section addr=0x%zx, "
+		DBG("Address found is outside of the .text section addr=0x%" PRIx64 ", "
 			".text section=[0x%jd - 0x%jd].", addr, (intmax_t)text_section_addr_beg,
 			(intmax_t)text_section_addr_end);
 		ret = LTTNG_ERR_ELF_PARSING;
@@ -734,38 +729,121 @@ error:
 	return ret;
 }
 
+static
+unsigned long hash_symbol(const char *name)
+{
+	return hash_key_str(name, ELF_INDEX_HASH_SEED);
+}
+
+static
+unsigned long hash_sdt_probe(const char *provider_name, const char *probe_name)
+{
+	return hash_key_str(probe_name,
+			hash_key_str(provider_name, ELF_INDEX_HASH_SEED));
+}
+
+static
+void lttng_elf_index_init(struct lttng_elf_index *index, size_t element_size)
+{
+	index->built = false;
+	index->error = 0;
+	lttng_dynamic_array_init(&index->elements, element_size, NULL);
+	index->buckets = NULL;
+	index->bucket_mask = 0;
+}
+
+static
+void lttng_elf_index_fini(struct lttng_elf_index *index)
+{
+	lttng_dynamic_array_reset(&index->elements);
+	free(index->buckets);
+	index->buckets = NULL;
+}
+
 /*
- * Compute the offset of a symbol from the begining of the ELF binary.
- *
- * On success, returns 0 offset parameter is set to the computed value
- * On failure, returns -1.
+ * Allocate at least as many empty buckets as the index has elements.
  */
-int lttng_elf_get_symbol_offset(int fd, char *symbol, uint64_t *offset)
+static
+int lttng_elf_index_alloc_buckets(struct lttng_elf_index *index)
 {
 	int ret = 0;
-	int sym_found = 0;
-	int sym_count = 0;
-	int sym_idx = 0;
-	uint64_t addr = 0;
-	char *curr_sym_str = NULL;
-	char *symbol_table_data = NULL;
-	char *string_table_data = NULL;
-	const char *string_table_name = NULL;
-	struct lttng_elf_shdr symtab_hdr;
-	struct lttng_elf_shdr strtab_hdr;
-	struct lttng_elf *elf = NULL;
+	uint32_t i, nb_buckets;
+	const size_t count = lttng_dynamic_array_get_count(&index->elements);
 
-	if (!symbol || !offset ) {
+	if (count >= ELF_INDEX_END) {
+		DBG("Too many elements to index in ELF file: %zu", count);
 		ret = LTTNG_ERR_ELF_PARSING;
 		goto end;
 	}
 
-	elf = lttng_elf_create(fd);
-	if (!elf) {
-		ret = LTTNG_ERR_ELF_PARSING;
+	nb_buckets = UINT32_C(1) << utils_get_count_order_u32(
+			max_t(uint32_t, count, 1));
+	index->buckets = calloc(nb_buckets, sizeof(*index->buckets));
+	if (!index->buckets) {
+		PERROR("Error allocating ELF index buckets");
+		ret = LTTNG_ERR_NOMEM;
+		goto end;
+	}
+
+	for (i = 0; i < nb_buckets; i++) {
+		index->buckets[i] = ELF_INDEX_END;
+	}
+	index->bucket_mask = nb_buckets - 1;
+end:
+	return ret;
+}
+
+/*
+ * Build an index of a cache entry on its first lookup.
+ *
+ * Returns the error of the build, which is kept to be returned by the later
+ * lookups unless the build can succeed on retry.
+ */
+static
+int lttng_elf_index_build(struct lttng_elf_cache_entry *entry,
+		struct lttng_elf_index *index, lttng_elf_index_build_cb build)
+{
+	int ret;
+
+	if (index->built) {
+		ret = index->error;
 		goto end;
 	}
 
+	ret = build(entry, index);
+	if (ret) {
+		lttng_dynamic_array_clear(&index->elements);
+		free(index->buckets);
+		index->buckets = NULL;
+		if (ret == LTTNG_ERR_NOMEM) {
+			goto end;
+		}
+	}
+
+	index->error = ret;
+	index->built = true;
+end:
+	return ret;
+}
+
+/*
+ * Index the function symbols of the symbol table, or of the dynamic symbol
+ * table if the file has no symbol table.
+ */
+static
+int lttng_elf_build_symbol_index(struct lttng_elf_cache_entry *entry,
+		struct lttng_elf_index *index)
+{
+	int ret = 0;
+	uint64_t sym_count, sym_idx;
+	size_t sym_size, i;
+	const char *symbol_table_data = NULL;
+	const char *string_table_data = NULL;
+	const char *string_table_name = NULL;
+	struct lttng_elf_shdr symtab_hdr;
+	struct lttng_elf_shdr strtab_hdr;
+	struct lttng_elf *elf = entry->elf;
+
 	/*
 	 * The .symtab section might not exist on stripped binaries.
 	 * Try to get the symbol table section header first. If it's absent,
@@ -782,7 +860,7 @@ int lttng_elf_get_symbol_offset(int fd, char *symbol, uint64_t *offset)
 		if (ret) {
 			DBG("Cannot get ELF Symbol Table nor Dynamic Symbol Table sections.");
 			ret = LTTNG_ERR_ELF_PARSING;
-			goto destroy_elf;
+			goto end;
 		}
 		string_table_name = DYNAMIC_STRING_TAB_SECTION_NAME;
 	} else {
@@ -794,7 +872,15 @@ int lttng_elf_get_symbol_offset(int fd, char *symbol, uint64_t *offset)
 	if (symbol_table_data == NULL) {
 		DBG("Cannot get ELF Symbol Table data.");
 		ret = LTTNG_ERR_ELF_PARSING;
-		goto destroy_elf;
+		goto end;
+	}
+
+	sym_size = is_elf_32_bit(elf) ? sizeof(Elf32_Sym) : sizeof(Elf64_Sym);
+	if (symtab_hdr.sh_entsize != sym_size) {
+		DBG("Unexpected ELF Symbol Table entry size: %" PRIu64,
+				symtab_hdr.sh_entsize);
+		ret = LTTNG_ERR_ELF_PARSING;
+		goto end;
 	}
 
 	/* Get the string table section header. */
@@ -802,7 +888,7 @@ int lttng_elf_get_symbol_offset(int fd, char *symbol, uint64_t *offset)
 			&strtab_hdr);
 	if (ret) {
 		DBG("Cannot get ELF string table section.");
-		goto free_symbol_table_data;
+		goto end;
 	}
 
 	/* Get the data associated with the string table section. */
@@ -810,7 +896,7 @@ int lttng_elf_get_symbol_offset(int fd, char *symbol, uint64_t *offset)
 	if (string_table_data == NULL) {
 		DBG("Cannot get ELF string table section data.");
 		ret = LTTNG_ERR_ELF_PARSING;
-		goto free_symbol_table_data;
+		goto end;
 	}
 
 	/* Get the number of symbol in the table for the iteration. */
@@ -819,13 +905,19 @@ int lttng_elf_get_symbol_offset(int fd, char *symbol, uint64_t *offset)
 	/* Loop over all symbol. */
 	for (sym_idx = 0; sym_idx < sym_count; sym_idx++) {
 		struct lttng_elf_sym curr_sym;
+		struct lttng_elf_symbol symbol;
+		const char *sym_data = symbol_table_data + sym_idx * sym_size;
 
 		/* Get the symbol at the current index. */
 		if (is_elf_32_bit(elf)) {
-			Elf32_Sym tmp = ((Elf32_Sym *) symbol_table_data)[sym_idx];
+			Elf32_Sym tmp;
+
+			memcpy(&tmp, sym_data, sizeof(tmp));
 			copy_sym(tmp, curr_sym);
 		} else {
-			Elf64_Sym tmp = ((Elf64_Sym *) symbol_table_data)[sym_idx];
+			Elf64_Sym tmp;
+
+			memcpy(&tmp, sym_data, sizeof(tmp));
 			copy_sym(tmp, curr_sym);
 		}
 
@@ -837,12 +929,6 @@ int lttng_elf_get_symbol_offset(int fd, char *symbol, uint64_t *offset)
 			continue;
 		}
 
-		/*
-		 * Use the st_name field in the lttng_elf_sym struct to get offset of
-		 * the symbol's name from the beginning of the string table.
-		 */
-		curr_sym_str = string_table_data + curr_sym.st_name;
-
 		/*
 		 * If the current symbol is not a function; skip to the next symbol.
 		 */
@@ -851,111 +937,101 @@ int lttng_elf_get_symbol_offset(int fd, char *symbol, uint64_t *offset)
 		}
 
 		/*
-		 * Compare with the search symbol. If there is a match set the address
-		 * output parameter and return success.
+		 * Use the st_name field in the lttng_elf_sym struct to get offset of
+		 * the symbol's name from the beginning of the string table. Skip
+		 * the names not terminated within the string table.
 		 */
-		if (strcmp(symbol, curr_sym_str) == 0 ) {
-			sym_found = 1;
-			addr = curr_sym.st_value;
-			break;
+		if (curr_sym.st_name >= strtab_hdr.sh_size ||
+				!memchr(string_table_data + curr_sym.st_name, '\0',
+						strtab_hdr.sh_size - curr_sym.st_name)) {
+			continue;
+		}
+
+		symbol.name = string_table_data + curr_sym.st_name;
+		symbol.addr = curr_sym.st_value;
+		symbol.next = ELF_INDEX_END;
+		ret = lttng_dynamic_array_add_element(&index->elements, &symbol);
+		if (ret) {
+			ret = LTTNG_ERR_NOMEM;
+			goto end;
 		}
 	}
 
-	if (!sym_found) {
-		DBG("Symbol not found.");
-		ret = LTTNG_ERR_ELF_PARSING;
-		goto free_string_table_data;
+	ret = lttng_elf_index_alloc_buckets(index);
+	if (ret) {
+		goto end;
 	}
 
 	/*
-	 * Use the virtual address of the symbol to compute the offset of this
-	 * symbol from the beginning of the executable file.
+	 * Chain the symbols starting from the last so that a lookup finds the
+	 * first function of a name, as a scan of the table does.
 	 */
-	ret = lttng_elf_convert_addr_in_text_to_offset(elf, addr, offset);
-	if (ret) {
-		DBG("Cannot convert addr to offset.");
-		goto free_string_table_data;
+	for (i = lttng_dynamic_array_get_count(&index->elements); i-- > 0;) {
+		struct lttng_elf_symbol *symbol =
+				lttng_dynamic_array_get_element(
+						&index->elements, i);
+		uint32_t *bucket = &index->buckets[hash_symbol(symbol->name) &
+				index->bucket_mask];
+
+		symbol->next = *bucket;
+		*bucket = (uint32_t) i;
 	}
 
-
-free_string_table_data:
-	free(string_table_data);
-free_symbol_table_data:
-	free(symbol_table_data);
-destroy_elf:
-	lttng_elf_destroy(elf);
+	DBG("Indexed %zu ELF function symbols",
+			lttng_dynamic_array_get_count(&index->elements));
 end:
 	return ret;
 }
 
 /*
- * Compute the offsets of SDT probes from the begining of the ELF binary.
- *
- * On success, returns 0 and the nb_probes parameter is set to the number of
- * offsets found and the offsets parameter points to an array of offsets where
- * the SDT probes are.
- * On failure, returns -1.
+ * Index the probes described by the stap note section.
  */
-int lttng_elf_get_sdt_probe_offsets(int fd, const char *provider_name,
-		const char *probe_name, uint64_t **offsets, uint32_t *nb_probes)
+static
+int lttng_elf_build_sdt_probe_index(struct lttng_elf_cache_entry *entry,
+		struct lttng_elf_index *index)
 {
-	int ret = 0, nb_match = 0;
+	int ret = 0;
+	size_t i;
 	struct lttng_elf_shdr stap_note_section_hdr;
-	struct lttng_elf *elf = NULL;
-	char *stap_note_section_data = NULL;
-	char *curr_note_section_begin, *curr_data_ptr, *curr_probe, *curr_provider;
-	char *next_note_ptr;
-	uint32_t name_size, desc_size, note_type;
-	uint64_t curr_probe_location, curr_probe_offset, curr_semaphore_location;
-	uint64_t *probe_locs = NULL, *new_probe_locs = NULL;
-
-	if (!provider_name || !probe_name || !nb_probes || !offsets) {
-		DBG("Invalid arguments.");
-		ret = LTTNG_ERR_ELF_PARSING;
-		goto error;
-	}
-
-	elf = lttng_elf_create(fd);
-	if (!elf) {
-		DBG("Error allocation ELF.");
-		ret = LTTNG_ERR_ELF_PARSING;
-		goto error;
-	}
+	const char *stap_note_section_data, *stap_note_section_end;
+	const char *next_note_ptr;
 
 	/* Get the stap note section header. */
-	ret = lttng_elf_get_section_hdr_by_name(elf, NOTE_STAPSDT_SECTION_NAME,
-			&stap_note_section_hdr);
+	ret = lttng_elf_get_section_hdr_by_name(entry->elf,
+			NOTE_STAPSDT_SECTION_NAME, &stap_note_section_hdr);
 	if (ret) {
 		DBG("Cannot get ELF stap note section.");
-		goto destroy_elf_error;
+		goto end;
 	}
 
 	/* Get the data associated with the stap note section. */
-	stap_note_section_data =
-			lttng_elf_get_section_data(elf, &stap_note_section_hdr);
+	stap_note_section_data = lttng_elf_get_section_data(entry->elf,
+			&stap_note_section_hdr);
 	if (stap_note_section_data == NULL) {
 		DBG("Cannot get ELF stap note section data.");
 		ret = LTTNG_ERR_ELF_PARSING;
-		goto destroy_elf_error;
+		goto end;
 	}
+	stap_note_section_end = stap_note_section_data +
+			stap_note_section_hdr.sh_size;
 
 	next_note_ptr = stap_note_section_data;
-	curr_note_section_begin = stap_note_section_data;
-
-	*offsets = NULL;
-	while (1) {
-		curr_data_ptr = next_note_ptr;
-		/* Check if we have reached the end of the note section. */
-		if (curr_data_ptr >=
-				curr_note_section_begin +
-						stap_note_section_hdr.sh_size) {
-			*nb_probes = nb_match;
-			*offsets = probe_locs;
-			ret = 0;
-			break;
+	while (next_note_ptr < stap_note_section_end) {
+		uint32_t name_size, desc_size, note_type;
+		const char *curr_data_ptr = next_note_ptr;
+		const char *desc_end, *name_end;
+		struct lttng_elf_sdt_probe probe;
+
+		if (stap_note_section_end - curr_data_ptr <
+				3 * sizeof(uint32_t)) {
+			DBG("Truncated note in SDT probe descriptions section.");
+			ret = LTTNG_ERR_ELF_PARSING;
+			goto end;
 		}
+
 		/* Get name size field. */
-		name_size = next_4bytes_boundary(*(uint32_t*) curr_data_ptr);
+		memcpy(&name_size, curr_data_ptr, sizeof(name_size));
+		name_size = next_4bytes_boundary(name_size);
 		curr_data_ptr += sizeof(uint32_t);
 
 		/* Sanity check; a zero name_size is reserved. */
@@ -963,105 +1039,403 @@ int lttng_elf_get_sdt_probe_offsets(int fd, const char *provider_name,
 			DBG("Invalid name size field in SDT probe descriptions"
 				"section.");
 			ret = -1;
-			goto realloc_error;
+			goto end;
 		}
 
 		/* Get description size field. */
-		desc_size = next_4bytes_boundary(*(uint32_t*) curr_data_ptr);
+		memcpy(&desc_size, curr_data_ptr, sizeof(desc_size));
+		desc_size = next_4bytes_boundary(desc_size);
 		curr_data_ptr += sizeof(uint32_t);
 
 		/* Get type field. */
-		note_type = *(uint32_t *) curr_data_ptr;
+		memcpy(&note_type, curr_data_ptr, sizeof(note_type));
 		curr_data_ptr += sizeof(uint32_t);
 
+		if ((uint64_t) name_size + desc_size >
+				stap_note_section_end - curr_data_ptr) {
+			DBG("Truncated note in SDT probe descriptions section.");
+			ret = LTTNG_ERR_ELF_PARSING;
+			goto end;
+		}
+
 		/*
 		 * Move the pointer to the next note to be ready for the next
 		 * iteration. The current note is made of 3 unsigned 32bit
 		 * integers (name size, descriptor size and note type), the
-		 * name and the descriptor. To move to the next note, we move
-		 * the pointer according to those values.
+		 * name and the descriptor.
 		 */
-		next_note_ptr = next_note_ptr +
-			(3 * sizeof(uint32_t)) + desc_size + name_size;
+		next_note_ptr = curr_data_ptr + name_size + desc_size;
 
-		/*
-		 * Move ptr to the end of the name string (we don't need it)
-		 * and go to the next 4 byte alignement.
-		 */
 		if (note_type != NOTE_STAPSDT_TYPE ||
 			strncmp(curr_data_ptr, NOTE_STAPSDT_NAME, name_size) != 0) {
 			continue;
 		}
 
+		/* Move ptr to the descriptor, past the name. */
 		curr_data_ptr += name_size;
+		desc_end = curr_data_ptr + desc_size;
+
+		if (desc_size < 3 * sizeof(uint64_t)) {
+			DBG("Truncated SDT probe description.");
+			ret = LTTNG_ERR_ELF_PARSING;
+			goto end;
+		}
 
 		/* Get probe location.  */
-		curr_probe_location = *(uint64_t *) curr_data_ptr;
+		memcpy(&probe.location, curr_data_ptr, sizeof(uint64_t));
 		curr_data_ptr += sizeof(uint64_t);
 
 		/* Pass over the base. Not needed. */
 		curr_data_ptr += sizeof(uint64_t);
 
 		/* Get semaphore location. */
-		curr_semaphore_location = *(uint64_t *) curr_data_ptr;
+		memcpy(&probe.semaphore_location, curr_data_ptr,
+				sizeof(uint64_t));
 		curr_data_ptr += sizeof(uint64_t);
+
 		/* Get provider name. */
-		curr_provider = curr_data_ptr;
-		curr_data_ptr += strlen(curr_provider) + 1;
+		probe.provider_name = curr_data_ptr;
+		name_end = memchr(curr_data_ptr, '\0', desc_end - curr_data_ptr);
+		if (!name_end) {
+			DBG("Unterminated SDT provider name.");
+			ret = LTTNG_ERR_ELF_PARSING;
+			goto end;
+		}
+		curr_data_ptr = name_end + 1;
 
 		/* Get probe name. */
-		curr_probe = curr_data_ptr;
+		probe.probe_name = curr_data_ptr;
+		if (!memchr(curr_data_ptr, '\0', desc_end - curr_data_ptr)) {
+			DBG("Unterminated SDT probe name.");
+			ret = LTTNG_ERR_ELF_PARSING;
+			goto end;
+		}
+
+		probe.next = ELF_INDEX_END;
+		ret = lttng_dynamic_array_add_element(&index->elements, &probe);
+		if (ret) {
+			ret = LTTNG_ERR_NOMEM;
+			goto end;
+		}
+	}
+
+	ret = lttng_elf_index_alloc_buckets(index);
+	if (ret) {
+		goto end;
+	}
+
+	/*
+	 * Chain the probes starting from the last so that a lookup finds them
+	 * in the order of the note section.
+	 */
+	for (i = lttng_dynamic_array_get_count(&index->elements); i-- > 0;) {
+		struct lttng_elf_sdt_probe *probe =
+				lttng_dynamic_array_get_element(
+						&index->elements, i);
+		uint32_t *bucket = &index->buckets[hash_sdt_probe(
+				probe->provider_name, probe->probe_name) &
+				index->bucket_mask];
+
+		probe->next = *bucket;
+		*bucket = (uint32_t) i;
+	}
+
+	DBG("Indexed %zu ELF SDT probes",
+			lttng_dynamic_array_get_count(&index->elements));
+end:
+	return ret;
+}
+
+static
+void lttng_elf_cache_entry_destroy(struct lttng_elf_cache_entry *entry)
+{
+	if (!entry) {
+		return;
+	}
+
+	lttng_elf_index_fini(&entry->symbols);
+	lttng_elf_index_fini(&entry->sdt_probes);
+	lttng_elf_destroy(entry->elf);
+	free(entry);
+}
+
+static
+struct lttng_elf_cache_entry *lttng_elf_cache_entry_create(int fd,
+		const struct lttng_elf_cache_key *key)
+{
+	struct lttng_elf_cache_entry *entry;
+
+	entry = zmalloc(sizeof(*entry));
+	if (!entry) {
+		PERROR("Error allocating ELF cache entry");
+		goto error;
+	}
+
+	entry->key = *key;
+	lttng_elf_index_init(&entry->symbols, sizeof(struct lttng_elf_symbol));
+	lttng_elf_index_init(&entry->sdt_probes,
+			sizeof(struct lttng_elf_sdt_probe));
+
+	entry->elf = lttng_elf_create(fd);
+	if (!entry->elf) {
+		goto error;
+	}
+
+	entry->has_text_section = !lttng_elf_get_section_hdr_by_name(
+			entry->elf, TEXT_SECTION_NAME,
+			&entry->text_section_hdr);
+	return entry;
+
+error:
+	lttng_elf_cache_entry_destroy(entry);
+	return NULL;
+}
+
+static
+bool lttng_elf_cache_key_same_file(const struct lttng_elf_cache_key *a,
+		const struct lttng_elf_cache_key *b)
+{
+	return a->dev == b->dev && a->ino == b->ino;
+}
+
+static
+bool lttng_elf_cache_key_same_content(const struct lttng_elf_cache_key *a,
+		const struct lttng_elf_cache_key *b)
+{
+	return a->size == b->size && a->mtime.tv_sec == b->mtime.tv_sec &&
+			a->mtime.tv_nsec == b->mtime.tv_nsec;
+}
+
+/*
+ * Get the cache entry of the ELF file open as `fd`, creating it if the file
+ * was not looked up since it was last modified. The entry of a file whose
+ * size or modification time changed is dropped. The least recently used
+ * entry is evicted if the cache is full.
+ *
+ * Must be called with the cache lock held. Returns NULL on error.
+ */
+static
+struct lttng_elf_cache_entry *lttng_elf_cache_get(int fd)
+{
+	struct stat stat_buf;
+	struct lttng_elf_cache_key key;
+	struct lttng_elf_cache_entry *entry;
+
+	if (fd < 0) {
+		entry = NULL;
+		goto end;
+	}
+
+	if (fstat(fd, &stat_buf)) {
+		PERROR("Failed to stat elf file");
+		entry = NULL;
+		goto end;
+	}
+
+	key.dev = stat_buf.st_dev;
+	key.ino = stat_buf.st_ino;
+	key.size = stat_buf.st_size;
+	key.mtime = stat_buf.st_mtim;
+
+	cds_list_for_each_entry(entry, &elf_cache.entries, node) {
+		if (!lttng_elf_cache_key_same_file(&entry->key, &key)) {
+			continue;
+		}
+
+		cds_list_del(&entry->node);
+		if (lttng_elf_cache_key_same_content(&entry->key, &key)) {
+			cds_list_add(&entry->node, &elf_cache.entries);
+			goto end;
+		}
+
+		DBG("ELF file changed since it was cached, dropping its entry");
+		lttng_elf_cache_entry_destroy(entry);
+		elf_cache.nb_entries--;
+		break;
+	}
+
+	entry = lttng_elf_cache_entry_create(fd, &key);
+	if (!entry) {
+		goto end;
+	}
+
+	if (elf_cache.nb_entries == ELF_CACHE_MAX_ENTRIES) {
+		struct lttng_elf_cache_entry *lru_entry = cds_list_entry(
+				elf_cache.entries.prev,
+				struct lttng_elf_cache_entry, node);
+
+		cds_list_del(&lru_entry->node);
+		lttng_elf_cache_entry_destroy(lru_entry);
+		elf_cache.nb_entries--;
+	}
+	cds_list_add(&entry->node, &elf_cache.entries);
+	elf_cache.nb_entries++;
+end:
+	return entry;
+}
+
+/*
+ * Compute the offset of a symbol from the begining of the ELF binary.
+ *
+ * On success, returns 0 offset parameter is set to the computed value
+ * On failure, returns -1.
+ */
+int lttng_elf_get_symbol_offset(int fd, char *symbol, uint64_t *offset)
+{
+	int ret = 0;
+	uint32_t i;
+	struct lttng_elf_cache_entry *entry;
+	const struct lttng_elf_symbol *elf_symbol = NULL;
+
+	if (!symbol || !offset ) {
+		ret = LTTNG_ERR_ELF_PARSING;
+		goto end;
+	}
+
+	pthread_mutex_lock(&elf_cache.lock);
+	entry = lttng_elf_cache_get(fd);
+	if (!entry) {
+		ret = LTTNG_ERR_ELF_PARSING;
+		goto end_unlock;
+	}
+
+	ret = lttng_elf_index_build(entry, &entry->symbols,
+			lttng_elf_build_symbol_index);
+	if (ret) {
+		goto end_unlock;
+	}
+
+	for (i = entry->symbols.buckets[hash_symbol(symbol) &
+				entry->symbols.bucket_mask];
+			i != ELF_INDEX_END; i = elf_symbol->next) {
+		elf_symbol = lttng_dynamic_array_get_element(
+				&entry->symbols.elements, i);
+		if (strcmp(symbol, elf_symbol->name) == 0) {
+			break;
+		}
+	}
+
+	if (i == ELF_INDEX_END) {
+		DBG("Symbol not found.");
+		ret = LTTNG_ERR_ELF_PARSING;
+		goto end_unlock;
+	}
+
+	/*
+	 * Use the virtual address of the symbol to compute the offset of this
+	 * symbol from the beginning of the executable file.
+	 */
+	ret = lttng_elf_convert_addr_in_text_to_offset(entry, elf_symbol->addr,
+			offset);
+	if (ret) {
+		DBG("Cannot convert addr to offset.");
+		goto end_unlock;
+	}
+
+end_unlock:
+	pthread_mutex_unlock(&elf_cache.lock);
+end:
+	return ret;
+}
+
+/*
+ * Compute the offsets of SDT probes from the begining of the ELF binary.
+ *
+ * On success, returns 0 and the nb_probes parameter is set to the number of
+ * offsets found and the offsets parameter points to an array of offsets where
+ * the SDT probes are.
+ * On failure, returns -1.
+ */
+int lttng_elf_get_sdt_probe_offsets(int fd, const char *provider_name,
+		const char *probe_name, uint64_t **offsets, uint32_t *nb_probes)
+{
+	int ret = 0, nb_match = 0;
+	uint32_t i;
+	struct lttng_elf_cache_entry *entry;
+	const struct lttng_elf_sdt_probe *probe;
+	uint64_t curr_probe_offset;
+	uint64_t *probe_locs = NULL, *new_probe_locs = NULL;
+
+	if (!provider_name || !probe_name || !nb_probes || !offsets) {
+		DBG("Invalid arguments.");
+		ret = LTTNG_ERR_ELF_PARSING;
+		goto error;
+	}
+
+	pthread_mutex_lock(&elf_cache.lock);
+	entry = lttng_elf_cache_get(fd);
+	if (!entry) {
+		DBG("Error allocation ELF.");
+		ret = LTTNG_ERR_ELF_PARSING;
+		goto end;
+	}
+
+	ret = lttng_elf_index_build(entry, &entry->sdt_probes,
+			lttng_elf_build_sdt_probe_index);
+	if (ret) {
+		goto end;
+	}
+
+	*offsets = NULL;
+	for (i = entry->sdt_probes.buckets[hash_sdt_probe(provider_name,
+				probe_name) & entry->sdt_probes.bucket_mask];
+			i != ELF_INDEX_END; i = probe->next) {
+		int new_size;
+
+		probe = lttng_dynamic_array_get_element(
+				&entry->sdt_probes.elements, i);
 
 		/* Check if the provider and probe name match */
-		if (strcmp(provider_name, curr_provider) == 0 &&
-				strcmp(probe_name, curr_probe) == 0) {
-			int new_size;
-
-			/*
-			 * We currently don't support SDT probes with semaphores. Return
-			 * success as we found a matching probe but it's guarded by a
-			 * semaphore.
-			 */
-			if (curr_semaphore_location != 0) {
-				ret = LTTNG_ERR_SDT_PROBE_SEMAPHORE;
-				goto realloc_error;
-			}
-
-			new_size = (++nb_match) * sizeof(uint64_t);
-
-			/*
-			 * Found a match with not semaphore, we need to copy the
-			 * probe_location to the output parameter.
-			 */
-			new_probe_locs = realloc(probe_locs, new_size);
-			if (!new_probe_locs) {
-				/* Error allocating a larger buffer */
-				DBG("Allocation error in SDT.");
-				ret = LTTNG_ERR_NOMEM;
-				goto realloc_error;
-			}
-			probe_locs = new_probe_locs;
-			new_probe_locs = NULL;
-
-			/*
-			 * Use the virtual address of the probe to compute the offset of
-			 * this probe from the beginning of the executable file.
-			 */
-			ret = lttng_elf_convert_addr_in_text_to_offset(elf,
-					curr_probe_location, &curr_probe_offset);
-			if (ret) {
-				DBG("Conversion error in SDT.");
-				goto realloc_error;
-			}
-
-			probe_locs[nb_match - 1] = curr_probe_offset;
+		if (strcmp(provider_name, probe->provider_name) != 0 ||
+				strcmp(probe_name, probe->probe_name) != 0) {
+			continue;
+		}
+
+		/*
+		 * We currently don't support SDT probes with semaphores. Return
+		 * success as we found a matching probe but it's guarded by a
+		 * semaphore.
+		 */
+		if (probe->semaphore_location != 0) {
+			ret = LTTNG_ERR_SDT_PROBE_SEMAPHORE;
+			goto realloc_error;
+		}
+
+		new_size = (++nb_match) * sizeof(uint64_t);
+
+		/*
+		 * Found a match with not semaphore, we need to copy the
+		 * probe_location to the output parameter.
+		 */
+		new_probe_locs = realloc(probe_locs, new_size);
+		if (!new_probe_locs) {
+			/* Error allocating a larger buffer */
+			DBG("Allocation error in SDT.");
+			ret = LTTNG_ERR_NOMEM;
+			goto realloc_error;
+		}
+		probe_locs = new_probe_locs;
+		new_probe_locs = NULL;
+
+		/*
+		 * Use the virtual address of the probe to compute the offset of
+		 * this probe from the beginning of the executable file.
+		 */
+		ret = lttng_elf_convert_addr_in_text_to_offset(entry,
+				probe->location, &curr_probe_offset);
+		if (ret) {
+			DBG("Conversion error in SDT.");
+			goto realloc_error;
 		}
+
+		probe_locs[nb_match - 1] = curr_probe_offset;
 	}
 
+	*nb_probes = nb_match;
+	*offsets = probe_locs;
+
 end:
-	free(stap_note_section_data);
-destroy_elf_error:
-	lttng_elf_destroy(elf);
+	pthread_mutex_unlock(&elf_cache.lock);
 error:
 	return ret;
 realloc_error:
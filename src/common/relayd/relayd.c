@@ -11,6 +11,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <inttypes.h>
 
 #include <common/common.h>
@@ -837,6 +840,128 @@ error:
 	return ret;
 }
 
+/*
+ * Send a data packet, that is its data header followed by its payload, to the
+ * relayd using a single vectored send. Pass MSG_MORE in flags to let the
+ * socket coalesce the packet with the ones that follow, in which case
+ * relayd_push_data() must be called once no more packets are to be sent.
+ *
+ * Return the number of payload bytes sent or a negative errno value.
+ */
+ssize_t relayd_send_data_packet(struct lttcomm_relayd_sock *rsock,
+		const struct lttcomm_relayd_data_hdr *hdr,
+		const void *payload, size_t payload_size, int flags)
+{
+	ssize_t ret;
+	struct iovec iov[2];
+
+	/* Code flow error. Safety net. */
+	assert(rsock);
+	assert(hdr);
+
+	if (rsock->sock.fd < 0) {
+		return -ECONNRESET;
+	}
+
+	DBG3("Relayd sending data packet of size %zu", payload_size);
+
+	iov[0].iov_base = (void *) hdr;
+	iov[0].iov_len = sizeof(*hdr);
+	iov[1].iov_base = (void *) payload;
+	iov[1].iov_len = payload_size;
+
+	ret = rsock->sock.ops->sendmsgv(&rsock->sock, iov, 2, flags);
+	if (ret < 0) {
+		ret = -errno;
+		goto error;
+	}
+	ret = payload_size;
+
+error:
+	return ret;
+}
+
+/*
+ * Send a metadata packet to the relayd on the control socket. The
+ * RELAYD_SEND_METADATA command, the metadata payload header and the payload
+ * itself are sent using a single vectored send.
+ *
+ * Return the number of payload bytes sent or a negative errno value.
+ */
+ssize_t relayd_send_metadata_packet(struct lttcomm_relayd_sock *rsock,
+		uint64_t stream_id, uint32_t padding,
+		const void *payload, size_t payload_size)
+{
+	ssize_t ret;
+	struct lttcomm_relayd_hdr header;
+	struct lttcomm_relayd_metadata_payload metadata_hdr;
+	struct iovec iov[3];
+
+	/* Code flow error. Safety net. */
+	assert(rsock);
+
+	if (rsock->sock.fd < 0) {
+		return -ECONNRESET;
+	}
+
+	DBG("Relayd sending metadata packet of size %zu", payload_size);
+
+	memset(&header, 0, sizeof(header));
+	header.cmd = htobe32(RELAYD_SEND_METADATA);
+	header.data_size = htobe64(sizeof(metadata_hdr) + payload_size);
+
+	metadata_hdr.stream_id = htobe64(stream_id);
+	metadata_hdr.padding_size = htobe32(padding);
+
+	iov[0].iov_base = &header;
+	iov[0].iov_len = sizeof(header);
+	iov[1].iov_base = &metadata_hdr;
+	iov[1].iov_len = sizeof(metadata_hdr);
+	iov[2].iov_base = (void *) payload;
+	iov[2].iov_len = payload_size;
+
+	ret = rsock->sock.ops->sendmsgv(&rsock->sock, iov, 3, 0);
+	if (ret < 0) {
+		ret = -errno;
+		goto error;
+	}
+	ret = payload_size;
+
+error:
+	return ret;
+}
+
+/*
+ * Push out the data held back on a relayd socket by sends done with MSG_MORE.
+ */
+int relayd_push_data(struct lttcomm_relayd_sock *rsock)
+{
+	int ret = 0;
+
+	/* Code flow error. Safety net. */
+	assert(rsock);
+
+	if (rsock->sock.fd < 0) {
+		return -ECONNRESET;
+	}
+
+#ifdef TCP_CORK
+	{
+		int val = 0;
+
+		/* Uncorking the socket sends the pending partial frames. */
+		ret = setsockopt(rsock->sock.fd, IPPROTO_TCP, TCP_CORK, &val,
+				sizeof(val));
+		if (ret < 0) {
+			PERROR("setsockopt TCP_CORK relayd data socket");
+			ret = -errno;
+		}
+	}
+#endif /* TCP_CORK */
+
+	return ret;
+}
+
 /*
  * Send close stream command to the relayd.
  */
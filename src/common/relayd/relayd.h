@@ -50,6 +50,13 @@ int relayd_start_data(struct lttcomm_relayd_sock *sock);
 int relayd_send_metadata(struct lttcomm_relayd_sock *sock, size_t len);
 int relayd_send_data_hdr(struct lttcomm_relayd_sock *sock,
 		struct lttcomm_relayd_data_hdr *hdr, size_t size);
+ssize_t relayd_send_data_packet(struct lttcomm_relayd_sock *rsock,
+		const struct lttcomm_relayd_data_hdr *hdr,
+		const void *payload, size_t payload_size, int flags);
+ssize_t relayd_send_metadata_packet(struct lttcomm_relayd_sock *rsock,
+		uint64_t stream_id, uint32_t padding,
+		const void *payload, size_t payload_size);
+int relayd_push_data(struct lttcomm_relayd_sock *rsock);
 int relayd_data_pending(struct lttcomm_relayd_sock *sock, uint64_t stream_id,
 		uint64_t last_net_seq_num);
 int relayd_quiescent_control(struct lttcomm_relayd_sock *sock,
@@ -22,6 +22,7 @@
 #include <signal.h>
 #include <assert.h>
 #include <signal.h>
+#include <urcu/uatomic.h>
 
 #include <common/lttng-kernel.h>
 #include <common/common.h>
@@ -63,8 +64,18 @@ enum run_as_cmd {
 	RUN_AS_EXTRACT_ELF_SYMBOL_OFFSET,
 	RUN_AS_EXTRACT_SDT_PROBE_OFFSETS,
 	RUN_AS_GENERATE_FILTER_BYTECODE,
+	RUN_AS_OPENAT_BATCH,
 };
 
+/*
+ * Maximal number of files opened by a single RUN_AS_OPENAT_BATCH command.
+ * All the resulting file descriptors are passed in one message.
+ */
+#define RUN_AS_OPEN_BATCH_MAX	16
+
+/* Maximal number of workers in the pool. */
+#define RUN_AS_MAX_WORKERS	64
+
 struct run_as_mkdir_data {
 	int dirfd;
 	char path[LTTNG_PATH_MAX];
@@ -78,6 +89,15 @@ struct run_as_open_data {
 	mode_t mode;
 } LTTNG_PACKED;
 
+struct run_as_open_batch_data {
+	int dirfd;
+	int flags;
+	mode_t mode;
+	uint32_t count;
+	/* `count` null-terminated file names, laid out back to back. */
+	char names[LTTNG_PATH_MAX];
+} LTTNG_PACKED;
+
 struct run_as_unlink_data {
 	int dirfd;
 	char path[LTTNG_PATH_MAX];
@@ -118,6 +138,12 @@ struct run_as_open_ret {
 	int fd;
 } LTTNG_PACKED;
 
+struct run_as_open_batch_ret {
+	/* Number of files opened; either 0 or all of the requested files. */
+	uint32_t count;
+	int fds[RUN_AS_OPEN_BATCH_MAX];
+} LTTNG_PACKED;
+
 struct run_as_extract_elf_symbol_offset_ret {
 	uint64_t offset;
 } LTTNG_PACKED;
@@ -137,6 +163,7 @@ struct run_as_data {
 	union {
 		struct run_as_mkdir_data mkdir;
 		struct run_as_open_data open;
+		struct run_as_open_batch_data open_batch;
 		struct run_as_unlink_data unlink;
 		struct run_as_rmdir_data rmdir;
 		struct run_as_rename_data rename;
@@ -167,6 +194,7 @@ struct run_as_ret {
 	union {
 		int ret;
 		struct run_as_open_ret open;
+		struct run_as_open_batch_ret open_batch;
 		struct run_as_extract_elf_symbol_offset_ret extract_elf_symbol_offset;
 		struct run_as_extract_sdt_probe_offsets_ret extract_sdt_probe_offsets;
 		struct run_as_generate_filter_bytecode_ret generate_filter_bytecode;
@@ -195,8 +223,11 @@ struct run_as_ret {
 	command_properties[data_ptr->cmd].in_fd_count;	\
 })
 
-#define COMMAND_OUT_FD_COUNT(cmd) ({		\
-	command_properties[cmd].out_fd_count;	\
+/* The number of files opened by a batch varies with the command. */
+#define COMMAND_OUT_FD_COUNT(cmd, ret_ptr) ({				\
+	(cmd) == RUN_AS_OPENAT_BATCH ?					\
+		(ret_ptr)->u.open_batch.count :				\
+		command_properties[cmd].out_fd_count;			\
 })
 
 #define COMMAND_USE_CWD_FD(data_ptr) command_properties[data_ptr->cmd].use_cwd_fd
@@ -251,6 +282,13 @@ static const struct run_as_command_properties command_properties[] = {
 		.out_fd_count = 1,
 		.use_cwd_fd = false,
 	},
+	[RUN_AS_OPENAT_BATCH] = {
+		.in_fds_offset = offsetof(struct run_as_data, u.open_batch.dirfd),
+		.in_fd_count = 1,
+		.out_fds_offset = offsetof(struct run_as_ret, u.open_batch.fds),
+		.out_fd_count = RUN_AS_OPEN_BATCH_MAX,
+		.use_cwd_fd = false,
+	},
 	[RUN_AS_UNLINK] = {
 		.in_fds_offset = offsetof(struct run_as_data, u.unlink.dirfd),
 		.in_fd_count = 1,
@@ -338,10 +376,31 @@ struct run_as_worker {
 	char *procname;
 };
 
-/* Single global worker per process (for now). */
-static struct run_as_worker *global_worker;
-/* Lock protecting the worker. */
-static pthread_mutex_t worker_lock = PTHREAD_MUTEX_INITIALIZER;
+struct run_as_worker_slot {
+	/* Serializes the commands sent to the worker and its restarts. */
+	pthread_mutex_t lock;
+	/* NULL if the worker could not be restarted. */
+	struct run_as_worker *worker;
+};
+
+/*
+ * Pool of workers. Commands are dispatched to the first idle worker so that
+ * concurrent run-as commands of different threads (e.g. the creation of the
+ * stream files of many channels) do not serialize on a single worker.
+ */
+static struct {
+	struct run_as_worker_slot *slots;
+	unsigned int count;
+	/* Used to restart a worker. */
+	char *procname;
+	/* Slot from which the search for an idle worker starts. */
+	unsigned long next_slot;
+} worker_pool;
+/*
+ * Protects the creation and destruction of the worker pool (write side)
+ * against the commands using its workers (read side).
+ */
+static pthread_rwlock_t worker_pool_lock = PTHREAD_RWLOCK_INITIALIZER;
 
 #ifdef VALGRIND
 static
@@ -452,6 +511,79 @@ end:
 	return ret_value->u.ret;
 }
 
+/*
+ * Open all the files of a batch or none of them, in which case the errno of
+ * the first failure is returned.
+ */
+static
+int _open_batch(struct run_as_data *data, struct run_as_ret *ret_value)
+{
+	int ret = 0;
+	uint32_t i;
+	const char *name = data->u.open_batch.names;
+	const char *names_end = name + sizeof(data->u.open_batch.names);
+	struct lttng_directory_handle *handle;
+
+	ret_value->u.open_batch.count = 0;
+	handle = lttng_directory_handle_create_from_dirfd(
+			data->u.open_batch.dirfd);
+	if (!handle) {
+		ret_value->_errno = errno;
+		ret_value->_error = true;
+		ret = -1;
+		goto end;
+	}
+	/* Ownership of dirfd is transferred to the handle. */
+	data->u.open_batch.dirfd = -1;
+
+	if (data->u.open_batch.count > RUN_AS_OPEN_BATCH_MAX) {
+		ret_value->_errno = EINVAL;
+		ret = -1;
+		goto error;
+	}
+
+	for (i = 0; i < data->u.open_batch.count; i++) {
+		int fd;
+		const char *name_end;
+
+		name_end = memchr(name, '\0', names_end - name);
+		if (!name_end) {
+			ret_value->_errno = EINVAL;
+			ret = -1;
+			goto error;
+		}
+
+		fd = lttng_directory_handle_open_file(handle, name,
+				data->u.open_batch.flags,
+				data->u.open_batch.mode);
+		if (fd < 0) {
+			ret_value->_errno = errno;
+			ret = -1;
+			goto error;
+		}
+
+		ret_value->u.open_batch.fds[i] = fd;
+		ret_value->u.open_batch.count++;
+		name = name_end + 1;
+	}
+
+	ret_value->_errno = 0;
+	ret_value->_error = false;
+	goto put_handle;
+error:
+	for (i = 0; i < ret_value->u.open_batch.count; i++) {
+		if (close(ret_value->u.open_batch.fds[i])) {
+			PERROR("Failed to close file descriptor of batch");
+		}
+	}
+	ret_value->u.open_batch.count = 0;
+	ret_value->_error = true;
+put_handle:
+	lttng_directory_handle_put(handle);
+end:
+	return ret;
+}
+
 static
 int _unlink(struct run_as_data *data, struct run_as_ret *ret_value)
 {
@@ -698,6 +830,8 @@ run_as_fct run_as_enum_to_fct(enum run_as_cmd cmd)
 	case RUN_AS_OPEN:
 	case RUN_AS_OPENAT:
 		return _open;
+	case RUN_AS_OPENAT_BATCH:
+		return _open_batch;
 	case RUN_AS_UNLINK:
 	case RUN_AS_UNLINKAT:
 		return _unlink;
@@ -806,18 +940,18 @@ int send_fds_to_master(struct run_as_worker *worker, enum run_as_cmd cmd,
 	int ret = 0;
 	unsigned int i;
 
-	if (COMMAND_OUT_FD_COUNT(cmd) == 0) {
+	if (COMMAND_OUT_FD_COUNT(cmd, run_as_ret) == 0) {
 		goto end;
 	}
 
 	ret = do_send_fds(worker->sockpair[1], COMMAND_OUT_FDS(cmd, run_as_ret),
-			COMMAND_OUT_FD_COUNT(cmd));
+			COMMAND_OUT_FD_COUNT(cmd, run_as_ret));
 	if (ret < 0) {
 		PERROR("Failed to send file descriptor to master process");
 		goto end;
 	}
 
-	for (i = 0; i < COMMAND_OUT_FD_COUNT(cmd); i++) {
+	for (i = 0; i < COMMAND_OUT_FD_COUNT(cmd, run_as_ret); i++) {
 		int ret_close = close(COMMAND_OUT_FDS(cmd, run_as_ret)[i]);
 
 		if (ret_close < 0) {
@@ -834,12 +968,19 @@ int recv_fds_from_worker(const struct run_as_worker *worker, enum run_as_cmd cmd
 {
 	int ret = 0;
 
-	if (COMMAND_OUT_FD_COUNT(cmd) == 0) {
+	if (COMMAND_OUT_FD_COUNT(cmd, run_as_ret) == 0) {
+		goto end;
+	}
+
+	if (COMMAND_OUT_FD_COUNT(cmd, run_as_ret) >
+			command_properties[cmd].out_fd_count) {
+		ERR("Invalid file descriptor count announced by run-as worker");
+		ret = -1;
 		goto end;
 	}
 
 	ret = do_recv_fds(worker->sockpair[0], COMMAND_OUT_FDS(cmd, run_as_ret),
-			COMMAND_OUT_FD_COUNT(cmd));
+			COMMAND_OUT_FD_COUNT(cmd, run_as_ret));
 	if (ret < 0) {
 		PERROR("Failed to receive file descriptor from run-as worker");
 		ret = -1;
@@ -1254,7 +1395,8 @@ end:
 static
 int run_as_create_worker_no_lock(const char *procname,
 		post_fork_cleanup_cb clean_up_func,
-		void *clean_up_user_data)
+		void *clean_up_user_data,
+		struct run_as_worker **_worker)
 {
 	pid_t pid;
 	int i, ret = 0;
@@ -1262,15 +1404,6 @@ int run_as_create_worker_no_lock(const char *procname,
 	struct run_as_ret recvret;
 	struct run_as_worker *worker;
 
-	assert(!global_worker);
-	if (!use_clone()) {
-		/*
-		 * Don't initialize a worker, all run_as tasks will be performed
-		 * in the current process.
-		 */
-		ret = 0;
-		goto end;
-	}
 	worker = zmalloc(sizeof(*worker));
 	if (!worker) {
 		ret = -ENOMEM;
@@ -1353,7 +1486,7 @@ int run_as_create_worker_no_lock(const char *procname,
 			ret = -1;
 			goto error_fork;
 		}
-		global_worker = worker;
+		*_worker = worker;
 	}
 end:
 	return ret;
@@ -1377,14 +1510,9 @@ error_procname_alloc:
 }
 
 static
-void run_as_destroy_worker_no_lock(void)
+void run_as_destroy_worker_no_lock(struct run_as_worker *worker)
 {
-	struct run_as_worker *worker = global_worker;
-
 	DBG("Destroying run_as worker");
-	if (!worker) {
-		return;
-	}
 	/* Close unix socket */
 	DBG("Closing run_as worker socket");
 	if (lttcomm_close_unix_sock(worker->sockpair[0])) {
@@ -1418,22 +1546,22 @@ void run_as_destroy_worker_no_lock(void)
 	}
 	free(worker->procname);
 	free(worker);
-	global_worker = NULL;
 }
 
 static
-int run_as_restart_worker(struct run_as_worker *worker)
+int run_as_restart_worker(struct run_as_worker_slot *slot)
 {
 	int ret = 0;
-	char *procname = NULL;
-
-	procname = worker->procname;
 
 	/* Close socket to run_as worker process and clean up the zombie process */
-	run_as_destroy_worker_no_lock();
+	if (slot->worker) {
+		run_as_destroy_worker_no_lock(slot->worker);
+		slot->worker = NULL;
+	}
 
 	/* Create a new run_as worker process*/
-	ret = run_as_create_worker_no_lock(procname, NULL, NULL);
+	ret = run_as_create_worker_no_lock(worker_pool.procname, NULL, NULL,
+			&slot->worker);
 	if (ret < 0 ) {
 		ERR("Restarting the worker process failed");
 		ret = -1;
@@ -1443,19 +1571,155 @@ err:
 	return ret;
 }
 
+/*
+ * Returns the number of workers to launch, as set in the environment.
+ */
+static
+unsigned int get_worker_count(void)
+{
+	char *endptr;
+	unsigned long count;
+	const char *env_value;
+
+	env_value = lttng_secure_getenv(DEFAULT_RUN_AS_WORKERS_ENV);
+	if (!env_value) {
+		count = DEFAULT_RUN_AS_WORKERS;
+		goto end;
+	}
+
+	errno = 0;
+	count = strtoul(env_value, &endptr, 10);
+	if (errno != 0 || endptr == env_value || *endptr != '\0' ||
+			count == 0 || count > RUN_AS_MAX_WORKERS) {
+		ERR("Invalid value \"%s\" used for \"%s\" environment variable, launching %d run-as worker(s)",
+				env_value, DEFAULT_RUN_AS_WORKERS_ENV,
+				DEFAULT_RUN_AS_WORKERS);
+		count = DEFAULT_RUN_AS_WORKERS;
+	}
+end:
+	return (unsigned int) count;
+}
+
+static
+void run_as_destroy_worker_pool_no_lock(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < worker_pool.count; i++) {
+		struct run_as_worker_slot *slot = &worker_pool.slots[i];
+
+		if (slot->worker) {
+			run_as_destroy_worker_no_lock(slot->worker);
+		}
+		pthread_mutex_destroy(&slot->lock);
+	}
+	free(worker_pool.slots);
+	free(worker_pool.procname);
+	worker_pool.slots = NULL;
+	worker_pool.procname = NULL;
+	worker_pool.count = 0;
+}
+
+static
+int run_as_create_worker_pool_no_lock(const char *procname,
+		post_fork_cleanup_cb clean_up_func,
+		void *clean_up_user_data)
+{
+	int ret = 0;
+	unsigned int i, count;
+
+	assert(!worker_pool.slots);
+	if (!use_clone()) {
+		/*
+		 * Don't initialize a worker, all run_as tasks will be performed
+		 * in the current process.
+		 */
+		ret = 0;
+		goto end;
+	}
+
+	count = get_worker_count();
+	worker_pool.slots = zmalloc(count * sizeof(*worker_pool.slots));
+	if (!worker_pool.slots) {
+		ret = -ENOMEM;
+		goto end;
+	}
+	worker_pool.procname = strdup(procname);
+	if (!worker_pool.procname) {
+		free(worker_pool.slots);
+		worker_pool.slots = NULL;
+		ret = -ENOMEM;
+		goto end;
+	}
+
+	for (i = 0; i < count; i++) {
+		struct run_as_worker_slot *slot = &worker_pool.slots[i];
+
+		pthread_mutex_init(&slot->lock, NULL);
+		/* Account for the slot so that it is cleaned-up on error. */
+		worker_pool.count++;
+		ret = run_as_create_worker_no_lock(procname, clean_up_func,
+				clean_up_user_data, &slot->worker);
+		if (ret < 0) {
+			run_as_destroy_worker_pool_no_lock();
+			goto end;
+		}
+	}
+	DBG("Launched %u run-as worker(s)", count);
+end:
+	return ret;
+}
+
+/*
+ * Lock and return the slot of an idle worker, or of any worker if they are
+ * all busy.
+ */
+static
+struct run_as_worker_slot *acquire_worker_slot(void)
+{
+	unsigned int i;
+	struct run_as_worker_slot *slot;
+	const unsigned long first_slot =
+			uatomic_add_return(&worker_pool.next_slot, 1);
+
+	for (i = 0; i < worker_pool.count; i++) {
+		slot = &worker_pool.slots[(first_slot + i) % worker_pool.count];
+		if (!pthread_mutex_trylock(&slot->lock)) {
+			goto end;
+		}
+	}
+
+	slot = &worker_pool.slots[first_slot % worker_pool.count];
+	pthread_mutex_lock(&slot->lock);
+end:
+	return slot;
+}
+
 static
 int run_as(enum run_as_cmd cmd, struct run_as_data *data,
 		   struct run_as_ret *ret_value, uid_t uid, gid_t gid)
 {
 	int ret, saved_errno;
 
-	pthread_mutex_lock(&worker_lock);
 	if (use_clone()) {
+		struct run_as_worker_slot *slot;
+
 		DBG("Using run_as worker");
 
-		assert(global_worker);
+		pthread_rwlock_rdlock(&worker_pool_lock);
+		assert(worker_pool.count > 0);
+		slot = acquire_worker_slot();
+		if (!slot->worker) {
+			/* A previous restart of this worker failed. */
+			ret = run_as_restart_worker(slot);
+			if (ret == -1) {
+				ERR("Failed to restart worker process.");
+				ret_value->_errno = EIO;
+				goto release_slot;
+			}
+		}
 
-		ret = run_as_cmd(global_worker, cmd, data, ret_value, uid, gid);
+		ret = run_as_cmd(slot->worker, cmd, data, ret_value, uid, gid);
 		saved_errno = ret_value->_errno;
 
 		/*
@@ -1465,18 +1729,25 @@ int run_as(enum run_as_cmd cmd, struct run_as_data *data,
 		if (ret == -1 && saved_errno == EIO) {
 			DBG("Socket closed unexpectedly... "
 					"Restarting the worker process");
-			ret = run_as_restart_worker(global_worker);
+			ret = run_as_restart_worker(slot);
 			if (ret == -1) {
 				ERR("Failed to restart worker process.");
-				goto err;
+				goto release_slot;
 			}
 		}
+release_slot:
+		pthread_mutex_unlock(&slot->lock);
+		pthread_rwlock_unlock(&worker_pool_lock);
 	} else {
 		DBG("Using run_as without worker");
+		/*
+		 * The umask is shared by the threads of the process;
+		 * serialize the commands.
+		 */
+		pthread_rwlock_wrlock(&worker_pool_lock);
 		ret = run_as_noworker(cmd, data, ret_value, uid, gid);
+		pthread_rwlock_unlock(&worker_pool_lock);
 	}
-err:
-	pthread_mutex_unlock(&worker_lock);
 	return ret;
 }
 
@@ -1583,6 +1854,79 @@ error:
 	return ret;
 }
 
+LTTNG_HIDDEN
+int run_as_openat_batch(int dirfd, const char **filenames, unsigned int count,
+		int flags, mode_t mode, uid_t uid, gid_t gid, int *fds)
+{
+	int ret = 0, saved_errno;
+	unsigned int i, opened = 0;
+
+	DBG3("openat() batch fd = %d, count = %u, flags = %X, mode = %d, uid %d, gid %d",
+			dirfd, count, flags, (int) mode, (int) uid, (int) gid);
+	if (dirfd < 0) {
+		errno = EINVAL;
+		ret = -1;
+		goto error;
+	}
+
+	while (opened < count) {
+		struct run_as_data data = {};
+		struct run_as_ret run_as_ret = {};
+		unsigned int batch_count = 0;
+		size_t names_len = 0;
+
+		/* Pack as many names as the command can hold. */
+		while (opened + batch_count < count &&
+				batch_count < RUN_AS_OPEN_BATCH_MAX) {
+			const char *name = filenames[opened + batch_count];
+			const size_t name_size = strlen(name) + 1;
+
+			if (names_len + name_size >
+					sizeof(data.u.open_batch.names)) {
+				break;
+			}
+			memcpy(data.u.open_batch.names + names_len, name,
+					name_size);
+			names_len += name_size;
+			batch_count++;
+		}
+		if (batch_count == 0) {
+			ERR("Failed to copy file name argument of open batch command");
+			errno = ENAMETOOLONG;
+			ret = -1;
+			goto error;
+		}
+
+		data.u.open_batch.dirfd = dirfd;
+		data.u.open_batch.flags = flags;
+		data.u.open_batch.mode = mode;
+		data.u.open_batch.count = batch_count;
+		run_as(RUN_AS_OPENAT_BATCH, &data, &run_as_ret, uid, gid);
+		errno = run_as_ret._errno;
+		if (run_as_ret._error ||
+				run_as_ret.u.open_batch.count != batch_count) {
+			ret = -1;
+			goto error;
+		}
+
+		memcpy(fds + opened, run_as_ret.u.open_batch.fds,
+				batch_count * sizeof(*fds));
+		opened += batch_count;
+	}
+	goto end;
+error:
+	saved_errno = errno;
+	for (i = 0; i < opened; i++) {
+		if (close(fds[i])) {
+			PERROR("Failed to close file descriptor of open batch");
+		}
+		fds[i] = -1;
+	}
+	errno = saved_errno;
+end:
+	return ret;
+}
+
 LTTNG_HIDDEN
 int run_as_unlink(const char *path, uid_t uid, gid_t gid)
 {
@@ -1847,17 +2191,17 @@ int run_as_create_worker(const char *procname,
 {
 	int ret;
 
-	pthread_mutex_lock(&worker_lock);
-	ret = run_as_create_worker_no_lock(procname, clean_up_func,
+	pthread_rwlock_wrlock(&worker_pool_lock);
+	ret = run_as_create_worker_pool_no_lock(procname, clean_up_func,
 			clean_up_user_data);
-	pthread_mutex_unlock(&worker_lock);
+	pthread_rwlock_unlock(&worker_pool_lock);
 	return ret;
 }
 
 LTTNG_HIDDEN
 void run_as_destroy_worker(void)
 {
-	pthread_mutex_lock(&worker_lock);
-	run_as_destroy_worker_no_lock();
-	pthread_mutex_unlock(&worker_lock);
+	pthread_rwlock_wrlock(&worker_pool_lock);
+	run_as_destroy_worker_pool_no_lock();
+	pthread_rwlock_unlock(&worker_pool_lock);
 }
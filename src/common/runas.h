@@ -46,6 +46,17 @@ int run_as_open(const char *path, int flags, mode_t mode, uid_t uid, gid_t gid);
 LTTNG_HIDDEN
 int run_as_openat(int dirfd, const char *filename, int flags, mode_t mode,
 		uid_t uid, gid_t gid);
+/*
+ * Open `count` files of the `dirfd` directory, sending as many of them as
+ * possible to a run-as worker at once. `dirfd` must be a valid directory file
+ * descriptor (not AT_FDCWD).
+ *
+ * On success, the file descriptors are returned in `fds` and 0 is returned.
+ * On failure, no file is left opened and -1 is returned with errno set.
+ */
+LTTNG_HIDDEN
+int run_as_openat_batch(int dirfd, const char **filenames, unsigned int count,
+		int flags, mode_t mode, uid_t uid, gid_t gid, int *fds);
 LTTNG_HIDDEN
 int run_as_unlink(const char *path, uid_t uid, gid_t gid);
 LTTNG_HIDDEN
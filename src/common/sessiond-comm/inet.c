@@ -37,6 +37,7 @@ static const struct lttcomm_proto_ops inet_ops = {
 	.listen = lttcomm_listen_inet_sock,
 	.recvmsg = lttcomm_recvmsg_inet_sock,
 	.sendmsg = lttcomm_sendmsg_inet_sock,
+	.sendmsgv = lttcomm_sendmsgv_inet_sock,
 };
 
 unsigned long lttcomm_inet_tcp_timeout;
@@ -443,6 +444,72 @@ ssize_t lttcomm_sendmsg_inet_sock(struct lttcomm_sock *sock, const void *buf,
 	return ret;
 }
 
+/*
+ * Send the iovcnt buffers of iov using the sendmsg API. Partial sends are
+ * completed by sending the remaining data, which modifies the content of the
+ * iov array.
+ *
+ * Return the size of sent data.
+ */
+LTTNG_HIDDEN
+ssize_t lttcomm_sendmsgv_inet_sock(struct lttcomm_sock *sock,
+		struct iovec *iov, size_t iovcnt, int flags)
+{
+	struct msghdr msg;
+	ssize_t ret = -1, sent = 0;
+
+	memset(&msg, 0, sizeof(msg));
+
+	msg.msg_iov = iov;
+	msg.msg_iovlen = iovcnt;
+
+	switch (sock->proto) {
+	case LTTCOMM_SOCK_UDP:
+	{
+		struct sockaddr_in addr = sock->sockaddr.addr.sin;
+
+		msg.msg_name = (struct sockaddr *) &addr;
+		msg.msg_namelen = sizeof(sock->sockaddr.addr.sin);
+		break;
+	}
+	default:
+		break;
+	}
+
+	while (msg.msg_iovlen > 0) {
+		do {
+			ret = sendmsg(sock->fd, &msg, flags);
+		} while (ret < 0 && errno == EINTR);
+		if (ret < 0) {
+			/*
+			 * Only warn about EPIPE when quiet mode is deactivated.
+			 * We consider EPIPE as expected.
+			 */
+			if (errno != EPIPE || !lttng_opt_quiet) {
+				PERROR("sendmsg inet");
+			}
+			goto end;
+		}
+		sent += ret;
+
+		/* Skip the buffers sent entirely and trim the partial one. */
+		while (msg.msg_iovlen > 0 &&
+				(size_t) ret >= msg.msg_iov->iov_len) {
+			ret -= msg.msg_iov->iov_len;
+			msg.msg_iov++;
+			msg.msg_iovlen--;
+		}
+		if (msg.msg_iovlen > 0) {
+			msg.msg_iov->iov_base = (char *) msg.msg_iov->iov_base + ret;
+			msg.msg_iov->iov_len -= ret;
+		}
+	}
+	ret = sent;
+
+end:
+	return ret;
+}
+
 /*
  * Shutdown cleanly and close.
  */
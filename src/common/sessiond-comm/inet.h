@@ -34,6 +34,7 @@ extern unsigned long lttcomm_inet_tcp_timeout;
 
 /* Stub */
 struct lttcomm_sock;
+struct iovec;
 
 /* Net family callback */
 extern int lttcomm_create_inet_sock(struct lttcomm_sock *sock, int type,
@@ -49,6 +50,8 @@ extern ssize_t lttcomm_recvmsg_inet_sock(struct lttcomm_sock *sock, void *buf,
 		size_t len, int flags);
 extern ssize_t lttcomm_sendmsg_inet_sock(struct lttcomm_sock *sock,
 		const void *buf, size_t len, int flags);
+extern ssize_t lttcomm_sendmsgv_inet_sock(struct lttcomm_sock *sock,
+		struct iovec *iov, size_t iovcnt, int flags);
 
 /* Initialize inet communication layer. */
 extern void lttcomm_inet_init(void);
@@ -14,6 +14,7 @@
 
 /* Stub */
 struct lttcomm_sock;
+struct iovec;
 
 /* Net family callback */
 extern int lttcomm_create_inet6_sock(struct lttcomm_sock *sock, int type,
@@ -30,5 +31,7 @@ extern ssize_t lttcomm_recvmsg_inet6_sock(struct lttcomm_sock *sock, void *buf,
 		size_t len, int flags);
 extern ssize_t lttcomm_sendmsg_inet6_sock(struct lttcomm_sock *sock,
 		const void *buf, size_t len, int flags);
+extern ssize_t lttcomm_sendmsgv_inet6_sock(struct lttcomm_sock *sock,
+		struct iovec *iov, size_t iovcnt, int flags);
 
 #endif	/* _LTTCOMM_INET6_H */
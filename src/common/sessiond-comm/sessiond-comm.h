@@ -106,6 +106,7 @@ enum lttcomm_sessiond_command {
 	LTTNG_SESSION_LIST_ROTATION_SCHEDULES           = 48,
 	LTTNG_CREATE_SESSION_EXT                        = 49,
 	LTTNG_CLEAR_SESSION                             = 50,
+	LTTNG_OPEN_PERSISTENT_CONNECTION                = 51,
 };
 
 enum lttcomm_relayd_command {
@@ -263,6 +264,8 @@ struct lttcomm_proto_ops {
 			int flags);
 	ssize_t (*sendmsg) (struct lttcomm_sock *sock, const void *buf,
 			size_t len, int flags);
+	ssize_t (*sendmsgv) (struct lttcomm_sock *sock, struct iovec *iov,
+			size_t iovcnt, int flags);
 };
 
 struct process_attr_integral_value_comm {
@@ -500,6 +503,20 @@ struct lttcomm_tracker_command_header {
 	uint32_t nb_tracker_id;
 } LTTNG_PACKED;
 
+/*
+ * Header preceding each command sent on a persistent connection to the
+ * session daemon, and each reply sent back by the session daemon.
+ *
+ * A connection is made persistent by the reply to an
+ * LTTNG_OPEN_PERSISTENT_CONNECTION command. It then carries any number of
+ * commands, one at a time. Each command is preceded by this header, sent with
+ * the client's credentials, and its reply is preceded by a header holding the
+ * same request id.
+ */
+struct lttcomm_session_request_header {
+	uint64_t request_id;
+} LTTNG_PACKED;
+
 /*
  * Data structure for the response from sessiond to the lttng client.
  */
@@ -737,6 +754,14 @@ struct lttcomm_consumer_channel_monitor_msg {
 	uint64_t total_consumed;
 } LTTNG_PACKED;
 
+/*
+ * Maximal number of channel monitor samples sent in one write to the channel
+ * monitor pipe. Writes of at most PIPE_BUF bytes are atomic, which keeps the
+ * samples whole on the reader's end.
+ */
+#define LTTCOMM_CONSUMER_CHANNEL_MONITOR_MSG_BATCH \
+	(PIPE_BUF / sizeof(struct lttcomm_consumer_channel_monitor_msg))
+
 /*
  * Status message returned to the sessiond after a received command.
  */
@@ -0,0 +1,220 @@
+/*
+ * Copyright (C) 2020 EfficiOS Inc.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ */
+
+#include <assert.h>
+
+#include "timer-wheel.h"
+
+#define LEVEL_SLOT_MASK	((uint64_t) TIMER_WHEEL_LEVEL_SIZE - 1)
+
+static
+unsigned int level_shift(unsigned int level)
+{
+	return level * TIMER_WHEEL_LEVEL_BITS;
+}
+
+/*
+ * Place an entry in the level of the most significant group of bits in
+ * which its expiry differs from the current tick. Entries which expire at
+ * the current tick, or before, are appended to `expired` or, if it is NULL,
+ * to the list of due entries.
+ */
+static
+void place_entry(struct timer_wheel *wheel, struct timer_wheel_entry *entry,
+		struct cds_list_head *expired)
+{
+	unsigned int level, slot;
+
+	if (entry->expiry <= wheel->now) {
+		if (expired) {
+			entry->state = TIMER_WHEEL_ENTRY_STATE_EXPIRED;
+			cds_list_add_tail(&entry->node, expired);
+		} else {
+			entry->state = TIMER_WHEEL_ENTRY_STATE_ARMED;
+			entry->level = TIMER_WHEEL_LEVELS;
+			cds_list_add_tail(&entry->node, &wheel->due);
+		}
+		return;
+	}
+
+	level = (63 - __builtin_clzll(entry->expiry ^ wheel->now)) /
+			TIMER_WHEEL_LEVEL_BITS;
+	slot = (entry->expiry >> level_shift(level)) & LEVEL_SLOT_MASK;
+
+	entry->state = TIMER_WHEEL_ENTRY_STATE_ARMED;
+	entry->level = level;
+	entry->slot = slot;
+	cds_list_add_tail(&entry->node, &wheel->slots[level][slot]);
+	wheel->occupied[level] |= 1ULL << slot;
+}
+
+LTTNG_HIDDEN
+void timer_wheel_init(struct timer_wheel *wheel, uint64_t now)
+{
+	unsigned int level, slot;
+
+	wheel->now = now;
+	CDS_INIT_LIST_HEAD(&wheel->due);
+	for (level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+		wheel->occupied[level] = 0;
+		for (slot = 0; slot < TIMER_WHEEL_LEVEL_SIZE; slot++) {
+			CDS_INIT_LIST_HEAD(&wheel->slots[level][slot]);
+		}
+	}
+}
+
+LTTNG_HIDDEN
+void timer_wheel_arm(struct timer_wheel *wheel,
+		struct timer_wheel_entry *entry, uint64_t expiry)
+{
+	assert(entry->state == TIMER_WHEEL_ENTRY_STATE_IDLE);
+
+	entry->expiry = expiry;
+	place_entry(wheel, entry, NULL);
+}
+
+LTTNG_HIDDEN
+void timer_wheel_cancel(struct timer_wheel *wheel,
+		struct timer_wheel_entry *entry)
+{
+	switch (entry->state) {
+	case TIMER_WHEEL_ENTRY_STATE_IDLE:
+		return;
+	case TIMER_WHEEL_ENTRY_STATE_ARMED:
+		cds_list_del(&entry->node);
+		if (entry->level < TIMER_WHEEL_LEVELS &&
+				cds_list_empty(&wheel->slots[entry->level][entry->slot])) {
+			wheel->occupied[entry->level] &= ~(1ULL << entry->slot);
+		}
+		break;
+	case TIMER_WHEEL_ENTRY_STATE_EXPIRED:
+		cds_list_del(&entry->node);
+		break;
+	}
+	entry->state = TIMER_WHEEL_ENTRY_STATE_IDLE;
+}
+
+/*
+ * Returns the first tick, after the current one, at which a non-empty slot
+ * of the wheel is reached.
+ */
+static
+uint64_t next_slot_tick(const struct timer_wheel *wheel)
+{
+	unsigned int level;
+	uint64_t next_tick = UINT64_MAX;
+
+	for (level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+		const unsigned int shift = level_shift(level);
+		const unsigned int current_slot =
+				(wheel->now >> shift) & LEVEL_SLOT_MASK;
+		const unsigned int higher_shift = shift + TIMER_WHEEL_LEVEL_BITS;
+		uint64_t later_slots, tick;
+
+		/* The entries of a level are all in slots after the current one. */
+		if (current_slot == TIMER_WHEEL_LEVEL_SIZE - 1) {
+			continue;
+		}
+		later_slots = wheel->occupied[level] &
+				(~0ULL << (current_slot + 1));
+		if (!later_slots) {
+			continue;
+		}
+
+		tick = (uint64_t) __builtin_ctzll(later_slots) << shift;
+		if (higher_shift < 64) {
+			tick |= (wheel->now >> higher_shift) << higher_shift;
+		}
+		if (tick < next_tick) {
+			next_tick = tick;
+		}
+	}
+
+	return next_tick;
+}
+
+LTTNG_HIDDEN
+uint64_t timer_wheel_next_tick(struct timer_wheel *wheel)
+{
+	if (!cds_list_empty(&wheel->due)) {
+		return wheel->now;
+	}
+
+	return next_slot_tick(wheel);
+}
+
+/*
+ * Remove all the entries of a slot and place them again relative to the
+ * current tick.
+ */
+static
+void cascade_slot(struct timer_wheel *wheel, unsigned int level,
+		unsigned int slot, struct cds_list_head *expired)
+{
+	struct timer_wheel_entry *entry, *tmp;
+	struct cds_list_head entries;
+
+	CDS_INIT_LIST_HEAD(&entries);
+	cds_list_splice(&wheel->slots[level][slot], &entries);
+	CDS_INIT_LIST_HEAD(&wheel->slots[level][slot]);
+	wheel->occupied[level] &= ~(1ULL << slot);
+
+	cds_list_for_each_entry_safe(entry, tmp, &entries, node) {
+		cds_list_del(&entry->node);
+		place_entry(wheel, entry, expired);
+	}
+}
+
+LTTNG_HIDDEN
+void timer_wheel_advance(struct timer_wheel *wheel, uint64_t now,
+		struct cds_list_head *expired)
+{
+	struct timer_wheel_entry *entry, *tmp;
+
+	cds_list_for_each_entry_safe(entry, tmp, &wheel->due, node) {
+		cds_list_del(&entry->node);
+		entry->state = TIMER_WHEEL_ENTRY_STATE_EXPIRED;
+		cds_list_add_tail(&entry->node, expired);
+	}
+
+	for (;;) {
+		unsigned int level;
+		const uint64_t tick = next_slot_tick(wheel);
+
+		if (tick > now) {
+			break;
+		}
+
+		wheel->now = tick;
+
+		/*
+		 * Cascade the slots which start at this tick, from the highest
+		 * level down, so that the entries expiring at this tick end up
+		 * in the expired list.
+		 */
+		for (level = TIMER_WHEEL_LEVELS - 1; level > 0; level--) {
+			const unsigned int shift = level_shift(level);
+			const unsigned int slot = (tick >> shift) & LEVEL_SLOT_MASK;
+
+			if (tick & ((1ULL << shift) - 1)) {
+				continue;
+			}
+			if (wheel->occupied[level] & (1ULL << slot)) {
+				cascade_slot(wheel, level, slot, expired);
+			}
+		}
+
+		/* The entries of the first level's slot expire at this tick. */
+		if (wheel->occupied[0] & (1ULL << (tick & LEVEL_SLOT_MASK))) {
+			cascade_slot(wheel, 0, tick & LEVEL_SLOT_MASK, expired);
+		}
+	}
+
+	if (now > wheel->now) {
+		wheel->now = now;
+	}
+}
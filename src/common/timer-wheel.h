@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2020 EfficiOS Inc.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ */
+
+#ifndef LTTNG_TIMER_WHEEL_H
+#define LTTNG_TIMER_WHEEL_H
+
+#include <common/macros.h>
+#include <stdint.h>
+#include <urcu/list.h>
+
+#define TIMER_WHEEL_LEVEL_BITS	6
+#define TIMER_WHEEL_LEVEL_SIZE	(1U << TIMER_WHEEL_LEVEL_BITS)
+/* Enough levels to cover the whole range of 64-bit ticks. */
+#define TIMER_WHEEL_LEVELS	11
+
+enum timer_wheel_entry_state {
+	TIMER_WHEEL_ENTRY_STATE_IDLE = 0,
+	/* Waiting in the wheel. */
+	TIMER_WHEEL_ENTRY_STATE_ARMED,
+	/* Moved to an expired list by timer_wheel_advance(). */
+	TIMER_WHEEL_ENTRY_STATE_EXPIRED,
+};
+
+/*
+ * Timer armed in a timer wheel. Meant to be embedded in the structure of its
+ * user. A zero-initialized entry is idle.
+ */
+struct timer_wheel_entry {
+	struct cds_list_head node;
+	/* Tick at which the timer expires. */
+	uint64_t expiry;
+	enum timer_wheel_entry_state state;
+	/* Position of an armed entry in the wheel. */
+	uint8_t level, slot;
+};
+
+/*
+ * Hierarchical timer wheel.
+ *
+ * Time is expressed in ticks, the unit of which is left to the user. An
+ * entry is placed in the level of the most significant group of
+ * TIMER_WHEEL_LEVEL_BITS bits in which its expiry differs from the current
+ * tick, and is cascaded to the lower levels as time reaches its slot.
+ * Arming and cancelling a timer are O(1).
+ *
+ * The wheel performs no locking.
+ */
+struct timer_wheel {
+	/* Current tick. */
+	uint64_t now;
+	/* Entries which were armed with an expiry in the past. */
+	struct cds_list_head due;
+	/* Bitmap of the non-empty slots of each level. */
+	uint64_t occupied[TIMER_WHEEL_LEVELS];
+	struct cds_list_head slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_LEVEL_SIZE];
+};
+
+LTTNG_HIDDEN
+void timer_wheel_init(struct timer_wheel *wheel, uint64_t now);
+
+/*
+ * Arm an idle entry to expire at the `expiry` tick. An entry armed with an
+ * expiry which is not in the future expires on the next advance of the
+ * wheel.
+ */
+LTTNG_HIDDEN
+void timer_wheel_arm(struct timer_wheel *wheel,
+		struct timer_wheel_entry *entry, uint64_t expiry);
+
+/*
+ * Cancel an armed entry or remove an expired entry from the list it was
+ * moved to. Idle entries are left untouched.
+ */
+LTTNG_HIDDEN
+void timer_wheel_cancel(struct timer_wheel *wheel,
+		struct timer_wheel_entry *entry);
+
+/*
+ * Advance the wheel to the `now` tick, appending the entries which expired
+ * to the `expired` list in order of expiry. The expired entries are in the
+ * TIMER_WHEEL_ENTRY_STATE_EXPIRED state until they are cancelled or
+ * re-armed; the user is expected to remove them from the list with
+ * timer_wheel_cancel() before handling them.
+ */
+LTTNG_HIDDEN
+void timer_wheel_advance(struct timer_wheel *wheel, uint64_t now,
+		struct cds_list_head *expired);
+
+/*
+ * Returns the tick at which the wheel must next be advanced, or UINT64_MAX
+ * if no entry is armed.
+ *
+ * This can be earlier than the expiry of the next entry as the entries of
+ * the higher levels are cascaded when time reaches their slot.
+ */
+LTTNG_HIDDEN
+uint64_t timer_wheel_next_tick(struct timer_wheel *wheel);
+
+#endif /* LTTNG_TIMER_WHEEL_H */
@@ -27,6 +27,7 @@
 #include <pthread.h>
 #include <stdio.h>
 #include <sys/stat.h>
+#include <urcu/list.h>
 #include <urcu/rculfhash.h>
 #include <urcu/ref.h>
 
@@ -36,6 +37,8 @@
  */
 #define GENERATED_CHUNK_NAME_LEN (2 * sizeof("YYYYmmddTHHMMSS+HHMM") + MAX_INT_DEC_LEN(uint64_t))
 #define DIR_CREATION_MODE (S_IRWXU | S_IRWXG)
+/* Initial number of buckets of a trace chunk's file index. */
+#define FILE_SET_MIN_BUCKET_COUNT 64
 
 enum trace_chunk_mode {
 	TRACE_CHUNK_MODE_USER,
@@ -68,6 +71,30 @@ struct chunk_credentials {
 	struct lttng_credentials user;
 };
 
+/* File contained within a trace chunk. */
+struct chunk_file {
+	unsigned long hash;
+	/* Node in a bucket of the file set's index. */
+	struct cds_list_head index_node;
+	/* Node in the file set's list, in order of addition. */
+	struct cds_list_head list_node;
+	char path[];
+};
+
+/*
+ * Set of the files contained within a trace chunk.
+ *
+ * The files are kept in order of addition and indexed by path in a hash
+ * table which grows with the set. The set is protected by the chunk's lock.
+ */
+struct chunk_file_set {
+	struct cds_list_head list;
+	/* Array of 'bucket_count' lists; a power of two. */
+	struct cds_list_head *buckets;
+	size_t bucket_count;
+	size_t count;
+};
+
 /*
  * NOTE: Make sure to update:
  * - lttng_trace_chunk_copy(),
@@ -85,11 +112,8 @@ struct lttng_trace_chunk {
 	 * Only used by _owner_ mode chunks.
 	 */
 	struct lttng_dynamic_pointer_array top_level_directories;
-	/*
-	 * All files contained within the trace chunk.
-	 * Array of paths (char *).
-	 */
-	struct lttng_dynamic_pointer_array files;
+	/* All files contained within the trace chunk. */
+	struct chunk_file_set files;
 	/* Is contained within an lttng_trace_chunk_registry_element? */
 	bool in_registry_element;
 	bool name_overridden;
@@ -349,13 +373,139 @@ error:
 	return NULL;
 }
 
+static
+void chunk_file_set_init(struct chunk_file_set *set)
+{
+	CDS_INIT_LIST_HEAD(&set->list);
+	set->buckets = NULL;
+	set->bucket_count = 0;
+	set->count = 0;
+}
+
+static
+void chunk_file_set_fini(struct chunk_file_set *set)
+{
+	struct chunk_file *file, *tmp;
+
+	cds_list_for_each_entry_safe(file, tmp, &set->list, list_node) {
+		cds_list_del(&file->list_node);
+		free(file);
+	}
+	free(set->buckets);
+	chunk_file_set_init(set);
+}
+
+static
+struct cds_list_head *chunk_file_set_get_bucket(
+		const struct chunk_file_set *set, unsigned long hash)
+{
+	return &set->buckets[hash & (set->bucket_count - 1)];
+}
+
+/*
+ * Double the number of buckets of the index (or allocate the initial
+ * buckets) and rehash the files.
+ */
+static
+int chunk_file_set_grow(struct chunk_file_set *set)
+{
+	int ret = 0;
+	size_t i;
+	struct chunk_file *file;
+	struct cds_list_head *new_buckets;
+	const size_t new_bucket_count = set->bucket_count ?
+			set->bucket_count << 1 : FILE_SET_MIN_BUCKET_COUNT;
+
+	new_buckets = zmalloc(new_bucket_count * sizeof(*new_buckets));
+	if (!new_buckets) {
+		ret = -1;
+		goto end;
+	}
+
+	for (i = 0; i < new_bucket_count; i++) {
+		CDS_INIT_LIST_HEAD(&new_buckets[i]);
+	}
+
+	free(set->buckets);
+	set->buckets = new_buckets;
+	set->bucket_count = new_bucket_count;
+	cds_list_for_each_entry(file, &set->list, list_node) {
+		cds_list_add(&file->index_node,
+				chunk_file_set_get_bucket(set, file->hash));
+	}
+end:
+	return ret;
+}
+
+static
+struct chunk_file *chunk_file_set_find(const struct chunk_file_set *set,
+		const char *path)
+{
+	struct chunk_file *file;
+	unsigned long hash;
+
+	if (!set->count) {
+		return NULL;
+	}
+
+	hash = hash_key_str(path, lttng_ht_seed);
+	cds_list_for_each_entry(file,
+			chunk_file_set_get_bucket(set, hash), index_node) {
+		if (file->hash == hash && !strcmp(file->path, path)) {
+			return file;
+		}
+	}
+	return NULL;
+}
+
+static
+int chunk_file_set_add(struct chunk_file_set *set, const char *path)
+{
+	int ret = 0;
+	struct chunk_file *file;
+	const size_t path_len = strlen(path);
+
+	/* Keep an average of at most one file per bucket. */
+	if (set->count >= set->bucket_count) {
+		ret = chunk_file_set_grow(set);
+		if (ret) {
+			goto end;
+		}
+	}
+
+	file = zmalloc(sizeof(*file) + path_len + 1);
+	if (!file) {
+		ret = -1;
+		goto end;
+	}
+
+	memcpy(file->path, path, path_len + 1);
+	file->hash = hash_key_str(path, lttng_ht_seed);
+	cds_list_add_tail(&file->list_node, &set->list);
+	cds_list_add(&file->index_node,
+			chunk_file_set_get_bucket(set, file->hash));
+	set->count++;
+end:
+	return ret;
+}
+
+static
+void chunk_file_set_remove(struct chunk_file_set *set,
+		struct chunk_file *file)
+{
+	cds_list_del(&file->list_node);
+	cds_list_del(&file->index_node);
+	set->count--;
+	free(file);
+}
+
 static
 void lttng_trace_chunk_init(struct lttng_trace_chunk *chunk)
 {
 	urcu_ref_init(&chunk->ref);
 	pthread_mutex_init(&chunk->lock, NULL);
 	lttng_dynamic_pointer_array_init(&chunk->top_level_directories, free);
-	lttng_dynamic_pointer_array_init(&chunk->files, free);
+	chunk_file_set_init(&chunk->files);
 }
 
 static
@@ -375,7 +525,7 @@ void lttng_trace_chunk_fini(struct lttng_trace_chunk *chunk)
 	free(chunk->path);
 	chunk->path = NULL;
 	lttng_dynamic_pointer_array_reset(&chunk->top_level_directories);
-	lttng_dynamic_pointer_array_reset(&chunk->files);
+	chunk_file_set_fini(&chunk->files);
 	pthread_mutex_destroy(&chunk->lock);
 }
 
@@ -469,7 +619,7 @@ void lttng_trace_chunk_set_fd_tracker(struct lttng_trace_chunk *chunk,
 {
 	assert(!chunk->session_output_directory);
 	assert(!chunk->chunk_directory);
-	assert(lttng_dynamic_pointer_array_get_count(&chunk->files) == 0);
+	assert(chunk->files.count == 0);
 	chunk->fd_tracker = fd_tracker;
 }
 
@@ -1276,55 +1426,22 @@ end:
 	return status;
 }
 
-/*
- * TODO: Implement O(1) lookup.
- */
-static
-bool lttng_trace_chunk_find_file(struct lttng_trace_chunk *chunk,
-		const char *path, size_t *index)
-{
-	size_t i, count;
-
-	count = lttng_dynamic_pointer_array_get_count(&chunk->files);
-	for (i = 0; i < count; i++) {
-		const char *iter_path =
-				lttng_dynamic_pointer_array_get_pointer(
-					&chunk->files, i);
-		if (!strcmp(iter_path, path)) {
-			if (index) {
-				*index = i;
-			}
-			return true;
-		}
-	}
-	return false;
-}
-
 static
 enum lttng_trace_chunk_status lttng_trace_chunk_add_file(
 		struct lttng_trace_chunk *chunk,
 		const char *path)
 {
-	char *copy;
 	int ret;
 	enum lttng_trace_chunk_status status = LTTNG_TRACE_CHUNK_STATUS_OK;
 
-	if (lttng_trace_chunk_find_file(chunk, path, NULL)) {
+	if (chunk_file_set_find(&chunk->files, path)) {
 		return LTTNG_TRACE_CHUNK_STATUS_OK;
 	}
 	DBG("Adding new file \"%s\" to trace chunk \"%s\"",
 			path, chunk->name ? : "(unnamed)");
-	copy = strdup(path);
-	if (!copy) {
-		PERROR("Failed to copy path");
-		status = LTTNG_TRACE_CHUNK_STATUS_ERROR;
-		goto end;
-	}
-	ret = lttng_dynamic_pointer_array_add_pointer(
-			&chunk->files, copy);
+	ret = chunk_file_set_add(&chunk->files, path);
 	if (ret) {
 		ERR("Allocation failure while adding file to a trace chunk");
-		free(copy);
 		status = LTTNG_TRACE_CHUNK_STATUS_ERROR;
 		goto end;
 	}
@@ -1337,17 +1454,13 @@ void lttng_trace_chunk_remove_file(
 		struct lttng_trace_chunk *chunk,
 		const char *path)
 {
-	size_t index;
-	bool found;
-	int ret;
+	struct chunk_file *file;
 
-	found = lttng_trace_chunk_find_file(chunk, path, &index);
-	if (!found) {
+	file = chunk_file_set_find(&chunk->files, path);
+	if (!file) {
 		return;
 	}
-	ret = lttng_dynamic_pointer_array_remove_pointer(
-			&chunk->files, index);
-	assert(!ret);
+	chunk_file_set_remove(&chunk->files, file);
 }
 
 static
@@ -1470,6 +1583,86 @@ enum lttng_trace_chunk_status lttng_trace_chunk_open_file(
 	return status;
 }
 
+LTTNG_HIDDEN
+enum lttng_trace_chunk_status lttng_trace_chunk_open_files(
+		struct lttng_trace_chunk *chunk,
+		const char **file_paths,
+		unsigned int count,
+		int flags,
+		mode_t mode,
+		int *out_fds)
+{
+	int ret;
+	unsigned int i, added = 0;
+	enum lttng_trace_chunk_status status = LTTNG_TRACE_CHUNK_STATUS_OK;
+
+	pthread_mutex_lock(&chunk->lock);
+	/*
+	 * Using this method is never valid when an fd_tracker is being
+	 * used since the resulting file descriptors would not be tracked.
+	 */
+	assert(!chunk->fd_tracker);
+	if (!chunk->credentials.is_set) {
+		/*
+		 * Fatal error, credentials must be set before a
+		 * file is created.
+		 */
+		ERR("Credentials of trace chunk are unset: refusing to open %u files",
+				count);
+		status = LTTNG_TRACE_CHUNK_STATUS_ERROR;
+		goto end;
+	}
+	if (!chunk->chunk_directory) {
+		ERR("Attempted to open %u trace chunk files before setting the chunk output directory",
+				count);
+		status = LTTNG_TRACE_CHUNK_STATUS_ERROR;
+		goto end;
+	}
+	for (added = 0; added < count; added++) {
+		DBG("Opening trace chunk file \"%s\"", file_paths[added]);
+		status = lttng_trace_chunk_add_file(chunk, file_paths[added]);
+		if (status != LTTNG_TRACE_CHUNK_STATUS_OK) {
+			goto error;
+		}
+	}
+	ret = lttng_directory_handle_open_files_as_user(
+			chunk->chunk_directory, file_paths, count, flags, mode,
+			chunk->credentials.value.use_current_user ?
+					NULL : &chunk->credentials.value.user,
+			out_fds);
+	if (ret < 0) {
+		PERROR("Failed to open %u files relative to trace chunk, first file_path = \"%s\", flags = %d, mode = %d",
+				count, file_paths[0], flags, (int) mode);
+		status = LTTNG_TRACE_CHUNK_STATUS_ERROR;
+		goto error;
+	}
+	goto end;
+error:
+	for (i = 0; i < added; i++) {
+		lttng_trace_chunk_remove_file(chunk, file_paths[i]);
+	}
+end:
+	pthread_mutex_unlock(&chunk->lock);
+	return status;
+}
+
+LTTNG_HIDDEN
+struct fs_handle *lttng_trace_chunk_create_fs_handle(
+		struct lttng_trace_chunk *chunk,
+		const char *file_path,
+		int fd)
+{
+	struct fs_handle *handle;
+
+	pthread_mutex_lock(&chunk->lock);
+	assert(!chunk->fd_tracker);
+	assert(chunk->chunk_directory);
+	handle = fs_handle_untracked_create(chunk->chunk_directory, file_path,
+			fd);
+	pthread_mutex_unlock(&chunk->lock);
+	return handle;
+}
+
 LTTNG_HIDDEN
 int lttng_trace_chunk_unlink_file(struct lttng_trace_chunk *chunk,
 		const char *file_path)
@@ -1662,13 +1855,13 @@ int lttng_trace_chunk_delete_post_release_user(
 	DBG("Trace chunk \"delete\" close command post-release (User)");
 
 	/* Unlink all files. */
-	while (lttng_dynamic_pointer_array_get_count(&trace_chunk->files) != 0) {
+	while (!cds_list_empty(&trace_chunk->files.list)) {
 		enum lttng_trace_chunk_status status;
 		const char *path;
 
 		/* Remove first. */
-		path = lttng_dynamic_pointer_array_get_pointer(
-				&trace_chunk->files, 0);
+		path = cds_list_first_entry(&trace_chunk->files.list,
+				struct chunk_file, list_node)->path;
 		DBG("Unlink file: %s", path);
 		status = lttng_trace_chunk_unlink_file(trace_chunk, path);
 		if (status != LTTNG_TRACE_CHUNK_STATUS_OK) {
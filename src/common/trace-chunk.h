@@ -182,6 +182,31 @@ enum lttng_trace_chunk_status lttng_trace_chunk_open_fs_handle(
 		struct fs_handle **out_handle,
 		bool expect_no_file);
 
+/*
+ * Open several files of a trace chunk, with a single run-as command when they
+ * are opened as another user. Either all the files are opened or none.
+ *
+ * As for lttng_trace_chunk_open_file(), the chunk must not use an fd_tracker.
+ */
+LTTNG_HIDDEN
+enum lttng_trace_chunk_status lttng_trace_chunk_open_files(
+		struct lttng_trace_chunk *chunk,
+		const char **filenames,
+		unsigned int count,
+		int flags,
+		mode_t mode,
+		int *out_fds);
+
+/*
+ * Create a filesystem handle owning the file descriptor of a file opened by
+ * lttng_trace_chunk_open_files().
+ */
+LTTNG_HIDDEN
+struct fs_handle *lttng_trace_chunk_create_fs_handle(
+		struct lttng_trace_chunk *chunk,
+		const char *filename,
+		int fd);
+
 LTTNG_HIDDEN
 int lttng_trace_chunk_unlink_file(struct lttng_trace_chunk *chunk,
 		const char *filename);
@@ -189,8 +189,8 @@ static int send_stream_to_thread(struct lttng_consumer_stream *stream,
 		consumer_add_metadata_stream(stream);
 		stream_pipe = ctx->consumer_metadata_pipe;
 	} else {
-		consumer_add_data_stream(stream);
-		stream_pipe = ctx->consumer_data_pipe;
+		consumer_add_data_stream(ctx, stream);
+		stream_pipe = stream->data_worker->data_pipe;
 	}
 
 	/*
@@ -1096,174 +1096,163 @@ error:
 
 }
 
+struct snapshot_channel_args {
+	char *path;
+	uint64_t relayd_id;
+	uint64_t nb_packets_per_stream;
+	bool use_relayd;
+};
+
 /*
- * Take a snapshot of all the stream of a channel.
- * RCU read-side lock and the channel lock must be held by the caller.
+ * Take a snapshot of a stream of a channel. Called by the snapshot threads
+ * with the RCU read-side lock held.
  *
  * Returns 0 on success, < 0 on error
  */
-static int snapshot_channel(struct lttng_consumer_channel *channel,
-		uint64_t key, char *path, uint64_t relayd_id,
-		uint64_t nb_packets_per_stream,
-		struct lttng_consumer_local_data *ctx)
+static int snapshot_stream(struct lttng_consumer_stream *stream, void *data)
 {
 	int ret;
-	unsigned use_relayd = 0;
+	const struct snapshot_channel_args *args = data;
+	struct lttng_consumer_channel *channel = stream->chan;
 	unsigned long consumed_pos, produced_pos;
-	struct lttng_consumer_stream *stream;
-
-	assert(path);
-	assert(ctx);
 
-	rcu_read_lock();
+	health_code_update();
 
-	if (relayd_id != (uint64_t) -1ULL) {
-		use_relayd = 1;
+	/* Lock stream because we are about to change its state. */
+	pthread_mutex_lock(&stream->lock);
+	assert(channel->trace_chunk);
+	if (!lttng_trace_chunk_get(channel->trace_chunk)) {
+		/*
+		 * Can't happen barring an internal error as the channel
+		 * holds a reference to the trace chunk.
+		 */
+		ERR("Failed to acquire reference to channel's trace chunk");
+		ret = -1;
+		goto error_unlock;
 	}
+	assert(!stream->trace_chunk);
+	stream->trace_chunk = channel->trace_chunk;
 
-	assert(!channel->monitor);
-	DBG("UST consumer snapshot channel %" PRIu64, key);
+	stream->net_seq_idx = args->relayd_id;
 
-	cds_list_for_each_entry(stream, &channel->streams.head, send_node) {
-		health_code_update();
-
-		/* Lock stream because we are about to change its state. */
-		pthread_mutex_lock(&stream->lock);
-		assert(channel->trace_chunk);
-		if (!lttng_trace_chunk_get(channel->trace_chunk)) {
-			/*
-			 * Can't happen barring an internal error as the channel
-			 * holds a reference to the trace chunk.
-			 */
-			ERR("Failed to acquire reference to channel's trace chunk");
-			ret = -1;
+	if (args->use_relayd) {
+		ret = consumer_send_relayd_stream(stream, args->path);
+		if (ret < 0) {
+			goto error_unlock;
+		}
+	} else {
+		ret = consumer_stream_create_output_files(stream,
+				false);
+		if (ret < 0) {
 			goto error_unlock;
 		}
-		assert(!stream->trace_chunk);
-		stream->trace_chunk = channel->trace_chunk;
+		DBG("UST consumer snapshot stream (%" PRIu64 ")",
+				stream->key);
+	}
 
-		stream->net_seq_idx = relayd_id;
+	/*
+	 * If tracing is active, we want to perform a "full" buffer flush.
+	 * Else, if quiescent, it has already been done by the prior stop.
+	 */
+	if (!stream->quiescent) {
+		ustctl_flush_buffer(stream->ustream, 0);
+	}
 
-		if (use_relayd) {
-			ret = consumer_send_relayd_stream(stream, path);
-			if (ret < 0) {
-				goto error_unlock;
-			}
-		} else {
-			ret = consumer_stream_create_output_files(stream,
-					false);
-			if (ret < 0) {
-				goto error_unlock;
-			}
-			DBG("UST consumer snapshot stream (%" PRIu64 ")",
-					stream->key);
-		}
+	ret = lttng_ustconsumer_take_snapshot(stream);
+	if (ret < 0) {
+		ERR("Taking UST snapshot");
+		goto error_unlock;
+	}
 
-		/*
-		 * If tracing is active, we want to perform a "full" buffer flush.
-		 * Else, if quiescent, it has already been done by the prior stop.
-		 */
-		if (!stream->quiescent) {
-			ustctl_flush_buffer(stream->ustream, 0);
-		}
+	ret = lttng_ustconsumer_get_produced_snapshot(stream, &produced_pos);
+	if (ret < 0) {
+		ERR("Produced UST snapshot position");
+		goto error_unlock;
+	}
+
+	ret = lttng_ustconsumer_get_consumed_snapshot(stream, &consumed_pos);
+	if (ret < 0) {
+		ERR("Consumerd UST snapshot position");
+		goto error_unlock;
+	}
+
+	/*
+	 * The original value is sent back if max stream size is larger than
+	 * the possible size of the snapshot. Also, we assume that the session
+	 * daemon should never send a maximum stream size that is lower than
+	 * subbuffer size.
+	 */
+	consumed_pos = consumer_get_consume_start_pos(consumed_pos,
+			produced_pos, args->nb_packets_per_stream,
+			stream->max_sb_size);
+
+	while ((long) (consumed_pos - produced_pos) < 0) {
+		ssize_t read_len;
+		unsigned long len, padded_len;
+		const char *subbuf_addr;
+		struct lttng_buffer_view subbuf_view;
+
+		health_code_update();
+
+		DBG("UST consumer taking snapshot at pos %lu", consumed_pos);
 
-		ret = lttng_ustconsumer_take_snapshot(stream);
+		ret = ustctl_get_subbuf(stream->ustream, &consumed_pos);
 		if (ret < 0) {
-			ERR("Taking UST snapshot");
-			goto error_unlock;
+			if (ret != -EAGAIN) {
+				PERROR("ustctl_get_subbuf snapshot");
+				goto error_close_stream;
+			}
+			DBG("UST consumer get subbuf failed. Skipping it.");
+			consumed_pos += stream->max_sb_size;
+			/* Streams of the channel are snapshot concurrently. */
+			uatomic_inc(&channel->lost_packets);
+			continue;
 		}
 
-		ret = lttng_ustconsumer_get_produced_snapshot(stream, &produced_pos);
+		ret = ustctl_get_subbuf_size(stream->ustream, &len);
 		if (ret < 0) {
-			ERR("Produced UST snapshot position");
-			goto error_unlock;
+			ERR("Snapshot ustctl_get_subbuf_size");
+			goto error_put_subbuf;
 		}
 
-		ret = lttng_ustconsumer_get_consumed_snapshot(stream, &consumed_pos);
+		ret = ustctl_get_padded_subbuf_size(stream->ustream, &padded_len);
 		if (ret < 0) {
-			ERR("Consumerd UST snapshot position");
-			goto error_unlock;
+			ERR("Snapshot ustctl_get_padded_subbuf_size");
+			goto error_put_subbuf;
 		}
 
-		/*
-		 * The original value is sent back if max stream size is larger than
-		 * the possible size of the snapshot. Also, we assume that the session
-		 * daemon should never send a maximum stream size that is lower than
-		 * subbuffer size.
-		 */
-		consumed_pos = consumer_get_consume_start_pos(consumed_pos,
-				produced_pos, nb_packets_per_stream,
-				stream->max_sb_size);
-
-		while ((long) (consumed_pos - produced_pos) < 0) {
-			ssize_t read_len;
-			unsigned long len, padded_len;
-			const char *subbuf_addr;
-			struct lttng_buffer_view subbuf_view;
-
-			health_code_update();
-
-			DBG("UST consumer taking snapshot at pos %lu", consumed_pos);
-
-			ret = ustctl_get_subbuf(stream->ustream, &consumed_pos);
-			if (ret < 0) {
-				if (ret != -EAGAIN) {
-					PERROR("ustctl_get_subbuf snapshot");
-					goto error_close_stream;
-				}
-				DBG("UST consumer get subbuf failed. Skipping it.");
-				consumed_pos += stream->max_sb_size;
-				stream->chan->lost_packets++;
-				continue;
-			}
-
-			ret = ustctl_get_subbuf_size(stream->ustream, &len);
-			if (ret < 0) {
-				ERR("Snapshot ustctl_get_subbuf_size");
-				goto error_put_subbuf;
-			}
+		ret = get_current_subbuf_addr(stream, &subbuf_addr);
+		if (ret) {
+			goto error_put_subbuf;
+		}
 
-			ret = ustctl_get_padded_subbuf_size(stream->ustream, &padded_len);
-			if (ret < 0) {
-				ERR("Snapshot ustctl_get_padded_subbuf_size");
+		subbuf_view = lttng_buffer_view_init(
+				subbuf_addr, 0, padded_len);
+		read_len = lttng_consumer_on_read_subbuffer_mmap(
+				stream, &subbuf_view, padded_len - len);
+		if (args->use_relayd) {
+			if (read_len != len) {
+				ret = -EPERM;
 				goto error_put_subbuf;
 			}
-
-			ret = get_current_subbuf_addr(stream, &subbuf_addr);
-			if (ret) {
+		} else {
+			if (read_len != padded_len) {
+				ret = -EPERM;
 				goto error_put_subbuf;
 			}
-
-			subbuf_view = lttng_buffer_view_init(
-					subbuf_addr, 0, padded_len);
-			read_len = lttng_consumer_on_read_subbuffer_mmap(
-					stream, &subbuf_view, padded_len - len);
-			if (use_relayd) {
-				if (read_len != len) {
-					ret = -EPERM;
-					goto error_put_subbuf;
-				}
-			} else {
-				if (read_len != padded_len) {
-					ret = -EPERM;
-					goto error_put_subbuf;
-				}
-			}
-
-			ret = ustctl_put_subbuf(stream->ustream);
-			if (ret < 0) {
-				ERR("Snapshot ustctl_put_subbuf");
-				goto error_close_stream;
-			}
-			consumed_pos += stream->max_sb_size;
 		}
 
-		/* Simply close the stream so we can use it on the next snapshot. */
-		consumer_stream_close(stream);
-		pthread_mutex_unlock(&stream->lock);
+		ret = ustctl_put_subbuf(stream->ustream);
+		if (ret < 0) {
+			ERR("Snapshot ustctl_put_subbuf");
+			goto error_close_stream;
+		}
+		consumed_pos += stream->max_sb_size;
 	}
 
-	rcu_read_unlock();
+	/* Simply close the stream so we can use it on the next snapshot. */
+	consumer_stream_close(stream);
+	pthread_mutex_unlock(&stream->lock);
 	return 0;
 
 error_put_subbuf:
@@ -1274,6 +1263,42 @@ error_close_stream:
 	consumer_stream_close(stream);
 error_unlock:
 	pthread_mutex_unlock(&stream->lock);
+	return ret;
+}
+
+/*
+ * Take a snapshot of all the stream of a channel.
+ * RCU read-side lock and the channel lock must be held by the caller.
+ *
+ * The streams are snapshot concurrently by up to the configured number of
+ * snapshot threads.
+ *
+ * Returns 0 on success, < 0 on error
+ */
+static int snapshot_channel(struct lttng_consumer_channel *channel,
+		uint64_t key, char *path, uint64_t relayd_id,
+		uint64_t nb_packets_per_stream,
+		struct lttng_consumer_local_data *ctx)
+{
+	int ret;
+	struct snapshot_channel_args args = {
+		.path = path,
+		.relayd_id = relayd_id,
+		.nb_packets_per_stream = nb_packets_per_stream,
+		.use_relayd = relayd_id != (uint64_t) -1ULL,
+	};
+
+	assert(path);
+	assert(ctx);
+
+	rcu_read_lock();
+
+	assert(!channel->monitor);
+	DBG("UST consumer snapshot channel %" PRIu64, key);
+
+	ret = consumer_snapshot_channel_streams(channel, ctx, snapshot_stream,
+			&args);
+
 	rcu_read_unlock();
 	return ret;
 }
@@ -2651,17 +2676,19 @@ static int notify_if_more_data(struct lttng_consumer_stream *stream,
 	/* This stream still has data. Flag it and wake up the data thread. */
 	stream->has_data = 1;
 
-	if (stream->monitor && !stream->hangup_flush_done && !ctx->has_wakeup) {
+	if (stream->monitor && !stream->hangup_flush_done &&
+			!stream->data_worker->has_wakeup) {
 		ssize_t writelen;
 
-		writelen = lttng_pipe_write(ctx->consumer_wakeup_pipe, "!", 1);
+		writelen = lttng_pipe_write(stream->data_worker->wakeup_pipe,
+				"!", 1);
 		if (writelen < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
 			ret = writelen;
 			goto end;
 		}
 
 		/* The wake up pipe has been notified. */
-		ctx->has_wakeup = 1;
+		stream->data_worker->has_wakeup = 1;
 	}
 	ret = 0;
 
@@ -1385,6 +1385,52 @@ end:
 	return ret;
 }
 
+/*
+ * Advance the position of `fd` by `len` bytes, extending the file without
+ * writing the skipped range. The range reads as zeros and, on file systems
+ * supporting sparse files, occupies no disk space.
+ *
+ * The position must be at the end of the file or in a range which only holds
+ * zeros, as is the case for packet padding.
+ */
+LTTNG_HIDDEN
+int utils_skip_file_range(int fd, off_t len)
+{
+	int ret;
+	struct stat st;
+	off_t position;
+
+	position = lseek(fd, 0, SEEK_CUR);
+	if (position < 0) {
+		PERROR("lseek");
+		ret = -1;
+		goto end;
+	}
+
+	ret = fstat(fd, &st);
+	if (ret < 0) {
+		PERROR("fstat");
+		goto end;
+	}
+
+	/* Never shrink a file the position was moved back into. */
+	if (st.st_size < position + len) {
+		ret = ftruncate(fd, position + len);
+		if (ret < 0) {
+			PERROR("ftruncate");
+			goto end;
+		}
+	}
+
+	if (lseek(fd, position + len, SEEK_SET) < 0) {
+		PERROR("lseek");
+		ret = -1;
+		goto end;
+	}
+end:
+	return ret;
+}
+
 static const char *get_man_bin_path(void)
 {
 	char *env_man_path = lttng_secure_getenv(DEFAULT_MAN_BIN_PATH_ENV);
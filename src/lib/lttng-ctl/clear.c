@@ -299,6 +299,7 @@ enum lttng_error_code lttng_clear_session(const char *session_name,
 		ret_code = LTTNG_ERR_INVALID;
 		goto error;
 	}
+	lttng_ctl_wait_deferred_replies();
 	ret = connect_sessiond();
 	if (ret < 0) {
 		ret_code = LTTNG_ERR_NO_SESSIOND;
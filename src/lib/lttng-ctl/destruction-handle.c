@@ -406,6 +406,7 @@ enum lttng_error_code lttng_destroy_session_ext(const char *session_name,
 		goto error;
 	}
 
+	lttng_ctl_wait_deferred_replies();
 	ret = connect_sessiond();
 	if (ret < 0) {
 		ret_code = LTTNG_ERR_NO_SESSIOND;
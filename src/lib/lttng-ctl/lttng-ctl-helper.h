@@ -83,4 +83,10 @@ int lttng_check_tracing_group(void);
 
 int connect_sessiond(void);
 
+/*
+ * Wait for the replies to the commands of the open batch, if any, before
+ * sending a command through a connection of its own.
+ */
+void lttng_ctl_wait_deferred_replies(void);
+
 #endif /* LTTNG_CTL_HELPER_H */
@@ -14,9 +14,12 @@
 #include <assert.h>
 #include <grp.h>
 #include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
 #include <unistd.h>
 
 #include <common/common.h>
@@ -65,6 +68,47 @@ static char sessiond_sock_path[PATH_MAX];
 static char *tracing_group;
 static int connected;
 
+/*
+ * Persistent connection to the session daemon, see
+ * lttng_session_daemon_connection_open().
+ */
+struct lttng_session_daemon_connection {
+	/* -1 if the connection must be opened again. */
+	int sock;
+	uint64_t next_request_id;
+	/* Request id of the command being carried by the connection. */
+	uint64_t request_id;
+	/* The reply to the command being carried is deferred. */
+	bool reply_deferred;
+	/*
+	 * A batch of commands is open, see
+	 * lttng_session_daemon_connection_begin_batch().
+	 */
+	bool batch;
+	/* Commands whose reply is deferred and not received yet. */
+	unsigned int deferred_replies;
+	/* Request id of the oldest of those commands. */
+	uint64_t deferred_request_id;
+	/* First error returned to a deferred command of the batch. */
+	enum lttng_error_code batch_error;
+};
+
+/*
+ * Maximum number of commands of a batch whose reply is not received yet. This
+ * bounds the size of the replies queued on the socket, which must never fill
+ * up while the client is still sending commands.
+ */
+#define PERSISTENT_CONNECTION_MAX_DEFERRED_REPLIES	64
+
+/*
+ * Protects the persistent connection, and is held during each of the
+ * commands it carries.
+ */
+static pthread_mutex_t persistent_connection_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct lttng_session_daemon_connection *persistent_connection;
+/* Persistent connection carrying the current command, if any. */
+static struct lttng_session_daemon_connection *command_connection;
+
 /* Global */
 
 /*
@@ -117,12 +161,14 @@ void lttng_ctl_copy_lttng_domain(struct lttng_domain *dst,
 }
 
 /*
- * Send lttcomm_session_msg to the session daemon.
+ * Send the beginning of a command, starting with its lttcomm_session_msg, to
+ * the session daemon along with the credentials of the client. On a
+ * persistent connection, the command is preceded by its request header.
  *
  * On success, returns the number of bytes sent (>=0)
- * On error, returns -1
+ * On error, returns a negative lttng_error_code.
  */
-static int send_session_msg(struct lttcomm_session_msg *lsm)
+static int send_session_command(const void *data, size_t len)
 {
 	int ret;
 
@@ -131,10 +177,22 @@ static int send_session_msg(struct lttcomm_session_msg *lsm)
 		goto end;
 	}
 
-	DBG("LSM cmd type : %d", lsm->cmd_type);
+	if (command_connection) {
+		const struct lttcomm_session_request_header header = {
+			.request_id = command_connection->request_id,
+		};
+
+		ret = lttcomm_send_creds_unix_sock(sessiond_socket, &header,
+				sizeof(header));
+		if (ret < 0) {
+			ret = -LTTNG_ERR_FATAL;
+			goto end;
+		}
 
-	ret = lttcomm_send_creds_unix_sock(sessiond_socket, lsm,
-			sizeof(struct lttcomm_session_msg));
+		ret = lttcomm_send_unix_sock(sessiond_socket, data, len);
+	} else {
+		ret = lttcomm_send_creds_unix_sock(sessiond_socket, data, len);
+	}
 	if (ret < 0) {
 		ret = -LTTNG_ERR_FATAL;
 	}
@@ -143,6 +201,19 @@ end:
 	return ret;
 }
 
+/*
+ * Send lttcomm_session_msg to the session daemon.
+ *
+ * On success, returns the number of bytes sent (>=0)
+ * On error, returns -1
+ */
+static int send_session_msg(struct lttcomm_session_msg *lsm)
+{
+	DBG("LSM cmd type : %d", lsm->cmd_type);
+
+	return send_session_command(lsm, sizeof(struct lttcomm_session_msg));
+}
+
 /*
  * Send var len data to the session daemon.
  *
@@ -249,6 +320,44 @@ end:
 	return ret;
 }
 
+/*
+ * Receive the header preceding the reply to a command carried by a
+ * persistent connection and check that it matches the command.
+ *
+ * On success, returns 0.
+ * On error, returns a negative lttng_error_code.
+ */
+static int recv_session_reply_header(void)
+{
+	int ret = 0;
+	struct lttcomm_session_request_header header;
+
+	if (!command_connection) {
+		goto end;
+	}
+
+	ret = recv_data_sessiond(&header, sizeof(header));
+	if (ret < 0) {
+		goto end;
+	} else if (ret == 0) {
+		/* The session daemon closed the connection. */
+		ret = -LTTNG_ERR_FATAL;
+		goto end;
+	}
+
+	if (header.request_id != command_connection->request_id) {
+		ERR("Received the reply to request %" PRIu64 " from the session daemon, expected request %" PRIu64,
+				header.request_id,
+				command_connection->request_id);
+		ret = -LTTNG_ERR_FATAL;
+		goto end;
+	}
+
+	ret = 0;
+end:
+	return ret;
+}
+
 /*
  * Check if we are in the specified group.
  *
@@ -483,6 +592,327 @@ static int disconnect_sessiond(void)
 	return ret;
 }
 
+/*
+ * Connect to the session daemon and make the connection persistent.
+ *
+ * On success, returns 0. On error, returns a negative lttng_error_code.
+ */
+static int connect_persistent_connection(
+		struct lttng_session_daemon_connection *connection)
+{
+	int ret, sock;
+	struct lttcomm_session_msg lsm;
+	struct lttcomm_lttng_msg llm;
+
+	sock = connect_sessiond();
+	if (sock < 0) {
+		ret = -LTTNG_ERR_NO_SESSIOND;
+		goto end;
+	}
+
+	memset(&lsm, 0, sizeof(lsm));
+	lsm.cmd_type = LTTNG_OPEN_PERSISTENT_CONNECTION;
+
+	ret = lttcomm_send_creds_unix_sock(sock, &lsm, sizeof(lsm));
+	if (ret < 0) {
+		ret = -LTTNG_ERR_FATAL;
+		goto error;
+	}
+
+	ret = lttcomm_recv_unix_sock(sock, &llm, sizeof(llm));
+	if (ret <= 0) {
+		ret = -LTTNG_ERR_FATAL;
+		goto error;
+	}
+
+	if (llm.ret_code != LTTNG_OK) {
+		ret = -llm.ret_code;
+		goto error;
+	}
+
+	if (llm.cmd_header_size || llm.data_size || llm.fd_count) {
+		ret = -LTTNG_ERR_FATAL;
+		goto error;
+	}
+
+	DBG("Opened persistent connection to the session daemon (sock = %d)",
+			sock);
+	connection->sock = sock;
+	ret = 0;
+	goto end;
+
+error:
+	(void) lttcomm_close_unix_sock(sock);
+end:
+	return ret;
+}
+
+/*
+ * Returns true if nothing follows the header of a reply.
+ */
+static bool reply_is_empty(const struct lttcomm_lttng_msg *llm)
+{
+	return !llm->cmd_header_size && !llm->data_size && !llm->fd_count;
+}
+
+/*
+ * Record the error returned to a deferred command of a batch, unless an
+ * earlier one already failed.
+ */
+static void record_batch_error(
+		struct lttng_session_daemon_connection *connection,
+		enum lttng_error_code error)
+{
+	if (connection->batch_error == LTTNG_OK) {
+		connection->batch_error = error;
+	}
+}
+
+/*
+ * Close the socket of a persistent connection, which is opened again by the
+ * next command. The outcome of the deferred commands whose reply was not
+ * received is unknown and fails the batch.
+ */
+static void close_persistent_connection_socket(
+		struct lttng_session_daemon_connection *connection)
+{
+	DBG("Closing persistent connection to the session daemon (sock = %d)",
+			connection->sock);
+	(void) lttcomm_close_unix_sock(connection->sock);
+	connection->sock = -1;
+
+	if (connection->deferred_replies) {
+		record_batch_error(connection, LTTNG_ERR_FATAL);
+		connection->deferred_replies = 0;
+	}
+}
+
+/*
+ * Receive the reply to the oldest deferred command of a persistent
+ * connection and record its error in the batch.
+ *
+ * On success, returns 0. On error, the connection is closed and a negative
+ * lttng_error_code is returned.
+ */
+static int recv_deferred_reply(
+		struct lttng_session_daemon_connection *connection)
+{
+	int ret;
+	struct lttcomm_session_request_header header;
+	struct lttcomm_lttng_msg llm;
+
+	ret = lttcomm_recv_unix_sock(connection->sock, &header,
+			sizeof(header));
+	if (ret <= 0) {
+		ret = -LTTNG_ERR_FATAL;
+		goto error;
+	}
+
+	if (header.request_id != connection->deferred_request_id) {
+		ERR("Received the reply to request %" PRIu64 " from the session daemon, expected request %" PRIu64,
+				header.request_id,
+				connection->deferred_request_id);
+		ret = -LTTNG_ERR_FATAL;
+		goto error;
+	}
+
+	ret = lttcomm_recv_unix_sock(connection->sock, &llm, sizeof(llm));
+	if (ret <= 0) {
+		ret = -LTTNG_ERR_FATAL;
+		goto error;
+	}
+
+	/* Only commands with an empty reply are deferred. */
+	if (!reply_is_empty(&llm)) {
+		ret = -LTTNG_ERR_FATAL;
+		goto error;
+	}
+
+	if (llm.ret_code != LTTNG_OK) {
+		record_batch_error(connection, llm.ret_code);
+	}
+
+	connection->deferred_request_id++;
+	connection->deferred_replies--;
+	ret = 0;
+	goto end;
+
+error:
+	close_persistent_connection_socket(connection);
+end:
+	return ret;
+}
+
+/*
+ * Receive the replies to the deferred commands of a persistent connection,
+ * in the order the commands were sent, and record the first error they
+ * return in the batch.
+ *
+ * On success, returns 0. On error, the connection is closed and a negative
+ * lttng_error_code is returned.
+ */
+static int recv_deferred_replies(
+		struct lttng_session_daemon_connection *connection)
+{
+	int ret = 0;
+
+	while (connection->deferred_replies && !ret) {
+		ret = recv_deferred_reply(connection);
+	}
+
+	return ret;
+}
+
+/*
+ * Receive the replies to the deferred commands of a persistent connection
+ * which the session daemon already sent, without waiting for the others.
+ *
+ * On success, returns 0. On error, the connection is closed and a negative
+ * lttng_error_code is returned.
+ */
+static int recv_available_deferred_replies(
+		struct lttng_session_daemon_connection *connection)
+{
+	int ret = 0;
+
+	while (connection->deferred_replies && !ret) {
+		int available = 0;
+
+		ret = ioctl(connection->sock, FIONREAD, &available);
+		if (ret < 0) {
+			PERROR("ioctl FIONREAD on persistent connection");
+			close_persistent_connection_socket(connection);
+			ret = -LTTNG_ERR_FATAL;
+			break;
+		}
+
+		if ((size_t) available <
+				sizeof(struct lttcomm_session_request_header) +
+				sizeof(struct lttcomm_lttng_msg)) {
+			break;
+		}
+
+		ret = recv_deferred_reply(connection);
+	}
+
+	return ret;
+}
+
+/*
+ * Connect to the session daemon to send it a command: through the persistent
+ * connection, if one is open, or else through a new connection.
+ *
+ * The reply to a command whose reply is empty, when `defer_reply` is set, is
+ * not waited for if a batch is open on the persistent connection; it is
+ * received by a later command or when the batch ends.
+ *
+ * Once a command of the batch failed, the following commands of the batch
+ * are not sent and return its error.
+ *
+ * On success, returns 0 and the command must be ended with
+ * end_sessiond_command(). On error, returns a negative lttng_error_code.
+ */
+static int begin_sessiond_command(bool defer_reply)
+{
+	int ret;
+
+	pthread_mutex_lock(&persistent_connection_lock);
+	if (!persistent_connection) {
+		pthread_mutex_unlock(&persistent_connection_lock);
+
+		ret = connect_sessiond();
+		if (ret < 0) {
+			ret = -LTTNG_ERR_NO_SESSIOND;
+			goto end;
+		}
+
+		sessiond_socket = ret;
+		connected = 1;
+		ret = 0;
+		goto end;
+	}
+
+	/*
+	 * The lock is held until the end of the command.
+	 *
+	 * The replies to the deferred commands precede the reply to a command
+	 * which is waited for. Errors are recorded in the batch.
+	 */
+	if (persistent_connection->deferred_replies &&
+			(!defer_reply ||
+			persistent_connection->deferred_replies >=
+				PERSISTENT_CONNECTION_MAX_DEFERRED_REPLIES)) {
+		(void) recv_deferred_replies(persistent_connection);
+	} else {
+		/* Learn of the errors of the batch as early as possible. */
+		(void) recv_available_deferred_replies(persistent_connection);
+	}
+
+	if (persistent_connection->batch &&
+			persistent_connection->batch_error != LTTNG_OK) {
+		ret = -persistent_connection->batch_error;
+		pthread_mutex_unlock(&persistent_connection_lock);
+		goto end;
+	}
+
+	if (persistent_connection->sock < 0) {
+		ret = connect_persistent_connection(persistent_connection);
+		if (ret < 0) {
+			pthread_mutex_unlock(&persistent_connection_lock);
+			goto end;
+		}
+	}
+
+	command_connection = persistent_connection;
+	command_connection->request_id = command_connection->next_request_id++;
+	command_connection->reply_deferred =
+			defer_reply && command_connection->batch;
+	sessiond_socket = command_connection->sock;
+	connected = 1;
+	ret = 0;
+end:
+	return ret;
+}
+
+/*
+ * Returns true if the reply to the command being sent is deferred.
+ */
+static bool command_reply_deferred(void)
+{
+	return command_connection && command_connection->reply_deferred;
+}
+
+/*
+ * End a command started with begin_sessiond_command().
+ *
+ * A persistent connection is kept open if the whole reply to the command was
+ * received or, for a command whose reply is deferred, if the whole command
+ * was sent. Otherwise, its state is unknown and it is opened again by the
+ * next command.
+ */
+static void end_sessiond_command(bool reply_received)
+{
+	if (!command_connection) {
+		disconnect_sessiond();
+		return;
+	}
+
+	if (!reply_received) {
+		close_persistent_connection_socket(command_connection);
+	} else if (command_connection->reply_deferred) {
+		if (!command_connection->deferred_replies) {
+			command_connection->deferred_request_id =
+					command_connection->request_id;
+		}
+		command_connection->deferred_replies++;
+	}
+	command_connection->reply_deferred = false;
+
+	reset_global_sessiond_connection_state();
+	command_connection = NULL;
+	pthread_mutex_unlock(&persistent_connection_lock);
+}
+
 static int recv_sessiond_optional_data(size_t len, void **user_buf,
 	size_t *user_len)
 {
@@ -547,14 +977,16 @@ int lttng_ctl_ask_sessiond_fds_varlen(struct lttcomm_session_msg *lsm,
 	int ret;
 	size_t payload_len;
 	struct lttcomm_lttng_msg llm;
+	bool reply_received = false;
 
-	ret = connect_sessiond();
+	/*
+	 * The session daemon closes a persistent connection when a command
+	 * carrying data fails: only the commands without data are deferred.
+	 */
+	ret = begin_sessiond_command(!user_payload_buf && !user_cmd_header_buf &&
+			!vardata_len && !nb_fd);
 	if (ret < 0) {
-		ret = -LTTNG_ERR_NO_SESSIOND;
-		goto end;
-	} else {
-		sessiond_socket = ret;
-		connected = 1;
+		goto end_no_command;
 	}
 
 	ret = send_session_msg(lsm);
@@ -576,6 +1008,18 @@ int lttng_ctl_ask_sessiond_fds_varlen(struct lttcomm_session_msg *lsm,
 		goto end;
 	}
 
+	if (command_reply_deferred()) {
+		/* The reply is checked by recv_deferred_replies(). */
+		ret = 0;
+		reply_received = true;
+		goto end;
+	}
+
+	ret = recv_session_reply_header();
+	if (ret < 0) {
+		goto end;
+	}
+
 	/* Get header from data transmission */
 	ret = recv_data_sessiond(&llm, sizeof(llm));
 	if (ret < 0) {
@@ -586,6 +1030,12 @@ int lttng_ctl_ask_sessiond_fds_varlen(struct lttcomm_session_msg *lsm,
 	/* Check error code if OK */
 	if (llm.ret_code != LTTNG_OK) {
 		ret = -llm.ret_code;
+		/*
+		 * The session daemon closes a persistent connection when a
+		 * command carrying data fails.
+		 */
+		reply_received = reply_is_empty(&llm) &&
+				!vardata_len && !nb_fd;
 		goto end;
 	}
 
@@ -604,9 +1054,11 @@ int lttng_ctl_ask_sessiond_fds_varlen(struct lttcomm_session_msg *lsm,
 	}
 
 	ret = llm.data_size;
+	reply_received = llm.fd_count == 0;
 
 end:
-	disconnect_sessiond();
+	end_sessiond_command(reply_received);
+end_no_command:
 	return ret;
 }
 
@@ -617,24 +1069,19 @@ int lttng_ctl_ask_sessiond_payload(struct lttng_payload_view *message,
 	int ret;
 	struct lttcomm_lttng_msg llm;
 	const int fd_count = lttng_payload_view_get_fd_handle_count(message);
+	bool reply_received = false;
 
 	assert(reply->buffer.size == 0);
 	assert(lttng_dynamic_pointer_array_get_count(&reply->_fd_handles) == 0);
 
-	ret = connect_sessiond();
+	ret = begin_sessiond_command(false);
 	if (ret < 0) {
-		ret = -LTTNG_ERR_NO_SESSIOND;
-		goto end;
-	} else {
-		sessiond_socket = ret;
-		connected = 1;
+		goto end_no_command;
 	}
 
 	/* Send command to session daemon */
-	ret = lttcomm_send_creds_unix_sock(sessiond_socket, message->buffer.data,
-			message->buffer.size);
+	ret = send_session_command(message->buffer.data, message->buffer.size);
 	if (ret < 0) {
-		ret = -LTTNG_ERR_FATAL;
 		goto end;
 	}
 
@@ -647,6 +1094,11 @@ int lttng_ctl_ask_sessiond_payload(struct lttng_payload_view *message,
 		}
 	}
 
+	ret = recv_session_reply_header();
+	if (ret < 0) {
+		goto end;
+	}
+
 	/* Get header from data transmission */
 	ret = recv_payload_sessiond(reply, sizeof(llm));
 	if (ret < 0) {
@@ -659,6 +1111,14 @@ int lttng_ctl_ask_sessiond_payload(struct lttng_payload_view *message,
 	/* Check error code if OK */
 	if (llm.ret_code != LTTNG_OK) {
 		ret = -llm.ret_code;
+		/*
+		 * The session daemon closes a persistent connection when a
+		 * command carrying data fails.
+		 */
+		reply_received = reply_is_empty(&llm) &&
+				message->buffer.size <=
+					sizeof(struct lttcomm_session_msg) &&
+				fd_count == 0;
 		goto end;
 	}
 
@@ -696,9 +1156,11 @@ int lttng_ctl_ask_sessiond_payload(struct lttng_payload_view *message,
 	}
 
 	ret = reply->buffer.size;
+	reply_received = true;
 
 end:
-	disconnect_sessiond();
+	end_sessiond_command(reply_received);
+end_no_command:
 	return ret;
 }
 
@@ -3079,6 +3541,123 @@ end:
 	return ret;
 }
 
+enum lttng_error_code lttng_session_daemon_connection_open(
+		struct lttng_session_daemon_connection **_connection)
+{
+	int ret;
+	enum lttng_error_code ret_code;
+	struct lttng_session_daemon_connection *connection = NULL;
+
+	if (!_connection) {
+		ret_code = LTTNG_ERR_INVALID;
+		goto end_unlocked;
+	}
+
+	pthread_mutex_lock(&persistent_connection_lock);
+	if (persistent_connection) {
+		ret_code = LTTNG_ERR_INVALID;
+		goto end;
+	}
+
+	connection = zmalloc(sizeof(*connection));
+	if (!connection) {
+		ret_code = LTTNG_ERR_NOMEM;
+		goto end;
+	}
+	connection->sock = -1;
+	connection->batch_error = LTTNG_OK;
+
+	ret = connect_persistent_connection(connection);
+	if (ret < 0) {
+		ret_code = (enum lttng_error_code) -ret;
+		goto end;
+	}
+
+	persistent_connection = connection;
+	*_connection = connection;
+	connection = NULL;
+	ret_code = LTTNG_OK;
+end:
+	pthread_mutex_unlock(&persistent_connection_lock);
+	free(connection);
+end_unlocked:
+	return ret_code;
+}
+
+void lttng_session_daemon_connection_close(
+		struct lttng_session_daemon_connection *connection)
+{
+	if (!connection) {
+		return;
+	}
+
+	/* Wait for the command being carried by the connection, if any. */
+	pthread_mutex_lock(&persistent_connection_lock);
+	assert(connection == persistent_connection);
+	persistent_connection = NULL;
+	pthread_mutex_unlock(&persistent_connection_lock);
+
+	if (connection->sock >= 0) {
+		(void) lttcomm_close_unix_sock(connection->sock);
+	}
+	free(connection);
+}
+
+enum lttng_error_code lttng_session_daemon_connection_begin_batch(
+		struct lttng_session_daemon_connection *connection)
+{
+	enum lttng_error_code ret;
+
+	pthread_mutex_lock(&persistent_connection_lock);
+	if (!connection || connection != persistent_connection ||
+			connection->batch) {
+		ret = LTTNG_ERR_INVALID;
+		goto end;
+	}
+
+	connection->batch = true;
+	connection->batch_error = LTTNG_OK;
+	ret = LTTNG_OK;
+end:
+	pthread_mutex_unlock(&persistent_connection_lock);
+	return ret;
+}
+
+enum lttng_error_code lttng_session_daemon_connection_end_batch(
+		struct lttng_session_daemon_connection *connection)
+{
+	enum lttng_error_code ret;
+
+	pthread_mutex_lock(&persistent_connection_lock);
+	if (!connection || connection != persistent_connection ||
+			!connection->batch) {
+		ret = LTTNG_ERR_INVALID;
+		goto end;
+	}
+
+	(void) recv_deferred_replies(connection);
+	connection->batch = false;
+	ret = connection->batch_error;
+end:
+	pthread_mutex_unlock(&persistent_connection_lock);
+	return ret;
+}
+
+/*
+ * Wait for the replies to the deferred commands of the persistent connection,
+ * if any, so that a command sent through another connection is applied after
+ * them.
+ */
+LTTNG_HIDDEN
+void lttng_ctl_wait_deferred_replies(void)
+{
+	pthread_mutex_lock(&persistent_connection_lock);
+	if (persistent_connection) {
+		(void) recv_deferred_replies(persistent_connection);
+	}
+	pthread_mutex_unlock(&persistent_connection_lock);
+}
+
 /*
  * lib constructor.
  */
@@ -0,0 +1,335 @@
+/*
+ * Copyright (C) 2020 EfficiOS Inc.
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ *
+ */
+
+/*
+ * Micro-benchmark of the run-as workers.
+ *
+ * Creates N stream files through the run-as workers, as the consumer daemon
+ * does for the streams of a session owned by another user, from a number of
+ * concurrent threads, and then "rotates" them by renaming them to an archive
+ * directory. Reports the time spent in each phase.
+ *
+ * The files are opened one by one or in batches of the given size with
+ * run_as_openat_batch(). The consumer daemon opens each stream file and its
+ * index file as a batch of 2. The number of run-as workers is set with the
+ * LTTNG_RUN_AS_WORKERS environment variable.
+ */
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <common/common.h>
+#include <common/runas.h>
+#include <common/time.h>
+
+#define DEFAULT_NR_FILES	10000
+#define DEFAULT_NR_THREADS	4
+#define DEFAULT_BATCH_SIZE	1
+#define MAX_BATCH_SIZE		64
+#define ARCHIVE_DIR		"archive"
+
+/* For error.h */
+int lttng_opt_quiet = 1;
+int lttng_opt_verbose;
+int lttng_opt_mi;
+
+enum bench_phase {
+	BENCH_PHASE_CREATE,
+	BENCH_PHASE_ROTATE,
+};
+
+struct bench_thread {
+	pthread_t thread;
+	enum bench_phase phase;
+	/* Files [first_file, first_file + nr_files) are handled by the thread. */
+	unsigned int first_file, nr_files;
+	int ret;
+};
+
+static int trace_dirfd = -1;
+static unsigned int batch_size = DEFAULT_BATCH_SIZE;
+
+static
+void format_file_name(char *name, size_t len, unsigned int file)
+{
+	(void) snprintf(name, len, "channel0_%u", file);
+}
+
+static
+int create_files(const struct bench_thread *bench_thread)
+{
+	int ret = 0;
+	unsigned int i, j;
+	char names[MAX_BATCH_SIZE][LTTNG_NAME_MAX];
+	const char *name_ptrs[MAX_BATCH_SIZE];
+	int fds[MAX_BATCH_SIZE];
+
+	for (i = 0; i < MAX_BATCH_SIZE; i++) {
+		name_ptrs[i] = names[i];
+	}
+
+	for (i = 0; i < bench_thread->nr_files; i += batch_size) {
+		const unsigned int count = min_t(unsigned int, batch_size,
+				bench_thread->nr_files - i);
+
+		for (j = 0; j < count; j++) {
+			format_file_name(names[j], sizeof(names[j]),
+					bench_thread->first_file + i + j);
+		}
+
+		if (count == 1) {
+			fds[0] = run_as_openat(trace_dirfd, names[0],
+					O_WRONLY | O_CREAT | O_TRUNC,
+					S_IRWXU | S_IRWXG,
+					geteuid(), getegid());
+			ret = fds[0] < 0 ? -1 : 0;
+		} else {
+			ret = run_as_openat_batch(trace_dirfd, name_ptrs, count,
+					O_WRONLY | O_CREAT | O_TRUNC,
+					S_IRWXU | S_IRWXG,
+					geteuid(), getegid(), fds);
+		}
+		if (ret) {
+			perror("Failed to create stream file");
+			goto end;
+		}
+
+		for (j = 0; j < count; j++) {
+			(void) close(fds[j]);
+		}
+	}
+end:
+	return ret;
+}
+
+static
+int rotate_files(const struct bench_thread *bench_thread)
+{
+	int ret = 0;
+	unsigned int i;
+
+	for (i = 0; i < bench_thread->nr_files; i++) {
+		char old_name[LTTNG_NAME_MAX], new_name[LTTNG_PATH_MAX];
+
+		format_file_name(old_name, sizeof(old_name),
+				bench_thread->first_file + i);
+		(void) snprintf(new_name, sizeof(new_name), ARCHIVE_DIR "/%s",
+				old_name);
+		ret = run_as_renameat(trace_dirfd, old_name, trace_dirfd,
+				new_name, geteuid(), getegid());
+		if (ret) {
+			perror("Failed to rename stream file");
+			goto end;
+		}
+	}
+end:
+	return ret;
+}
+
+/*
+ * Remove the files left by the benchmark, wherever they are.
+ */
+static
+void remove_files(const char *trace_path, unsigned int nr_files)
+{
+	unsigned int i;
+
+	for (i = 0; i < nr_files; i++) {
+		char name[LTTNG_NAME_MAX], archived_name[LTTNG_PATH_MAX];
+
+		format_file_name(name, sizeof(name), i);
+		(void) snprintf(archived_name, sizeof(archived_name),
+				ARCHIVE_DIR "/%s", name);
+		(void) unlinkat(trace_dirfd, name, 0);
+		(void) unlinkat(trace_dirfd, archived_name, 0);
+	}
+	(void) unlinkat(trace_dirfd, ARCHIVE_DIR, AT_REMOVEDIR);
+	if (rmdir(trace_path)) {
+		perror("Failed to remove the benchmark directory");
+	}
+}
+
+static
+void *thread_bench(void *data)
+{
+	struct bench_thread *bench_thread = data;
+
+	switch (bench_thread->phase) {
+	case BENCH_PHASE_CREATE:
+		bench_thread->ret = create_files(bench_thread);
+		break;
+	case BENCH_PHASE_ROTATE:
+		bench_thread->ret = rotate_files(bench_thread);
+		break;
+	}
+	return NULL;
+}
+
+/*
+ * Run a phase of the benchmark on all threads and return the time it took,
+ * or a negative value on error.
+ */
+static
+int64_t run_phase(struct bench_thread *threads, unsigned int nr_threads,
+		enum bench_phase phase)
+{
+	int ret;
+	unsigned int i, launched;
+	struct timespec start, end;
+	int64_t elapsed_ns = -1;
+
+	ret = lttng_clock_gettime(CLOCK_MONOTONIC, &start);
+	if (ret) {
+		perror("clock_gettime");
+		goto end;
+	}
+
+	for (launched = 0; launched < nr_threads; launched++) {
+		threads[launched].phase = phase;
+		threads[launched].ret = 0;
+		ret = pthread_create(&threads[launched].thread, NULL,
+				thread_bench, &threads[launched]);
+		if (ret) {
+			errno = ret;
+			perror("pthread_create");
+			break;
+		}
+	}
+
+	for (i = 0; i < launched; i++) {
+		(void) pthread_join(threads[i].thread, NULL);
+		if (threads[i].ret) {
+			ret = -1;
+		}
+	}
+	if (ret) {
+		goto end;
+	}
+
+	ret = lttng_clock_gettime(CLOCK_MONOTONIC, &end);
+	if (ret) {
+		perror("clock_gettime");
+		goto end;
+	}
+
+	elapsed_ns = (int64_t) (end.tv_sec - start.tv_sec) * NSEC_PER_SEC +
+			(end.tv_nsec - start.tv_nsec);
+end:
+	return elapsed_ns;
+}
+
+int main(int argc, char **argv)
+{
+	int ret;
+	unsigned int i, nr_files = DEFAULT_NR_FILES,
+			nr_threads = DEFAULT_NR_THREADS;
+	char trace_path[] = "/tmp/lttng-bench-runas-XXXXXX";
+	bool created_trace_dir = false, created_worker = false;
+	struct bench_thread *threads = NULL;
+	int64_t create_ns, rotate_ns;
+
+	if (argc > 4) {
+		fprintf(stderr, "Usage: %s [FILE COUNT] [THREAD COUNT] [BATCH SIZE]\n",
+				argv[0]);
+		ret = EXIT_FAILURE;
+		goto end;
+	}
+	if (argc > 1) {
+		nr_files = (unsigned int) strtoul(argv[1], NULL, 0);
+	}
+	if (argc > 2) {
+		nr_threads = (unsigned int) strtoul(argv[2], NULL, 0);
+	}
+	if (argc > 3) {
+		batch_size = (unsigned int) strtoul(argv[3], NULL, 0);
+	}
+	if (nr_threads == 0 || batch_size == 0 || batch_size > MAX_BATCH_SIZE) {
+		fprintf(stderr, "Invalid thread count or batch size (1 to %d)\n",
+				MAX_BATCH_SIZE);
+		ret = EXIT_FAILURE;
+		goto end;
+	}
+
+	if (!mkdtemp(trace_path)) {
+		perror("mkdtemp");
+		ret = EXIT_FAILURE;
+		goto end;
+	}
+	created_trace_dir = true;
+
+	trace_dirfd = open(trace_path, O_RDONLY | O_DIRECTORY);
+	if (trace_dirfd < 0) {
+		perror("open");
+		ret = EXIT_FAILURE;
+		goto end;
+	}
+	if (mkdirat(trace_dirfd, ARCHIVE_DIR, S_IRWXU)) {
+		perror("mkdirat");
+		ret = EXIT_FAILURE;
+		goto end;
+	}
+
+	if (run_as_create_worker(argv[0], NULL, NULL) < 0) {
+		fprintf(stderr, "Failed to launch the run-as workers\n");
+		ret = EXIT_FAILURE;
+		goto end;
+	}
+	created_worker = true;
+
+	threads = zmalloc(nr_threads * sizeof(*threads));
+	if (!threads) {
+		fprintf(stderr, "Failed to allocate threads\n");
+		ret = EXIT_FAILURE;
+		goto end;
+	}
+	for (i = 0; i < nr_threads; i++) {
+		const unsigned int share = nr_files / nr_threads;
+
+		threads[i].first_file = i * share;
+		threads[i].nr_files = i == nr_threads - 1 ?
+				nr_files - i * share : share;
+	}
+
+	create_ns = run_phase(threads, nr_threads, BENCH_PHASE_CREATE);
+	if (create_ns < 0) {
+		ret = EXIT_FAILURE;
+		goto end;
+	}
+	rotate_ns = run_phase(threads, nr_threads, BENCH_PHASE_ROTATE);
+	if (rotate_ns < 0) {
+		ret = EXIT_FAILURE;
+		goto end;
+	}
+
+	printf("files: %u, threads: %u, batch size: %u\n", nr_files,
+			nr_threads, batch_size);
+	printf("create: %" PRId64 " ns, per file: %" PRId64 " ns\n",
+			create_ns,
+			nr_files ? create_ns / (int64_t) nr_files : 0);
+	printf("rotate: %" PRId64 " ns, per file: %" PRId64 " ns\n",
+			rotate_ns,
+			nr_files ? rotate_ns / (int64_t) nr_files : 0);
+	ret = EXIT_SUCCESS;
+end:
+	if (created_worker) {
+		run_as_destroy_worker();
+	}
+	if (created_trace_dir) {
+		remove_files(trace_path, nr_files);
+	}
+	if (trace_dirfd >= 0) {
+		(void) close(trace_dirfd);
+	}
+	free(threads);
+	return ret;
+}
@@ -0,0 +1,295 @@
+/*
+ * Copyright (C) 2020 EfficiOS Inc.
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ *
+ */
+
+/*
+ * Micro-benchmark of the sparse packet padding.
+ *
+ * Writes N packets of a given size, holding a given amount of content, to a
+ * stream file as the consumer and relay daemons do: once writing the padding
+ * of the packets as zeros, and once skipping it by extending the file
+ * sparsely. Reports, for each mode, the bytes written, the disk space
+ * allocated to the file and the write throughput, the file being synced to
+ * disk before the time is taken. Both files are then checked to read the
+ * same.
+ */
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <common/align.h>
+#include <common/common.h>
+#include <common/readwrite.h>
+#include <common/time.h>
+#include <common/utils.h>
+
+#define DEFAULT_NR_PACKETS	4096
+#define DEFAULT_PACKET_SIZE	262144
+#define DEFAULT_CONTENT_SIZE	16384
+#define DENSE_FILE_NAME		"channel0_0_dense"
+#define SPARSE_FILE_NAME	"channel0_0_sparse"
+
+/* For error.h */
+int lttng_opt_quiet = 1;
+int lttng_opt_verbose;
+int lttng_opt_mi;
+
+struct bench_result {
+	uint64_t written_bytes;
+	uint64_t file_size;
+	uint64_t allocated_bytes;
+	int64_t elapsed_ns;
+};
+
+static unsigned int nr_packets = DEFAULT_NR_PACKETS;
+static size_t packet_size = DEFAULT_PACKET_SIZE;
+static size_t content_size = DEFAULT_CONTENT_SIZE;
+
+/*
+ * Write the packets to `fd`, skipping their padding if `sparse` is set and
+ * it spans at least a page, as the daemons do.
+ */
+static
+int write_packets(int fd, const char *packet, bool sparse,
+		uint64_t *written_bytes)
+{
+	int ret = 0;
+	unsigned int i;
+	const size_t padding = packet_size - content_size;
+
+	*written_bytes = 0;
+	for (i = 0; i < nr_packets; i++) {
+		size_t write_len = packet_size;
+		ssize_t write_ret;
+
+		if (sparse && padding >= (size_t) PAGE_SIZE) {
+			write_len = content_size;
+		}
+
+		write_ret = lttng_write(fd, packet, write_len);
+		if (write_ret != write_len) {
+			perror("Failed to write packet");
+			ret = -1;
+			goto end;
+		}
+		*written_bytes += write_len;
+
+		if (write_len != packet_size) {
+			ret = utils_skip_file_range(fd, padding);
+			if (ret) {
+				fprintf(stderr, "Failed to skip packet padding\n");
+				goto end;
+			}
+		}
+	}
+end:
+	return ret;
+}
+
+static
+int run_mode(int dirfd, const char *name, const char *packet, bool sparse,
+		struct bench_result *result)
+{
+	int ret, fd;
+	struct stat st;
+	struct timespec start, end;
+
+	fd = openat(dirfd, name, O_WRONLY | O_CREAT | O_TRUNC,
+			S_IRUSR | S_IWUSR);
+	if (fd < 0) {
+		perror("openat");
+		ret = -1;
+		goto end;
+	}
+
+	ret = lttng_clock_gettime(CLOCK_MONOTONIC, &start);
+	if (ret) {
+		perror("clock_gettime");
+		goto end_close;
+	}
+
+	ret = write_packets(fd, packet, sparse, &result->written_bytes);
+	if (ret) {
+		goto end_close;
+	}
+	ret = fsync(fd);
+	if (ret) {
+		perror("fsync");
+		goto end_close;
+	}
+
+	ret = lttng_clock_gettime(CLOCK_MONOTONIC, &end);
+	if (ret) {
+		perror("clock_gettime");
+		goto end_close;
+	}
+	result->elapsed_ns = (int64_t) (end.tv_sec - start.tv_sec) *
+			NSEC_PER_SEC + (end.tv_nsec - start.tv_nsec);
+
+	ret = fstat(fd, &st);
+	if (ret) {
+		perror("fstat");
+		goto end_close;
+	}
+	result->file_size = (uint64_t) st.st_size;
+	result->allocated_bytes = (uint64_t) st.st_blocks * 512;
+end_close:
+	if (close(fd)) {
+		perror("close");
+	}
+end:
+	return ret;
+}
+
+/*
+ * Returns 0 if both files read the same.
+ */
+static
+int compare_files(int dirfd)
+{
+	int ret = -1;
+	int dense_fd = -1, sparse_fd = -1;
+	char *dense_buf = NULL, *sparse_buf = NULL;
+	unsigned int i;
+
+	dense_buf = zmalloc(packet_size);
+	sparse_buf = zmalloc(packet_size);
+	if (!dense_buf || !sparse_buf) {
+		fprintf(stderr, "Failed to allocate comparison buffers\n");
+		goto end;
+	}
+
+	dense_fd = openat(dirfd, DENSE_FILE_NAME, O_RDONLY);
+	sparse_fd = openat(dirfd, SPARSE_FILE_NAME, O_RDONLY);
+	if (dense_fd < 0 || sparse_fd < 0) {
+		perror("openat");
+		goto end;
+	}
+
+	for (i = 0; i < nr_packets; i++) {
+		if (lttng_read(dense_fd, dense_buf, packet_size) != packet_size ||
+				lttng_read(sparse_fd, sparse_buf, packet_size) !=
+						packet_size) {
+			fprintf(stderr, "Failed to read packet %u\n", i);
+			goto end;
+		}
+		if (memcmp(dense_buf, sparse_buf, packet_size)) {
+			fprintf(stderr, "Packet %u differs\n", i);
+			goto end;
+		}
+	}
+	ret = 0;
+end:
+	if (dense_fd >= 0) {
+		(void) close(dense_fd);
+	}
+	if (sparse_fd >= 0) {
+		(void) close(sparse_fd);
+	}
+	free(dense_buf);
+	free(sparse_buf);
+	return ret;
+}
+
+static
+void print_result(const char *mode, const struct bench_result *result)
+{
+	const double seconds = (double) result->elapsed_ns / NSEC_PER_SEC;
+
+	printf("%s: written: %" PRIu64 " bytes, file size: %" PRIu64 " bytes, allocated: %" PRIu64 " bytes, time: %" PRId64 " ns, throughput: %.1f MiB/s of packets\n",
+			mode, result->written_bytes, result->file_size,
+			result->allocated_bytes, result->elapsed_ns,
+			seconds > 0 ? (double) result->file_size / seconds /
+					(1024 * 1024) : 0);
+}
+
+int main(int argc, char **argv)
+{
+	int ret, dirfd = -1;
+	char trace_path[] = "/tmp/lttng-bench-padding-XXXXXX";
+	bool created_trace_dir = false;
+	char *packet = NULL;
+	struct bench_result dense, sparse;
+
+	if (argc > 4) {
+		fprintf(stderr, "Usage: %s [PACKET COUNT] [PACKET SIZE] [CONTENT SIZE]\n",
+				argv[0]);
+		ret = EXIT_FAILURE;
+		goto end;
+	}
+	if (argc > 1) {
+		nr_packets = (unsigned int) strtoul(argv[1], NULL, 0);
+	}
+	if (argc > 2) {
+		packet_size = (size_t) strtoul(argv[2], NULL, 0);
+	}
+	if (argc > 3) {
+		content_size = (size_t) strtoul(argv[3], NULL, 0);
+	}
+	if (packet_size == 0 || content_size > packet_size) {
+		fprintf(stderr, "Invalid packet or content size\n");
+		ret = EXIT_FAILURE;
+		goto end;
+	}
+
+	/* Content is non-zero so that only the padding can be sparse. */
+	packet = zmalloc(packet_size);
+	if (!packet) {
+		fprintf(stderr, "Failed to allocate packet\n");
+		ret = EXIT_FAILURE;
+		goto end;
+	}
+	memset(packet, 0xab, content_size);
+
+	if (!mkdtemp(trace_path)) {
+		perror("mkdtemp");
+		ret = EXIT_FAILURE;
+		goto end;
+	}
+	created_trace_dir = true;
+
+	dirfd = open(trace_path, O_RDONLY | O_DIRECTORY);
+	if (dirfd < 0) {
+		perror("open");
+		ret = EXIT_FAILURE;
+		goto end;
+	}
+
+	if (run_mode(dirfd, DENSE_FILE_NAME, packet, false, &dense) ||
+			run_mode(dirfd, SPARSE_FILE_NAME, packet, true,
+					&sparse)) {
+		ret = EXIT_FAILURE;
+		goto end;
+	}
+
+	printf("packets: %u, packet size: %zu, content size: %zu\n",
+			nr_packets, packet_size, content_size);
+	print_result("dense", &dense);
+	print_result("sparse", &sparse);
+
+	if (compare_files(dirfd)) {
+		ret = EXIT_FAILURE;
+		goto end;
+	}
+	printf("files read the same\n");
+	ret = EXIT_SUCCESS;
+end:
+	if (dirfd >= 0) {
+		(void) unlinkat(dirfd, DENSE_FILE_NAME, 0);
+		(void) unlinkat(dirfd, SPARSE_FILE_NAME, 0);
+		(void) close(dirfd);
+	}
+	if (created_trace_dir && rmdir(trace_path)) {
+		perror("Failed to remove the benchmark directory");
+	}
+	free(packet);
+	return ret;
+}
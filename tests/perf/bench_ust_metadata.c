@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2020 EfficiOS Inc.
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ *
+ */
+
+/*
+ * Micro-benchmark of the CTF metadata generation of the session daemon.
+ *
+ * Dumps the metadata of N synthetic events, each having the same number of
+ * integer fields, to a session registry backed by a metadata file (as is the
+ * case for sessions created with --shm-path) and reports the time spent.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <common/common.h>
+#include <common/time.h>
+#include <bin/lttng-sessiond/session.h>
+#include <bin/lttng-sessiond/ust-registry.h>
+
+#define DEFAULT_NR_EVENTS	10000
+#define DEFAULT_NR_FIELDS	32
+
+/*
+ * The metadata of the benchmarked events does not reference any session or
+ * enumeration; stub the lookups rather than linking the whole session daemon.
+ */
+struct ltt_session *session_find_by_id(uint64_t id)
+{
+	return NULL;
+}
+
+void session_put(struct ltt_session *session)
+{
+}
+
+struct ust_registry_enum *ust_registry_lookup_enum_by_id(
+		struct ust_registry_session *session,
+		const char *name, uint64_t id)
+{
+	return NULL;
+}
+
+static
+struct ustctl_field *create_fields(size_t nr_fields)
+{
+	size_t i;
+	struct ustctl_field *fields;
+
+	fields = zmalloc(nr_fields * sizeof(*fields));
+	if (!fields) {
+		goto end;
+	}
+
+	for (i = 0; i < nr_fields; i++) {
+		struct ustctl_integer_type *integer =
+				&fields[i].type.u.integer;
+
+		(void) snprintf(fields[i].name, sizeof(fields[i].name),
+				"field_%zu", i);
+		fields[i].type.atype = ustctl_atype_integer;
+		integer->size = 64;
+		integer->alignment = 8;
+		integer->signedness = i & 1;
+		integer->reverse_byte_order = 0;
+		integer->base = 10;
+		integer->encoding = ustctl_encode_none;
+	}
+end:
+	return fields;
+}
+
+static
+int create_metadata_file(void)
+{
+	int fd;
+	char path[] = "/tmp/lttng-bench-metadata-XXXXXX";
+
+	fd = mkstemp(path);
+	if (fd < 0) {
+		perror("mkstemp");
+		goto end;
+	}
+	(void) unlink(path);
+end:
+	return fd;
+}
+
+int main(int argc, char **argv)
+{
+	int ret;
+	unsigned int i, nr_events = DEFAULT_NR_EVENTS;
+	size_t nr_fields = DEFAULT_NR_FIELDS;
+	struct ust_registry_session session = { .metadata_fd = -1 };
+	struct ust_registry_channel chan = {};
+	struct ustctl_field *fields = NULL;
+	struct timespec start, end;
+	int64_t elapsed_ns;
+
+	if (argc > 3) {
+		fprintf(stderr, "Usage: %s [EVENT COUNT] [FIELDS PER EVENT]\n",
+				argv[0]);
+		ret = EXIT_FAILURE;
+		goto end;
+	}
+	if (argc > 1) {
+		nr_events = (unsigned int) strtoul(argv[1], NULL, 0);
+	}
+	if (argc > 2) {
+		nr_fields = (size_t) strtoul(argv[2], NULL, 0);
+	}
+
+	session.bits_per_long = CAA_BITS_PER_LONG;
+	session.uint8_t_alignment = 8;
+	session.uint16_t_alignment = 8;
+	session.uint32_t_alignment = 8;
+	session.uint64_t_alignment = 8;
+	session.long_alignment = 8;
+	session.byte_order = BYTE_ORDER;
+	session.metadata_fd = create_metadata_file();
+	if (session.metadata_fd < 0) {
+		ret = EXIT_FAILURE;
+		goto end;
+	}
+
+	chan.chan_id = 0;
+	chan.header_type = USTCTL_CHANNEL_HEADER_LARGE;
+
+	fields = create_fields(nr_fields);
+	if (!fields) {
+		fprintf(stderr, "Failed to allocate event fields\n");
+		ret = EXIT_FAILURE;
+		goto end;
+	}
+
+	ret = lttng_clock_gettime(CLOCK_MONOTONIC, &start);
+	if (ret) {
+		perror("clock_gettime");
+		ret = EXIT_FAILURE;
+		goto end;
+	}
+
+	for (i = 0; i < nr_events; i++) {
+		struct ust_registry_event event = {};
+
+		(void) snprintf(event.name, sizeof(event.name),
+				"bench_provider:event_%u", i);
+		event.id = i;
+		event.loglevel_value = 13;
+		event.nr_fields = nr_fields;
+		event.fields = fields;
+
+		ret = ust_metadata_event_statedump(&session, &chan, &event);
+		if (ret) {
+			fprintf(stderr, "Failed to dump metadata of event %u\n",
+					i);
+			ret = EXIT_FAILURE;
+			goto end;
+		}
+	}
+
+	ret = lttng_clock_gettime(CLOCK_MONOTONIC, &end);
+	if (ret) {
+		perror("clock_gettime");
+		ret = EXIT_FAILURE;
+		goto end;
+	}
+
+	elapsed_ns = (int64_t) (end.tv_sec - start.tv_sec) * NSEC_PER_SEC +
+			(end.tv_nsec - start.tv_nsec);
+	printf("events: %u, fields per event: %zu, metadata: %zu bytes\n",
+			nr_events, nr_fields, session.metadata_len);
+	printf("total: %" PRId64 " ns, per event: %" PRId64 " ns\n",
+			elapsed_ns,
+			nr_events ? elapsed_ns / (int64_t) nr_events : 0);
+	ret = EXIT_SUCCESS;
+end:
+	if (session.metadata_fd >= 0) {
+		(void) close(session.metadata_fd);
+	}
+	free(session.metadata);
+	free(fields);
+	return ret;
+}
@@ -38,7 +38,7 @@
 #define LIVE_TIMER 2000000
 
 /* Number of TAP tests in this file */
-#define NUM_TESTS 11
+#define NUM_TESTS 12
 #define mmap_size 524288
 
 static int control_sock;
@@ -47,6 +47,7 @@ struct live_session *session;
 static int first_packet_offset;
 static int first_packet_len;
 static int first_packet_stream_id = -1;
+static uint32_t viewer_capabilities;
 
 struct viewer_stream {
 	uint64_t id;
@@ -174,6 +175,7 @@ int establish_connection(void)
 		diag("Error receiving version");
 		goto error;
 	}
+	viewer_capabilities = be32toh(connect.type);
 	return 0;
 
 error:
@@ -685,6 +687,8 @@ int main(int argc, char **argv)
 	ret = establish_connection();
 	ok(ret == 0, "Established connection and version check with %d.%d",
 			VERSION_MAJOR, VERSION_MINOR);
+	ok(viewer_capabilities & LTTNG_VIEWER_CAPABILITY_BATCH,
+			"Relayd announces the batch commands");
 
 	ret = list_sessions(&session_id);
 	ok(ret > 0, "List sessions : %d session(s)", ret);
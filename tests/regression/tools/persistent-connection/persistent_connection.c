@@ -0,0 +1,174 @@
+/*
+ * persistent_connection.c
+ *
+ * Tests suite for the persistent session daemon connection API.
+ *
+ * Copyright (C) 2020 EfficiOS Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tap/tap.h>
+#include <lttng/lttng.h>
+
+#define TEST_COUNT 17
+
+static const char * const unknown_session_name = "unknown-session";
+
+/*
+ * Enable an event of the user space domain with a filter and exclusions,
+ * which are sent after the command as variable-length data.
+ */
+static
+int enable_filtered_event(const char *session_name)
+{
+	int ret;
+	char exclusion[] = "tp:excluded";
+	char *exclusions[] = { exclusion };
+	struct lttng_domain domain = {
+		.type = LTTNG_DOMAIN_UST,
+		.buf_type = LTTNG_BUFFER_PER_UID,
+	};
+	struct lttng_handle *handle = NULL;
+	struct lttng_event *event = NULL;
+
+	handle = lttng_create_handle(session_name, &domain);
+	event = lttng_event_create();
+	if (!handle || !event) {
+		ret = -LTTNG_ERR_NOMEM;
+		goto end;
+	}
+
+	strcpy(event->name, "tp:*");
+	event->type = LTTNG_EVENT_TRACEPOINT;
+	event->loglevel_type = LTTNG_EVENT_LOGLEVEL_ALL;
+	ret = lttng_enable_event_with_exclusions(handle, event, NULL,
+			"intfield > 0", 1, exclusions);
+end:
+	lttng_event_destroy(event);
+	lttng_destroy_handle(handle);
+	return ret;
+}
+
+/*
+ * Returns the number of sessions named `session_name`, or a negative value
+ * if the sessions could not be listed.
+ */
+static
+int count_sessions(const char *session_name)
+{
+	int ret, i, count = 0;
+	struct lttng_session *sessions = NULL;
+
+	ret = lttng_list_sessions(&sessions);
+	if (ret < 0) {
+		goto end;
+	}
+
+	for (i = 0; i < ret; i++) {
+		if (!strcmp(sessions[i].name, session_name)) {
+			count++;
+		}
+	}
+	ret = count;
+end:
+	free(sessions);
+	return ret;
+}
+
+int main(int argc, const char *argv[])
+{
+	int ret;
+	const char *session_name;
+	enum lttng_error_code ret_code;
+	struct lttng_session_daemon_connection *connection = NULL;
+	struct lttng_session_daemon_connection *other_connection = NULL;
+
+	if (argc != 2) {
+		fprintf(stderr, "Usage: %s SESSION_NAME\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	session_name = argv[1];
+
+	plan_tests(TEST_COUNT);
+
+	ret_code = lttng_session_daemon_connection_open(&connection);
+	ok(ret_code == LTTNG_OK && connection,
+			"Opening a persistent connection succeeds");
+	if (ret_code != LTTNG_OK) {
+		skip(TEST_COUNT - 1, "No persistent connection");
+		goto end;
+	}
+
+	ret_code = lttng_session_daemon_connection_open(&other_connection);
+	ok(ret_code == LTTNG_ERR_INVALID && !other_connection,
+			"Opening a second persistent connection fails with LTTNG_ERR_INVALID");
+
+	ok(count_sessions(session_name) == 1,
+			"Listing the sessions through the persistent connection succeeds");
+
+	/*
+	 * The session is looked up before the filter and the exclusions are
+	 * received: the connection must not take them for the next command.
+	 */
+	ret = enable_filtered_event(unknown_session_name);
+	ok(ret == -LTTNG_ERR_SESS_NOT_FOUND,
+			"Enabling a filtered event of an unknown session fails with LTTNG_ERR_SESS_NOT_FOUND");
+
+	ok(count_sessions(session_name) == 1,
+			"Listing the sessions after a failed filtered event enable succeeds");
+
+	ret = enable_filtered_event(unknown_session_name);
+	ok(ret == -LTTNG_ERR_SESS_NOT_FOUND,
+			"Enabling a filtered event of an unknown session fails again");
+
+	ret = lttng_start_tracing(unknown_session_name);
+	ok(ret == -LTTNG_ERR_SESS_NOT_FOUND,
+			"Starting an unknown session after a failed filtered event enable fails with LTTNG_ERR_SESS_NOT_FOUND");
+
+	ret_code = lttng_session_daemon_connection_begin_batch(connection);
+	ok(ret_code == LTTNG_OK, "Beginning a batch succeeds");
+
+	ret_code = lttng_session_daemon_connection_begin_batch(connection);
+	ok(ret_code == LTTNG_ERR_INVALID,
+			"Beginning a second batch fails with LTTNG_ERR_INVALID");
+
+	ret = lttng_start_tracing(unknown_session_name);
+	ok(ret == 0, "Starting an unknown session in a batch returns 0 at once");
+
+	/* The batch stops at its first error. */
+	ret = enable_filtered_event(session_name);
+	ok(ret == -LTTNG_ERR_SESS_NOT_FOUND,
+			"A filtered event enable following the failed start of the batch fails with its error");
+
+	ret_code = lttng_session_daemon_connection_end_batch(connection);
+	ok(ret_code == LTTNG_ERR_SESS_NOT_FOUND,
+			"Ending the batch fails with LTTNG_ERR_SESS_NOT_FOUND");
+
+	ret_code = lttng_session_daemon_connection_end_batch(connection);
+	ok(ret_code == LTTNG_ERR_INVALID,
+			"Ending a batch which is not open fails with LTTNG_ERR_INVALID");
+
+	ok(count_sessions(session_name) == 1,
+			"Listing the sessions after a failed batch succeeds");
+
+	ret = lttng_destroy_session(session_name);
+	ok(ret == 0,
+			"Destroying a session while a persistent connection is open succeeds");
+
+	ok(count_sessions(session_name) == 0,
+			"The destroyed session is not listed through the persistent connection");
+
+	lttng_session_daemon_connection_close(connection);
+	connection = NULL;
+
+	ok(count_sessions(session_name) == 0,
+			"Listing the sessions after closing the persistent connection succeeds");
+end:
+	lttng_session_daemon_connection_close(connection);
+	return exit_status();
+}
@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2020 EfficiOS Inc.
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ *
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include <common/timer-wheel.h>
+#include <tap/tap.h>
+
+#define NR_TIMERS 4096
+
+static const int TEST_COUNT = 8;
+
+/* For error.h */
+int lttng_opt_quiet = 1;
+int lttng_opt_verbose;
+int lttng_opt_mi;
+
+struct test_timer {
+	struct timer_wheel_entry entry;
+	bool cancelled;
+	/* Ticks between which the timer was reported as expired. */
+	uint64_t expired_after, expired_at;
+	bool expired;
+};
+
+static struct test_timer timers[NR_TIMERS];
+
+static uint64_t random_u64(void)
+{
+	return ((uint64_t) rand() << 31) ^ (uint64_t) rand();
+}
+
+static void test_single_timer(void)
+{
+	struct timer_wheel wheel;
+	struct timer_wheel_entry entry = {};
+	struct cds_list_head expired;
+
+	CDS_INIT_LIST_HEAD(&expired);
+	timer_wheel_init(&wheel, 1000);
+	ok(timer_wheel_next_tick(&wheel) == UINT64_MAX,
+			"Empty wheel has no next tick");
+
+	timer_wheel_arm(&wheel, &entry, 1000 + 70);
+	ok(timer_wheel_next_tick(&wheel) <= 1000 + 70,
+			"Next tick is not after the expiry of the only timer");
+
+	timer_wheel_advance(&wheel, 1000 + 69, &expired);
+	ok(cds_list_empty(&expired), "Timer does not expire early");
+
+	timer_wheel_advance(&wheel, 1000 + 70, &expired);
+	ok(!cds_list_empty(&expired) && expired.next == &entry.node &&
+			entry.state == TIMER_WHEEL_ENTRY_STATE_EXPIRED,
+			"Timer expires at its expiry tick");
+	timer_wheel_cancel(&wheel, &entry);
+	ok(cds_list_empty(&expired) &&
+			entry.state == TIMER_WHEEL_ENTRY_STATE_IDLE,
+			"Expired timer is removed from the expired list");
+}
+
+static void test_random_timers(void)
+{
+	unsigned int i;
+	struct timer_wheel wheel;
+	struct cds_list_head expired;
+	uint64_t now = random_u64();
+	bool next_tick_valid = true, expired_in_time = true, all_expired = true;
+
+	CDS_INIT_LIST_HEAD(&expired);
+	timer_wheel_init(&wheel, now);
+
+	for (i = 0; i < NR_TIMERS; i++) {
+		/* Mix short and very long delays, crossing many levels. */
+		const uint64_t delay = 1 + (random_u64() >> (rand() % 64));
+
+		timer_wheel_arm(&wheel, &timers[i].entry, now + delay);
+		if (i % 7 == 0) {
+			timer_wheel_cancel(&wheel, &timers[i].entry);
+			timers[i].cancelled = true;
+		}
+	}
+
+	while (timer_wheel_next_tick(&wheel) != UINT64_MAX) {
+		const uint64_t next_tick = timer_wheel_next_tick(&wheel);
+		const uint64_t previous_now = now;
+		struct timer_wheel_entry *entry, *tmp;
+		uint64_t earliest = UINT64_MAX;
+
+		for (i = 0; i < NR_TIMERS; i++) {
+			if (timers[i].entry.state == TIMER_WHEEL_ENTRY_STATE_ARMED &&
+					timers[i].entry.expiry < earliest) {
+				earliest = timers[i].entry.expiry;
+			}
+		}
+		if (next_tick > earliest) {
+			next_tick_valid = false;
+		}
+
+		/* Jump past the next tick by a random amount. */
+		now = next_tick + (rand() % 3 ? 0 : (uint64_t) (rand() % 100));
+		timer_wheel_advance(&wheel, now, &expired);
+		cds_list_for_each_entry_safe(entry, tmp, &expired, node) {
+			struct test_timer *timer = caa_container_of(entry,
+					struct test_timer, entry);
+
+			timer_wheel_cancel(&wheel, entry);
+			timer->expired = true;
+			timer->expired_after = previous_now;
+			timer->expired_at = now;
+		}
+	}
+
+	for (i = 0; i < NR_TIMERS; i++) {
+		if (timers[i].cancelled) {
+			if (timers[i].expired) {
+				expired_in_time = false;
+			}
+			continue;
+		}
+		if (!timers[i].expired) {
+			all_expired = false;
+		} else if (timers[i].expired_at < timers[i].entry.expiry ||
+				timers[i].expired_after >= timers[i].entry.expiry) {
+			expired_in_time = false;
+		}
+	}
+
+	ok(next_tick_valid, "Next tick never comes after the earliest expiry");
+	ok(all_expired, "All armed timers expire");
+	ok(expired_in_time, "Timers expire on the advance reaching their expiry and cancelled timers never expire");
+}
+
+int main(void)
+{
+	plan_tests(TEST_COUNT);
+	srand(42);
+
+	test_single_timer();
+	test_random_timers();
+
+	return exit_status();
+}